@@ -0,0 +1,25 @@
+# FindBasisu
+#
+# Locates the Basis Universal transcoder and sets the following variables:
+#
+# basisu_FOUND basisu_INCLUDE_DIRS basisu_LIBRARIES
+#
+# basisu_FOUND is set to YES only when the header and the library are found.
+
+unset(basisu_FOUND)
+
+find_path(basisu_INCLUDE_DIRS NAMES basisu_transcoder.h
+  PATH_SUFFIXES transcoder basisu basisu/transcoder
+  PATHS ${ACTUAL_3RDPARTY_DIR}/basisu/release/include
+)
+
+find_library(basisu_LIBRARIES NAMES basisu_transcoder basisu
+  PATHS ${ACTUAL_3RDPARTY_DIR}/basisu/release/lib
+)
+
+mark_as_advanced(basisu_INCLUDE_DIRS)
+mark_as_advanced(basisu_LIBRARIES)
+
+if(basisu_INCLUDE_DIRS AND basisu_LIBRARIES)
+  set(basisu_FOUND YES)
+endif()
@@ -0,0 +1,557 @@
+#include <benchmark/benchmark.h>
+
+#include <osg/Image>
+#include <osg/TextureCubeMap>
+#include <osg/MatrixTransform>
+#include <osg/Geode>
+#include <osg/ShapeDrawable>
+#include <osg/State>
+#include <osgUtil/CullVisitor>
+#include <osgUtil/RenderStage>
+#include <osgAnimation/Skeleton>
+#include <osgAnimation/Bone>
+
+#include <functional>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <osgThreeJSX/DirectionalLight>
+#include <osgThreeJSX/PointLight>
+#include <osgThreeJSX/SpotLight>
+#include <osgThreeJSX/ProbeLight>
+#include <osgThreeJSX/InstanceGeometry>
+#include <osgThreeJSX/RenderState>
+#include <osgThreeJSX/Materials>
+#include <osgThreeJSX/MaterialNode>
+#include <osgThreeJSX/Programs>
+#include <osgThreeJSX/ShaderLib>
+#include <osgThreeJSX/Animation>
+#include <osgThreeJSX/KtxTranscoder>
+#include <osgThreeJSX/VertexQuantizer>
+#include <osgThreeJSX/MeshOptimizer>
+#include <osgThreeJSX/MeshSimplifier>
+#include <osgThreeJSX/SceneCache>
+#include <osgThreeJSX/CompressedAnimation>
+
+//CPU only paths of the library, none of them needs a GL context
+//
+//	benchmark_MicroBenchmark --benchmark_format=json --benchmark_out=micro.json
+
+static void setupParameters(const std::string& shaderId, osgThreeJSX::ProgramParameters& parameters)
+{
+	parameters.shaderId = shaderId;
+	osgThreeJSX::ShaderObject* shaderObject = osgThreeJSX::ShaderLib::instance().getShaderObject(shaderId);
+	if (shaderObject)
+	{
+		parameters.vertex = shaderObject->vertex;
+		parameters.fragment = shaderObject->fragment;
+	}
+	parameters.numDirLights = 1;
+	parameters.numPointLights = 2;
+}
+
+//shader source assembly, includes and defines of one family
+static void BM_ProgramConstruction(benchmark::State& state, const char* shaderId)
+{
+	osgThreeJSX::ProgramParameters parameters;
+	setupParameters(shaderId, parameters);
+	std::string key = osgThreeJSX::ProgramGenerator::instance().getKey(parameters);
+
+	for (auto _ : state)
+	{
+		osg::ref_ptr<osgThreeJSX::Program> program = new osgThreeJSX::Program(key, parameters);
+		benchmark::DoNotOptimize(program.get());
+	}
+}
+BENCHMARK_CAPTURE(BM_ProgramConstruction, basic, "basic");
+BENCHMARK_CAPTURE(BM_ProgramConstruction, lambert, "lambert");
+BENCHMARK_CAPTURE(BM_ProgramConstruction, phong, "phong");
+BENCHMARK_CAPTURE(BM_ProgramConstruction, standard, "standard");
+BENCHMARK_CAPTURE(BM_ProgramConstruction, depth, "depth");
+BENCHMARK_CAPTURE(BM_ProgramConstruction, distanceRGBA, "distanceRGBA");
+
+//built for every material update that changes state
+static void BM_ProgramGetKey(benchmark::State& state, const char* shaderId)
+{
+	osgThreeJSX::ProgramParameters parameters;
+	setupParameters(shaderId, parameters);
+
+	for (auto _ : state)
+	{
+		std::string key = osgThreeJSX::ProgramGenerator::instance().getKey(parameters);
+		benchmark::DoNotOptimize(key.data());
+	}
+}
+BENCHMARK_CAPTURE(BM_ProgramGetKey, phong, "phong");
+BENCHMARK_CAPTURE(BM_ProgramGetKey, standard, "standard");
+
+//a cull visitor that can run RenderState::onCull without a viewer
+struct OnCullFixture
+{
+	osg::ref_ptr<osg::Camera> camera;
+	osg::ref_ptr<osgThreeJSX::RenderState> renderState;
+	osg::ref_ptr<osgUtil::CullVisitor> cv;
+	osg::ref_ptr<osgUtil::RenderStage> renderStage;
+	osg::ref_ptr<osg::State> glState;
+	osg::ref_ptr<osg::FrameStamp> frameStamp;
+
+	OnCullFixture()
+	{
+		camera = new osg::Camera;
+		camera->setViewMatrixAsLookAt(osg::Vec3(0.0, -100.0, 50.0), osg::Vec3(), osg::Vec3(0.0, 0.0, 1.0));
+		camera->setProjectionMatrixAsPerspective(45.0, 16.0 / 9.0, 1.0, 1000.0);
+
+		renderState = new osgThreeJSX::RenderState();
+		renderState->setupCamera(camera);
+
+		glState = new osg::State;
+		frameStamp = new osg::FrameStamp;
+		renderStage = new osgUtil::RenderStage;
+		cv = new osgUtil::CullVisitor;
+		cv->setState(glState.get());
+		cv->setFrameStamp(frameStamp.get());
+		cv->setRenderStage(renderStage.get());
+		cv->setCurrentRenderBin(renderStage.get());
+		cv->pushProjectionMatrix(new osg::RefMatrix(camera->getProjectionMatrix()));
+		cv->pushModelViewMatrix(new osg::RefMatrix(camera->getViewMatrix()), osg::Transform::ABSOLUTE_RF);
+	}
+};
+
+//light uniforms rebuilt by the camera every frame
+static void BM_LightUpload(benchmark::State& state, const std::function<osgThreeJSX::Light*(int, int)>& createLight)
+{
+	OnCullFixture fixture;
+	int count = state.range(0);
+	for (int i = 0; i < count; i++)
+	{
+		fixture.renderState->addLight(createLight(i, count));
+	}
+
+	for (auto _ : state)
+	{
+		fixture.frameStamp->setFrameNumber(fixture.frameStamp->getFrameNumber() + 1);
+		fixture.renderState->onCull(fixture.cv.get());
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+
+static osg::Vec3 circlePosition(int i, int count)
+{
+	float angle = osg::PI * 2.0 * i / count;
+	return osg::Vec3(cos(angle) * 50.0, sin(angle) * 50.0, 20.0);
+}
+
+static void BM_LightUploadPoint(benchmark::State& state)
+{
+	BM_LightUpload(state, [](int i, int count) -> osgThreeJSX::Light* {
+		return new osgThreeJSX::PointLight(circlePosition(i, count), osg::Vec3(1.0, 1.0, 1.0), 1.0, 100.0, 1.0);
+	});
+}
+BENCHMARK(BM_LightUploadPoint)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_LightUploadSpot(benchmark::State& state)
+{
+	BM_LightUpload(state, [](int i, int count) -> osgThreeJSX::Light* {
+		osg::Vec3 position = circlePosition(i, count);
+		osg::Vec3 direction = -position;
+		direction.normalize();
+		return new osgThreeJSX::SpotLight(position, direction, osg::Vec3(1.0, 1.0, 1.0), 1.0, 200.0, osg::PI / 5.0, 0.3, 1);
+	});
+}
+BENCHMARK(BM_LightUploadSpot)->RangeMultiplier(4)->Range(1, 256);
+
+static void BM_LightUploadDirectional(benchmark::State& state)
+{
+	BM_LightUpload(state, [](int i, int count) -> osgThreeJSX::Light* {
+		osg::Vec3 direction = -circlePosition(i, count);
+		direction.normalize();
+		return new osgThreeJSX::DirectionalLight(direction, osg::Vec3(1.0, 1.0, 1.0), 1.0);
+	});
+}
+BENCHMARK(BM_LightUploadDirectional)->RangeMultiplier(4)->Range(1, 256);
+
+//bound of every instance, recomputed whenever the instances change
+static void BM_InstanceComputeBound(benchmark::State& state)
+{
+	osg::ref_ptr<osg::ShapeDrawable> drawable = new osg::ShapeDrawable(new osg::Sphere(osg::Vec3(), 1.0));
+	osg::ref_ptr<osgThreeJSX::InstanceGeometry> instanceGeometry = new osgThreeJSX::InstanceGeometry;
+	instanceGeometry->setGeometry(drawable);
+
+	int count = state.range(0);
+	srand(1);
+	for (int i = 0; i < count; i++)
+	{
+		osg::Matrix mat;
+		mat.makeTranslate(osg::Vec3(rand() % 1000, rand() % 1000, rand() % 1000));
+		instanceGeometry->addInstance(mat);
+	}
+
+	for (auto _ : state)
+	{
+		osg::BoundingSphere bound = instanceGeometry->computeBound();
+		benchmark::DoNotOptimize(bound);
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_InstanceComputeBound)->RangeMultiplier(8)->Range(8, 1 << 15);
+
+//bone matrices of a skinned mesh, one chain of bones under the skeleton
+static void BM_RigPaletteBuild(benchmark::State& state)
+{
+	int count = state.range(0);
+
+	osg::ref_ptr<osg::MatrixTransform> root = new osg::MatrixTransform;
+	osg::ref_ptr<osgAnimation::Skeleton> skeleton = new osgAnimation::Skeleton;
+	root->addChild(skeleton);
+
+	osg::ref_ptr<osgThreeJSX::RigTransformMaterial> rigTransform = new osgThreeJSX::RigTransformMaterial;
+	osg::ref_ptr<osg::MatrixfArray> palette = new osg::MatrixfArray;
+	osg::Group* parent = skeleton.get();
+	for (int i = 0; i < count; i++)
+	{
+		osg::ref_ptr<osgAnimation::Bone> bone = new osgAnimation::Bone;
+		bone->setMatrix(osg::Matrix::translate(0.0, 0.0, 1.0));
+		parent->addChild(bone);
+		parent = bone.get();
+
+		rigTransform->addBone(bone);
+		palette->push_back(osg::Matrixf::translate(0.0, 0.0, -i));
+	}
+	rigTransform->setMatrixPalette(palette);
+
+	osg::ref_ptr<osgThreeJSX::MaterialStandard> material = new osgThreeJSX::MaterialStandard;
+	material->setSkinning(true);
+	osg::ref_ptr<osgThreeJSX::MaterialRigGeometry> rigGeometry = new osgThreeJSX::MaterialRigGeometry;
+	rigGeometry->setSkeleton(skeleton.get());
+	rigGeometry->setMaterial(material);
+
+	osg::ref_ptr<osg::Geode> geode = new osg::Geode;
+	geode->addDrawable(rigGeometry);
+	root->addChild(geode);
+
+	for (auto _ : state)
+	{
+		(*rigTransform)(*rigGeometry);
+	}
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_RigPaletteBuild)->RangeMultiplier(4)->Range(4, 256);
+
+//spherical harmonics projection of a probe cube map
+static void BM_ProbeProjection(benchmark::State& state)
+{
+	int size = state.range(0);
+
+	osg::ref_ptr<osg::TextureCubeMap> cubeMap = new osg::TextureCubeMap;
+	srand(1);
+	for (int face = 0; face < 6; face++)
+	{
+		osg::ref_ptr<osg::Image> image = new osg::Image;
+		image->allocateImage(size, size, 1, GL_RGBA, GL_UNSIGNED_BYTE);
+		unsigned char* data = image->data();
+		for (unsigned int i = 0; i < image->getTotalSizeInBytes(); i++)
+		{
+			data[i] = rand() % 256;
+		}
+		cubeMap->setImage(face, image);
+	}
+
+	for (auto _ : state)
+	{
+		osg::ref_ptr<osgThreeJSX::ProbeLight> probe = new osgThreeJSX::ProbeLight(cubeMap, 1.0);
+		benchmark::DoNotOptimize(probe.get());
+	}
+	state.SetItemsProcessed(state.iterations() * size * size * 6);
+}
+BENCHMARK(BM_ProbeProjection)->RangeMultiplier(2)->Range(16, 128);
+
+//KTX2 container with one RGBA8 level, read with its mip chain baked
+static void BM_KtxMipmapBake(benchmark::State& state)
+{
+	unsigned int size = state.range(0);
+	std::vector<unsigned char> file(104 + size * size * 4, 0);
+	const unsigned char identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+	memcpy(&file[0], identifier, sizeof(identifier));
+	unsigned int header[] = { 37, 1, size, size, 0, 0, 1, 1, 0 };
+	memcpy(&file[12], header, sizeof(header));
+	unsigned long long level[] = { 104, size * size * 4ull, size * size * 4ull };
+	memcpy(&file[80], level, sizeof(level));
+	srand(1);
+	for (size_t i = 104; i < file.size(); i++)
+		file[i] = rand() % 256;
+
+	osg::ref_ptr<osgThreeJSX::KtxTranscoder> transcoder = new osgThreeJSX::KtxTranscoder();
+	for (auto _ : state)
+	{
+		osg::ref_ptr<osg::Image> image = transcoder->read(&file[0], file.size());
+		benchmark::DoNotOptimize(image.get());
+	}
+	state.SetBytesProcessed(state.iterations() * size * size * 4);
+}
+BENCHMARK(BM_KtxMipmapBake)->RangeMultiplier(2)->Range(256, 2048);
+
+//Basis Universal transcoding of OSGTHREEJSX_KTX2_FILE to each target format, skipped without the file or basisu
+static void BM_KtxTranscode(benchmark::State& state, osgThreeJSX::KtxTargetFormat format)
+{
+	const char* filename = getenv("OSGTHREEJSX_KTX2_FILE");
+	std::vector<unsigned char> file;
+	if (filename)
+	{
+		std::ifstream stream(filename, std::ios::binary);
+		file.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+	}
+	if (file.empty() || !osgThreeJSX::KtxTranscoder::getBasisSupported())
+	{
+		state.SkipWithError("needs OSGTHREEJSX_KTX2_FILE and osgThreeJSX built with basisu");
+		return;
+	}
+
+	osg::ref_ptr<osgThreeJSX::KtxTranscoder> transcoder = new osgThreeJSX::KtxTranscoder();
+	transcoder->setSupportedFormats(format);
+	for (auto _ : state)
+	{
+		osg::ref_ptr<osg::Image> image = transcoder->read(&file[0], file.size());
+		benchmark::DoNotOptimize(image.get());
+	}
+	state.SetBytesProcessed(state.iterations() * file.size());
+}
+BENCHMARK_CAPTURE(BM_KtxTranscode, rgba, osgThreeJSX::KtxTargetFormat_RGBA);
+BENCHMARK_CAPTURE(BM_KtxTranscode, bc7, osgThreeJSX::KtxTargetFormat_BC7);
+BENCHMARK_CAPTURE(BM_KtxTranscode, bc1, osgThreeJSX::KtxTargetFormat_BC1);
+BENCHMARK_CAPTURE(BM_KtxTranscode, etc2, osgThreeJSX::KtxTargetFormat_ETC2);
+BENCHMARK_CAPTURE(BM_KtxTranscode, astc, osgThreeJSX::KtxTargetFormat_ASTC);
+
+//conversion of a material node with one geometry to the compact layouts, bytes after the conversion in the counters
+static void BM_VertexQuantize(benchmark::State& state)
+{
+	unsigned int count = state.range(0);
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array(count);
+	osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(count);
+	osg::ref_ptr<osg::Vec2Array> uvs = new osg::Vec2Array(count);
+	srand(1);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		(*vertices)[i].set(rand() % 1000, rand() % 1000, rand() % 1000);
+		(*normals)[i].set(rand() % 100 - 50.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+		(*normals)[i].normalize();
+		(*uvs)[i].set((rand() % 1000) / 1000.0f, (rand() % 1000) / 1000.0f);
+	}
+
+	size_t sourceBytes = 0;
+	size_t quantizedBytes = 0;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+		geometry->setVertexArray(vertices);
+		geometry->setNormalArray(normals, osg::Array::BIND_PER_VERTEX);
+		geometry->setTexCoordArray(0, uvs, osg::Array::BIND_PER_VERTEX);
+		geometry->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, count));
+		osg::ref_ptr<osgThreeJSX::MaterialBaseNode<osg::Geode> > geode = new osgThreeJSX::MaterialBaseNode<osg::Geode>();
+		geode->addDrawable(geometry);
+		geode->setMaterial(new osgThreeJSX::MaterialStandard());
+		osg::ref_ptr<osgThreeJSX::VertexQuantizer> quantizer = new osgThreeJSX::VertexQuantizer();
+		state.ResumeTiming();
+
+		quantizer->quantize(geode);
+		sourceBytes = quantizer->getSourceBytes();
+		quantizedBytes = quantizer->getQuantizedBytes();
+	}
+	state.counters["sourceBytes"] = sourceBytes;
+	state.counters["quantizedBytes"] = quantizedBytes;
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_VertexQuantize)->RangeMultiplier(8)->Range(1 << 10, 1 << 19);
+
+//height field of size x size quads, two triangles each, normals and uvs are filled when given
+static void buildGrid(unsigned int size, osg::Vec3Array* vertices, osg::Vec3Array* normals, osg::Vec2Array* uvs, std::vector<unsigned int>& triangles)
+{
+	for (unsigned int y = 0; y <= size; y++)
+	{
+		for (unsigned int x = 0; x <= size; x++)
+		{
+			vertices->push_back(osg::Vec3(x, y, sin(x * 0.1f) * cos(y * 0.1f)));
+			if (normals)
+			{
+				osg::Vec3 normal(-0.1f * cos(x * 0.1f) * cos(y * 0.1f), 0.1f * sin(x * 0.1f) * sin(y * 0.1f), 1.0f);
+				normal.normalize();
+				normals->push_back(normal);
+			}
+			if (uvs)
+				uvs->push_back(osg::Vec2((float)x / size, (float)y / size));
+		}
+	}
+	for (unsigned int y = 0; y < size; y++)
+	{
+		for (unsigned int x = 0; x < size; x++)
+		{
+			unsigned int i = y * (size + 1) + x;
+			unsigned int quad[6] = { i, i + 1, i + size + 2, i, i + size + 2, i + size + 1 };
+			triangles.insert(triangles.end(), quad, quad + 6);
+		}
+	}
+}
+
+//grid of quads with its triangles shuffled, ACMR after the reordering in the counters
+static void BM_MeshOptimize(benchmark::State& state)
+{
+	unsigned int size = state.range(0);
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+	std::vector<unsigned int> triangles;
+	buildGrid(size, vertices.get(), NULL, NULL, triangles);
+	srand(1);
+	for (size_t i = triangles.size() / 3 - 1; i > 0; i--)
+	{
+		size_t j = rand() % (i + 1);
+		std::swap_ranges(triangles.begin() + i * 3, triangles.begin() + i * 3 + 3, triangles.begin() + j * 3);
+	}
+
+	osg::ref_ptr<osgThreeJSX::MeshOptimizer> optimizer = new osgThreeJSX::MeshOptimizer();
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+		geometry->setVertexArray(new osg::Vec3Array(vertices->begin(), vertices->end()));
+		geometry->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES, triangles.begin(), triangles.end()));
+		optimizer->resetStats();
+		state.ResumeTiming();
+
+		optimizer->optimize(geometry.get());
+	}
+	state.counters["acmrBefore"] = optimizer->getAcmrBefore();
+	state.counters["acmrAfter"] = optimizer->getAcmrAfter();
+	state.SetItemsProcessed(state.iterations() * triangles.size() / 3);
+}
+BENCHMARK(BM_MeshOptimize)->RangeMultiplier(4)->Range(16, 512);
+
+//height field grid with normals and uvs collapsed to a quarter of its triangles, error of the result in the counters
+static void BM_MeshSimplify(benchmark::State& state)
+{
+	unsigned int size = state.range(0);
+	osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array;
+	osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array;
+	osg::ref_ptr<osg::Vec2Array> uvs = new osg::Vec2Array;
+	std::vector<unsigned int> triangles;
+	buildGrid(size, vertices.get(), normals.get(), uvs.get(), triangles);
+	normals->setBinding(osg::Array::BIND_PER_VERTEX);
+	uvs->setBinding(osg::Array::BIND_PER_VERTEX);
+	geometry->setVertexArray(vertices);
+	geometry->setNormalArray(normals);
+	geometry->setTexCoordArray(0, uvs);
+
+	osg::ref_ptr<osgThreeJSX::MeshSimplifier> simplifier = new osgThreeJSX::MeshSimplifier();
+	std::vector<unsigned int> result;
+	float error = 0.0f;
+	for (auto _ : state)
+	{
+		error = simplifier->simplify(geometry.get(), triangles, triangles.size() / 4, FLT_MAX, result);
+		benchmark::DoNotOptimize(result.data());
+	}
+	state.counters["triangles"] = result.size() / 3;
+	state.counters["error"] = error;
+	state.SetItemsProcessed(state.iterations() * triangles.size() / 3);
+}
+BENCHMARK(BM_MeshSimplify)->RangeMultiplier(4)->Range(16, 256);
+
+//read of a scene cache holding material nodes of one geometry each, bytes of the file in the counters
+static void BM_SceneCacheRead(benchmark::State& state)
+{
+	unsigned int count = state.range(0);
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array(4096);
+	osg::ref_ptr<osg::Vec3Array> normals = new osg::Vec3Array(4096);
+	srand(1);
+	for (unsigned int i = 0; i < vertices->size(); i++)
+	{
+		(*vertices)[i].set(rand() % 1000, rand() % 1000, rand() % 1000);
+		(*normals)[i].set(0.0f, 0.0f, 1.0f);
+	}
+
+	osg::ref_ptr<osg::Group> scene = new osg::Group;
+	osg::ref_ptr<osgThreeJSX::MaterialStandard> material = new osgThreeJSX::MaterialStandard();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		osg::ref_ptr<osg::Geometry> geometry = new osg::Geometry;
+		geometry->setVertexArray(new osg::Vec3Array(vertices->begin(), vertices->end()));
+		geometry->setNormalArray(new osg::Vec3Array(normals->begin(), normals->end()), osg::Array::BIND_PER_VERTEX);
+		geometry->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, vertices->size()));
+		osg::ref_ptr<osgThreeJSX::MaterialBaseNode<osg::Geode> > geode = new osgThreeJSX::MaterialBaseNode<osg::Geode>();
+		geode->addDrawable(geometry);
+		geode->setMaterial(material);
+		osg::ref_ptr<osg::MatrixTransform> transform = new osg::MatrixTransform(osg::Matrix::translate(i, 0.0, 0.0));
+		transform->addChild(geode);
+		scene->addChild(transform);
+	}
+
+	std::string filename = "BM_SceneCacheRead.otjs";
+	osg::ref_ptr<osgThreeJSX::SceneCache> cache = new osgThreeJSX::SceneCache();
+	if (!cache->write(filename, scene))
+	{
+		state.SkipWithError(cache->getError().c_str());
+		return;
+	}
+	for (auto _ : state)
+	{
+		osg::ref_ptr<osg::Node> node = cache->read(filename);
+		benchmark::DoNotOptimize(node.get());
+	}
+	std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+	state.counters["bytes"] = (double)file.tellg();
+	file.close();
+	remove(filename.c_str());
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_SceneCacheRead)->RangeMultiplier(4)->Range(4, 256);
+
+// plays a mocap like clip, 120 keys per second for 30 seconds, on many rotation channels at 60 frames per second
+static void BM_AnimationSample(benchmark::State& state, bool compressed)
+{
+	unsigned int count = state.range(0);
+	const unsigned int numKeys = 3600;
+	srand(1);
+	osg::ref_ptr<osgAnimation::Animation> animation = new osgAnimation::Animation;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		osg::ref_ptr<osgAnimation::QuatSphericalLinearChannel> channel = new osgAnimation::QuatSphericalLinearChannel;
+		channel->setName("quaternion");
+		osgAnimation::QuatKeyframeContainer* keyframes = channel->getOrCreateSampler()->getOrCreateKeyframeContainer();
+		double phase = rand() % 1000 * 0.001;
+		for (unsigned int k = 0; k < numKeys; k++)
+		{
+			double time = k / 120.0;
+			keyframes->push_back(osgAnimation::QuatKeyframe(time, osg::Quat(sin(time + phase), osg::Vec3(0.0, 0.0, 1.0)) * osg::Quat(0.3 * sin(3.0 * time), osg::Vec3(1.0, 0.0, 0.0))));
+		}
+		animation->addChannel(channel);
+	}
+
+	osg::ref_ptr<osgThreeJSX::AnimationCompressor> compressor = new osgThreeJSX::AnimationCompressor();
+	if (compressed)
+		compressor->compress(animation);
+
+	double time = 0.0;
+	for (auto _ : state)
+	{
+		time = fmod(time + 1.0 / 60.0, numKeys / 120.0);
+		osgAnimation::ChannelList& channels = animation->getChannels();
+		for (size_t i = 0; i < channels.size(); i++)
+		{
+			channels[i]->getTarget()->reset();
+			channels[i]->update(time, 1.0f, 0);
+		}
+	}
+	if (compressed)
+		state.counters["bytes"] = (double)compressor->getCompressedBytes();
+	else
+		state.counters["bytes"] = (double)(count * numKeys * sizeof(osgAnimation::QuatKeyframe));
+	state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK_CAPTURE(BM_AnimationSample, source, false)->RangeMultiplier(4)->Range(16, 1024);
+BENCHMARK_CAPTURE(BM_AnimationSample, compressed, true)->RangeMultiplier(4)->Range(16, 1024);
+
+BENCHMARK_MAIN();
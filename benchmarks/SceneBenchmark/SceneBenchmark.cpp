@@ -0,0 +1,457 @@
+#include <osg/ArgumentParser>
+#include <osg/ShapeDrawable>
+#include <osg/MatrixTransform>
+#include <osg/CullFace>
+#include <osg/Stats>
+#include <osg/Timer>
+
+#include <osgViewer/Viewer>
+
+#include <cmath>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <string>
+
+#include <osgThreeJSX/AmbientLight>
+#include <osgThreeJSX/DirectionalLight>
+#include <osgThreeJSX/PointLight>
+#include <osgThreeJSX/RectAreaLight>
+#include <osgThreeJSX/SpotLight>
+#include <osgThreeJSX/InstanceGeometry>
+#include <osgThreeJSX/RenderState>
+#include <osgThreeJSX/Materials>
+#include <osgThreeJSX/Programs>
+
+//renders the example scenes offscreen for a fixed number of frames and reports the update, cull and draw times as JSON
+//
+//	benchmark_SceneBenchmark [--scene Shadow] [--frames 300] [--warmup 30] [--width 1280] [--height 720] [--output results.json]
+//
+//the context is a pbuffer, on hosts without a GPU run it on Mesa llvmpipe, e.g.
+//	LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a benchmark_SceneBenchmark
+
+osg::Vec3 HSLtoRGB(float h, float s, float l) {
+	float r, g, b;
+
+	if (s == 0.0f) {
+		r = g = b = l; // achromatic
+	}
+	else {
+		auto hue2rgb = [](float p, float q, float t) {
+			if (t < 0.0f) t += 1.0f;
+			if (t > 1.0f) t -= 1.0f;
+			if (t < 1.0f / 6.0f) return p + (q - p) * 6.0f * t;
+			if (t < 1.0f / 2.0f) return q;
+			if (t < 2.0f / 3.0f) return p + (q - p) * (2.0f / 3.0f - t) * 6.0f;
+			return p;
+		};
+
+		float q = l < 0.5f ? l * (1.0f + s) : l + s - l * s;
+		float p = 2.0f * l - q;
+		r = hue2rgb(p, q, h + 1.0f / 3.0f);
+		g = hue2rgb(p, q, h);
+		b = hue2rgb(p, q, h - 1.0f / 3.0f);
+	}
+
+	return osg::Vec3(r, g, b);
+}
+
+struct BenchmarkScene
+{
+	osg::ref_ptr<osg::Group> root;
+	osg::ref_ptr<osgThreeJSX::RenderState> renderState;
+	//camera orbit
+	osg::Vec3 center;
+	float distance;
+};
+
+typedef std::function<void(BenchmarkScene&)> SceneBuilder;
+
+osgThreeJSX::MaterialBaseNode<osg::Geode>* addShape(osg::Group* parent, osg::Shape* shape, osgThreeJSX::Material* material)
+{
+	osg::ref_ptr<osg::ShapeDrawable> drawable = new osg::ShapeDrawable();
+	drawable->setShape(shape);
+	drawable->setUseVertexBufferObjects(true);
+
+	osgThreeJSX::MaterialBaseNode<osg::Geode>* geode = new osgThreeJSX::MaterialBaseNode<osg::Geode>();
+	geode->addChild(drawable);
+	geode->setMaterial(material);
+	parent->addChild(geode);
+	return geode;
+}
+
+osgThreeJSX::MaterialPhysical* createPhysical(float alpha, float beta, float gamma, bool castShadow, bool receiveShadow)
+{
+	osgThreeJSX::MaterialPhysical* material = new osgThreeJSX::MaterialPhysical();
+	material->setVertexColors(false);
+	material->setCastShadow(castShadow);
+	material->setReceiveShadow(receiveShadow);
+	material->_common.color = HSLtoRGB(alpha, 0.5, 0.25);
+	material->_metalness.metalness = 1.0 - alpha;
+	material->_roughness.roughness = 1.0 - beta;
+	material->_physical.clearcoat = 1.0 - alpha;
+	material->_physical.clearcoatRoughness = 1.0 - beta;
+	material->_physical.reflectivity = 1.0 - gamma;
+	return material;
+}
+
+//spheres over a receiver box
+void buildShadowCasters(BenchmarkScene& scene, int spheresPerSide)
+{
+	float stepSize = 1.0f / spheresPerSide;
+	float sphereRadius = (400.0f / spheresPerSide) * 0.8f * 0.5f;
+	for (int i = 0; i <= spheresPerSide; i++)
+	{
+		for (int j = 0; j <= spheresPerSide; j++)
+		{
+			for (int k = 0; k <= spheresPerSide; k++)
+			{
+				float alpha = i * stepSize, beta = j * stepSize, gamma = k * stepSize;
+				addShape(scene.root, new osg::Sphere(osg::Vec3(alpha * 400 - 200, beta * 400 - 200, gamma * 400 - 200), sphereRadius),
+					createPhysical(alpha, beta, gamma, true, false));
+			}
+		}
+	}
+
+	addShape(scene.root, new osg::Box(osg::Vec3(0.0, 0.0, -400.0), 2000.0, 2000.0, 20.0), createPhysical(0.5, 0.5, 0.5, false, true));
+
+	scene.center = osg::Vec3(0.0, 0.0, -100.0);
+	scene.distance = 1200.0f;
+}
+
+void setupRenderState(BenchmarkScene& scene)
+{
+	scene.renderState = new osgThreeJSX::RenderState();
+	scene.renderState->setOutputEncoding(osgThreeJSX::TextureEncodingType_sRGBEncoding);
+	scene.renderState->setToneMapping(osgThreeJSX::ToneMappingType_Uncharted2ToneMapping);
+	scene.renderState->setToneMappingExposure(0.75);
+}
+
+void buildShadow(BenchmarkScene& scene)
+{
+	buildShadowCasters(scene, 3);
+	setupRenderState(scene);
+	scene.renderState->setupShadow(scene.root, osgThreeJSX::ShadowMapType_BasicShadowMap);
+
+	osg::Vec3 lightPosition = osg::Vec3(400.0, 400.0, 400.0);
+	osg::Vec3 lightDirection = osg::Vec3() - lightPosition;
+	lightDirection.normalize();
+	osgThreeJSX::SpotLight* spotLight = new osgThreeJSX::SpotLight(lightPosition, lightDirection,
+		osg::Vec3(1.0, 1.0, 1.0), 1.0, 2000.0, osg::PI / 4.0, 0.05, 2);
+	spotLight->setCastShadow(true);
+	scene.renderState->addLight(spotLight);
+}
+
+void buildShadowVsm(BenchmarkScene& scene)
+{
+	buildShadowCasters(scene, 3);
+	setupRenderState(scene);
+	scene.renderState->setupShadow(scene.root, osgThreeJSX::ShadowMapType_VSMShadowMap);
+
+	osg::Vec3 direction = osg::Vec3() - osg::Vec3(3.0, 17.0, 12.0);
+	direction.normalize();
+	osgThreeJSX::DirectionalLight* directionLight = new osgThreeJSX::DirectionalLight(direction, osg::Vec3(1.0, 1.0, 1.0), 1.0);
+	directionLight->setCastShadow(true);
+	directionLight->getShadow()->setBias(-0.0005);
+	directionLight->getShadow()->getMapSize() = osg::Vec2(1024, 1024);
+	directionLight->getShadow()->setRadius(4);
+	scene.renderState->addLight(directionLight);
+}
+
+void buildInstance(BenchmarkScene& scene)
+{
+	const int spheresPerSide = 20;
+	float stepSize = 1.0f / spheresPerSide;
+	float sphereRadius = (400.0f / spheresPerSide) * 0.8f * 0.5f;
+
+	osg::ref_ptr<osg::ShapeDrawable> drawable = new osg::ShapeDrawable();
+	drawable->setShape(new osg::Sphere(osg::Vec3(0, 0, 0), sphereRadius));
+
+	osgThreeJSX::MaterialBaseNode<osgThreeJSX::InstanceGeometry>* instanceGeometry = new osgThreeJSX::MaterialBaseNode<osgThreeJSX::InstanceGeometry>;
+	instanceGeometry->setGeometry(drawable);
+	for (int i = 0; i <= spheresPerSide; i++)
+	{
+		for (int j = 0; j <= spheresPerSide; j++)
+		{
+			for (int k = 0; k <= spheresPerSide; k++)
+			{
+				osg::Matrix mat;
+				mat.makeTranslate(osg::Vec3(i * stepSize * 400 - 200, j * stepSize * 400 - 200, k * stepSize * 400 - 200));
+				instanceGeometry->addInstance(mat);
+			}
+		}
+	}
+
+	osg::ref_ptr<osgThreeJSX::MaterialLambert> material = new osgThreeJSX::MaterialLambert();
+	material->setVertexColors(false);
+	material->setInstancing(true);
+	instanceGeometry->setMaterial(material);
+	scene.root->addChild(instanceGeometry);
+
+	setupRenderState(scene);
+	scene.renderState->addLight(new osgThreeJSX::AmbientLight(osg::Vec3(0x22 / 255.0, 0x22 / 255.0, 0x22 / 255.0), 1.0));
+	osg::Vec3 direction = osg::Vec3() - osg::Vec3(1.0, 1.0, 1.0);
+	direction.normalize();
+	scene.renderState->addLight(new osgThreeJSX::DirectionalLight(direction, osg::Vec3(1.0, 1.0, 1.0), 1.0));
+	scene.renderState->addLight(new osgThreeJSX::PointLight(osg::Vec3(0.0, 0.0, 0.0), osg::Vec3(1.0, 1.0, 1.0), 2.0, 800.0, 1.0));
+
+	scene.center = osg::Vec3();
+	scene.distance = 900.0f;
+}
+
+void buildRectAreaLight(BenchmarkScene& scene)
+{
+	addShape(scene.root, new osg::Box(osg::Vec3(0.0, 0.0, -1.0), 200.0, 200.0, 2.0), createPhysical(0.5, 0.3, 0.5, false, false));
+	for (int i = 0; i < 5; i++)
+	{
+		addShape(scene.root, new osg::Sphere(osg::Vec3(i * 12.0 - 24.0, 0.0, 5.0), 5.0), createPhysical(i / 5.0f, 0.5, 0.5, false, false));
+	}
+
+	setupRenderState(scene);
+	osg::Vec3 lightPosition = osg::Vec3(15.0, 40.0, 35.0);
+	osg::Vec3 lightDirection = osg::Vec3() - lightPosition;
+	lightDirection.normalize();
+	scene.renderState->addLight(new osgThreeJSX::RectAreaLight(lightPosition, lightDirection, osg::Vec3(1.0, 1.0, 1.0), 1.0, 10.0, 10.0));
+	scene.renderState->addLight(new osgThreeJSX::AmbientLight(osg::Vec3(1.0, 1.0, 1.0), 0.1));
+
+	scene.center = osg::Vec3();
+	scene.distance = 120.0f;
+}
+
+//many point lights over a grid of phong spheres, stresses the light uniforms and the forward shading
+void buildSpotLight(BenchmarkScene& scene)
+{
+	const int count = 16;
+	for (int i = 0; i < count; i++)
+	{
+		for (int j = 0; j < count; j++)
+		{
+			osgThreeJSX::MaterialPhong* material = new osgThreeJSX::MaterialPhong();
+			material->setVertexColors(false);
+			material->_common.color = HSLtoRGB(float(i) / count, 0.5, 0.5);
+			addShape(scene.root, new osg::Sphere(osg::Vec3(i * 10.0 - count * 5.0, j * 10.0 - count * 5.0, 0.0), 4.0), material);
+		}
+	}
+
+	setupRenderState(scene);
+	for (int i = 0; i < 8; i++)
+	{
+		float angle = osg::PI * 2.0 * i / 8;
+		osg::Vec3 position(cos(angle) * 60.0, sin(angle) * 60.0, 30.0);
+		osg::Vec3 direction = osg::Vec3() - position;
+		direction.normalize();
+		scene.renderState->addLight(new osgThreeJSX::SpotLight(position, direction, HSLtoRGB(i / 8.0f, 1.0, 0.5), 1.0, 200, osg::PI / 5.0, 0.3, 1));
+		scene.renderState->addLight(new osgThreeJSX::PointLight(position * 0.5, HSLtoRGB(i / 8.0f, 1.0, 0.5), 1.0, 100.0, 1.0));
+	}
+
+	scene.center = osg::Vec3();
+	scene.distance = 200.0f;
+}
+
+struct TimeSeries
+{
+	std::vector<double> values;
+
+	void add(double value) { values.push_back(value); }
+
+	double percentile(double p) const
+	{
+		if (values.empty())
+			return 0.0;
+		std::vector<double> sorted = values;
+		std::sort(sorted.begin(), sorted.end());
+		size_t index = std::min(sorted.size() - 1, (size_t)(p * (sorted.size() - 1) + 0.5));
+		return sorted[index];
+	}
+
+	double mean() const
+	{
+		double sum = 0.0;
+		for (size_t i = 0; i < values.size(); i++)
+			sum += values[i];
+		return values.empty() ? 0.0 : sum / values.size();
+	}
+
+	void write(std::ostream& os, const char* name) const
+	{
+		os << "\"" << name << "\": {\"mean\": " << mean() << ", \"median\": " << percentile(0.5)
+			<< ", \"p95\": " << percentile(0.95) << ", \"max\": " << percentile(1.0) << "}";
+	}
+};
+
+struct BenchmarkResult
+{
+	std::string name;
+	TimeSeries frame;
+	TimeSeries update;
+	TimeSeries cull;
+	TimeSeries draw;
+	unsigned int warmupPrograms;
+	unsigned int measuredPrograms;
+};
+
+//milliseconds recorded by the viewer for the frame
+static void readTime(osg::Stats* stats, unsigned int frameNumber, const std::string& attribute, TimeSeries& series)
+{
+	double value = 0.0;
+	if (stats && stats->getAttribute(frameNumber, attribute, value))
+		series.add(value * 1000.0);
+}
+
+bool runScene(const std::string& name, const SceneBuilder& builder, osg::GraphicsContext* gc, int width, int height,
+	int warmup, int frames, BenchmarkResult& result)
+{
+	BenchmarkScene scene;
+	scene.root = new osg::Group();
+	scene.distance = 100.0f;
+
+	osg::ref_ptr<osg::CullFace> cf = new osg::CullFace;
+	cf->setMode(osg::CullFace::BACK);
+	scene.root->getOrCreateStateSet()->setAttributeAndModes(cf.get(), osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON);
+
+	builder(scene);
+
+	osg::ref_ptr<osgViewer::Viewer> viewer = new osgViewer::Viewer;
+	viewer->setThreadingModel(osgViewer::Viewer::SingleThreaded);
+	viewer->getCamera()->setGraphicsContext(gc);
+	viewer->getCamera()->setViewport(new osg::Viewport(0, 0, width, height));
+	viewer->getCamera()->setProjectionMatrixAsPerspective(45.0, double(width) / height, 1.0, 10000.0);
+	viewer->getCamera()->setDrawBuffer(GL_BACK);
+	viewer->getCamera()->setReadBuffer(GL_BACK);
+	viewer->setSceneData(scene.root);
+	scene.renderState->setupCamera(viewer->getCamera());
+
+	viewer->realize();
+	if (!viewer->isRealized())
+		return false;
+
+	viewer->getViewerStats()->collectStats("update", true);
+	viewer->getCamera()->getStats()->collectStats("rendering", true);
+
+	osgThreeJSX::ProgramGenerator& generator = osgThreeJSX::ProgramGenerator::instance();
+	unsigned int programs = generator.getNumPrograms();
+
+	result.name = name;
+	for (int i = 0; i < warmup + frames; i++)
+	{
+		//the same deterministic orbit for every run
+		float angle = osg::PI * 2.0 * i / (warmup + frames);
+		osg::Vec3 eye = scene.center + osg::Vec3(cos(angle), sin(angle), 0.5) * scene.distance;
+		viewer->getCamera()->setViewMatrixAsLookAt(eye, scene.center, osg::Vec3(0.0, 0.0, 1.0));
+
+		osg::Timer_t start = osg::Timer::instance()->tick();
+		viewer->frame();
+		gc->makeCurrent();
+		glFinish();
+		double frameTime = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+
+		if (i == warmup - 1)
+		{
+			result.warmupPrograms = generator.getNumPrograms() - programs;
+			programs = generator.getNumPrograms();
+		}
+		if (i < warmup)
+			continue;
+
+		unsigned int frameNumber = viewer->getFrameStamp()->getFrameNumber();
+		result.frame.add(frameTime);
+		readTime(viewer->getViewerStats(), frameNumber, "Update traversal time taken", result.update);
+		readTime(viewer->getCamera()->getStats(), frameNumber, "Cull traversal time taken", result.cull);
+		readTime(viewer->getCamera()->getStats(), frameNumber, "Draw traversal time taken", result.draw);
+	}
+	if (warmup <= 0)
+		result.warmupPrograms = 0;
+	result.measuredPrograms = generator.getNumPrograms() - programs;
+
+	//keep the shared context alive for the next scene
+	viewer->getCamera()->setGraphicsContext(NULL);
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	osg::ArgumentParser arguments(&argc, argv);
+
+	std::string sceneName, output;
+	int frames = 300, warmup = 30, width = 1280, height = 720;
+	while (arguments.read("--scene", sceneName)) {}
+	while (arguments.read("--frames", frames)) {}
+	while (arguments.read("--warmup", warmup)) {}
+	while (arguments.read("--width", width)) {}
+	while (arguments.read("--height", height)) {}
+	while (arguments.read("--output", output)) {}
+
+	std::vector< std::pair<std::string, SceneBuilder> > scenes;
+	scenes.push_back(std::make_pair(std::string("Shadow"), SceneBuilder(buildShadow)));
+	scenes.push_back(std::make_pair(std::string("ShadowVsm"), SceneBuilder(buildShadowVsm)));
+	scenes.push_back(std::make_pair(std::string("Instance"), SceneBuilder(buildInstance)));
+	scenes.push_back(std::make_pair(std::string("RectAreaLight"), SceneBuilder(buildRectAreaLight)));
+	scenes.push_back(std::make_pair(std::string("SpotLight"), SceneBuilder(buildSpotLight)));
+
+	osg::ref_ptr<osg::GraphicsContext::Traits> traits = new osg::GraphicsContext::Traits;
+	traits->x = 0;
+	traits->y = 0;
+	traits->width = width;
+	traits->height = height;
+	traits->windowDecoration = false;
+	traits->doubleBuffer = true;
+	traits->pbuffer = true;
+	traits->vsync = false;
+	traits->readDISPLAY();
+	traits->setUndefinedScreenDetailsToDefaultScreen();
+
+	osg::ref_ptr<osg::GraphicsContext> gc = osg::GraphicsContext::createGraphicsContext(traits.get());
+	if (!gc.valid())
+	{
+		std::cerr << "could not create an offscreen context" << std::endl;
+		return 1;
+	}
+	gc->getState()->setUseModelViewAndProjectionUniforms(true);
+	gc->getState()->setUseVertexAttributeAliasing(true);
+
+	std::vector<BenchmarkResult> results;
+	for (size_t i = 0; i < scenes.size(); i++)
+	{
+		if (!sceneName.empty() && sceneName != scenes[i].first)
+			continue;
+
+		BenchmarkResult result;
+		if (!runScene(scenes[i].first, scenes[i].second, gc.get(), width, height, warmup, frames, result))
+		{
+			std::cerr << "could not realize the viewer for " << scenes[i].first << std::endl;
+			return 1;
+		}
+		results.push_back(result);
+	}
+
+	std::stringstream ss;
+	ss << "{\n\t\"width\": " << width << ",\n\t\"height\": " << height << ",\n\t\"frames\": " << frames
+		<< ",\n\t\"warmup\": " << warmup << ",\n\t\"scenes\": [\n";
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& result = results[i];
+		ss << "\t\t{\"name\": \"" << result.name << "\", ";
+		result.frame.write(ss, "frame_ms"); ss << ", ";
+		result.update.write(ss, "update_ms"); ss << ", ";
+		result.cull.write(ss, "cull_ms"); ss << ", ";
+		result.draw.write(ss, "draw_ms"); ss << ", ";
+		ss << "\"warmup_programs\": " << result.warmupPrograms << ", \"measured_programs\": " << result.measuredPrograms << "}";
+		ss << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	ss << "\t]\n}\n";
+
+	if (output.empty())
+	{
+		std::cout << ss.str();
+	}
+	else
+	{
+		std::ofstream file(output.c_str());
+		file << ss.str();
+	}
+
+	return 0;
+}
@@ -34,6 +34,13 @@
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/Materials>
 #include <osgThreeJSX/Animation>
+#include <osgThreeJSX/GltfLoader>
+#include <osgThreeJSX/StreamingLoader>
+#include <osgThreeJSX/VertexQuantizer>
+#include <osgThreeJSX/MeshOptimizer>
+#include <osgThreeJSX/MeshSimplifier>
+#include <osgThreeJSX/SceneCache>
+#include <osgThreeJSX/CompressedAnimation>
 #include <osg/ShapeDrawable>
 #include <osg/VertexAttribDivisor>
 #include <osg/CullFace>
@@ -173,11 +180,96 @@ int main(int argc, char** argv)
 	files.push_back("/assets/env/skyboxsun25deg/nz.jpg");
 	osg::TextureCubeMap* cubeMap = createCubemapFromImageFiles(files, true);
 
-	osg::ref_ptr<osg::Node> gltfNode = osgDB::readNodeFile("/assets/models/1959_porsche_718_rsk.glb");
+	std::string filename = "/assets/models/1959_porsche_718_rsk.glb";
+	arguments.read("--file", filename);
+	//--stream shows the window at once and adds the model when it is ready
+	bool stream = arguments.read("--stream");
+	//--quantize packs the vertex arrays of the model
+	bool quantize = arguments.read("--quantize");
+	//--optimize reorders the triangles and vertices of the model
+	bool optimize = arguments.read("--optimize");
+	//--lod generates levels of detail for the meshes of the model
+	bool lod = arguments.read("--lod");
+	//--compress-animations reduces and quantizes the keys of the animations of the model
+	bool compressAnimations = arguments.read("--compress-animations");
+	//--oit blends the transparent materials with weighted blended order independent transparency
+	bool oit = arguments.read("--oit");
+	//--write-cache writes the processed model to a scene cache, --cache reads one instead of the model
+	std::string writeCacheFile, cacheFile;
+	arguments.read("--write-cache", writeCacheFile);
+	bool readCache = arguments.read("--cache", cacheFile);
 
 	osg::ref_ptr<osg::Group> root = new osg::Group();
 
-	root->addChild(gltfNode);
+	osg::ref_ptr<osgThreeJSX::StreamingLoader> streamingLoader;
+	osgThreeJSX::LightList cachedLights;
+	osg::ref_ptr<osg::Node> modelNode;
+	if (stream)
+	{
+		streamingLoader = new osgThreeJSX::StreamingLoader();
+		streamingLoader->load(filename, root);
+	}
+	else if (readCache)
+	{
+		osg::ref_ptr<osgThreeJSX::SceneCache> cache = new osgThreeJSX::SceneCache();
+		osg::ref_ptr<osg::Node> cachedNode = cache->read(cacheFile, &cachedLights);
+		if (!cachedNode)
+		{
+			std::cout << cache->getError() << std::endl;
+			return 1;
+		}
+		std::cout << cacheFile << " read in " << cache->getLoadTime() << " ms" << std::endl;
+		root->addChild(cachedNode);
+		modelNode = cachedNode;
+	}
+	else
+	{
+		osg::ref_ptr<osgThreeJSX::GltfLoader> loader = new osgThreeJSX::GltfLoader();
+		osg::ref_ptr<osg::Node> gltfNode = loader->load(filename);
+		if (!gltfNode)
+		{
+			std::cout << loader->getError() << std::endl;
+			return 1;
+		}
+		std::cout << filename << " loaded in " << loader->getLoadTime() << " ms with " << loader->getThreadPool()->getNumThreads() << " threads" << std::endl;
+		if (optimize)
+		{
+			osg::ref_ptr<osgThreeJSX::MeshOptimizer> optimizer = new osgThreeJSX::MeshOptimizer();
+			unsigned int count = optimizer->optimize(gltfNode);
+			std::cout << count << " geometries optimized, ACMR " << optimizer->getAcmrBefore() << " -> " << optimizer->getAcmrAfter() << std::endl;
+		}
+		if (lod)
+		{
+			osg::ref_ptr<osgThreeJSX::MeshSimplifier> simplifier = new osgThreeJSX::MeshSimplifier();
+			simplifier->setThreadPool(loader->getThreadPool());
+			unsigned int count = simplifier->generate(gltfNode);
+			std::cout << count << " meshes with levels of detail" << std::endl;
+		}
+		if (quantize)
+		{
+			osg::ref_ptr<osgThreeJSX::VertexQuantizer> quantizer = new osgThreeJSX::VertexQuantizer();
+			unsigned int count = quantizer->quantize(gltfNode);
+			std::cout << count << " geometries quantized, vertex arrays " << quantizer->getSourceBytes() / 1024 << " KB -> " << quantizer->getQuantizedBytes() / 1024 << " KB" << std::endl;
+		}
+		if (!writeCacheFile.empty())
+		{
+			osg::ref_ptr<osgThreeJSX::SceneCache> cache = new osgThreeJSX::SceneCache();
+			if (cache->write(writeCacheFile, gltfNode))
+				std::cout << "scene cache written to " << writeCacheFile << std::endl;
+			else
+				std::cout << cache->getError() << std::endl;
+		}
+		root->addChild(gltfNode);
+		modelNode = gltfNode;
+	}
+	//after the cache is written, the scene cache keeps the source channels
+	if (compressAnimations && modelNode.valid())
+	{
+		osg::ref_ptr<osgThreeJSX::AnimationCompressor> compressor = new osgThreeJSX::AnimationCompressor();
+		unsigned int count = compressor->compress(modelNode);
+		std::cout << count << " animation channels compressed, keys " << compressor->getNumSourceKeys() << " -> " << compressor->getNumKeys()
+			<< ", " << compressor->getSourceBytes() / 1024 << " KB -> " << compressor->getCompressedBytes() / 1024 << " KB" << std::endl;
+	}
 	viewer->setSceneData(root);
 
 	osg::ref_ptr<osgThreeJSX::RenderState> renderState = new osgThreeJSX::RenderState();
@@ -185,6 +277,7 @@ int main(int argc, char** argv)
 	renderState->setToneMapping(osgThreeJSX::ToneMappingType_ACESFilmicToneMapping);
 	//renderState->_physicallyCorrectLights = true;
 	renderState->setToneMappingExposure(0.8);
+	renderState->setWeightedBlendedOitEnable(oit);
 
 	osgThreeJSX::AmbientLight* ambientLight = new osgThreeJSX::AmbientLight(osg::Vec3(1.0,1.0,1.0), 1.0);
 	renderState->addLight(ambientLight);
@@ -193,9 +286,13 @@ int main(int argc, char** argv)
 	direction.normalize();
 	osgThreeJSX::DirectionalLight* directionLight = new osgThreeJSX::DirectionalLight(direction, osg::Vec3(1.0, 1.0, 1.0), 1.0);
 	renderState->addLight(directionLight);
+	for (size_t i = 0; i < cachedLights.size(); i++)
+		renderState->addLight(cachedLights[i]);
 
 	auto camera = viewer->getCamera();
 	renderState->setupCamera(camera);
+	if (streamingLoader.valid())
+		streamingLoader->setupCamera(camera);
 
 	if (cubeMap)
 	{
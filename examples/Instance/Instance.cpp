@@ -30,6 +30,7 @@
 #include <osgThreeJSX/SpotLight>
 #include <osgThreeJSX/ProbeLight>
 #include <osgThreeJSX/InstanceGeometry>
+#include <osgThreeJSX/InstrumentationStats>
 
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/Materials>
@@ -272,6 +273,11 @@ int main(int argc, char** argv)
 		viewer->setCameraManipulator(keyswitchManipulator.get());
 	}
 
+	//'s' cycles the stats HUD, the library counters and timers are shown below the viewer lines
+	osg::ref_ptr<osgViewer::StatsHandler> statsHandler = new osgViewer::StatsHandler;
+	osgThreeJSX::addInstrumentationStatsLines(statsHandler.get(), viewer.get());
+	viewer->addEventHandler(statsHandler.get());
+
 	osgViewer::Viewer::Windows windows;
 	viewer->getWindows(windows);
 	for (osgViewer::Viewer::Windows::iterator itr = windows.begin(); itr != windows.end(); ++itr)
@@ -3,6 +3,7 @@
 #include <sstream>
 #include <osg/Program>
 #include <osgThreeJSX/Animation>
+#include <osgThreeJSX/Tracer>
 #include <osgAnimation/BoneMapVisitor>
 
 using namespace osgThreeJSX;
@@ -99,6 +100,10 @@ bool RigTransformMaterial::init(osgAnimation::RigGeometry& geom)
 
 void RigTransformMaterial::operator()(osgAnimation::RigGeometry& geom)
 {
+    ScopedTrace trace("skeleton update", "animation");
+    if (trace.isActive())
+        trace.setArg("bones", _bonePalette.size());
+
     if (_needInit)
     {
         if (!init(geom))
@@ -109,7 +114,16 @@ void RigTransformMaterial::operator()(osgAnimation::RigGeometry& geom)
     if (matGeom == NULL)
         return;
 
-    osg::MatrixTransform* matTransform = dynamic_cast<osg::MatrixTransform*>(geom.getParent(0)->getParent(0));
+    //a MeshLod may sit between the geode and the transform of the mesh
+    osg::MatrixTransform* matTransform = NULL;
+    osg::Node* parent = geom.getNumParents() ? geom.getParent(0) : NULL;
+    while (parent && !matTransform)
+    {
+        matTransform = dynamic_cast<osg::MatrixTransform*>(parent);
+        parent = parent->getNumParents() ? parent->getParent(0) : NULL;
+    }
+    if (matTransform == NULL)
+        return;
     _uniformBindMatrixInverse->set(osg::Matrix::inverse(matTransform->getMatrix()));
 
     for (unsigned int i = 0; i < _bonePalette.size(); ++i)
@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <set>
+#include <osg/NodeVisitor>
+#include <osg/Notify>
+#include <osgThreeJSX/CompressedAnimation>
+#include <osgAnimation/AnimationManagerBase>
+
+using namespace osgThreeJSX;
+
+namespace
+{
+	//largest magnitude of the three smallest components of a unit quaternion
+	const float g_quatRange = 0.70710678f;
+	//keys the cursor steps forward before falling back to a binary search
+	const unsigned int g_maxCursorSteps = 4;
+	//longest run of keys one straight segment may replace, bounds the reduction cost of flat curves
+	const unsigned int g_maxSpan = 512;
+}
+
+static unsigned short quantize(float value, float minimum, float extent)
+{
+	if (extent <= 0.0f)
+		return 0;
+	float t = osg::clampBetween((value - minimum) / extent, 0.0f, 1.0f);
+	return (unsigned short)(t * 65535.0f + 0.5f);
+}
+
+static float dequantize(unsigned short value, float minimum, float extent)
+{
+	return minimum + value * (extent / 65535.0f);
+}
+
+template<typename T>
+static void keepElements(std::vector<T>& elements, const std::vector<unsigned int>& keys)
+{
+	if (elements.empty())
+		return;
+	for (size_t i = 0; i < keys.size(); i++)
+		elements[i] = elements[keys[i]];
+	elements.resize(keys.size());
+}
+
+//////////////////////////////////////////////////////////////////////////
+CompressedTrack::CompressedTrack(CompressedTrackType type) :
+	_type(type)
+{
+}
+
+size_t CompressedTrack::getSizeInBytes() const
+{
+	size_t size = _times.size() * sizeof(float) + _largest.size();
+	for (unsigned int i = 0; i < 3; i++)
+		size += _components[i].size() * sizeof(unsigned short);
+	return size;
+}
+
+void CompressedTrack::setKeys(const std::vector<float>& times, const std::vector<osg::Vec3f>& values)
+{
+	size_t count = std::min(times.size(), values.size());
+	_times.assign(times.begin(), times.begin() + count);
+	_largest.clear();
+
+	osg::Vec3f minimum(FLT_MAX, FLT_MAX, FLT_MAX), maximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		for (unsigned int c = 0; c < 3; c++)
+		{
+			minimum[c] = std::min(minimum[c], values[i][c]);
+			maximum[c] = std::max(maximum[c], values[i][c]);
+		}
+	}
+	_minimum = count ? minimum : osg::Vec3f();
+	_extent = count ? maximum - minimum : osg::Vec3f();
+
+	for (unsigned int c = 0; c < 3; c++)
+	{
+		_components[c].resize(count);
+		for (size_t i = 0; i < count; i++)
+			_components[c][i] = quantize(values[i][c], _minimum[c], _extent[c]);
+	}
+}
+
+void CompressedTrack::setKeys(const std::vector<float>& times, const std::vector<osg::Quat>& values)
+{
+	size_t count = std::min(times.size(), values.size());
+	_times.assign(times.begin(), times.begin() + count);
+	_largest.resize(count);
+	_minimum.set(-g_quatRange, -g_quatRange, -g_quatRange);
+	_extent.set(2.0f * g_quatRange, 2.0f * g_quatRange, 2.0f * g_quatRange);
+	for (unsigned int c = 0; c < 3; c++)
+		_components[c].resize(count);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		osg::Quat q = values[i];
+		double length = q.length();
+		if (length > 0.0)
+			q /= length;
+		else
+			q.set(0.0, 0.0, 0.0, 1.0);
+
+		unsigned int largest = 0;
+		for (unsigned int c = 1; c < 4; c++)
+		{
+			if (fabs(q[c]) > fabs(q[largest]))
+				largest = c;
+		}
+		//q and -q are the same rotation, the dropped component is kept positive
+		double sign = q[largest] < 0.0 ? -1.0 : 1.0;
+		_largest[i] = (unsigned char)largest;
+		for (unsigned int c = 0, j = 0; c < 4; c++)
+		{
+			if (c != largest)
+				_components[j++][i] = quantize((float)(q[c] * sign), _minimum[0], _extent[0]);
+		}
+	}
+}
+
+void CompressedTrack::setKeys(const std::vector<float>& times, const std::vector<float>& values)
+{
+	size_t count = std::min(times.size(), values.size());
+	_times.assign(times.begin(), times.begin() + count);
+	_largest.clear();
+	_components[1].clear();
+	_components[2].clear();
+
+	float minimum = FLT_MAX, maximum = -FLT_MAX;
+	for (size_t i = 0; i < count; i++)
+	{
+		minimum = std::min(minimum, values[i]);
+		maximum = std::max(maximum, values[i]);
+	}
+	_minimum.set(count ? minimum : 0.0f, 0.0f, 0.0f);
+	_extent.set(count ? maximum - minimum : 0.0f, 0.0f, 0.0f);
+
+	_components[0].resize(count);
+	for (size_t i = 0; i < count; i++)
+		_components[0][i] = quantize(values[i], _minimum[0], _extent[0]);
+}
+
+void CompressedTrack::getKey(unsigned int key, osg::Vec3f& value) const
+{
+	value.set(dequantize(_components[0][key], _minimum[0], _extent[0]),
+		dequantize(_components[1][key], _minimum[1], _extent[1]),
+		dequantize(_components[2][key], _minimum[2], _extent[2]));
+}
+
+void CompressedTrack::getKey(unsigned int key, osg::Quat& value) const
+{
+	float a = dequantize(_components[0][key], _minimum[0], _extent[0]);
+	float b = dequantize(_components[1][key], _minimum[0], _extent[0]);
+	float c = dequantize(_components[2][key], _minimum[0], _extent[0]);
+	float d = sqrtf(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+	switch (_largest[key])
+	{
+	case 0: value.set(d, a, b, c); break;
+	case 1: value.set(a, d, b, c); break;
+	case 2: value.set(a, b, d, c); break;
+	default: value.set(a, b, c, d); break;
+	}
+}
+
+void CompressedTrack::getKey(unsigned int key, float& value) const
+{
+	value = dequantize(_components[0][key], _minimum[0], _extent[0]);
+}
+
+void CompressedTrack::keepKeys(const std::vector<unsigned int>& keys)
+{
+	keepElements(_times, keys);
+	keepElements(_largest, keys);
+	for (unsigned int c = 0; c < 3; c++)
+		keepElements(_components[c], keys);
+}
+
+unsigned int CompressedTrack::findKey(double time, unsigned int& cursor) const
+{
+	unsigned int count = _times.size();
+	if (count == 0)
+		return 0;
+	if (cursor >= count)
+		cursor = 0;
+
+	if (time >= _times[cursor])
+	{
+		//playing forward moves a key or two per frame
+		for (unsigned int step = 0; step < g_maxCursorSteps; step++)
+		{
+			if (cursor + 1 >= count || time < _times[cursor + 1])
+				return cursor;
+			cursor++;
+		}
+	}
+
+	//a jump, a loop back or a slow frame
+	std::vector<float>::const_iterator it = std::upper_bound(_times.begin(), _times.end(), time,
+		[](double t, float keyTime) { return t < keyTime; });
+	cursor = it == _times.begin() ? 0 : (unsigned int)(it - _times.begin()) - 1;
+	return cursor;
+}
+
+void CompressedTrack::sample(double time, unsigned int& cursor, osg::Vec3f& value) const
+{
+	unsigned int key = findKey(time, cursor);
+	getKey(key, value);
+	if (key + 1 >= _times.size() || time <= _times[key])
+		return;
+
+	osg::Vec3f next;
+	getKey(key + 1, next);
+	float t = (float)((time - _times[key]) / (_times[key + 1] - _times[key]));
+	value = value * (1.0f - t) + next * t;
+}
+
+void CompressedTrack::sample(double time, unsigned int& cursor, osg::Quat& value) const
+{
+	unsigned int key = findKey(time, cursor);
+	getKey(key, value);
+	if (key + 1 >= _times.size() || time <= _times[key])
+		return;
+
+	osg::Quat next, result;
+	getKey(key + 1, next);
+	double t = (time - _times[key]) / (_times[key + 1] - _times[key]);
+	result.slerp(t, value, next);
+	value = result;
+}
+
+void CompressedTrack::sample(double time, unsigned int& cursor, float& value) const
+{
+	unsigned int key = findKey(time, cursor);
+	getKey(key, value);
+	if (key + 1 >= _times.size() || time <= _times[key])
+		return;
+
+	float next;
+	getKey(key + 1, next);
+	float t = (float)((time - _times[key]) / (_times[key + 1] - _times[key]));
+	value = value * (1.0f - t) + next * t;
+}
+
+//////////////////////////////////////////////////////////////////////////
+static osg::Vec3f interpolate(const osg::Vec3f& a, const osg::Vec3f& b, float t)
+{
+	return a * (1.0f - t) + b * t;
+}
+
+static osg::Quat interpolate(const osg::Quat& a, const osg::Quat& b, float t)
+{
+	osg::Quat result;
+	result.slerp(t, a, b);
+	return result;
+}
+
+static float interpolate(float a, float b, float t)
+{
+	return a * (1.0f - t) + b * t;
+}
+
+static float computeError(const osg::Vec3f& a, const osg::Vec3f& b)
+{
+	return (a - b).length();
+}
+
+//angle between the rotations
+static float computeError(const osg::Quat& a, const osg::Quat& b)
+{
+	double dot = fabs(a.asVec4() * b.asVec4());
+	return (float)(2.0 * acos(std::min(dot, 1.0)));
+}
+
+static float computeError(float a, float b)
+{
+	return fabs(a - b);
+}
+
+//true when the keys between first and last stay within maxError of the segment joining them
+template<typename ValueType>
+static bool fitsSegment(const std::vector<float>& times, const std::vector<ValueType>& source, const std::vector<ValueType>& quantized,
+	unsigned int first, unsigned int last, float maxError)
+{
+	float duration = times[last] - times[first];
+	for (unsigned int i = first + 1; i < last; i++)
+	{
+		float t = duration > 0.0f ? (times[i] - times[first]) / duration : 0.0f;
+		if (computeError(interpolate(quantized[first], quantized[last], t), source[i]) > maxError)
+			return false;
+	}
+	return true;
+}
+
+//greedy piecewise linear fit, each segment grows while the keys it replaces stay within maxError
+template<typename ValueType>
+static void reduceKeys(const std::vector<float>& times, const std::vector<ValueType>& source, const std::vector<ValueType>& quantized,
+	float maxError, std::vector<unsigned int>& keys)
+{
+	unsigned int count = times.size();
+	keys.clear();
+	if (count == 0)
+		return;
+
+	keys.push_back(0);
+	unsigned int first = 0;
+	while (first + 1 < count)
+	{
+		unsigned int last = first + 1;
+		while (last + 1 < count && last + 1 - first <= g_maxSpan && fitsSegment(times, source, quantized, first, last + 1, maxError))
+			last++;
+		keys.push_back(last);
+		first = last;
+	}
+
+	//a constant curve needs one key, every key it replaces must stay within maxError of it
+	if (keys.size() == 2)
+	{
+		for (unsigned int i = 1; i < count; i++)
+		{
+			if (computeError(quantized[0], source[i]) > maxError)
+				return;
+		}
+		keys.pop_back();
+	}
+}
+
+template<typename ValueType, typename ChannelType>
+static const osg::Referenced* readKeyframes(ChannelType* channel, std::vector<float>& times, std::vector<ValueType>& values, size_t& bytes)
+{
+	typedef typename ChannelType::KeyframeContainerType KeyframeContainerType;
+	KeyframeContainerType* keyframes = channel->getSamplerTyped() ? channel->getSamplerTyped()->getKeyframeContainerTyped() : NULL;
+	if (keyframes == NULL || keyframes->empty())
+		return NULL;
+
+	times.resize(keyframes->size());
+	values.resize(keyframes->size());
+	for (size_t i = 0; i < keyframes->size(); i++)
+	{
+		times[i] = (float)(*keyframes)[i].getTime();
+		values[i] = (*keyframes)[i].getValue();
+	}
+	bytes = keyframes->size() * sizeof(typename KeyframeContainerType::value_type);
+	return keyframes;
+}
+
+class AnimationManagerVisitor : public osg::NodeVisitor
+{
+public:
+	AnimationManagerVisitor() :
+		osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+	{
+	}
+
+	virtual void apply(osg::Node& node)
+	{
+		for (osg::Callback* callback = node.getUpdateCallback(); callback; callback = callback->getNestedCallback())
+		{
+			osgAnimation::AnimationManagerBase* manager = dynamic_cast<osgAnimation::AnimationManagerBase*>(callback);
+			if (manager)
+				_managers.insert(manager);
+		}
+		traverse(node);
+	}
+
+	std::set<osgAnimation::AnimationManagerBase*> _managers;
+};
+
+//////////////////////////////////////////////////////////////////////////
+AnimationCompressor::AnimationCompressor() :
+	_translationError(1e-3f),
+	_rotationError(1e-3f),
+	_scaleError(1e-3f),
+	_weightError(1e-3f)
+{
+	resetStats();
+}
+
+void AnimationCompressor::resetStats()
+{
+	_numSourceKeys = 0;
+	_numKeys = 0;
+	_sourceBytes = 0;
+	_compressedBytes = 0;
+}
+
+osg::ref_ptr<CompressedTrack> AnimationCompressor::compressTrack(osgAnimation::Channel* channel)
+{
+	osgAnimation::Vec3LinearChannel* vec3Channel = dynamic_cast<osgAnimation::Vec3LinearChannel*>(channel);
+	osgAnimation::QuatSphericalLinearChannel* quatChannel = dynamic_cast<osgAnimation::QuatSphericalLinearChannel*>(channel);
+	osgAnimation::FloatLinearChannel* floatChannel = dynamic_cast<osgAnimation::FloatLinearChannel*>(channel);
+	if (!vec3Channel && !quatChannel && !floatChannel)
+		return NULL;
+
+	std::vector<float> times;
+	std::vector<osg::Vec3f> vec3Values;
+	std::vector<osg::Quat> quatValues;
+	std::vector<float> floatValues;
+	size_t sourceBytes = 0;
+	const osg::Referenced* keyframes = NULL;
+	if (vec3Channel)
+		keyframes = readKeyframes(vec3Channel, times, vec3Values, sourceBytes);
+	else if (quatChannel)
+		keyframes = readKeyframes(quatChannel, times, quatValues, sourceBytes);
+	else
+		keyframes = readKeyframes(floatChannel, times, floatValues, sourceBytes);
+	if (keyframes == NULL)
+		return NULL;
+
+	std::map<const osg::Referenced*, osg::ref_ptr<CompressedTrack> >::iterator it = _tracks.find(keyframes);
+	if (it != _tracks.end())
+		return it->second;
+
+	//keys are removed against the quantized values, so the error bound holds for what is played
+	osg::ref_ptr<CompressedTrack> track;
+	std::vector<unsigned int> keys;
+	if (vec3Channel)
+	{
+		track = new CompressedTrack(CompressedTrackType_Vec3);
+		track->setKeys(times, vec3Values);
+		std::vector<osg::Vec3f> quantized(times.size());
+		for (unsigned int i = 0; i < times.size(); i++)
+			track->getKey(i, quantized[i]);
+		float maxError = channel->getName() == "scale" ? _scaleError : _translationError;
+		reduceKeys(times, vec3Values, quantized, maxError, keys);
+	}
+	else if (quatChannel)
+	{
+		track = new CompressedTrack(CompressedTrackType_Quat);
+		track->setKeys(times, quatValues);
+		std::vector<osg::Quat> quantized(times.size());
+		for (unsigned int i = 0; i < times.size(); i++)
+			track->getKey(i, quantized[i]);
+		reduceKeys(times, quatValues, quantized, _rotationError, keys);
+	}
+	else
+	{
+		track = new CompressedTrack(CompressedTrackType_Float);
+		track->setKeys(times, floatValues);
+		std::vector<float> quantized(times.size());
+		for (unsigned int i = 0; i < times.size(); i++)
+			track->getKey(i, quantized[i]);
+		reduceKeys(times, floatValues, quantized, _weightError, keys);
+	}
+	track->keepKeys(keys);
+
+	_tracks[keyframes] = track;
+	_numSourceKeys += times.size();
+	_numKeys += track->getNumKeys();
+	_sourceBytes += sourceBytes;
+	_compressedBytes += track->getSizeInBytes();
+	return track;
+}
+
+unsigned int AnimationCompressor::compress(osgAnimation::Animation* animation)
+{
+	unsigned int count = 0;
+	osgAnimation::ChannelList& channels = animation->getChannels();
+	for (size_t i = 0; i < channels.size(); i++)
+	{
+		osg::ref_ptr<CompressedTrack> track = compressTrack(channels[i].get());
+		if (!track.valid())
+			continue;
+
+		osg::ref_ptr<osgAnimation::Channel> channel;
+		if (track->getType() == CompressedTrackType_Vec3)
+			channel = new CompressedVec3Channel(track);
+		else if (track->getType() == CompressedTrackType_Quat)
+			channel = new CompressedQuatChannel(track);
+		else
+			channel = new CompressedFloatChannel(track);
+		channel->setName(channels[i]->getName());
+		channel->setTargetName(channels[i]->getTargetName());
+		channels[i] = channel;
+		count++;
+	}
+	return count;
+}
+
+unsigned int AnimationCompressor::compress(osg::Node* node)
+{
+	if (node == NULL)
+		return 0;
+
+	AnimationManagerVisitor visitor;
+	node->accept(visitor);
+
+	unsigned int count = 0;
+	for (std::set<osgAnimation::AnimationManagerBase*>::iterator it = visitor._managers.begin(); it != visitor._managers.end(); ++it)
+	{
+		osgAnimation::AnimationManagerBase* manager = *it;
+		const osgAnimation::AnimationList& animations = manager->getAnimationList();
+		unsigned int managerCount = 0;
+		for (size_t i = 0; i < animations.size(); i++)
+			managerCount += compress(animations[i].get());
+		if (managerCount == 0)
+			continue;
+
+		//the new channels are linked to the stacked elements and morphs on the next update
+		manager->buildTargetReference();
+		manager->dirty();
+		count += managerCount;
+	}
+	if (count == 0)
+		OSG_INFO << "osgThreeJSX::AnimationCompressor: no linear channels to compress" << std::endl;
+	return count;
+}
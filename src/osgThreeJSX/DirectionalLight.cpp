@@ -27,12 +27,22 @@ public:
 
 	}
 
+	std::vector<osg::ref_ptr<osg::Camera>> _cascadeCameras;
 public:
 	//
 	virtual void renderCamera(ShadowMap* shadowMap, osg::ref_ptr<Light>& light, osgUtil::CullVisitor* cv)
 	{
 		CullSettingAutoRecover ar(cv, osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
 
+		if (_cascadeCameras.size())
+		{
+			for (size_t i = 0; i < _cascadeCameras.size(); i++)
+			{
+				_cascadeCameras[i]->accept(*cv);
+			}
+			return;
+		}
+
 		_camera->accept(*cv);
 		_matrix = _camera->getViewMatrix() *
 			_camera->getProjectionMatrix() *
@@ -40,21 +50,41 @@ public:
 			osg::Matrix::scale(0.5f, 0.5f, 0.5f);
 	}
 	//
+	virtual void getCameras(CameraList& cameras)
+	{
+		if (_cascadeCameras.size())
+		{
+			cameras.insert(cameras.end(), _cascadeCameras.begin(), _cascadeCameras.end());
+			return;
+		}
+		LightShadow::getCameras(cameras);
+	}
+	//
 	virtual void setupCamera(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
 	{
-		_camera = new osg::Camera;
-		_camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
-		_camera->setViewport(0, 0, _mapSize.x(), _mapSize.y());
-		_camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
-		_camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
-		_camera->attach(osg::Camera::COLOR_BUFFER, _map);
-		_camera->setClearColor(osg::Vec4f(1.0f, 1.0f, 1.0f, 1.0f));
-		_camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		_camera->addChild(node);
+		if (_cascadeCount > 1)
+		{
+			for (int i = 0; i < _cascadeCount; i++)
+			{
+				int column = i % _frameExtents.x();
+				int row = i / _frameExtents.x();
+				_cascadeCameras.push_back(createCamera(light, node, _mapSize.x() * column, _mapSize.y() * row));
+			}
+			_camera = _cascadeCameras[0];
+		}
+		else
+		{
+			_camera = createCamera(light, node, 0, 0);
+		}
 
-		osg::ref_ptr<RenderState> rs = new RenderState();
-		rs->setupCamera(_camera, light);
+		updateCamera(shadowMap, light, node);
+	}
+	//
+	virtual void updateCamera(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
+	{
+		//cascades follow the viewing camera, see fitToView
+		if (_cascadeCameras.size())
+			return;
 
 		DirectionalLight* dLight = dynamic_cast<DirectionalLight*>(light.get());
 
@@ -73,20 +103,202 @@ public:
 
 		_camera->setProjectionMatrixAsOrtho(-right, right, -top, top, znear, zfar);
 
-		float length = ortho_lightDir.length();
-		osg::Vec3 orthogonalVector = ortho_lightDir ^ osg::Vec3(0.0f, 1.0f, 0.0f);
-		if (orthogonalVector.normalize() < length*0.5f)
+		_camera->setViewMatrixAsLookAt(position, bb.center(), getUpVector(ortho_lightDir));
+
+		_matrix = _camera->getViewMatrix() *
+			_camera->getProjectionMatrix() *
+			osg::Matrix::translate(1.0, 1.0, 1.0) *
+			osg::Matrix::scale(0.5f, 0.5f, 0.5f);
+	}
+	//split the viewing frustum and fit one cascade around each slice, or fit the single camera to the visible receivers and casters
+	virtual bool fitToView(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node, osgUtil::CullVisitor* cv)
+	{
+		if (_cascadeCameras.empty())
+			return _autoFit ? fitSingleCamera(light, node, cv) : false;
+
+		DirectionalLight* dLight = dynamic_cast<DirectionalLight*>(light.get());
+
+		osg::BoundingSphere bb = node->getBound();
+		osg::Vec3d nearCorners[4], farCorners[4];
+		double viewNear, viewFar;
+		if (!computeViewFrustum(cv, bb, _cascadeMaxDistance, nearCorners, farCorners, viewNear, viewFar))
+			return false;
+
+		//practical split scheme
+		std::vector<double> splits(_cascadeCameras.size() + 1, viewNear);
+		for (size_t i = 1; i < splits.size(); i++)
 		{
-			orthogonalVector = ortho_lightDir ^ osg::Vec3(0.0f, 0.0f, 1.0f);
-			orthogonalVector.normalize();
+			double ratio = (double)i / (double)_cascadeCameras.size();
+			double uniformSplit = viewNear + (viewFar - viewNear) * ratio;
+			double logSplit = viewNear > 0.0 ? viewNear * pow(viewFar / viewNear, ratio) : uniformSplit;
+			splits[i] = _cascadeSplitLambda * logSplit + (1.0 - _cascadeSplitLambda) * uniformSplit;
 		}
 
-		_camera->setViewMatrixAsLookAt(position, bb.center(), orthogonalVector);
+		//the light basis only depends on the light direction, so snapped cascades keep their texels
+		osg::Vec3 lightDir = dLight->getDirection();
+		osg::Matrix lightView = osg::Matrix::lookAt(osg::Vec3(), lightDir, getUpVector(lightDir));
+		osg::Vec3d sceneCenter = osg::Vec3d(bb.center()) * lightView;
 
-		_matrix = _camera->getViewMatrix() *
+		std::vector<osg::Matrix> matrices;
+		for (size_t i = 0; i < _cascadeCameras.size(); i++)
+		{
+			osg::Vec3d corners[8];
+			osg::Vec3d center;
+			for (int j = 0; j < 4; j++)
+			{
+				osg::Vec3d edge = farCorners[j] - nearCorners[j];
+				corners[j] = nearCorners[j] + edge * ((splits[i] - viewNear) / (viewFar - viewNear));
+				corners[j + 4] = nearCorners[j] + edge * ((splits[i + 1] - viewNear) / (viewFar - viewNear));
+				center += corners[j] + corners[j + 4];
+			}
+			center /= 8.0;
+
+			double radius = 0.0;
+			for (int j = 0; j < 8; j++)
+			{
+				radius = osg::maximum(radius, (corners[j] - center).length());
+			}
+			radius = ceil(radius * 16.0) / 16.0;
+
+			//move the cascade in whole texels
+			osg::Vec3d lightCenter = center * lightView;
+			double texelsX = _mapSize.x() / (radius * 2.0);
+			double texelsY = _mapSize.y() / (radius * 2.0);
+			lightCenter.x() = floor(lightCenter.x() * texelsX) / texelsX;
+			lightCenter.y() = floor(lightCenter.y() * texelsY) / texelsY;
+
+			//casters between the light and the slice must still be drawn
+			double znear = osg::minimum(-(sceneCenter.z() + bb.radius()), -(lightCenter.z() + radius));
+			double zfar = osg::maximum(-(sceneCenter.z() - bb.radius()), -(lightCenter.z() - radius));
+
+			osg::Camera* camera = _cascadeCameras[i].get();
+			camera->setViewMatrix(lightView);
+			camera->setProjectionMatrixAsOrtho(lightCenter.x() - radius, lightCenter.x() + radius,
+				lightCenter.y() - radius, lightCenter.y() + radius, znear, zfar);
+
+			int column = i % _frameExtents.x();
+			int row = i / _frameExtents.x();
+			matrices.push_back(camera->getViewMatrix() *
+				camera->getProjectionMatrix() *
+				osg::Matrix::translate(1.0, 1.0, 1.0) *
+				osg::Matrix::scale(0.5f, 0.5f, 0.5f) *
+				osg::Matrix::scale(1.0 / _frameExtents.x(), 1.0 / _frameExtents.y(), 1.0) *
+				osg::Matrix::translate((double)column / _frameExtents.x(), (double)row / _frameExtents.y(), 0.0));
+		}
+
+		osg::Vec4 cascadeSplits;
+		for (int i = 0; i < 4; i++)
+		{
+			cascadeSplits[i] = splits[osg::minimum((size_t)i + 1, _cascadeCameras.size())];
+		}
+
+		bool moved = (matrices != _cascadeMatrices);
+		_cascadeMatrices = matrices;
+		_cascadeSplits = cascadeSplits;
+		_matrix = _cascadeMatrices[0];
+		return moved;
+	}
+protected:
+	//shrink the orthographic projection to the receivers in view and the casters that can shadow them
+	bool fitSingleCamera(const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node, osgUtil::CullVisitor* cv)
+	{
+		DirectionalLight* dLight = dynamic_cast<DirectionalLight*>(light.get());
+
+		osg::BoundingSphere bb = node->getBound();
+		osg::Vec3d nearCorners[4], farCorners[4];
+		double viewNear, viewFar;
+		if (!computeViewFrustum(cv, bb, _cascadeMaxDistance, nearCorners, farCorners, viewNear, viewFar))
+			return false;
+
+		osg::Vec3 lightDir = dLight->getDirection();
+		osg::Matrix lightView = osg::Matrix::lookAt(osg::Vec3(), lightDir, getUpVector(lightDir));
+
+		//receivers: the visible slice of the view frustum clipped to the scene
+		osg::BoundingBox receivers;
+		for (int i = 0; i < 4; i++)
+		{
+			receivers.expandBy(nearCorners[i] * lightView);
+			receivers.expandBy(farCorners[i] * lightView);
+		}
+		osg::Vec3d sceneCenter = osg::Vec3d(bb.center()) * lightView;
+		osg::Vec3d sceneExtent(bb.radius(), bb.radius(), bb.radius());
+		receivers = receivers.intersect(osg::BoundingBox(sceneCenter - sceneExtent, sceneCenter + sceneExtent));
+		if (!receivers.valid())
+			return false;
+
+		//casters: anything between the light and the receivers, the light looks down -z
+		osg::Polytope volume;
+		volume.add(osg::Plane(1.0, 0.0, 0.0, -receivers.xMin()));
+		volume.add(osg::Plane(-1.0, 0.0, 0.0, receivers.xMax()));
+		volume.add(osg::Plane(0.0, 1.0, 0.0, -receivers.yMin()));
+		volume.add(osg::Plane(0.0, -1.0, 0.0, receivers.yMax()));
+		volume.add(osg::Plane(0.0, 0.0, 1.0, -receivers.zMin()));
+		volume.transformProvidingInverse(lightView);
+
+		osg::BoundingBox casters = computeCasterBound(node, volume, lightView);
+		if (casters.valid())
+		{
+			receivers.xMin() = osg::maximum(receivers.xMin(), casters.xMin());
+			receivers.xMax() = osg::minimum(receivers.xMax(), casters.xMax());
+			receivers.yMin() = osg::maximum(receivers.yMin(), casters.yMin());
+			receivers.yMax() = osg::minimum(receivers.yMax(), casters.yMax());
+		}
+		if (receivers.xMin() >= receivers.xMax() || receivers.yMin() >= receivers.yMax())
+			return false;
+
+		//whole texels keep the shadow edges from crawling while the fit changes
+		double width = ceil((receivers.xMax() - receivers.xMin()) * 16.0) / 16.0;
+		double height = ceil((receivers.yMax() - receivers.yMin()) * 16.0) / 16.0;
+		double texelX = width / _mapSize.x();
+		double texelY = height / _mapSize.y();
+		width += texelX;
+		height += texelY;
+		double left = floor(receivers.xMin() / texelX) * texelX;
+		double bottom = floor(receivers.yMin() / texelY) * texelY;
+
+		double znear = -(casters.valid() ? osg::maximum(casters.zMax(), receivers.zMax()) : receivers.zMax());
+		double zfar = -receivers.zMin();
+		if (zfar <= znear)
+			zfar = znear + 1.0;
+
+		_camera->setViewMatrix(lightView);
+		_camera->setProjectionMatrixAsOrtho(left, left + width, bottom, bottom + height, znear, zfar);
+
+		osg::Matrix matrix = _camera->getViewMatrix() *
 			_camera->getProjectionMatrix() *
 			osg::Matrix::translate(1.0, 1.0, 1.0) *
 			osg::Matrix::scale(0.5f, 0.5f, 0.5f);
+		bool moved = (matrix != _matrix);
+		_matrix = matrix;
+		return moved;
+	}
+	//
+	osg::Camera* createCamera(const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node, int x, int y)
+	{
+		osg::Camera* camera = new osg::Camera;
+		camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+		camera->setViewport(x, y, _mapSize.x(), _mapSize.y());
+		camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
+		camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+		attachMap(camera, _map);
+
+		camera->addChild(node);
+
+		osg::ref_ptr<RenderState> rs = new RenderState();
+		rs->setupCamera(camera, light);
+		return camera;
+	}
+	//
+	osg::Vec3 getUpVector(const osg::Vec3& lightDir)
+	{
+		float length = lightDir.length();
+		osg::Vec3 orthogonalVector = lightDir ^ osg::Vec3(0.0f, 1.0f, 0.0f);
+		if (orthogonalVector.normalize() < length*0.5f)
+		{
+			orthogonalVector = lightDir ^ osg::Vec3(0.0f, 0.0f, 1.0f);
+			orthogonalVector.normalize();
+		}
+		return orthogonalVector;
 	}
 
 	META_Object(osg, DirectionalLightShadow);
@@ -0,0 +1,1793 @@
+#include <cstring>
+#include <cmath>
+#include <sstream>
+#include <streambuf>
+#include <istream>
+#include <list>
+#include <map>
+#include <memory>
+#include <algorithm>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/Texture2D>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/ReadFile>
+#include <osgDB/Registry>
+#include <osgAnimation/Skeleton>
+#include <osgAnimation/Bone>
+#include <osgAnimation/UpdateBone>
+#include <osgAnimation/UpdateMatrixTransform>
+#include <osgAnimation/StackedTranslateElement>
+#include <osgAnimation/StackedQuaternionElement>
+#include <osgAnimation/StackedScaleElement>
+#include <osgAnimation/Channel>
+#include <osgAnimation/Animation>
+#include <osgThreeJSX/GltfLoader>
+#include <osgThreeJSX/MappedFile>
+#include <osgThreeJSX/Materials>
+#include <osgThreeJSX/Animation>
+#include <osgThreeJSX/Config>
+#ifdef OSGTHREEJSX_DRACO
+#include <draco/compression/decode.h>
+#endif
+
+using namespace osgThreeJSX;
+
+//istream source over memory the caller keeps alive, no copy
+class MemoryStreamBuf : public std::streambuf
+{
+public:
+	MemoryStreamBuf(const unsigned char* data, size_t size)
+	{
+		char* begin = (char*)data;
+		setg(begin, begin, begin + size);
+	}
+protected:
+	virtual pos_type seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		char* position = dir == std::ios_base::beg ? eback() : (dir == std::ios_base::cur ? gptr() : egptr());
+		position += offset;
+		if (position < eback() || position > egptr())
+			return pos_type(off_type(-1));
+		setg(eback(), position, egptr());
+		return pos_type(position - eback());
+	}
+
+	virtual pos_type seekpos(pos_type position, std::ios_base::openmode which)
+	{
+		return seekoff(off_type(position), std::ios_base::beg, which);
+	}
+};
+
+static bool decodeBase64(const char* begin, const char* end, std::string& out)
+{
+	out.clear();
+	out.reserve((end - begin) * 3 / 4);
+	unsigned int value = 0;
+	int bits = 0;
+	for (const char* p = begin; p != end; p++)
+	{
+		char c = *p;
+		int digit;
+		if (c >= 'A' && c <= 'Z') digit = c - 'A';
+		else if (c >= 'a' && c <= 'z') digit = c - 'a' + 26;
+		else if (c >= '0' && c <= '9') digit = c - '0' + 52;
+		else if (c == '+' || c == '-') digit = 62;
+		else if (c == '/' || c == '_') digit = 63;
+		else if (c == '=') break;
+		else return false;
+
+		value = (value << 6) | digit;
+		bits += 6;
+		if (bits >= 8)
+		{
+			bits -= 8;
+			out.push_back((char)((value >> bits) & 0xFF));
+		}
+	}
+	return true;
+}
+
+//%20 and friends of relative uris
+static std::string decodeUri(const std::string& uri)
+{
+	std::string result;
+	for (size_t i = 0; i < uri.size(); i++)
+	{
+		if (uri[i] == '%' && i + 2 < uri.size())
+		{
+			result.push_back((char)strtol(uri.substr(i + 1, 2).c_str(), NULL, 16));
+			i += 2;
+		}
+		else
+		{
+			result.push_back(uri[i]);
+		}
+	}
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//the subset of JSON glTF needs, objects keep their keys in file order
+class JsonValue
+{
+public:
+	enum Type
+	{
+		Type_Null,
+		Type_Bool,
+		Type_Number,
+		Type_String,
+		Type_Array,
+		Type_Object
+	};
+	typedef std::vector<std::pair<std::string, JsonValue> > Members;
+public:
+	JsonValue() : _type(Type_Null), _number(0.0), _bool(false) {}
+
+	static const JsonValue& null()
+	{
+		static JsonValue value;
+		return value;
+	}
+
+	Type getType() const { return _type; }
+
+	bool isNull() const { return _type == Type_Null; }
+
+	bool isObject() const { return _type == Type_Object; }
+
+	bool isArray() const { return _type == Type_Array; }
+
+	size_t size() const { return _array.size(); }
+
+	const JsonValue& operator[](int index) const { return (index >= 0 && (size_t)index < _array.size()) ? _array[index] : null(); }
+
+	const JsonValue& operator[](const char* key) const
+	{
+		for (Members::const_iterator iter = _members.begin(); iter != _members.end(); iter++)
+		{
+			if (iter->first == key)
+				return iter->second;
+		}
+		return null();
+	}
+
+	bool has(const char* key) const { return !(*this)[key].isNull(); }
+
+	double asNumber(double defaultValue = 0.0) const { return _type == Type_Number ? _number : defaultValue; }
+
+	int asInt(int defaultValue = -1) const { return _type == Type_Number ? (int)_number : defaultValue; }
+
+	bool asBool(bool defaultValue = false) const { return _type == Type_Bool ? _bool : defaultValue; }
+
+	const std::string& asString() const { return _string; }
+
+	const Members& getMembers() const { return _members; }
+public:
+	Type _type;
+	double _number;
+	bool _bool;
+	std::string _string;
+	std::vector<JsonValue> _array;
+	Members _members;
+};
+
+class JsonParser
+{
+public:
+	JsonParser(const char* begin, const char* end) : _p(begin), _end(end) {}
+
+	bool parse(JsonValue& value)
+	{
+		if (!parseValue(value, 0))
+			return false;
+		skipSpace();
+		return _p == _end || *_p == '\0';
+	}
+protected:
+	void skipSpace()
+	{
+		while (_p != _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+			_p++;
+	}
+
+	bool match(const char* literal)
+	{
+		size_t length = strlen(literal);
+		if ((size_t)(_end - _p) < length || strncmp(_p, literal, length) != 0)
+			return false;
+		_p += length;
+		return true;
+	}
+
+	bool parseValue(JsonValue& value, int depth)
+	{
+		if (depth > 256)
+			return false;
+
+		skipSpace();
+		if (_p == _end)
+			return false;
+
+		switch (*_p)
+		{
+		case '{':
+		{
+			value._type = JsonValue::Type_Object;
+			_p++;
+			skipSpace();
+			if (_p != _end && *_p == '}')
+			{
+				_p++;
+				return true;
+			}
+			while (true)
+			{
+				skipSpace();
+				std::string key;
+				if (!parseString(key))
+					return false;
+				skipSpace();
+				if (_p == _end || *_p != ':')
+					return false;
+				_p++;
+				value._members.push_back(std::make_pair(key, JsonValue()));
+				if (!parseValue(value._members.back().second, depth + 1))
+					return false;
+				skipSpace();
+				if (_p == _end)
+					return false;
+				if (*_p == '}')
+				{
+					_p++;
+					return true;
+				}
+				if (*_p != ',')
+					return false;
+				_p++;
+			}
+		}
+		case '[':
+		{
+			value._type = JsonValue::Type_Array;
+			_p++;
+			skipSpace();
+			if (_p != _end && *_p == ']')
+			{
+				_p++;
+				return true;
+			}
+			while (true)
+			{
+				value._array.push_back(JsonValue());
+				if (!parseValue(value._array.back(), depth + 1))
+					return false;
+				skipSpace();
+				if (_p == _end)
+					return false;
+				if (*_p == ']')
+				{
+					_p++;
+					return true;
+				}
+				if (*_p != ',')
+					return false;
+				_p++;
+			}
+		}
+		case '"':
+			value._type = JsonValue::Type_String;
+			return parseString(value._string);
+		case 't':
+			value._type = JsonValue::Type_Bool;
+			value._bool = true;
+			return match("true");
+		case 'f':
+			value._type = JsonValue::Type_Bool;
+			value._bool = false;
+			return match("false");
+		case 'n':
+			value._type = JsonValue::Type_Null;
+			return match("null");
+		default:
+			value._type = JsonValue::Type_Number;
+			return parseNumber(value._number);
+		}
+	}
+
+	//locale independent, strtod would follow the C locale of the application
+	bool parseNumber(double& number)
+	{
+		bool negative = false;
+		if (_p != _end && *_p == '-')
+		{
+			negative = true;
+			_p++;
+		}
+		if (_p == _end || *_p < '0' || *_p > '9')
+			return false;
+
+		double mantissa = 0.0;
+		int exponent = 0;
+		while (_p != _end && *_p >= '0' && *_p <= '9')
+			mantissa = mantissa * 10.0 + (*_p++ - '0');
+		if (_p != _end && *_p == '.')
+		{
+			_p++;
+			while (_p != _end && *_p >= '0' && *_p <= '9')
+			{
+				mantissa = mantissa * 10.0 + (*_p++ - '0');
+				exponent--;
+			}
+		}
+		if (_p != _end && (*_p == 'e' || *_p == 'E'))
+		{
+			_p++;
+			bool negativeExponent = false;
+			if (_p != _end && (*_p == '+' || *_p == '-'))
+				negativeExponent = *_p++ == '-';
+			int value = 0;
+			while (_p != _end && *_p >= '0' && *_p <= '9')
+				value = std::min(value * 10 + (*_p++ - '0'), 100000);
+			exponent += negativeExponent ? -value : value;
+		}
+
+		number = exponent == 0 ? mantissa : mantissa * pow(10.0, exponent);
+		if (negative)
+			number = -number;
+		return true;
+	}
+
+	bool parseString(std::string& text)
+	{
+		if (_p == _end || *_p != '"')
+			return false;
+		_p++;
+		while (_p != _end && *_p != '"')
+		{
+			char c = *_p++;
+			if (c != '\\')
+			{
+				text.push_back(c);
+				continue;
+			}
+			if (_p == _end)
+				return false;
+			c = *_p++;
+			switch (c)
+			{
+			case 'b': text.push_back('\b'); break;
+			case 'f': text.push_back('\f'); break;
+			case 'n': text.push_back('\n'); break;
+			case 'r': text.push_back('\r'); break;
+			case 't': text.push_back('\t'); break;
+			case 'u':
+			{
+				unsigned int code;
+				if (!parseHex(code))
+					return false;
+				//surrogate pair
+				if (code >= 0xD800 && code <= 0xDBFF && match("\\u"))
+				{
+					unsigned int low;
+					if (!parseHex(low))
+						return false;
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUtf8(text, code);
+				break;
+			}
+			default: text.push_back(c); break;
+			}
+		}
+		if (_p == _end)
+			return false;
+		_p++;
+		return true;
+	}
+
+	bool parseHex(unsigned int& code)
+	{
+		if (_end - _p < 4)
+			return false;
+		code = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			char c = *_p++;
+			code <<= 4;
+			if (c >= '0' && c <= '9') code |= c - '0';
+			else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+			else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+			else return false;
+		}
+		return true;
+	}
+
+	static void appendUtf8(std::string& text, unsigned int code)
+	{
+		if (code < 0x80)
+		{
+			text.push_back((char)code);
+		}
+		else if (code < 0x800)
+		{
+			text.push_back((char)(0xC0 | (code >> 6)));
+			text.push_back((char)(0x80 | (code & 0x3F)));
+		}
+		else if (code < 0x10000)
+		{
+			text.push_back((char)(0xE0 | (code >> 12)));
+			text.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+			text.push_back((char)(0x80 | (code & 0x3F)));
+		}
+		else
+		{
+			text.push_back((char)(0xF0 | (code >> 18)));
+			text.push_back((char)(0x80 | ((code >> 12) & 0x3F)));
+			text.push_back((char)(0x80 | ((code >> 6) & 0x3F)));
+			text.push_back((char)(0x80 | (code & 0x3F)));
+		}
+	}
+protected:
+	const char* _p;
+	const char* _end;
+};
+
+//////////////////////////////////////////////////////////////////////////
+struct GltfSpan
+{
+	GltfSpan() : _data(NULL), _size(0) {}
+	GltfSpan(const unsigned char* data, size_t size) : _data(data), _size(size) {}
+	const unsigned char* _data;
+	size_t _size;
+};
+
+//typed view of an accessor into a buffer
+struct GltfAccessorView
+{
+	GltfAccessorView() : _data(NULL), _stride(0), _count(0), _componentType(0), _numComponents(0), _normalized(false) {}
+	//NULL for accessors without buffer view, their values are zeros
+	const unsigned char* _data;
+	size_t _stride;
+	size_t _count;
+	int _componentType;
+	int _numComponents;
+	bool _normalized;
+};
+
+static int getComponentSize(int componentType)
+{
+	switch (componentType)
+	{
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+		return 2;
+	case GL_UNSIGNED_INT:
+	case GL_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+static int getNumComponents(const std::string& type)
+{
+	if (type == "SCALAR") return 1;
+	if (type == "VEC2") return 2;
+	if (type == "VEC3") return 3;
+	if (type == "VEC4") return 4;
+	if (type == "MAT2") return 4;
+	if (type == "MAT3") return 9;
+	if (type == "MAT4") return 16;
+	return 0;
+}
+
+static float readComponent(const unsigned char* p, int componentType, bool normalized)
+{
+	switch (componentType)
+	{
+	case GL_FLOAT:
+	{
+		float value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+	case GL_BYTE:
+	{
+		signed char value = *(const signed char*)p;
+		return normalized ? std::max(value / 127.0f, -1.0f) : value;
+	}
+	case GL_UNSIGNED_BYTE:
+		return normalized ? p[0] / 255.0f : p[0];
+	case GL_SHORT:
+	{
+		short value;
+		memcpy(&value, p, 2);
+		return normalized ? std::max(value / 32767.0f, -1.0f) : value;
+	}
+	case GL_UNSIGNED_SHORT:
+	{
+		unsigned short value;
+		memcpy(&value, p, 2);
+		return normalized ? value / 65535.0f : value;
+	}
+	case GL_UNSIGNED_INT:
+	{
+		unsigned int value;
+		memcpy(&value, p, 4);
+		return (float)value;
+	}
+	default:
+		return 0.0f;
+	}
+}
+
+static unsigned int readIndex(const unsigned char* p, int componentType)
+{
+	switch (componentType)
+	{
+	case GL_UNSIGNED_BYTE:
+		return p[0];
+	case GL_UNSIGNED_SHORT:
+	{
+		unsigned short value;
+		memcpy(&value, p, 2);
+		return value;
+	}
+	default:
+	{
+		unsigned int value;
+		memcpy(&value, p, 4);
+		return value;
+	}
+	}
+}
+
+//geometry of one primitive, built on a worker thread
+struct GltfPrimitive
+{
+	GltfPrimitive() : _material(-1), _vertexColors(false), _vertexTangents(false), _flatShading(false), _numMorphTargets(0), _morphNormals(false) {}
+	osg::ref_ptr<osg::Geometry> _geometry;
+	//the geometry itself, or the source of a skinned geometry that also has morph targets
+	osg::ref_ptr<MaterialMorphGeometry> _morphGeometry;
+	int _material;
+	bool _vertexColors;
+	bool _vertexTangents;
+	bool _flatShading;
+	unsigned int _numMorphTargets;
+	bool _morphNormals;
+};
+
+typedef std::vector<GltfPrimitive> GltfPrimitiveList;
+
+//the document being loaded, buffers point into the mapped files
+class GltfDocument
+{
+public:
+	GltfDocument(osgDB::Options* options) : _options(options) {}
+
+	const std::string& getError() const { return _error; }
+	//
+	const JsonValue& getJson() const { return _json; }
+	//
+	bool open(const std::string& filename);
+	//
+	osg::ref_ptr<osg::Node> build(ThreadPool* threadPool);
+public:
+	//
+	bool getBufferView(int index, GltfSpan& span, size_t& stride);
+	//
+	bool getAccessor(int index, GltfAccessorView& view);
+	//
+	size_t getAccessorCount(int index) { return (size_t)_json["accessors"][index]["count"].asNumber(0.0); }
+	//count * numComponents floats, normalized integers are converted, missing components are 0 and a missing alpha 1
+	bool readFloats(int index, int numComponents, float* dst);
+	//NULL for empty accessors or indices past numVertices
+	osg::ref_ptr<osg::DrawElements> readIndices(int index, GLenum mode, size_t numVertices);
+protected:
+	//
+	bool loadBuffers();
+	//
+	void buildMesh(int meshIndex, bool skinned, GltfPrimitiveList& primitives);
+	//
+	bool buildPrimitive(const JsonValue& primitive, bool skinned, const JsonValue& weights, GltfPrimitive& result);
+	//
+	osg::ref_ptr<osg::Image> readImage(int index);
+	//
+	osg::ref_ptr<osg::Image> readImage(const GltfSpan& span, const std::string& extension);
+	//
+	osg::ref_ptr<osg::Texture> getTexture(const JsonValue& textureInfo);
+	//
+	osg::ref_ptr<Material> getMaterial(const GltfPrimitive& primitive, int skin);
+	//
+	//numMorphTargets bounds the weight channels of each node
+	void buildAnimations(AnimationNode* animationNode, const std::vector<std::string>& callbackNames, const std::vector<unsigned int>& numMorphTargets);
+protected:
+	JsonValue _json;
+	std::string _path;
+	osg::ref_ptr<osgDB::Options> _options;
+	std::vector<osg::ref_ptr<MappedFile> > _files;
+	std::list<std::string> _decodedBuffers;
+	std::vector<GltfSpan> _buffers;
+	GltfSpan _glbBinary;
+	std::map<std::string, osg::ref_ptr<osgDB::ReaderWriter> > _imageReaders;
+	std::vector<osg::ref_ptr<osg::Image> > _images;
+	std::map<int, osg::ref_ptr<osg::Texture> > _textures;
+	std::map<std::string, osg::ref_ptr<Material> > _materials;
+	std::string _error;
+};
+
+//attributes and indices of a primitive, from its accessors or from its Draco compressed buffer view
+class GltfPrimitiveReader
+{
+public:
+	GltfPrimitiveReader(GltfDocument& document, const JsonValue& primitive) :
+		_document(document),
+		_primitive(primitive),
+		_draco(primitive["extensions"]["KHR_draco_mesh_compression"])
+	{
+	}
+
+	bool init(std::string& error)
+	{
+		if (_draco.isNull())
+			return true;
+#ifdef OSGTHREEJSX_DRACO
+		GltfSpan span;
+		size_t stride;
+		if (!_document.getBufferView(_draco["bufferView"].asInt(), span, stride))
+		{
+			error = "invalid Draco buffer view";
+			return false;
+		}
+		draco::DecoderBuffer buffer;
+		buffer.Init((const char*)span._data, span._size);
+		draco::Decoder decoder;
+		draco::StatusOr<std::unique_ptr<draco::Mesh> > result = decoder.DecodeMeshFromBuffer(&buffer);
+		if (!result.ok())
+		{
+			error = result.status().error_msg_string();
+			return false;
+		}
+		_dracoMesh = std::move(result).value();
+		return true;
+#else
+		error = "KHR_draco_mesh_compression needs osgThreeJSX built with Draco";
+		return false;
+#endif
+	}
+
+	size_t getCount(const char* semantic)
+	{
+#ifdef OSGTHREEJSX_DRACO
+		if (_dracoMesh && _draco["attributes"].has(semantic))
+			return _dracoMesh->num_points();
+#endif
+		int accessor = _primitive["attributes"][semantic].asInt();
+		return accessor < 0 ? 0 : _document.getAccessorCount(accessor);
+	}
+
+	int getNumComponents(const char* semantic)
+	{
+#ifdef OSGTHREEJSX_DRACO
+		if (_dracoMesh && _draco["attributes"].has(semantic))
+		{
+			const draco::PointAttribute* attribute = _dracoMesh->GetAttributeByUniqueId(_draco["attributes"][semantic].asInt());
+			return attribute ? attribute->num_components() : 0;
+		}
+#endif
+		return ::getNumComponents(_document.getJson()["accessors"][_primitive["attributes"][semantic].asInt()]["type"].asString());
+	}
+
+	bool readFloats(const char* semantic, int numComponents, float* dst)
+	{
+#ifdef OSGTHREEJSX_DRACO
+		if (_dracoMesh && _draco["attributes"].has(semantic))
+		{
+			const draco::PointAttribute* attribute = _dracoMesh->GetAttributeByUniqueId(_draco["attributes"][semantic].asInt());
+			if (attribute == NULL)
+				return false;
+			for (draco::PointIndex i(0); i < _dracoMesh->num_points(); ++i)
+			{
+				if (!attribute->ConvertValue<float>(attribute->mapped_index(i), numComponents, dst + i.value() * numComponents))
+					return false;
+			}
+			return true;
+		}
+#endif
+		return _document.readFloats(_primitive["attributes"][semantic].asInt(), numComponents, dst);
+	}
+
+	osg::ref_ptr<osg::PrimitiveSet> readPrimitiveSet(GLenum mode, size_t numVertices)
+	{
+#ifdef OSGTHREEJSX_DRACO
+		if (_dracoMesh)
+		{
+			osg::ref_ptr<osg::DrawElementsUInt> elements = new osg::DrawElementsUInt(GL_TRIANGLES);
+			elements->reserve(_dracoMesh->num_faces() * 3);
+			for (draco::FaceIndex f(0); f < _dracoMesh->num_faces(); ++f)
+			{
+				const draco::Mesh::Face& face = _dracoMesh->face(f);
+				elements->push_back(face[0].value());
+				elements->push_back(face[1].value());
+				elements->push_back(face[2].value());
+			}
+			return elements;
+		}
+#endif
+		int indices = _primitive["indices"].asInt();
+		if (indices < 0)
+			return new osg::DrawArrays(mode, 0, numVertices);
+		return _document.readIndices(indices, mode, numVertices);
+	}
+protected:
+	GltfDocument& _document;
+	const JsonValue& _primitive;
+	const JsonValue& _draco;
+#ifdef OSGTHREEJSX_DRACO
+	std::unique_ptr<draco::Mesh> _dracoMesh;
+#endif
+};
+
+//////////////////////////////////////////////////////////////////////////
+bool GltfDocument::open(const std::string& filename)
+{
+	std::string path = osgDB::findDataFile(filename, _options.get());
+	if (path.empty())
+	{
+		_error = "can not find " + filename;
+		return false;
+	}
+	_path = osgDB::getFilePath(path);
+
+	osg::ref_ptr<MappedFile> file = new MappedFile;
+	if (!file->open(path))
+	{
+		_error = "can not map " + path;
+		return false;
+	}
+	_files.push_back(file);
+
+	const unsigned char* data = file->getData();
+	size_t size = file->getSize();
+	const char* jsonBegin = (const char*)data;
+	const char* jsonEnd = (const char*)data + size;
+
+	//binary container: header, JSON chunk, optional BIN chunk
+	if (size >= 12 && memcmp(data, "glTF", 4) == 0)
+	{
+		unsigned int header[3];
+		memcpy(header, data, 12);
+		if (header[1] != 2)
+		{
+			_error = "unsupported glb version";
+			return false;
+		}
+		size_t length = std::min((size_t)header[2], size);
+		size_t offset = 12;
+		jsonBegin = jsonEnd = NULL;
+		while (offset + 8 <= length)
+		{
+			unsigned int chunk[2];
+			memcpy(chunk, data + offset, 8);
+			offset += 8;
+			if (offset + chunk[0] > length)
+				break;
+			if (chunk[1] == 0x4E4F534A)
+			{
+				jsonBegin = (const char*)data + offset;
+				jsonEnd = jsonBegin + chunk[0];
+			}
+			else if (chunk[1] == 0x004E4942 && _glbBinary._data == NULL)
+			{
+				_glbBinary = GltfSpan(data + offset, chunk[0]);
+			}
+			offset += (chunk[0] + 3) & ~3u;
+		}
+		if (jsonBegin == NULL)
+		{
+			_error = "glb without JSON chunk";
+			return false;
+		}
+	}
+
+	JsonParser parser(jsonBegin, jsonEnd);
+	if (!parser.parse(_json) || !_json.isObject())
+	{
+		_error = "invalid JSON in " + path;
+		return false;
+	}
+
+	const std::string& version = _json["asset"]["version"].asString();
+	if (version.empty() || version[0] != '2')
+	{
+		_error = "unsupported glTF version " + version;
+		return false;
+	}
+
+	return loadBuffers();
+}
+
+bool GltfDocument::loadBuffers()
+{
+	const JsonValue& buffers = _json["buffers"];
+	for (size_t i = 0; i < buffers.size(); i++)
+	{
+		const JsonValue& buffer = buffers[(int)i];
+		const std::string& uri = buffer["uri"].asString();
+		size_t byteLength = (size_t)buffer["byteLength"].asNumber(0.0);
+
+		GltfSpan span;
+		if (uri.empty())
+		{
+			span = _glbBinary;
+		}
+		else if (uri.compare(0, 5, "data:") == 0)
+		{
+			size_t comma = uri.find(',');
+			_decodedBuffers.push_back(std::string());
+			if (comma == std::string::npos || !decodeBase64(uri.c_str() + comma + 1, uri.c_str() + uri.size(), _decodedBuffers.back()))
+			{
+				_error = "invalid data uri in buffer";
+				return false;
+			}
+			span = GltfSpan((const unsigned char*)_decodedBuffers.back().data(), _decodedBuffers.back().size());
+		}
+		else
+		{
+			osg::ref_ptr<MappedFile> file = new MappedFile;
+			std::string path = osgDB::concatPaths(_path, decodeUri(uri));
+			if (!file->open(path))
+			{
+				_error = "can not map " + path;
+				return false;
+			}
+			_files.push_back(file);
+			span = GltfSpan(file->getData(), file->getSize());
+		}
+
+		if (span._size < byteLength)
+		{
+			_error = "buffer shorter than its byteLength";
+			return false;
+		}
+		_buffers.push_back(span);
+	}
+	return true;
+}
+
+bool GltfDocument::getBufferView(int index, GltfSpan& span, size_t& stride)
+{
+	const JsonValue& bufferView = _json["bufferViews"][index];
+	int buffer = bufferView["buffer"].asInt();
+	if (buffer < 0 || buffer >= (int)_buffers.size())
+		return false;
+
+	size_t offset = (size_t)bufferView["byteOffset"].asNumber(0.0);
+	size_t length = (size_t)bufferView["byteLength"].asNumber(0.0);
+	if (offset + length > _buffers[buffer]._size)
+		return false;
+
+	span = GltfSpan(_buffers[buffer]._data + offset, length);
+	stride = (size_t)bufferView["byteStride"].asNumber(0.0);
+	return true;
+}
+
+bool GltfDocument::getAccessor(int index, GltfAccessorView& view)
+{
+	const JsonValue& accessor = _json["accessors"][index];
+	if (!accessor.isObject())
+		return false;
+
+	view._count = (size_t)accessor["count"].asNumber(0.0);
+	view._componentType = accessor["componentType"].asInt(0);
+	view._numComponents = getNumComponents(accessor["type"].asString());
+	view._normalized = accessor["normalized"].asBool(false);
+	size_t elementSize = getComponentSize(view._componentType) * view._numComponents;
+	if (elementSize == 0)
+		return false;
+
+	view._data = NULL;
+	view._stride = elementSize;
+	if (!accessor.has("bufferView"))
+		return true;
+
+	GltfSpan span;
+	size_t stride;
+	if (!getBufferView(accessor["bufferView"].asInt(), span, stride))
+		return false;
+
+	size_t offset = (size_t)accessor["byteOffset"].asNumber(0.0);
+	if (stride > 0)
+		view._stride = stride;
+	if (view._count > 0 && offset + view._stride * (view._count - 1) + elementSize > span._size)
+		return false;
+
+	view._data = span._data + offset;
+	return true;
+}
+
+bool GltfDocument::readFloats(int index, int numComponents, float* dst)
+{
+	GltfAccessorView view;
+	if (!getAccessor(index, view))
+		return false;
+
+	int copyComponents = std::min(numComponents, view._numComponents);
+	if (view._data == NULL)
+	{
+		memset(dst, 0, view._count * numComponents * sizeof(float));
+	}
+	else if (view._componentType == GL_FLOAT && view._numComponents == numComponents && view._stride == numComponents * sizeof(float))
+	{
+		//straight from the mapped file
+		memcpy(dst, view._data, view._count * view._stride);
+	}
+	else
+	{
+		int componentSize = getComponentSize(view._componentType);
+		for (size_t i = 0; i < view._count; i++)
+		{
+			const unsigned char* element = view._data + i * view._stride;
+			float* out = dst + i * numComponents;
+			for (int c = 0; c < copyComponents; c++)
+				out[c] = readComponent(element + c * componentSize, view._componentType, view._normalized);
+			for (int c = copyComponents; c < numComponents; c++)
+				out[c] = c == 3 ? 1.0f : 0.0f;
+		}
+	}
+
+	//sparse values replace the dense ones
+	const JsonValue& sparse = _json["accessors"][index]["sparse"];
+	if (sparse.isObject())
+	{
+		size_t count = (size_t)sparse["count"].asNumber(0.0);
+		const JsonValue& indices = sparse["indices"];
+		const JsonValue& values = sparse["values"];
+		int indexType = indices["componentType"].asInt(GL_UNSIGNED_INT);
+		size_t indexSize = getComponentSize(indexType);
+		size_t valueSize = getComponentSize(view._componentType) * view._numComponents;
+
+		GltfSpan indexSpan, valueSpan;
+		size_t stride;
+		if (!getBufferView(indices["bufferView"].asInt(), indexSpan, stride) || !getBufferView(values["bufferView"].asInt(), valueSpan, stride))
+			return false;
+		size_t indexOffset = (size_t)indices["byteOffset"].asNumber(0.0);
+		size_t valueOffset = (size_t)values["byteOffset"].asNumber(0.0);
+		if (indexOffset + count * indexSize > indexSpan._size || valueOffset + count * valueSize > valueSpan._size)
+			return false;
+
+		int componentSize = getComponentSize(view._componentType);
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned int target = readIndex(indexSpan._data + indexOffset + i * indexSize, indexType);
+			if (target >= view._count)
+				continue;
+			const unsigned char* element = valueSpan._data + valueOffset + i * valueSize;
+			float* out = dst + target * numComponents;
+			for (int c = 0; c < copyComponents; c++)
+				out[c] = readComponent(element + c * componentSize, view._componentType, view._normalized);
+		}
+	}
+	return true;
+}
+
+osg::ref_ptr<osg::DrawElements> GltfDocument::readIndices(int index, GLenum mode, size_t numVertices)
+{
+	GltfAccessorView view;
+	if (!getAccessor(index, view) || view._data == NULL || view._numComponents != 1 || view._count == 0)
+		return NULL;
+
+	osg::ref_ptr<osg::DrawElements> result;
+	if (view._componentType == GL_UNSIGNED_INT)
+	{
+		osg::ref_ptr<osg::DrawElementsUInt> elements = new osg::DrawElementsUInt(mode, view._count);
+		if (view._stride == 4)
+			memcpy(&(*elements)[0], view._data, view._count * 4);
+		else
+			for (size_t i = 0; i < view._count; i++)
+				(*elements)[i] = readIndex(view._data + i * view._stride, view._componentType);
+		result = elements;
+	}
+	else
+	{
+		osg::ref_ptr<osg::DrawElementsUShort> elements = new osg::DrawElementsUShort(mode, view._count);
+		if (view._componentType == GL_UNSIGNED_SHORT && view._stride == 2)
+			memcpy(&(*elements)[0], view._data, view._count * 2);
+		else
+			for (size_t i = 0; i < view._count; i++)
+				(*elements)[i] = readIndex(view._data + i * view._stride, view._componentType);
+		result = elements;
+	}
+
+	//an index past the vertices would read outside the vertex buffers
+	for (unsigned int i = 0; i < result->getNumIndices(); i++)
+	{
+		if (result->index(i) >= numVertices)
+		{
+			OSG_WARN << "osgThreeJSX::GltfLoader: index " << result->index(i) << " of accessor " << index << " is past " << numVertices << " vertices" << std::endl;
+			return NULL;
+		}
+	}
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+template<class ArrayType>
+static osg::ref_ptr<ArrayType> readArray(GltfPrimitiveReader& reader, const char* semantic, size_t count)
+{
+	const int numComponents = sizeof(typename ArrayType::ElementDataType) / sizeof(float);
+	osg::ref_ptr<ArrayType> array = new ArrayType(count);
+	if (count > 0 && !reader.readFloats(semantic, numComponents, (float*)&(*array)[0]))
+		return NULL;
+	return array;
+}
+
+//the skinned geometry draws the arrays of its morph source
+static void shareArrays(osg::Geometry* from, osg::Geometry* to)
+{
+	to->setVertexArray(from->getVertexArray());
+	to->setNormalArray(from->getNormalArray(), osg::Array::BIND_PER_VERTEX);
+	to->setColorArray(from->getColorArray(), osg::Array::BIND_PER_VERTEX);
+	for (unsigned int i = 0; i < from->getNumTexCoordArrays(); i++)
+		to->setTexCoordArray(i, from->getTexCoordArray(i));
+	for (unsigned int i = 0; i < from->getNumVertexAttribArrays(); i++)
+		to->setVertexAttribArray(i, from->getVertexAttribArray(i), osg::Array::BIND_PER_VERTEX);
+	for (unsigned int i = 0; i < from->getNumPrimitiveSets(); i++)
+		to->addPrimitiveSet(from->getPrimitiveSet(i));
+}
+
+void GltfDocument::buildMesh(int meshIndex, bool skinned, GltfPrimitiveList& primitives)
+{
+	const JsonValue& mesh = _json["meshes"][meshIndex];
+	const JsonValue& jsonPrimitives = mesh["primitives"];
+	primitives.resize(jsonPrimitives.size());
+	for (size_t i = 0; i < jsonPrimitives.size(); i++)
+	{
+		if (!buildPrimitive(jsonPrimitives[(int)i], skinned, mesh["weights"], primitives[i]))
+			OSG_WARN << "osgThreeJSX::GltfLoader: primitive " << i << " of mesh " << meshIndex << " skipped" << std::endl;
+	}
+}
+
+bool GltfDocument::buildPrimitive(const JsonValue& primitive, bool skinned, const JsonValue& weights, GltfPrimitive& result)
+{
+	GltfPrimitiveReader reader(*this, primitive);
+	std::string error;
+	if (!reader.init(error))
+	{
+		OSG_WARN << "osgThreeJSX::GltfLoader: " << error << std::endl;
+		return false;
+	}
+
+	size_t count = reader.getCount("POSITION");
+	if (count == 0)
+		return false;
+
+	const JsonValue& targets = primitive["targets"];
+	osg::ref_ptr<osg::Geometry> geometry;
+	osg::ref_ptr<MaterialMorphGeometry> morphGeometry;
+	if (targets.size() > 0)
+		morphGeometry = new MaterialMorphGeometry;
+	if (skinned)
+		geometry = new MaterialRigGeometry;
+	else if (morphGeometry.valid())
+		geometry = morphGeometry;
+	else
+		geometry = new osg::Geometry;
+	osg::Geometry* arrays = morphGeometry.valid() ? morphGeometry.get() : geometry.get();
+
+	osg::ref_ptr<osg::Vec3Array> positions = readArray<osg::Vec3Array>(reader, "POSITION", count);
+	if (!positions.valid())
+		return false;
+	arrays->setVertexArray(positions);
+
+	if (reader.getCount("NORMAL") == count)
+		arrays->setNormalArray(readArray<osg::Vec3Array>(reader, "NORMAL", count), osg::Array::BIND_PER_VERTEX);
+	else
+		result._flatShading = true;
+
+	if (reader.getCount("TEXCOORD_0") == count)
+		arrays->setTexCoordArray(0, readArray<osg::Vec2Array>(reader, "TEXCOORD_0", count));
+	if (reader.getCount("TEXCOORD_1") == count)
+		arrays->setTexCoordArray(1, readArray<osg::Vec2Array>(reader, "TEXCOORD_1", count));
+
+	if (reader.getCount("COLOR_0") == count)
+	{
+		if (reader.getNumComponents("COLOR_0") == 4)
+			arrays->setColorArray(readArray<osg::Vec4Array>(reader, "COLOR_0", count), osg::Array::BIND_PER_VERTEX);
+		else
+			arrays->setColorArray(readArray<osg::Vec3Array>(reader, "COLOR_0", count), osg::Array::BIND_PER_VERTEX);
+		result._vertexColors = true;
+	}
+
+	if (reader.getCount("TANGENT") == count)
+	{
+		arrays->setVertexAttribArray(GltfVertexAttrib_Tangent, readArray<osg::Vec4Array>(reader, "TANGENT", count), osg::Array::BIND_PER_VERTEX);
+		result._vertexTangents = true;
+	}
+
+	if (skinned)
+	{
+		if (reader.getCount("JOINTS_0") != count || reader.getCount("WEIGHTS_0") != count)
+			return false;
+		arrays->setVertexAttribArray(GltfVertexAttrib_SkinIndex, readArray<osg::Vec4Array>(reader, "JOINTS_0", count), osg::Array::BIND_PER_VERTEX);
+		arrays->setVertexAttribArray(GltfVertexAttrib_SkinWeight, readArray<osg::Vec4Array>(reader, "WEIGHTS_0", count), osg::Array::BIND_PER_VERTEX);
+	}
+
+	//relative targets, 8 positions or 4 positions and 4 normals like the morph chunks of the shaders
+	if (morphGeometry.valid())
+	{
+		bool morphNormals = targets.size() <= 4;
+		for (size_t i = 0; i < targets.size(); i++)
+			morphNormals = morphNormals && targets[(int)i].has("NORMAL");
+		result._numMorphTargets = std::min(targets.size(), (size_t)(morphNormals ? 4 : 8));
+		result._morphNormals = morphNormals;
+		if (targets.size() > result._numMorphTargets)
+			OSG_WARN << "osgThreeJSX::GltfLoader: only " << result._numMorphTargets << " of " << targets.size() << " morph targets are used" << std::endl;
+
+		const JsonValue& targetNames = primitive["extras"]["targetNames"];
+		for (unsigned int i = 0; i < result._numMorphTargets; i++)
+		{
+			const JsonValue& target = targets[i];
+			osg::ref_ptr<osg::Vec3Array> deltas = new osg::Vec3Array(count);
+			if (target.has("POSITION") && (getAccessorCount(target["POSITION"].asInt()) != count || !readFloats(target["POSITION"].asInt(), 3, (float*)&(*deltas)[0])))
+				return false;
+			arrays->setVertexAttribArray(GltfVertexAttrib_MorphTarget0 + i, deltas, osg::Array::BIND_PER_VERTEX);
+
+			osg::ref_ptr<osg::Geometry> targetGeometry = new osg::Geometry;
+			targetGeometry->setName(targetNames[i].asString());
+			targetGeometry->setVertexArray(deltas);
+			if (morphNormals)
+			{
+				osg::ref_ptr<osg::Vec3Array> normalDeltas = new osg::Vec3Array(count);
+				if (getAccessorCount(target["NORMAL"].asInt()) != count || !readFloats(target["NORMAL"].asInt(), 3, (float*)&(*normalDeltas)[0]))
+					return false;
+				arrays->setVertexAttribArray(GltfVertexAttrib_MorphNormal0 + i, normalDeltas, osg::Array::BIND_PER_VERTEX);
+				targetGeometry->setNormalArray(normalDeltas, osg::Array::BIND_PER_VERTEX);
+			}
+			morphGeometry->addMorphTarget(targetGeometry, (float)weights[i].asNumber(0.0));
+		}
+		morphGeometry->setMethod(osgAnimation::MorphGeometry::RELATIVE);
+		morphGeometry->setMorphTransformImplementation(new MorphTransformMaterial);
+	}
+
+	GLenum mode = (GLenum)primitive["mode"].asInt(GL_TRIANGLES);
+	osg::ref_ptr<osg::PrimitiveSet> primitiveSet = reader.readPrimitiveSet(mode, count);
+	if (!primitiveSet.valid())
+		return false;
+	arrays->addPrimitiveSet(primitiveSet);
+
+	if (arrays != geometry.get())
+	{
+		shareArrays(arrays, geometry.get());
+		static_cast<MaterialRigGeometry*>(geometry.get())->setSourceGeometry(morphGeometry);
+	}
+
+	geometry->setUseDisplayList(false);
+	geometry->setUseVertexBufferObjects(true);
+	result._geometry = geometry;
+	result._morphGeometry = morphGeometry;
+	result._material = primitive["material"].asInt();
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+static std::string getImageExtension(const std::string& mimeType, const std::string& uri)
+{
+	if (mimeType == "image/png") return "png";
+	if (mimeType == "image/jpeg") return "jpg";
+	if (mimeType == "image/ktx2") return "ktx2";
+	if (mimeType == "image/webp") return "webp";
+	return osgDB::getLowerCaseFileExtension(uri);
+}
+
+osg::ref_ptr<osg::Image> GltfDocument::readImage(const GltfSpan& span, const std::string& extension)
+{
+	std::map<std::string, osg::ref_ptr<osgDB::ReaderWriter> >::iterator iter = _imageReaders.find(extension);
+	if (iter == _imageReaders.end() || !iter->second.valid())
+		return NULL;
+
+	MemoryStreamBuf buffer(span._data, span._size);
+	std::istream stream(&buffer);
+	osgDB::ReaderWriter::ReadResult result = iter->second->readImage(stream, _options.get());
+	return result.getImage();
+}
+
+osg::ref_ptr<osg::Image> GltfDocument::readImage(int index)
+{
+	const JsonValue& image = _json["images"][index];
+	const std::string& uri = image["uri"].asString();
+	std::string extension = getImageExtension(image["mimeType"].asString(), uri);
+
+	osg::ref_ptr<osg::Image> result;
+	if (image.has("bufferView"))
+	{
+		GltfSpan span;
+		size_t stride;
+		if (getBufferView(image["bufferView"].asInt(), span, stride))
+			result = readImage(span, extension);
+	}
+	else if (uri.compare(0, 5, "data:") == 0)
+	{
+		size_t comma = uri.find(',');
+		size_t semicolon = uri.find(';');
+		std::string data;
+		if (comma != std::string::npos && semicolon != std::string::npos && decodeBase64(uri.c_str() + comma + 1, uri.c_str() + uri.size(), data))
+			result = readImage(GltfSpan((const unsigned char*)data.data(), data.size()), getImageExtension(uri.substr(5, semicolon - 5), ""));
+	}
+	else if (!uri.empty())
+	{
+		result = osgDB::readRefImageFile(osgDB::concatPaths(_path, decodeUri(uri)), _options.get());
+	}
+
+	if (!result.valid())
+	{
+		OSG_WARN << "osgThreeJSX::GltfLoader: can not read image " << index << " " << (uri.compare(0, 5, "data:") == 0 ? "" : uri) << std::endl;
+		return NULL;
+	}
+
+	//glTF uvs start at the top row, like the textures three.js uploads without flipY, KTX2 images already do
+	if (!result->isCompressed() && result->getOrigin() == osg::Image::BOTTOM_LEFT)
+	{
+		result->flipVertical();
+		result->setOrigin(osg::Image::TOP_LEFT);
+	}
+	return result;
+}
+
+osg::ref_ptr<osg::Texture> GltfDocument::getTexture(const JsonValue& textureInfo)
+{
+	int index = textureInfo["index"].asInt();
+	if (index < 0)
+		return NULL;
+
+	std::map<int, osg::ref_ptr<osg::Texture> >::iterator iter = _textures.find(index);
+	if (iter != _textures.end())
+		return iter->second;
+
+	//KHR_texture_basisu points to the KTX2 version of the image
+	const JsonValue& texture = _json["textures"][index];
+	const JsonValue& basisu = texture["extensions"]["KHR_texture_basisu"];
+	int source = basisu.has("source") ? basisu["source"].asInt() : texture["source"].asInt();
+	osg::ref_ptr<osg::Texture2D> result;
+	if (source >= 0 && source < (int)_images.size() && _images[source].valid())
+	{
+		result = new osg::Texture2D(_images[source].get());
+		result->setResizeNonPowerOfTwoHint(false);
+
+		const JsonValue& sampler = _json["samplers"][texture["sampler"].asInt()];
+		int magFilter = sampler["magFilter"].asInt(GL_LINEAR);
+		int minFilter = sampler["minFilter"].asInt(GL_LINEAR_MIPMAP_LINEAR);
+		//compressed images can not get their mipmaps generated
+		if (_images[source]->isCompressed() && _images[source]->getNumMipmapLevels() <= 1 && minFilter != GL_NEAREST)
+			minFilter = GL_LINEAR;
+		result->setFilter(osg::Texture::MAG_FILTER, magFilter == GL_NEAREST ? osg::Texture::NEAREST : osg::Texture::LINEAR);
+		result->setFilter(osg::Texture::MIN_FILTER, (osg::Texture::FilterMode)minFilter);
+
+		int wrap[2] = { sampler["wrapS"].asInt(GL_REPEAT), sampler["wrapT"].asInt(GL_REPEAT) };
+		osg::Texture::WrapParameter parameters[2] = { osg::Texture::WRAP_S, osg::Texture::WRAP_T };
+		for (int i = 0; i < 2; i++)
+		{
+			if (wrap[i] == GL_CLAMP_TO_EDGE)
+				result->setWrap(parameters[i], osg::Texture::CLAMP_TO_EDGE);
+			else if (wrap[i] == GL_MIRRORED_REPEAT_IBM)
+				result->setWrap(parameters[i], osg::Texture::MIRROR);
+			else
+				result->setWrap(parameters[i], osg::Texture::REPEAT);
+		}
+	}
+
+	_textures[index] = result;
+	return result;
+}
+
+osg::ref_ptr<Material> GltfDocument::getMaterial(const GltfPrimitive& primitive, int skin)
+{
+	//one material per variant, the skinning uniforms belong to one skin
+	std::stringstream key;
+	key << primitive._material << ' ' << primitive._vertexColors << primitive._vertexTangents << primitive._flatShading << ' ' << skin << ' ' << primitive._numMorphTargets << primitive._morphNormals;
+	std::map<std::string, osg::ref_ptr<Material> >::iterator iter = _materials.find(key.str());
+	if (iter != _materials.end())
+		return iter->second;
+
+	const JsonValue& definition = _json["materials"][primitive._material];
+	const JsonValue& pbr = definition["pbrMetallicRoughness"];
+	const JsonValue& extensions = definition["extensions"];
+
+	osg::ref_ptr<Material> material;
+	MaterialBasic* basic = NULL;
+	if (extensions.has("KHR_materials_unlit"))
+	{
+		basic = new MaterialBasic;
+		material = basic;
+	}
+	else
+	{
+		MaterialStandard* standard = NULL;
+		const JsonValue& clearcoat = extensions["KHR_materials_clearcoat"];
+		if (clearcoat.isObject())
+		{
+			MaterialPhysical* physical = new MaterialPhysical;
+			physical->_physical.clearcoat = clearcoat["clearcoatFactor"].asNumber(0.0);
+			physical->_physical.clearcoatRoughness = clearcoat["clearcoatRoughnessFactor"].asNumber(0.0);
+			physical->_physical.clearcoatMap = getTexture(clearcoat["clearcoatTexture"]);
+			physical->_physical.clearcoatRoughnessMap = getTexture(clearcoat["clearcoatRoughnessTexture"]);
+			physical->_physical.clearcoatNormalMap = getTexture(clearcoat["clearcoatNormalTexture"]);
+			float scale = clearcoat["clearcoatNormalTexture"]["scale"].asNumber(1.0);
+			physical->_physical.clearcoatNormalScale.set(scale, scale);
+			standard = physical;
+		}
+		else
+		{
+			standard = new MaterialStandard;
+		}
+		basic = standard;
+		material = standard;
+
+		standard->_metalness.metalness = pbr["metallicFactor"].asNumber(1.0);
+		standard->_roughness.roughness = pbr["roughnessFactor"].asNumber(1.0);
+		osg::ref_ptr<osg::Texture> metallicRoughness = getTexture(pbr["metallicRoughnessTexture"]);
+		standard->_metalness.setMap(metallicRoughness);
+		standard->_roughness.setMap(metallicRoughness);
+
+		const JsonValue& normalTexture = definition["normalTexture"];
+		standard->_normal.setMap(getTexture(normalTexture));
+		//same convention as the three.js loader, green is flipped without vertex tangents
+		float scale = normalTexture["scale"].asNumber(1.0);
+		standard->_normal.normalScale.set(scale, primitive._vertexTangents ? scale : -scale);
+
+		const JsonValue& emissiveFactor = definition["emissiveFactor"];
+		standard->_emissive.emissive.set(emissiveFactor[0].asNumber(0.0), emissiveFactor[1].asNumber(0.0), emissiveFactor[2].asNumber(0.0));
+		standard->_emissive.setMap(getTexture(definition["emissiveTexture"]), TextureEncodingType_sRGBEncoding);
+	}
+
+	const JsonValue& baseColorFactor = pbr["baseColorFactor"];
+	basic->_common.color.set(baseColorFactor[0].asNumber(1.0), baseColorFactor[1].asNumber(1.0), baseColorFactor[2].asNumber(1.0));
+	basic->_common.opacity = baseColorFactor[3].asNumber(1.0);
+	basic->_common.setMap(getTexture(pbr["baseColorTexture"]), TextureEncodingType_sRGBEncoding);
+
+	const JsonValue& occlusionTexture = definition["occlusionTexture"];
+	basic->_ao.aoMap = getTexture(occlusionTexture);
+	basic->_ao.aoMapIntensity = occlusionTexture["strength"].asNumber(1.0);
+
+	const std::string& alphaMode = definition["alphaMode"].asString();
+	if (alphaMode == "BLEND")
+		material->setTransparent(true);
+	else if (alphaMode == "MASK")
+		material->setAlphaTest(definition["alphaCutoff"].asNumber(0.5));
+	if (definition["doubleSided"].asBool(false))
+		material->setSide(MaterialSideType_DoubleSide);
+
+	material->setVertexColors(primitive._vertexColors);
+	material->setFlatShading(primitive._flatShading);
+	if (primitive._vertexTangents)
+	{
+		material->setVertexTangents(true);
+		material->addVertexAttrib(MaterailVertexAttrib("tangent", GltfVertexAttrib_Tangent));
+	}
+	if (skin >= 0)
+	{
+		material->setSkinning(true);
+		material->setMaxBones(_json["skins"][skin]["joints"].size());
+		material->addVertexAttrib(MaterailVertexAttrib("skinIndex", GltfVertexAttrib_SkinIndex));
+		material->addVertexAttrib(MaterailVertexAttrib("skinWeight", GltfVertexAttrib_SkinWeight));
+	}
+	if (primitive._numMorphTargets > 0)
+	{
+		material->setMorphTargets(true);
+		material->setMorphNormals(primitive._morphNormals);
+		for (unsigned int i = 0; i < primitive._numMorphTargets; i++)
+		{
+			std::stringstream target, normal;
+			target << "morphTarget" << i;
+			normal << "morphNormal" << i;
+			material->addVertexAttrib(MaterailVertexAttrib(target.str(), GltfVertexAttrib_MorphTarget0 + i));
+			if (primitive._morphNormals)
+				material->addVertexAttrib(MaterailVertexAttrib(normal.str(), GltfVertexAttrib_MorphNormal0 + i));
+		}
+	}
+
+	material->setName(definition["name"].asString());
+	_materials[key.str()] = material;
+	return material;
+}
+
+//////////////////////////////////////////////////////////////////////////
+template<typename ChannelType, typename ValueType>
+static void addKeyframes(ChannelType* channel, const std::vector<float>& times, const std::vector<ValueType>& values, bool step)
+{
+	typedef typename ChannelType::KeyframeContainerType KeyframeContainerType;
+	typedef typename KeyframeContainerType::KeyType KeyType;
+	KeyframeContainerType* keyframes = channel->getOrCreateSampler()->getOrCreateKeyframeContainer();
+	for (size_t i = 0; i < times.size() && i < values.size(); i++)
+	{
+		//the previous value is held until just before the key
+		if (step && i > 0)
+			keyframes->push_back(KeyType(std::max((double)times[i - 1], times[i] - 1e-4), values[i - 1]));
+		keyframes->push_back(KeyType(times[i], values[i]));
+	}
+}
+
+void GltfDocument::buildAnimations(AnimationNode* animationNode, const std::vector<std::string>& callbackNames, const std::vector<unsigned int>& numMorphTargets)
+{
+	const JsonValue& animations = _json["animations"];
+	for (size_t a = 0; a < animations.size(); a++)
+	{
+		const JsonValue& definition = animations[(int)a];
+		osg::ref_ptr<osgAnimation::Animation> animation = new osgAnimation::Animation;
+		std::stringstream name;
+		name << "animation_" << a;
+		animation->setName(definition.has("name") ? definition["name"].asString() : name.str());
+
+		const JsonValue& channels = definition["channels"];
+		for (size_t c = 0; c < channels.size(); c++)
+		{
+			const JsonValue& target = channels[(int)c]["target"];
+			const JsonValue& sampler = definition["samplers"][channels[(int)c]["sampler"].asInt()];
+			int node = target["node"].asInt();
+			const std::string& path = target["path"].asString();
+			if (node < 0 || node >= (int)callbackNames.size())
+				continue;
+
+			//cubic splines keep their values, the tangents are dropped
+			const std::string& interpolation = sampler["interpolation"].asString();
+			bool step = interpolation == "STEP";
+			size_t stride = interpolation == "CUBICSPLINE" ? 3 : 1;
+			size_t offset = stride == 3 ? 1 : 0;
+
+			int input = sampler["input"].asInt();
+			int output = sampler["output"].asInt();
+			std::vector<float> times(getAccessorCount(input));
+			if (times.empty() || !readFloats(input, 1, &times[0]))
+				continue;
+
+			size_t numOutputs = getAccessorCount(output);
+			if (path == "translation" || path == "scale")
+			{
+				std::vector<osg::Vec3f> outputs(numOutputs);
+				if (numOutputs == 0 || !readFloats(output, 3, (float*)&outputs[0]))
+					continue;
+				std::vector<osg::Vec3f> values;
+				for (size_t i = offset; i < outputs.size(); i += stride)
+					values.push_back(outputs[i]);
+
+				osg::ref_ptr<osgAnimation::Vec3LinearChannel> channel = new osgAnimation::Vec3LinearChannel;
+				channel->setName(path == "translation" ? "translate" : "scale");
+				channel->setTargetName(callbackNames[node]);
+				addKeyframes(channel.get(), times, values, step);
+				animation->addChannel(channel);
+			}
+			else if (path == "rotation")
+			{
+				std::vector<osg::Vec4f> outputs(numOutputs);
+				if (numOutputs == 0 || !readFloats(output, 4, (float*)&outputs[0]))
+					continue;
+				std::vector<osg::Quat> values;
+				for (size_t i = offset; i < outputs.size(); i += stride)
+					values.push_back(osg::Quat(outputs[i].x(), outputs[i].y(), outputs[i].z(), outputs[i].w()));
+
+				osg::ref_ptr<osgAnimation::QuatSphericalLinearChannel> channel = new osgAnimation::QuatSphericalLinearChannel;
+				channel->setName("quaternion");
+				channel->setTargetName(callbackNames[node]);
+				addKeyframes(channel.get(), times, values, step);
+				animation->addChannel(channel);
+			}
+			else if (path == "weights")
+			{
+				//one channel per target, named by its index for UpdateMorph
+				size_t numTargets = numOutputs / (times.size() * stride);
+				std::vector<float> outputs(numOutputs);
+				if (numTargets == 0 || !readFloats(output, 1, &outputs[0]))
+					continue;
+				for (size_t t = 0; t < numTargets && t < numMorphTargets[node]; t++)
+				{
+					std::vector<float> values;
+					for (size_t i = 0; i < times.size(); i++)
+						values.push_back(outputs[(i * stride + offset) * numTargets + t]);
+
+					std::stringstream index;
+					index << t;
+					osg::ref_ptr<osgAnimation::FloatLinearChannel> channel = new osgAnimation::FloatLinearChannel;
+					channel->setName(index.str());
+					channel->setTargetName(callbackNames[node] + "_weights");
+					addKeyframes(channel.get(), times, values, step);
+					animation->addChannel(channel);
+				}
+			}
+		}
+
+		animationNode->getAnimationManager()->registerAnimation(animation);
+	}
+}
+
+osg::ref_ptr<osg::Node> GltfDocument::build(ThreadPool* threadPool)
+{
+	const JsonValue& nodes = _json["nodes"];
+	const JsonValue& skins = _json["skins"];
+	int numNodes = nodes.size();
+
+	std::vector<bool> joints(numNodes, false);
+	for (size_t s = 0; s < skins.size(); s++)
+	{
+		const JsonValue& skinJoints = skins[(int)s]["joints"];
+		for (size_t j = 0; j < skinJoints.size(); j++)
+		{
+			int joint = skinJoints[(int)j].asInt();
+			if (joint >= 0 && joint < numNodes)
+				joints[joint] = true;
+		}
+	}
+
+	std::vector<bool> animated(numNodes, false);
+	std::vector<bool> morphAnimated(numNodes, false);
+	const JsonValue& animations = _json["animations"];
+	for (size_t a = 0; a < animations.size(); a++)
+	{
+		const JsonValue& channels = animations[(int)a]["channels"];
+		for (size_t c = 0; c < channels.size(); c++)
+		{
+			int node = channels[(int)c]["target"]["node"].asInt();
+			if (node < 0 || node >= numNodes)
+				continue;
+			if (channels[(int)c]["target"]["path"].asString() == "weights")
+				morphAnimated[node] = true;
+			else
+				animated[node] = true;
+		}
+	}
+
+	//decode meshes and images in parallel, a skinned mesh is built for each node using it
+	typedef std::map<std::pair<int, int>, GltfPrimitiveList> MeshMap;
+	MeshMap meshes;
+	for (int i = 0; i < numNodes; i++)
+	{
+		int mesh = nodes[i]["mesh"].asInt();
+		if (mesh >= 0 && mesh < (int)_json["meshes"].size())
+			meshes[std::make_pair(mesh, nodes[i].has("skin") ? i : -1)];
+	}
+	for (MeshMap::iterator iter = meshes.begin(); iter != meshes.end(); iter++)
+	{
+		GltfPrimitiveList* primitives = &iter->second;
+		int mesh = iter->first.first;
+		bool skinned = iter->first.second >= 0;
+		threadPool->addTask([this, mesh, skinned, primitives]() { buildMesh(mesh, skinned, *primitives); });
+	}
+
+	const JsonValue& images = _json["images"];
+	_images.resize(images.size());
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		//plugins are loaded here, the workers only use them
+		const JsonValue& image = images[(int)i];
+		const std::string& uri = image["uri"].asString();
+		std::string extension = uri.compare(0, 5, "data:") == 0 ? getImageExtension(uri.substr(5, uri.find(';') - 5), "") : getImageExtension(image["mimeType"].asString(), uri);
+		if (_imageReaders.find(extension) == _imageReaders.end())
+			_imageReaders[extension] = osgDB::Registry::instance()->getReaderWriterForExtension(extension);
+
+		int index = i;
+		threadPool->addTask([this, index]() { _images[index] = readImage(index); });
+	}
+	threadPool->wait();
+
+	//nodes, the names of animated nodes are unique as the channels find them by name
+	std::vector<osg::ref_ptr<osg::MatrixTransform> > transforms(numNodes);
+	std::vector<std::string> callbackNames(numNodes);
+	std::map<std::string, int> usedNames;
+	for (int i = 0; i < numNodes; i++)
+	{
+		const JsonValue& node = nodes[i];
+		std::stringstream name;
+		name << (node.has("name") ? node["name"].asString() : "node");
+		if (usedNames[name.str()]++ > 0 || !node.has("name"))
+			name << "_" << i;
+		callbackNames[i] = name.str();
+
+		osg::Vec3d translation(0.0, 0.0, 0.0);
+		osg::Quat rotation;
+		osg::Vec3d scale(1.0, 1.0, 1.0);
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.size() == 16)
+		{
+			double values[16];
+			for (int m = 0; m < 16; m++)
+				values[m] = matrix[m].asNumber(0.0);
+			osg::Quat scaleOrientation;
+			osg::Matrixd(values).decompose(translation, rotation, scale, scaleOrientation);
+		}
+		else
+		{
+			const JsonValue& t = node["translation"];
+			const JsonValue& r = node["rotation"];
+			const JsonValue& s = node["scale"];
+			if (t.size() == 3)
+				translation.set(t[0].asNumber(), t[1].asNumber(), t[2].asNumber());
+			if (r.size() == 4)
+				rotation.set(r[0].asNumber(), r[1].asNumber(), r[2].asNumber(), r[3].asNumber());
+			if (s.size() == 3)
+				scale.set(s[0].asNumber(1.0), s[1].asNumber(1.0), s[2].asNumber(1.0));
+		}
+
+		osg::ref_ptr<osg::MatrixTransform> transform = joints[i] ? new osgAnimation::Bone(callbackNames[i]) : new osg::MatrixTransform;
+		transform->setName(callbackNames[i]);
+		transform->setMatrix(osg::Matrix::scale(scale) * osg::Matrix::rotate(rotation) * osg::Matrix::translate(translation));
+		if (joints[i] || animated[i])
+		{
+			osg::ref_ptr<osgAnimation::UpdateMatrixTransform> callback = joints[i] ? new osgAnimation::UpdateBone(callbackNames[i]) : new osgAnimation::UpdateMatrixTransform(callbackNames[i]);
+			callback->getStackedTransforms().push_back(new osgAnimation::StackedTranslateElement("translate", translation));
+			callback->getStackedTransforms().push_back(new osgAnimation::StackedQuaternionElement("quaternion", rotation));
+			callback->getStackedTransforms().push_back(new osgAnimation::StackedScaleElement("scale", scale));
+			transform->addUpdateCallback(callback);
+		}
+		transforms[i] = transform;
+	}
+
+	std::vector<bool> hasParent(numNodes, false);
+	for (int i = 0; i < numNodes; i++)
+	{
+		const JsonValue& children = nodes[i]["children"];
+		for (size_t c = 0; c < children.size(); c++)
+		{
+			int child = children[(int)c].asInt();
+			if (child >= 0 && child < numNodes && !hasParent[child] && child != i)
+			{
+				transforms[i]->addChild(transforms[child]);
+				hasParent[child] = true;
+			}
+		}
+	}
+
+	osg::ref_ptr<osg::Group> scene;
+	osg::ref_ptr<osgAnimation::Skeleton> skeleton;
+	if (skins.size() > 0)
+	{
+		skeleton = new osgAnimation::Skeleton;
+		skeleton->setDefaultUpdateCallback();
+		scene = skeleton;
+	}
+	else
+	{
+		scene = new osg::Group;
+	}
+
+	const JsonValue& scenes = _json["scenes"];
+	const JsonValue& sceneNodes = scenes[_json["scene"].asInt(0)]["nodes"];
+	if (scenes.size() > 0)
+	{
+		for (size_t i = 0; i < sceneNodes.size(); i++)
+		{
+			int node = sceneNodes[(int)i].asInt();
+			if (node >= 0 && node < numNodes)
+				scene->addChild(transforms[node]);
+		}
+	}
+	else
+	{
+		for (int i = 0; i < numNodes; i++)
+		{
+			if (!hasParent[i])
+				scene->addChild(transforms[i]);
+		}
+	}
+
+	//meshes, skinned ones under the skeleton as glTF ignores the transform of their node
+	std::vector<unsigned int> numMorphTargets(numNodes, 0);
+	for (int i = 0; i < numNodes; i++)
+	{
+		const JsonValue& node = nodes[i];
+		int mesh = node["mesh"].asInt();
+		int skin = node["skin"].asInt();
+		MeshMap::iterator iter = meshes.find(std::make_pair(mesh, skin >= 0 ? i : -1));
+		if (iter == meshes.end())
+			continue;
+
+		osg::ref_ptr<osg::MatrixTransform> parent = transforms[i];
+		osg::ref_ptr<osg::MatrixfArray> palette;
+		if (skin >= 0)
+		{
+			parent = new osg::MatrixTransform;
+			parent->setName(callbackNames[i]);
+			skeleton->addChild(parent);
+
+			const JsonValue& skinJoints = skins[skin]["joints"];
+			palette = new osg::MatrixfArray(skinJoints.size());
+			int inverseBindMatrices = skins[skin]["inverseBindMatrices"].asInt();
+			if (skinJoints.size() == 0 || inverseBindMatrices < 0 || getAccessorCount(inverseBindMatrices) != skinJoints.size() || !readFloats(inverseBindMatrices, 16, (float*)&(*palette)[0]))
+			{
+				for (size_t j = 0; j < palette->size(); j++)
+					(*palette)[j].makeIdentity();
+			}
+		}
+
+		const JsonValue& weights = node.has("weights") ? node["weights"] : _json["meshes"][mesh]["weights"];
+		GltfPrimitiveList& primitives = iter->second;
+		for (size_t p = 0; p < primitives.size(); p++)
+		{
+			GltfPrimitive& primitive = primitives[p];
+			if (!primitive._geometry.valid())
+				continue;
+
+			osg::ref_ptr<Material> material = getMaterial(primitive, skin);
+			osg::ref_ptr<MaterialBaseNode<osg::Geode> > geode = new MaterialBaseNode<osg::Geode>();
+			geode->addDrawable(primitive._geometry);
+			geode->setMaterial(material);
+			parent->addChild(geode);
+
+			//the ao map reads uv2
+			MaterialBasic* basic = dynamic_cast<MaterialBasic*>(material.get());
+			if (basic && basic->_ao.aoMap.valid() && primitive._geometry->getTexCoordArray(1) == NULL)
+				primitive._geometry->setTexCoordArray(1, primitive._geometry->getTexCoordArray(0));
+
+			MaterialRigGeometry* rigGeometry = dynamic_cast<MaterialRigGeometry*>(primitive._geometry.get());
+			if (rigGeometry)
+			{
+				osg::ref_ptr<RigTransformMaterial> rigTransform = new RigTransformMaterial;
+				const JsonValue& skinJoints = skins[skin]["joints"];
+				for (size_t j = 0; j < skinJoints.size(); j++)
+				{
+					int joint = skinJoints[(int)j].asInt();
+					if (joint >= 0 && joint < numNodes)
+						rigTransform->addBone(dynamic_cast<osgAnimation::Bone*>(transforms[joint].get()));
+				}
+				rigTransform->setMatrixPalette(palette);
+				rigGeometry->setRigTransformImplementation(rigTransform);
+				rigGeometry->setSkeleton(skeleton);
+				rigGeometry->setMaterial(material);
+			}
+
+			if (primitive._morphGeometry.valid())
+			{
+				primitive._morphGeometry->setMaterial(material);
+				numMorphTargets[i] = std::max(numMorphTargets[i], primitive._numMorphTargets);
+				for (unsigned int t = 0; t < primitive._numMorphTargets; t++)
+					primitive._morphGeometry->setWeight(t, weights[t].asNumber(0.0));
+				if (morphAnimated[i])
+					geode->addUpdateCallback(new osgAnimation::UpdateMorph(callbackNames[i] + "_weights"));
+			}
+		}
+	}
+
+	if (animations.size() == 0)
+		return scene;
+
+	osg::ref_ptr<AnimationNode> animationNode = new AnimationNode;
+	animationNode->addChild(scene);
+	buildAnimations(animationNode.get(), callbackNames, numMorphTargets);
+	return animationNode;
+}
+
+//////////////////////////////////////////////////////////////////////////
+GltfLoader::GltfLoader() :
+	_numThreads(0),
+	_loadTime(0.0)
+{
+}
+
+ThreadPool* GltfLoader::getThreadPool()
+{
+	if (!_threadPool.valid())
+		_threadPool = new ThreadPool(_numThreads);
+	return _threadPool.get();
+}
+
+osg::ref_ptr<osg::Node> GltfLoader::load(const std::string& filename)
+{
+	osg::Timer_t start = osg::Timer::instance()->tick();
+	_error.clear();
+
+	osg::ref_ptr<osg::Node> node;
+	GltfDocument document(_options.get());
+	if (document.open(filename))
+		node = document.build(getThreadPool());
+	if (!node.valid())
+		_error = document.getError().empty() ? "nothing loaded from " + filename : document.getError();
+
+	_loadTime = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+	return node;
+}
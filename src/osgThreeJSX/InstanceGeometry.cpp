@@ -4,10 +4,11 @@
 #include <osgUtil/CullVisitor>
 #include <osgUtil/IntersectionVisitor>
 #include <osgThreeJSX/RenderState>
+#include <osgThreeJSX/Instrumentation>
 
 using namespace osgThreeJSX;
 
-InstanceGeometry::InstanceGeometry() : _instanceNum(0)
+InstanceGeometry::InstanceGeometry() : _instanceNum(0), _maxPixelError(1.0f), _maxInstanceScale(1.0f)
 {
 	setupInstanceData();
 
@@ -30,9 +31,17 @@ void InstanceGeometry::traverse(osg::NodeVisitor& nv)
 		if (!_geometry)
 			return;
 
+		OSGTHREEJSX_SCOPED_TIMER(InstrumentTimer_InstanceTraverse);
+		OSGTHREEJSX_COUNT(InstrumentCounter_InstancesDrawn, _instanceNum);
+
 		osgUtil::CullVisitor* cv = nv.asCullVisitor();
-		int instanceTextureUnit = cv->getState()->getMaxTextureUnits() - 1;
-		osg::StateSet* ss = _geometry->getOrCreateStateSet();
+		osg::Geometry* geometry = selectGeometry(cv);
+
+		RenderState* rs = RenderState::FromCamera(cv->getCurrentCamera());
+		int instanceTextureUnit = rs ? rs->getTextureUnitAllocator().acquire(TextureUnitAllocator::InstanceDataName) : -1;
+		if (instanceTextureUnit < 0)
+			instanceTextureUnit = cv->getState()->getMaxTextureUnits() - 1;
+		osg::StateSet* ss = geometry->getOrCreateStateSet();
 		if (!ss->getTextureAttribute(instanceTextureUnit, osg::StateAttribute::TEXTURE))
 		{
 			ss->addUniform(new osg::Uniform("instanceImage", instanceTextureUnit));
@@ -40,8 +49,8 @@ void InstanceGeometry::traverse(osg::NodeVisitor& nv)
 		}
 
 		CullSettingAutoRecover ar(cv, osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
-		_geometry->setCullingActive(false);
-		_geometry->accept(nv);
+		geometry->setCullingActive(false);
+		geometry->accept(nv);
 	}
 	else if (nv.getVisitorType() == osg::NodeVisitor::INTERSECTION_VISITOR)
 	{
@@ -86,6 +95,7 @@ osg::BoundingSphere transformBoundingSphere(const osg::BoundingSphere& bs, const
 osg::BoundingSphere InstanceGeometry::computeBound() const
 {
 	osg::BoundingSphere bs;
+	_maxInstanceScale = 0.0f;
 	if (_geometry)
 	{
 		for (unsigned int i = 0; i < _instanceNum; i++)
@@ -94,6 +104,9 @@ osg::BoundingSphere InstanceGeometry::computeBound() const
 			osg::Matrix mat = getInstanceMatrix(i);
 			bsModel = transformBoundingSphere(bsModel, mat);
 			bs.expandBy(bsModel);
+
+			osg::Vec3 scale = mat.getScale();
+			_maxInstanceScale = osg::maximum(_maxInstanceScale, osg::maximum(scale.x(), osg::maximum(scale.y(), scale.z())));
 		}
 	}
 	return bs;
@@ -110,6 +123,26 @@ osg::Matrix InstanceGeometry::getInstanceMatrix(unsigned int idx) const
 	return mat;
 }
 
+osg::Geometry* InstanceGeometry::selectGeometry(osgUtil::CullVisitor* cv) const
+{
+	if (!_lodChain.valid() || _lodChain->getNumLevels() < 2)
+		return _geometry.get();
+
+	osg::BoundingSphere bsModel = _geometry->getBound();
+	const osg::BoundingSphere& bound = getBound();
+	if (!bsModel.valid() || bsModel.radius() <= 0.0f || !bound.valid())
+		return _geometry.get();
+
+	//no instance is nearer than the largest one touching the bound where it faces the eye, it bounds the detail without a scan
+	float radius = osg::minimum(bsModel.radius() * _maxInstanceScale, bound.radius());
+	osg::Vec3 toEye = cv->getEyeLocal() - bound.center();
+	float distance = toEye.length();
+	osg::Vec3 center = distance > bound.radius() ? bound.center() + toEye * ((bound.radius() - radius) / distance) : cv->getEyeLocal();
+	float pixelsPerUnit = cv->clampedPixelSize(osg::BoundingSphere(center, radius)) / bsModel.radius();
+	unsigned int level = MeshLodChain::selectLevel(_lodChain->getErrors(), pixelsPerUnit, _maxPixelError);
+	return _lodChain->getLevel(level);
+}
+
 void InstanceGeometry::setupInstanceData()
 {
 	_instanceImage = new osg::Image();
@@ -153,6 +186,21 @@ void InstanceGeometry::addInstance(const osg::Matrix& mat)
 	dirtyBound();
 }
 
+void InstanceGeometry::setInstances(const osg::Matrixf* matrices, unsigned int count)
+{
+	unsigned int sizeOfOne = sizeof(float) * 16;
+	unsigned int capacity = osg::maximum(count, 4u);
+	unsigned char* data = new unsigned char[capacity * sizeOfOne];
+	if (count > 0)
+		memcpy(data, matrices, count * sizeOfOne);
+	_instanceImage->setImage(4, capacity, 1, GL_RGBA32F_ARB, GL_RGBA, GL_FLOAT, data, osg::Image::USE_NEW_DELETE);
+	_instanceNum = count;
+
+	setPrimitiveSetNum();
+
+	dirtyBound();
+}
+
 void InstanceGeometry::setGeometry(osg::Geometry* geometry)
 {
 	_geometry = geometry;
@@ -160,6 +208,17 @@ void InstanceGeometry::setGeometry(osg::Geometry* geometry)
 	setPrimitiveSetNum();
 }
 
+void InstanceGeometry::setLodChain(MeshLodChain* chain)
+{
+	_lodChain = chain;
+	if (chain && chain->getNumLevels() > 0)
+		_geometry = chain->getLevel(0);
+
+	setPrimitiveSetNum();
+
+	dirtyBound();
+}
+
 void InstanceGeometry::setPrimitiveSetNum()
 {
 	if (!_geometry)
@@ -169,4 +228,14 @@ void InstanceGeometry::setPrimitiveSetNum()
 	{
 		_geometry->getPrimitiveSet(i)->setNumInstances(_instanceNum);
 	}
+
+	if (!_lodChain.valid())
+		return;
+
+	for (unsigned int level = 0; level < _lodChain->getNumLevels(); level++)
+	{
+		osg::Geometry* geometry = _lodChain->getLevel(level);
+		for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++)
+			geometry->getPrimitiveSet(i)->setNumInstances(_instanceNum);
+	}
 }
\ No newline at end of file
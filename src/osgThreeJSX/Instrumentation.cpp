@@ -0,0 +1,114 @@
+#include <fstream>
+#include <OpenThreads/ScopedLock>
+#include <osgThreeJSX/Instrumentation>
+
+using namespace osgThreeJSX;
+
+static const char* g_counterNames[InstrumentCounter_Count] = {
+	"osgThreeJSX program builds",
+	"osgThreeJSX program cache hits",
+	"osgThreeJSX uniforms touched",
+	"osgThreeJSX shadow passes",
+	"osgThreeJSX instances drawn"
+};
+
+static const char* g_timerNames[InstrumentTimer_Count] = {
+	"osgThreeJSX RenderState cull time taken",
+	"osgThreeJSX Material update time taken",
+	"osgThreeJSX program create time taken",
+	"osgThreeJSX ShadowMap cull time taken",
+	"osgThreeJSX InstanceGeometry traverse time taken"
+};
+
+Instrumentation& Instrumentation::instance()
+{
+	static Instrumentation instance;
+	return instance;
+}
+
+const char* Instrumentation::getCounterName(InstrumentCounter counter)
+{
+	return g_counterNames[counter];
+}
+
+const char* Instrumentation::getTimerName(InstrumentTimer timer)
+{
+	return g_timerNames[timer];
+}
+
+Instrumentation::Instrumentation() :
+	_reportedFrame(~0u),
+	_historySize(600)
+{
+	for (int i = 0; i < InstrumentCounter_Count; i++)
+		_counters[i] = 0;
+	for (int i = 0; i < InstrumentTimer_Count; i++)
+		_timers[i] = 0;
+}
+
+void Instrumentation::addTime(InstrumentTimer timer, osg::Timer_t start, osg::Timer_t end)
+{
+	_timers[timer] += (unsigned long long)osg::Timer::instance()->delta_u(start, end);
+}
+
+void Instrumentation::endFrame(unsigned int frameNumber, osg::Stats* cameraStats)
+{
+	//every main camera calls this, the exchange lets one of them report
+	if (_reportedFrame.exchange(frameNumber) == frameNumber)
+		return;
+
+	FrameRecord record;
+	record._frameNumber = frameNumber;
+	record._time = osg::Timer::instance()->time_m();
+	for (int i = 0; i < InstrumentCounter_Count; i++)
+		record._counters[i] = _counters[i].exchange(0);
+	for (int i = 0; i < InstrumentTimer_Count; i++)
+		record._timers[i] = _timers[i].exchange(0) / 1000.0;
+
+	osg::ref_ptr<osg::Stats> stats;
+	if (!_stats.lock(stats))
+		stats = cameraStats;
+	if (stats.valid() && stats->collectStats("rendering"))
+	{
+		for (int i = 0; i < InstrumentCounter_Count; i++)
+			stats->setAttribute(frameNumber, g_counterNames[i], record._counters[i]);
+		//seconds, like the traversal times of osgViewer
+		for (int i = 0; i < InstrumentTimer_Count; i++)
+			stats->setAttribute(frameNumber, g_timerNames[i], record._timers[i] / 1000.0);
+	}
+
+	if (_historySize > 0)
+	{
+		OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_historyMutex);
+		_history.push_back(record);
+		while (_history.size() > _historySize)
+			_history.pop_front();
+	}
+}
+
+bool Instrumentation::writeChromeTrace(const std::string& filename)
+{
+	std::ofstream file(filename.c_str());
+	if (!file)
+		return false;
+
+	OpenThreads::ScopedLock<OpenThreads::Mutex> lock(_historyMutex);
+	file << "{\"traceEvents\":[\n";
+	bool first = true;
+	for (std::deque<FrameRecord>::const_iterator iter = _history.begin(); iter != _history.end(); iter++)
+	{
+		//one counter track per group, timestamps in microseconds
+		double ts = iter->_time * 1000.0;
+		file << (first ? "" : ",\n") << "{\"name\":\"osgThreeJSX counters\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << ts << ",\"args\":{";
+		for (int i = 0; i < InstrumentCounter_Count; i++)
+			file << (i ? "," : "") << "\"" << g_counterNames[i] << "\":" << iter->_counters[i];
+		file << "}},\n";
+		file << "{\"name\":\"osgThreeJSX times (ms)\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << ts << ",\"args\":{";
+		for (int i = 0; i < InstrumentTimer_Count; i++)
+			file << (i ? "," : "") << "\"" << g_timerNames[i] << "\":" << iter->_timers[i];
+		file << "}}";
+		first = false;
+	}
+	file << "\n]}\n";
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,521 @@
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <osg/Texture>
+#include <osg/GLExtensions>
+#include <osg/Notify>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgDB/Registry>
+#include <osgThreeJSX/KtxTranscoder>
+#include <osgThreeJSX/Config>
+#ifdef OSGTHREEJSX_BASISU
+#include <basisu_transcoder.h>
+#endif
+
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM_ARB
+#define GL_COMPRESSED_RGBA_BPTC_UNORM_ARB 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+#ifndef GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define GL_COMPRESSED_RGBA_ASTC_4x4_KHR 0x93B0
+#endif
+
+using namespace osgThreeJSX;
+
+//////////////////////////////////////////////////////////////////////////
+static const unsigned char s_ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+static unsigned int readUInt32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+static unsigned long long readUInt64(const unsigned char* p)
+{
+	return readUInt32(p) | ((unsigned long long)readUInt32(p + 4) << 32);
+}
+
+//the fixed part of the KTX2 header and the level index
+struct KtxHeader
+{
+	unsigned int _vkFormat;
+	unsigned int _width;
+	unsigned int _height;
+	unsigned int _depth;
+	unsigned int _layerCount;
+	unsigned int _faceCount;
+	unsigned int _levelCount;
+	unsigned int _supercompression;
+	struct Level
+	{
+		unsigned long long _offset;
+		unsigned long long _length;
+	};
+	std::vector<Level> _levels;
+
+	bool read(const unsigned char* data, size_t size, std::string& error)
+	{
+		if (size < 80 || memcmp(data, s_ktx2Identifier, sizeof(s_ktx2Identifier)) != 0)
+		{
+			error = "not a KTX2 file";
+			return false;
+		}
+
+		_vkFormat = readUInt32(data + 12);
+		_width = readUInt32(data + 20);
+		_height = readUInt32(data + 24);
+		_depth = readUInt32(data + 28);
+		_layerCount = readUInt32(data + 32);
+		_faceCount = readUInt32(data + 36);
+		_levelCount = readUInt32(data + 40);
+		_supercompression = readUInt32(data + 44);
+
+		//0 levels asks the loader to generate the mipmaps, the bounds are checked in size_t as the counts come from the file
+		size_t numLevels = std::max(1u, _levelCount);
+		if (numLevels > (size - 80) / 24)
+		{
+			error = "truncated KTX2 level index";
+			return false;
+		}
+
+		_levels.resize(numLevels);
+		for (size_t i = 0; i < numLevels; i++)
+		{
+			_levels[i]._offset = readUInt64(data + 80 + i * 24);
+			_levels[i]._length = readUInt64(data + 80 + i * 24 + 8);
+			if (_levels[i]._offset > size || _levels[i]._length > size - _levels[i]._offset)
+			{
+				error = "truncated KTX2 level data";
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+//GL format of the Vulkan formats stored without Basis Universal
+static bool getVkFormat(unsigned int vkFormat, GLenum& internalFormat)
+{
+	switch (vkFormat)
+	{
+	case 37://VK_FORMAT_R8G8B8A8_UNORM
+	case 43://VK_FORMAT_R8G8B8A8_SRGB
+		internalFormat = GL_RGBA; return true;
+	case 131://VK_FORMAT_BC1_RGB_UNORM_BLOCK
+	case 132:
+		internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; return true;
+	case 133://VK_FORMAT_BC1_RGBA_UNORM_BLOCK
+	case 134:
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT; return true;
+	case 137://VK_FORMAT_BC3_UNORM_BLOCK
+	case 138:
+		internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; return true;
+	case 145://VK_FORMAT_BC7_UNORM_BLOCK
+	case 146:
+		internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB; return true;
+	case 147://VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+	case 148:
+		internalFormat = GL_COMPRESSED_RGB8_ETC2; return true;
+	case 151://VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK
+	case 152:
+		internalFormat = GL_COMPRESSED_RGBA8_ETC2_EAC; return true;
+	case 157://VK_FORMAT_ASTC_4x4_UNORM_BLOCK
+	case 158:
+		internalFormat = GL_COMPRESSED_RGBA_ASTC_4x4_KHR; return true;
+	default:
+		return false;
+	}
+}
+
+//bytes of a level, RGBA8 or 4x4 blocks, in 64 bits as the sizes come from the file
+static unsigned long long getLevelSize(GLenum internalFormat, unsigned int width, unsigned int height)
+{
+	if (internalFormat == GL_RGBA)
+		return (unsigned long long)width * height * 4;
+
+	bool halfBlock = internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGB8_ETC2;
+	return ((width + 3ull) / 4) * ((height + 3ull) / 4) * (halfBlock ? 8 : 16);
+}
+
+//levels concatenated from the largest, as osg::Image keeps its mipmaps
+static osg::ref_ptr<osg::Image> createImage(unsigned int width, unsigned int height, GLenum internalFormat, const std::vector<unsigned char*>& levels, const std::vector<size_t>& sizes, std::string& error)
+{
+	//a level shorter than its dimensions would be read past its end by the upload and the baked mipmaps
+	size_t total = 0;
+	osg::Image::MipmapDataType offsets;
+	for (size_t i = 0; i < sizes.size(); i++)
+	{
+		unsigned int levelWidth = i < 32 ? std::max(1u, width >> i) : 1;
+		unsigned int levelHeight = i < 32 ? std::max(1u, height >> i) : 1;
+		if (sizes[i] < getLevelSize(internalFormat, levelWidth, levelHeight))
+		{
+			error = "KTX2 level smaller than its dimensions";
+			return NULL;
+		}
+		if (i > 0)
+			offsets.push_back(total);
+		total += sizes[i];
+	}
+
+	unsigned char* data = new unsigned char[total];
+	for (size_t i = 0, offset = 0; i < sizes.size(); offset += sizes[i], i++)
+		memcpy(data + offset, levels[i], sizes[i]);
+
+	bool compressed = internalFormat != GL_RGBA;
+	osg::ref_ptr<osg::Image> image = new osg::Image();
+	image->setImage(width, height, 1, internalFormat, compressed ? internalFormat : GL_RGBA, GL_UNSIGNED_BYTE, data, osg::Image::USE_NEW_DELETE, 1);
+	image->setMipmapLevels(offsets);
+	image->setOrigin(osg::Image::TOP_LEFT);
+	return image;
+}
+
+#ifdef OSGTHREEJSX_BASISU
+static std::once_flag s_basisInit;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+KtxTranscoder::KtxTranscoder() :
+	_supportedFormats(KtxTargetFormat_RGBA),
+	_bakeMipmaps(true)
+{
+#if defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
+	setSupportedFormats(KtxTargetFormat_ETC2);
+#else
+	setSupportedFormats(KtxTargetFormat_BC7 | KtxTargetFormat_BC1);
+#endif
+}
+
+KtxTranscoder* KtxTranscoder::instance()
+{
+	static osg::ref_ptr<KtxTranscoder> instance = new KtxTranscoder();
+	return instance.get();
+}
+
+bool KtxTranscoder::getBasisSupported()
+{
+#ifdef OSGTHREEJSX_BASISU
+	return true;
+#else
+	return false;
+#endif
+}
+
+void KtxTranscoder::setSupportedFormats(unsigned int formats)
+{
+	//osg::Texture uploads the block formats it knows only
+	static const GLenum s_formats[][2] = {
+		{ KtxTargetFormat_BC7, GL_COMPRESSED_RGBA_BPTC_UNORM_ARB },
+		{ KtxTargetFormat_BC1, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT },
+		{ KtxTargetFormat_ETC2, GL_COMPRESSED_RGBA8_ETC2_EAC },
+		{ KtxTargetFormat_ASTC, GL_COMPRESSED_RGBA_ASTC_4x4_KHR },
+	};
+	for (size_t i = 0; i < sizeof(s_formats) / sizeof(s_formats[0]); i++)
+	{
+		if (!osg::Texture::isCompressedInternalFormat(s_formats[i][1]))
+			formats &= ~s_formats[i][0];
+	}
+	_supportedFormats = formats;
+}
+
+void KtxTranscoder::detectSupportedFormats(unsigned int contextID)
+{
+	unsigned int formats = 0;
+	if (osg::isGLExtensionSupported(contextID, "GL_ARB_texture_compression_bptc") || osg::isGLExtensionSupported(contextID, "GL_EXT_texture_compression_bptc"))
+		formats |= KtxTargetFormat_BC7;
+	if (osg::isGLExtensionSupported(contextID, "GL_EXT_texture_compression_s3tc"))
+		formats |= KtxTargetFormat_BC1;
+	if (osg::isGLExtensionSupported(contextID, "GL_ARB_ES3_compatibility"))
+		formats |= KtxTargetFormat_ETC2;
+	if (osg::isGLExtensionSupported(contextID, "GL_KHR_texture_compression_astc_ldr"))
+		formats |= KtxTargetFormat_ASTC;
+#if defined(OSG_GLES3_AVAILABLE)
+	formats |= KtxTargetFormat_ETC2;
+#endif
+	setSupportedFormats(formats);
+}
+
+ThreadPool* KtxTranscoder::getThreadPool()
+{
+	if (!_threadPool.valid())
+		_threadPool = new ThreadPool();
+	return _threadPool.get();
+}
+
+KtxTargetFormat KtxTranscoder::selectFormat(bool uastc) const
+{
+	//ETC1S is closest to ETC and BC1, UASTC to ASTC and BC7
+	static const KtxTargetFormat s_etc1s[] = { KtxTargetFormat_ETC2, KtxTargetFormat_BC1, KtxTargetFormat_BC7, KtxTargetFormat_ASTC };
+	static const KtxTargetFormat s_uastc[] = { KtxTargetFormat_ASTC, KtxTargetFormat_BC7, KtxTargetFormat_ETC2, KtxTargetFormat_BC1 };
+	const KtxTargetFormat* order = uastc ? s_uastc : s_etc1s;
+	for (int i = 0; i < 4; i++)
+	{
+		if (_supportedFormats & order[i])
+			return order[i];
+	}
+	return KtxTargetFormat_RGBA;
+}
+
+osg::ref_ptr<osg::Image> KtxTranscoder::read(const unsigned char* data, size_t size, std::string* error, unsigned int baseLevel)
+{
+	std::string message;
+	KtxHeader header;
+	osg::ref_ptr<osg::Image> image;
+	if (!header.read(data, size, message))
+	{
+		image = NULL;
+	}
+	else if (header._depth > 1 || header._layerCount > 1 || header._faceCount > 1)
+	{
+		message = "KTX2 arrays, cube maps and 3D textures are not supported";
+	}
+	else if (header._vkFormat == 0)
+	{
+		image = readBasis(data, size, message, baseLevel);
+	}
+	else
+	{
+		GLenum internalFormat;
+		if (header._supercompression != 0)
+		{
+			message = "supercompressed KTX2 is only supported for Basis Universal";
+		}
+		else if (!getVkFormat(header._vkFormat, internalFormat))
+		{
+			message = "unsupported KTX2 vkFormat";
+		}
+		else
+		{
+			//levels past 31 are 1x1, the shift of the base size stays defined
+			unsigned int skip = std::min(std::min(baseLevel, (unsigned int)header._levels.size() - 1), 31u);
+			std::vector<unsigned char*> levels;
+			std::vector<size_t> sizes;
+			for (size_t i = skip; i < header._levels.size(); i++)
+			{
+				levels.push_back(const_cast<unsigned char*>(data) + header._levels[i]._offset);
+				sizes.push_back((size_t)header._levels[i]._length);
+			}
+			image = createImage(std::max(1u, header._width >> skip), std::max(1u, header._height >> skip), internalFormat, levels, sizes, message);
+		}
+	}
+
+	if (image.valid() && _bakeMipmaps && !image->isCompressed() && image->getNumMipmapLevels() <= 1)
+		bakeMipmaps(image.get());
+
+	if (error)
+		*error = message;
+	return image;
+}
+
+osg::ref_ptr<osg::Image> KtxTranscoder::read(const std::string& filename, std::string* error, unsigned int baseLevel)
+{
+	std::ifstream file(filename.c_str(), std::ios::binary);
+	if (!file)
+	{
+		if (error)
+			*error = "can not open " + filename;
+		return NULL;
+	}
+
+	std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	osg::ref_ptr<osg::Image> image = data.empty() ? NULL : read(&data[0], data.size(), error, baseLevel);
+	if (image.valid())
+		image->setFileName(filename);
+	return image;
+}
+
+void KtxTranscoder::read(const std::vector<std::string>& filenames, std::vector<osg::ref_ptr<osg::Image> >& images)
+{
+	images.clear();
+	images.resize(filenames.size());
+
+	ThreadPool* threadPool = getThreadPool();
+	for (size_t i = 0; i < filenames.size(); i++)
+	{
+		osg::ref_ptr<osg::Image>* image = &images[i];
+		const std::string* filename = &filenames[i];
+		threadPool->addTask([this, image, filename]()
+		{
+			std::string error;
+			*image = read(*filename, &error);
+			if (!image->valid())
+				OSG_WARN << "osgThreeJSX::KtxTranscoder: " << *filename << ": " << error << std::endl;
+		});
+	}
+	threadPool->wait();
+}
+
+osg::ref_ptr<osg::Image> KtxTranscoder::readBasis(const unsigned char* data, size_t size, std::string& error, unsigned int baseLevel)
+{
+#ifdef OSGTHREEJSX_BASISU
+	std::call_once(s_basisInit, []() { basist::basisu_transcoder_init(); });
+
+	basist::ktx2_transcoder transcoder;
+	if (!transcoder.init(data, (uint32_t)size) || !transcoder.start_transcoding())
+	{
+		error = "invalid Basis Universal payload";
+		return NULL;
+	}
+
+	bool alpha = transcoder.get_has_alpha();
+	KtxTargetFormat target = selectFormat(transcoder.is_uastc());
+	basist::transcoder_texture_format format = basist::transcoder_texture_format::cTFRGBA32;
+	GLenum internalFormat = GL_RGBA;
+	switch (target)
+	{
+	case KtxTargetFormat_BC7:
+		format = basist::transcoder_texture_format::cTFBC7_RGBA;
+		internalFormat = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+		break;
+	case KtxTargetFormat_BC1:
+		format = alpha ? basist::transcoder_texture_format::cTFBC3_RGBA : basist::transcoder_texture_format::cTFBC1_RGB;
+		internalFormat = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		break;
+	case KtxTargetFormat_ETC2:
+		//ETC1 blocks are valid ETC2 RGB blocks
+		format = alpha ? basist::transcoder_texture_format::cTFETC2_RGBA : basist::transcoder_texture_format::cTFETC1_RGB;
+		internalFormat = alpha ? GL_COMPRESSED_RGBA8_ETC2_EAC : GL_COMPRESSED_RGB8_ETC2;
+		break;
+	case KtxTargetFormat_ASTC:
+		format = basist::transcoder_texture_format::cTFASTC_4x4_RGBA;
+		internalFormat = GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+		break;
+	default:
+		break;
+	}
+
+	bool uncompressed = basist::basis_transcoder_format_is_uncompressed(format);
+	unsigned int bytesPerBlock = basist::basis_get_bytes_per_block_or_pixel(format);
+	unsigned int numLevels = std::max(1u, transcoder.get_levels());
+	unsigned int skip = std::min(baseLevel, numLevels - 1);
+
+	std::vector<std::vector<unsigned char> > buffers(numLevels);
+	std::vector<unsigned char*> levels;
+	std::vector<size_t> sizes;
+	for (unsigned int level = skip; level < numLevels; level++)
+	{
+		basist::ktx2_image_level_info info;
+		if (!transcoder.get_image_level_info(info, level, 0, 0))
+		{
+			error = "invalid Basis Universal level";
+			return NULL;
+		}
+
+		unsigned int count = uncompressed ? info.m_orig_width * info.m_orig_height : info.m_total_blocks;
+		buffers[level].resize(count * bytesPerBlock);
+		if (!transcoder.transcode_image_level(level, 0, 0, &buffers[level][0], count, format))
+		{
+			error = "Basis Universal transcoding failed";
+			return NULL;
+		}
+		levels.push_back(&buffers[level][0]);
+		sizes.push_back(buffers[level].size());
+	}
+
+	return createImage(std::max(1u, transcoder.get_width() >> skip), std::max(1u, transcoder.get_height() >> skip), internalFormat, levels, sizes, error);
+#else
+	error = "Basis Universal textures need osgThreeJSX built with the basisu transcoder";
+	return NULL;
+#endif
+}
+
+void KtxTranscoder::bakeMipmaps(osg::Image* image)
+{
+	//2x2 box filter of RGBA8 levels, odd sizes repeat their last row or column
+	unsigned int width = image->s();
+	unsigned int height = image->t();
+	std::vector<unsigned char> data(image->data(), image->data() + width * height * 4);
+	osg::Image::MipmapDataType offsets;
+	size_t previous = 0;
+	while (width > 1 || height > 1)
+	{
+		unsigned int levelWidth = std::max(1u, width / 2);
+		unsigned int levelHeight = std::max(1u, height / 2);
+		size_t offset = data.size();
+		data.resize(offset + levelWidth * levelHeight * 4);
+		for (unsigned int y = 0; y < levelHeight; y++)
+		{
+			unsigned int y0 = std::min(y * 2, height - 1);
+			unsigned int y1 = std::min(y * 2 + 1, height - 1);
+			for (unsigned int x = 0; x < levelWidth; x++)
+			{
+				unsigned int x0 = std::min(x * 2, width - 1);
+				unsigned int x1 = std::min(x * 2 + 1, width - 1);
+				const unsigned char* p00 = &data[previous + (y0 * width + x0) * 4];
+				const unsigned char* p01 = &data[previous + (y0 * width + x1) * 4];
+				const unsigned char* p10 = &data[previous + (y1 * width + x0) * 4];
+				const unsigned char* p11 = &data[previous + (y1 * width + x1) * 4];
+				unsigned char* dst = &data[offset + (y * levelWidth + x) * 4];
+				for (int c = 0; c < 4; c++)
+					dst[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+			}
+		}
+		offsets.push_back(offset);
+		previous = offset;
+		width = levelWidth;
+		height = levelHeight;
+	}
+
+	unsigned char* copy = new unsigned char[data.size()];
+	memcpy(copy, &data[0], data.size());
+	image->setImage(image->s(), image->t(), 1, image->getInternalTextureFormat(), GL_RGBA, GL_UNSIGNED_BYTE, copy, osg::Image::USE_NEW_DELETE, 1);
+	image->setMipmapLevels(offsets);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//".ktx2" for osgDB, the images of the Material maps and the GltfLoader go through instance()
+class ReaderWriterKTX2 : public osgDB::ReaderWriter
+{
+public:
+	ReaderWriterKTX2()
+	{
+		supportsExtension("ktx2", "KTX 2.0 texture, Basis Universal transcoded when supported");
+	}
+
+	virtual const char* className() const { return "osgThreeJSX KTX2 reader"; }
+
+	virtual ReadResult readImage(std::istream& stream, const Options* options) const
+	{
+		std::vector<unsigned char> data((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		if (data.empty())
+			return ReadResult::ERROR_IN_READING_FILE;
+
+		std::string error;
+		osg::ref_ptr<osg::Image> image = KtxTranscoder::instance()->read(&data[0], data.size(), &error);
+		if (!image.valid())
+		{
+			OSG_WARN << "osgThreeJSX::KtxTranscoder: " << error << std::endl;
+			return ReadResult::ERROR_IN_READING_FILE;
+		}
+		return image.release();
+	}
+
+	virtual ReadResult readImage(const std::string& filename, const Options* options) const
+	{
+		std::string extension = osgDB::getLowerCaseFileExtension(filename);
+		if (!acceptsExtension(extension))
+			return ReadResult::FILE_NOT_HANDLED;
+
+		std::string path = osgDB::findDataFile(filename, options);
+		if (path.empty())
+			return ReadResult::FILE_NOT_FOUND;
+
+		std::string error;
+		osg::ref_ptr<osg::Image> image = KtxTranscoder::instance()->read(path, &error);
+		if (!image.valid())
+		{
+			OSG_WARN << "osgThreeJSX::KtxTranscoder: " << error << std::endl;
+			return ReadResult::ERROR_IN_READING_FILE;
+		}
+		return image.release();
+	}
+};
+
+static osgDB::RegisterReaderWriterProxy<ReaderWriterKTX2> g_readerWriterKTX2;
@@ -2,8 +2,14 @@
 #include <osgThreeJSX/Light>
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/Materials>
+#include <osgThreeJSX/MaterialNode>
+#include <osgThreeJSX/Animation>
+#include <osgThreeJSX/Tracer>
 #include <osg/Texture2D>
 #include <osg/Geometry>
+#include <osg/Depth>
+#include <osg/ColorMask>
+#include <osg/Polytope>
 
 static const char* g_shader_vsm_vert = R"(
 void main() {
@@ -56,8 +62,305 @@ void main() {
 }
 )";
 
+static const char* g_shader_layer_composite_vert = R"(
+in vec4 osg_Vertex;
+
+void main() {
+
+	gl_Position = vec4( osg_Vertex.xy, 0.0, 1.0 );
+
+}
+)";
+
+static const char* g_shader_layer_composite_frag = R"(
+uniform sampler2D staticShadowMap;
+
+out vec4 fragColor;
+
+const float UnpackDownscale = 255. / 256.;
+const vec3 PackFactors = vec3( 256. * 256. * 256., 256. * 256.,  256. );
+const vec4 UnpackFactors = UnpackDownscale / vec4( PackFactors, 1. );
+
+void main() {
+
+	vec4 storedDepth = texelFetch( staticShadowMap, ivec2( gl_FragCoord.xy ), 0 );
+#ifdef DEPTH_TEXTURE
+	fragColor = vec4( 1.0 );
+	gl_FragDepth = storedDepth.r;
+#else
+	fragColor = storedDepth;
+	gl_FragDepth = dot( storedDepth, UnpackFactors );
+#endif
+
+}
+)";
+
 using namespace osgThreeJSX;
 
+//////////////////////////////////////////////////////////////////////////
+static const unsigned long long g_fnv_offset = 14695981039346656037ULL;
+static const unsigned long long g_fnv_prime = 1099511628211ULL;
+
+static void hashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= g_fnv_prime;
+	}
+}
+
+static osg::BoundingSphere transformBound(const osg::BoundingSphere& bs, const osg::Matrix& matrix)
+{
+	osg::Vec3d scales = matrix.getScale();
+	double scale = osg::maximum(osg::maximum(scales.x(), scales.y()), scales.z());
+	return osg::BoundingSphere(bs.center() * matrix, bs.radius() * scale);
+}
+
+//accumulate the bounds and transforms of the casters intersecting the shadow frustums,
+//any moved, added, removed or modified caster changes the hash of its layer
+class ShadowCasterRevisionVisitor : public osg::NodeVisitor
+{
+public:
+	ShadowCasterRevisionVisitor(const std::vector<osg::Polytope>& frustums, unsigned int staticMask, unsigned int dynamicMask) :
+		osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+		_frustums(frustums),
+		_staticMask(staticMask),
+		_dynamicMask(dynamicMask),
+		_staticHash(g_fnv_offset),
+		_dynamicHash(g_fnv_offset)
+	{
+		_matrixStack.push_back(osg::Matrix::identity());
+		_maskStack.push_back(~0u);
+	}
+
+	virtual void apply(osg::Node& node)
+	{
+		if (!intersects(node.getBound()))
+			return;
+
+		_maskStack.push_back(_maskStack.back() & node.getNodeMask());
+		traverse(node);
+		_maskStack.pop_back();
+	}
+
+	virtual void apply(osg::Transform& transform)
+	{
+		if (!intersects(transform.getBound()))
+			return;
+
+		osg::Matrix matrix = _matrixStack.back();
+		transform.computeLocalToWorldMatrix(matrix, this);
+
+		unsigned int mask = _maskStack.back() & transform.getNodeMask();
+		accumulate(mask, matrix.ptr(), sizeof(osg::Matrix::value_type) * 16);
+
+		_matrixStack.push_back(matrix);
+		_maskStack.push_back(mask);
+		traverse(transform);
+		_maskStack.pop_back();
+		_matrixStack.pop_back();
+	}
+
+	virtual void apply(osg::Drawable& drawable)
+	{
+		const osg::BoundingSphere& bs = drawable.getBound();
+		if (!intersects(bs))
+			return;
+
+		unsigned int mask = _maskStack.back() & drawable.getNodeMask();
+
+		const osg::Drawable* pointer = &drawable;
+		accumulate(mask, &pointer, sizeof(pointer));
+		accumulate(mask, bs.center().ptr(), sizeof(osg::BoundingSphere::vec_type));
+		float radius = bs.radius();
+		accumulate(mask, &radius, sizeof(radius));
+
+		osg::Geometry* geometry = drawable.asGeometry();
+		if (geometry && geometry->getVertexArray())
+		{
+			unsigned int modifiedCount = geometry->getVertexArray()->getModifiedCount();
+			accumulate(mask, &modifiedCount, sizeof(modifiedCount));
+		}
+
+		osgAnimation::MorphGeometry* morph = dynamic_cast<osgAnimation::MorphGeometry*>(&drawable);
+		if (morph)
+		{
+			osgAnimation::MorphGeometry::MorphTargetList& targets = morph->getMorphTargetList();
+			for (size_t i = 0; i < targets.size(); i++)
+			{
+				float weight = targets[i].getWeight();
+				accumulate(mask, &weight, sizeof(weight));
+			}
+		}
+	}
+
+	unsigned long long getStaticHash() { return _staticHash; }
+
+	unsigned long long getDynamicHash() { return _dynamicHash; }
+protected:
+	bool intersects(const osg::BoundingSphere& bs)
+	{
+		//nodes without bound, such as bones, are always accounted
+		if (!bs.valid())
+			return true;
+
+		osg::BoundingSphere worldBound = transformBound(bs, _matrixStack.back());
+
+		for (size_t i = 0; i < _frustums.size(); i++)
+		{
+			if (_frustums[i].contains(worldBound))
+				return true;
+		}
+		return false;
+	}
+
+	void accumulate(unsigned int mask, const void* data, size_t size)
+	{
+		if (mask & _staticMask)
+			hashBytes(_staticHash, data, size);
+
+		if (mask & _dynamicMask)
+			hashBytes(_dynamicHash, data, size);
+	}
+protected:
+	const std::vector<osg::Polytope>& _frustums;
+	unsigned int _staticMask;
+	unsigned int _dynamicMask;
+	unsigned long long _staticHash;
+	unsigned long long _dynamicHash;
+	std::vector<osg::Matrix> _matrixStack;
+	std::vector<unsigned int> _maskStack;
+};
+
+//light space bounds of the drawables inside a world space volume, skipping materials that do not cast shadow
+class ShadowCasterBoundsVisitor : public osg::NodeVisitor
+{
+public:
+	ShadowCasterBoundsVisitor(const osg::Polytope& volume, const osg::Matrix& lightView) :
+		osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+		_volume(volume),
+		_lightView(lightView)
+	{
+		_matrixStack.push_back(osg::Matrix::identity());
+	}
+
+	virtual void apply(osg::Node& node)
+	{
+		if (!castShadow(node) || !intersects(node.getBound()))
+			return;
+
+		traverse(node);
+	}
+
+	virtual void apply(osg::Transform& transform)
+	{
+		if (!castShadow(transform) || !intersects(transform.getBound()))
+			return;
+
+		osg::Matrix matrix = _matrixStack.back();
+		transform.computeLocalToWorldMatrix(matrix, this);
+
+		_matrixStack.push_back(matrix);
+		traverse(transform);
+		_matrixStack.pop_back();
+	}
+
+	virtual void apply(osg::Drawable& drawable)
+	{
+		if (!castShadow(drawable) || !intersects(drawable.getBound()))
+			return;
+
+		const osg::BoundingBox& bb = drawable.getBoundingBox();
+		osg::Matrix matrix = _matrixStack.back() * _lightView;
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			_bound.expandBy(bb.corner(i) * matrix);
+		}
+	}
+
+	const osg::BoundingBox& getBound() { return _bound; }
+protected:
+	bool castShadow(osg::Node& node)
+	{
+		MaterialNodeCullback* callback = dynamic_cast<MaterialNodeCullback*>(node.getCullCallback());
+		if (callback && callback->getMaterial().valid())
+			return callback->getMaterial()->getCastShadow();
+		return true;
+	}
+
+	bool intersects(const osg::BoundingSphere& bs)
+	{
+		if (!bs.valid())
+			return true;
+
+		return _volume.contains(transformBound(bs, _matrixStack.back()));
+	}
+protected:
+	osg::Polytope _volume;
+	osg::Matrix _lightView;
+	osg::BoundingBox _bound;
+	std::vector<osg::Matrix> _matrixStack;
+};
+
+static osg::Texture2D* createShadowTexture(int width, int height, bool linear)
+{
+	osg::Texture2D* texture = new osg::Texture2D();
+	texture->setTextureSize(width, height);
+	texture->setInternalFormat(GL_RGBA);//GL_RGBA16F_ARB
+	texture->setSourceFormat(GL_RGBA);
+	texture->setSourceType(GL_UNSIGNED_BYTE);
+	texture->setBorderColor(osg::Vec4(1.0, 1.0, 1.0, 1.0));
+
+	if (linear)
+	{
+		texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+		texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+	}
+	else
+	{
+		texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+		texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+	}
+
+	texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+	texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+	return texture;
+}
+
+static osg::Texture2D* createShadowDepthTexture(int width, int height, bool compare, bool linear)
+{
+	osg::Texture2D* texture = new osg::Texture2D();
+	texture->setTextureSize(width, height);
+	texture->setInternalFormat(GL_DEPTH_COMPONENT24);
+	texture->setSourceFormat(GL_DEPTH_COMPONENT);
+	texture->setSourceType(GL_UNSIGNED_INT);
+
+	//sampled through sampler2DShadow, linear filtering gives a free 2x2 pcf
+	if (compare)
+	{
+		texture->setShadowComparison(true);
+		texture->setShadowCompareFunc(osg::Texture::LEQUAL);
+	}
+
+	if (linear)
+	{
+		texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
+		texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
+	}
+	else
+	{
+		texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+		texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+	}
+
+	texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+	texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+	return texture;
+}
+
+//////////////////////////////////////////////////////////////////////////
 LightShadow::LightShadow()
 {
 	_mapSize = osg::Vec2(2048, 2048);
@@ -66,6 +369,20 @@ LightShadow::LightShadow()
 	_radius = 1.0f;
 
 	_inited = false;
+	_depthTexture = false;
+	_layered = false;
+	_autoFit = false;
+	_cacheEnable = false;
+	_needsUpdate = true;
+	_lightRevision = 0;
+	_staticCasterHash = 0;
+	_dynamicCasterHash = 0;
+	_staticCasterMask = 0;
+	_dynamicCasterMask = 0;
+
+	_cascadeCount = 1;
+	_cascadeSplitLambda = 0.5f;
+	_cascadeMaxDistance = 0.0f;
 }
 
 LightShadow::LightShadow(const LightShadow& other, const osg::CopyOp& copyop /* = osg::CopyOp::SHALLOW_COPY */)
@@ -78,7 +395,7 @@ LightShadow::~LightShadow()
 
 }
 
-void LightShadow::render(ShadowMap* shadowMap, osg::ref_ptr<Light>& light, osg::ref_ptr<osg::Node>& sceneNode, osgUtil::CullVisitor* cv)
+bool LightShadow::render(ShadowMap* shadowMap, osg::ref_ptr<Light>& light, osg::ref_ptr<osg::Node>& sceneNode, osgUtil::CullVisitor* cv)
 {
 	if (_inited == false)
 	{
@@ -87,77 +404,276 @@ void LightShadow::render(ShadowMap* shadowMap, osg::ref_ptr<Light>& light, osg::
 		//
 		setupCamera(shadowMap, light, sceneNode);
 		//
+		setupCasterLayers(shadowMap, light, sceneNode);
+		//
 		setupVSM(shadowMap, light);
 
+		_lightRevision = light->getRevision();
+		_sceneBound = sceneNode->getBound();
 		_inited = true;
 	}
+	else if ((_lightRevision != light->getRevision()) || (_sceneBound != sceneNode->getBound()))
+	{
+		_lightRevision = light->getRevision();
+		_sceneBound = sceneNode->getBound();
+
+		updateCamera(shadowMap, light, sceneNode);
+		_needsUpdate = true;
+	}
+
+	if (fitToView(shadowMap, light, sceneNode, cv))
+		_needsUpdate = true;
+
+	bool staticDirty = true;
+	bool dynamicDirty = true;
+	if (_cacheEnable)
+	{
+		checkCasters(sceneNode, staticDirty, dynamicDirty);
+		staticDirty = staticDirty || _needsUpdate;
+	}
+	_needsUpdate = false;
+
+	if ((!staticDirty) && (!dynamicDirty))
+		return false;
+
+	ScopedTrace trace("shadow camera render", "shadow");
+	if (trace.isActive())
+		trace.setArg("lightType", light->getType());
+
+	if (staticDirty && _staticCameras.size())
+		renderStaticCameras(cv);
 
 	renderCamera(shadowMap, light, cv);
 
 	renderVSM(shadowMap, cv);
+	return true;
+}
+
+void LightShadow::checkCasters(const osg::ref_ptr<osg::Node>& sceneNode, bool& staticDirty, bool& dynamicDirty)
+{
+	CameraList cameras;
+	getCameras(cameras);
+
+	std::vector<osg::Polytope> frustums;
+	for (CameraList::iterator iter = cameras.begin(); iter != cameras.end(); iter++)
+	{
+		osg::Polytope frustum;
+		frustum.setToUnitFrustum(true, true);
+		frustum.transformProvidingInverse((*iter)->getViewMatrix() * (*iter)->getProjectionMatrix());
+		frustums.push_back(frustum);
+	}
+
+	//without layers every caster is part of the cached map
+	unsigned int staticMask = hasCasterLayers() ? _staticCasterMask : ~0u;
+	unsigned int dynamicMask = hasCasterLayers() ? _dynamicCasterMask : 0u;
+
+	ShadowCasterRevisionVisitor visitor(frustums, staticMask, dynamicMask);
+	sceneNode->accept(visitor);
+
+	staticDirty = (visitor.getStaticHash() != _staticCasterHash);
+	dynamicDirty = (visitor.getDynamicHash() != _dynamicCasterHash);
+
+	_staticCasterHash = visitor.getStaticHash();
+	_dynamicCasterHash = visitor.getDynamicHash();
 }
 
 void LightShadow::setupTexture(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light)
 {
+	//cascades are laid out in an atlas, two per row
+	if ((_cascadeCount > 1) && (light->getType() == LightType_Direction))
 	{
-		osg::Texture2D* texture = new osg::Texture2D();
-		texture->setTextureSize(_mapSize.x() * _frameExtents.x(), _mapSize.y() * _frameExtents.y());
-		texture->setInternalFormat(GL_RGBA);//GL_RGBA16F_ARB
-		texture->setSourceFormat(GL_RGBA);
-		texture->setSourceType(GL_UNSIGNED_BYTE);
-		texture->setBorderColor(osg::Vec4(1.0, 1.0, 1.0, 1.0));
+		_frameExtents = osg::Vec2i(osg::minimum(_cascadeCount, 2), (_cascadeCount + 1) / 2);
+	}
 
-		if ((shadowMap->getMapType() == ShadowMapType_VSMShadowMap) && (light->getType() != LightType_Point))
-		{
-			texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
-			texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
-		}
-		else
+	int width = _mapSize.x() * _frameExtents.x();
+	int height = _mapSize.y() * _frameExtents.y();
+	bool vsm = (shadowMap->getMapType() == ShadowMapType_VSMShadowMap) && (light->getType() != LightType_Point);
+
+	//distance packed point shadows and VSM moments stay in color textures
+	_depthTexture = shadowMap->getDepthTextureEnable() && (!vsm) && (light->getType() != LightType_Point);
+	if (_depthTexture)
+	{
+		_map = createShadowDepthTexture(width, height, true, shadowMap->getMapType() != ShadowMapType_BasicShadowMap);
+
+		if (hasCasterLayers())
 		{
-			texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
-			texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+			_staticMap = createShadowDepthTexture(width, height, false, false);
 		}
+		return;
+	}
+
+	_map = createShadowTexture(width, height, vsm);
 
-		texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
-		texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
-		_map = texture;
+	if (vsm)
+	{
+		_mapVsm = createShadowTexture(width, height, vsm);
 	}
 
-	if ((shadowMap->getMapType() == ShadowMapType_VSMShadowMap) && (light->getType() != LightType_Point))
+	//distance packed point shadows can not be depth composited
+	if (hasCasterLayers() && (light->getType() != LightType_Point))
 	{
-		osg::Texture2D* texture = new osg::Texture2D();
-		texture->setTextureSize(_mapSize.x() * _frameExtents.x(), _mapSize.y() * _frameExtents.y());
-		texture->setInternalFormat(GL_RGBA);//GL_RGBA16F_ARB
-		texture->setSourceFormat(GL_RGBA);
-		texture->setSourceType(GL_UNSIGNED_BYTE);
-		texture->setBorderColor(osg::Vec4(1.0, 1.0, 1.0, 1.0));
+		_staticMap = createShadowTexture(width, height, false);
+	}
+}
 
-		if ((shadowMap->getMapType() == ShadowMapType_VSMShadowMap) && (light->getType() != LightType_Point))
-		{
-			texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::LINEAR);
-			texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::LINEAR);
-		}
-		else
-		{
-			texture->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
-			texture->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
-		}
+void LightShadow::setupCasterLayers(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
+{
+	if (!_staticMap.valid())
+		return;
 
-		texture->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
-		texture->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
-		_mapVsm = texture;
+	osg::ref_ptr<osg::Program> program = new osg::Program();
+	{
+		Capabilities capabilities;
+		std::string header = "#version " + capabilities.glslversion + "\n";
+		if (capabilities.glslversion.find("es") != std::string::npos)
+			header += "precision " + capabilities.precision + " float;\n";
+		if (_depthTexture)
+			header += "#define DEPTH_TEXTURE\n";
+
+		program->addShader(new osg::Shader(osg::Shader::VERTEX, header + g_shader_layer_composite_vert));
+		program->addShader(new osg::Shader(osg::Shader::FRAGMENT, header + g_shader_layer_composite_frag));
+	}
+
+	CameraList cameras;
+	getCameras(cameras);
+
+	for (CameraList::iterator iter = cameras.begin(); iter != cameras.end(); iter++)
+	{
+		osg::ref_ptr<osg::Camera> camera = *iter;
+
+		//the static layer, only rendered when its casters changed
+		osg::ref_ptr<osg::Camera> staticCamera = new osg::Camera;
+		staticCamera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+		staticCamera->setViewport(new osg::Viewport(*camera->getViewport()));
+		staticCamera->setRenderOrder(osg::Camera::PRE_RENDER, 0);
+		staticCamera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+		attachMap(staticCamera, _staticMap);
+		staticCamera->setInheritanceMask(staticCamera->getInheritanceMask() & ~osg::CullSettings::CULL_MASK);
+		staticCamera->setCullMask(_staticCasterMask);
+		staticCamera->addChild(node);
+
+		osg::ref_ptr<RenderState> rs = new RenderState();
+		rs->setupCamera(staticCamera, light);
+
+		_staticCameras.push_back(staticCamera);
+
+		//the shadow camera copies the static layer with its depth, then draws the dynamic casters on top
+		camera->setInheritanceMask(camera->getInheritanceMask() & ~osg::CullSettings::CULL_MASK);
+		camera->setCullMask(_dynamicCasterMask);
+
+		osg::Vec3Array *vertices = new osg::Vec3Array;
+		vertices->push_back(osg::Vec3(-1.0, -1, 0.5));
+		vertices->push_back(osg::Vec3(3, -1, 0.5));
+		vertices->push_back(osg::Vec3(-1, 3, 0.5));
+
+		osg::Geometry *geom = new osg::Geometry;
+		geom->setName("ShadowLayerComposite");
+		geom->setVertexArray(vertices);
+		geom->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, 3));
+		geom->setUseVertexBufferObjects(true);
+		geom->setCullingActive(false);
+
+		osg::ref_ptr<osg::Geode> geode = new osg::Geode();
+		geode->setNodeMask(_dynamicCasterMask);
+		geode->addDrawable(geom);
+
+		osg::StateSet* stateset = geode->getOrCreateStateSet();
+		stateset->setAttributeAndModes(program, osg::StateAttribute::ON);
+		stateset->setTextureAttribute(0, _staticMap);
+		stateset->addUniform(new osg::Uniform("staticShadowMap", 0));
+		stateset->setAttributeAndModes(new osg::Depth(osg::Depth::ALWAYS), osg::StateAttribute::ON);
+		stateset->setRenderBinDetails(-1, "RenderBin");
+		camera->addChild(geode);
 	}
 }
 
+void LightShadow::attachMap(osg::Camera* camera, osg::Texture* map)
+{
+	if (_depthTexture)
+	{
+		//depth only pass, no color buffer is attached, cleared or written
+		camera->attach(osg::Camera::DEPTH_BUFFER, map);
+		camera->setImplicitBufferAttachmentMask(0, 0);
+		camera->setDrawBuffer(GL_NONE);
+		camera->setReadBuffer(GL_NONE);
+		camera->setClearMask(GL_DEPTH_BUFFER_BIT);
+		camera->getOrCreateStateSet()->setAttribute(new osg::ColorMask(false, false, false, false));
+	}
+	else
+	{
+		camera->attach(osg::Camera::COLOR_BUFFER, map);
+		camera->setClearColor(osg::Vec4f(1.0f, 1.0f, 1.0f, 1.0f));
+		camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+}
+
+bool LightShadow::computeViewFrustum(osgUtil::CullVisitor* cv, const osg::BoundingSphere& bound, double maxDistance,
+	osg::Vec3d nearCorners[4], osg::Vec3d farCorners[4], double& viewNear, double& viewFar)
+{
+	osg::Matrix view = *cv->getModelViewMatrix();
+	osg::Matrix inverseViewProjection = osg::Matrix::inverse(view * (*cv->getProjectionMatrix()));
+
+	const double ndc[4][2] = { { -1.0, -1.0 }, { 1.0, -1.0 }, { 1.0, 1.0 }, { -1.0, 1.0 } };
+	osg::Vec3d cameraNearCorners[4], cameraFarCorners[4];
+	for (int i = 0; i < 4; i++)
+	{
+		cameraNearCorners[i] = osg::Vec3d(ndc[i][0], ndc[i][1], -1.0) * inverseViewProjection;
+		cameraFarCorners[i] = osg::Vec3d(ndc[i][0], ndc[i][1], 1.0) * inverseViewProjection;
+	}
+	double cameraNear = -(cameraNearCorners[0] * view).z();
+	double cameraFar = -(cameraFarCorners[0] * view).z();
+
+	//only the part of the frustum inside the scene receives shadows
+	double sceneDepth = -(osg::Vec3d(bound.center()) * view).z();
+	viewNear = osg::maximum(cameraNear, sceneDepth - bound.radius());
+	viewFar = osg::minimum(cameraFar, sceneDepth + bound.radius());
+	if (maxDistance > 0.0)
+		viewFar = osg::minimum(viewFar, maxDistance);
+	if (viewFar <= viewNear)
+		return false;
+
+	//depth is linear along the frustum edges
+	for (int i = 0; i < 4; i++)
+	{
+		osg::Vec3d edge = cameraFarCorners[i] - cameraNearCorners[i];
+		nearCorners[i] = cameraNearCorners[i] + edge * ((viewNear - cameraNear) / (cameraFar - cameraNear));
+		farCorners[i] = cameraNearCorners[i] + edge * ((viewFar - cameraNear) / (cameraFar - cameraNear));
+	}
+	return true;
+}
+
+osg::BoundingBox LightShadow::computeCasterBound(const osg::ref_ptr<osg::Node>& node, const osg::Polytope& volume, const osg::Matrix& lightView)
+{
+	ShadowCasterBoundsVisitor visitor(volume, lightView);
+	node->accept(visitor);
+	return visitor.getBound();
+}
+
+void LightShadow::renderStaticCameras(osgUtil::CullVisitor* cv)
+{
+	CameraList cameras;
+	getCameras(cameras);
+
+	CullSettingAutoRecover ar(cv, osg::CullSettings::DO_NOT_COMPUTE_NEAR_FAR);
+
+	for (size_t i = 0; i < _staticCameras.size() && i < cameras.size(); i++)
+	{
+		_staticCameras[i]->setViewMatrix(cameras[i]->getViewMatrix());
+		_staticCameras[i]->setProjectionMatrix(cameras[i]->getProjectionMatrix());
+		_staticCameras[i]->accept(*cv);
+	}
+}
 
 void LightShadow::setupVSM(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light)
 {
 	if ((shadowMap->getMapType() == ShadowMapType_VSMShadowMap) && (light->getType() != LightType_Point))
 	{
+		//blur the whole atlas when the map holds cascades
+		osg::Vec2 resolution(_mapSize.x() * _frameExtents.x(), _mapSize.y() * _frameExtents.y());
 		{
 			_cameraVsmVertical = new osg::Camera;
 			_cameraVsmVertical->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
-			_cameraVsmVertical->setViewport(0, 0, _mapSize.x(), _mapSize.y());
+			_cameraVsmVertical->setViewport(0, 0, resolution.x(), resolution.y());
 			_cameraVsmVertical->setRenderOrder(osg::Camera::PRE_RENDER, 1);
 			_cameraVsmVertical->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
 			_cameraVsmVertical->attach(osg::Camera::COLOR_BUFFER, _mapVsm);
@@ -187,7 +703,7 @@ void LightShadow::setupVSM(ShadowMap* shadowMap, const osg::ref_ptr<Light>& ligh
 
 			material->setTexture("shadow_pass", _map);
 			material->setUniform("radius", _radius);
-			material->setUniform("resolution", _mapSize);
+			material->setUniform("resolution", resolution);
 
 			osg::ref_ptr<osgThreeJSX::MaterialBaseNode<osg::Geode>> geode = new osgThreeJSX::MaterialBaseNode<osg::Geode>();
 			geode->setMaterial(material);
@@ -201,7 +717,7 @@ void LightShadow::setupVSM(ShadowMap* shadowMap, const osg::ref_ptr<Light>& ligh
 		{
 			_cameraVsmHorizonal = new osg::Camera;
 			_cameraVsmHorizonal->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
-			_cameraVsmHorizonal->setViewport(0, 0, _mapSize.x(), _mapSize.y());
+			_cameraVsmHorizonal->setViewport(0, 0, resolution.x(), resolution.y());
 			_cameraVsmHorizonal->setRenderOrder(osg::Camera::PRE_RENDER, 1);
 			_cameraVsmHorizonal->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
 			_cameraVsmHorizonal->attach(osg::Camera::COLOR_BUFFER, _map);
@@ -232,7 +748,7 @@ void LightShadow::setupVSM(ShadowMap* shadowMap, const osg::ref_ptr<Light>& ligh
 
 			material->setTexture("shadow_pass", _mapVsm);
 			material->setUniform("radius", _radius);
-			material->setUniform("resolution", _mapSize);
+			material->setUniform("resolution", resolution);
 
 			osg::ref_ptr<osgThreeJSX::MaterialBaseNode<osg::Geode>> geode = new osgThreeJSX::MaterialBaseNode<osg::Geode>();
 			geode->setMaterial(material);
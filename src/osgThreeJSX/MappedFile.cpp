@@ -0,0 +1,73 @@
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <osgThreeJSX/MappedFile>
+
+using namespace osgThreeJSX;
+
+MappedFile::MappedFile() :
+	_data(NULL),
+	_size(0),
+	_file(NULL),
+	_mapping(NULL)
+{
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle((HANDLE)_mapping);
+	if (_file)
+		CloseHandle((HANDLE)_file);
+#else
+	if (_data)
+		munmap((void*)_data, _size);
+#endif
+}
+
+bool MappedFile::open(const std::string& filename)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	_file = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		return false;
+	_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (_mapping == NULL)
+		return false;
+	_data = (const unsigned char*)MapViewOfFile((HANDLE)_mapping, FILE_MAP_READ, 0, 0, 0);
+	_size = (size_t)size.QuadPart;
+	return _data != NULL;
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	_data = (const unsigned char*)data;
+	_size = st.st_size;
+	return true;
+#endif
+}
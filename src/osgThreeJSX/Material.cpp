@@ -9,6 +9,7 @@
 #include <osgThreeJSX/ShaderLib>
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/PointLight>
+#include <osgThreeJSX/Instrumentation>
 
 using namespace osgThreeJSX;
 
@@ -22,9 +23,13 @@ Material::Material()
 
 	_curVersion = 1;
 	_preVersion = 0;
+	_uniformsDirty = false;
 
 	_startTextureUnit = 0;
 
+	_uniformBlockEnable = false;
+	_blockSlot = -1;
+
 	setVertexTangents(false);
 	setVertexColors(false);
 	setFlatShading(false);
@@ -52,17 +57,28 @@ Material::Material()
 	_blendEquationAlpha = osg::BlendEquation::FUNC_ADD;
 
 	setInstancing(false);
+	setVertexQuantization(VertexQuantizationType_None);
 }
 
 Material::Material(const Material& other, const osg::CopyOp& copyop)
 {
 	_curVersion = 1;
 	_preVersion = 0;
+	_uniformsDirty = false;
+	_uniformBlockEnable = false;
+	_blockSlot = -1;
 }
 
 Material::~Material()
 {
+	if (_blockArena.valid())
+		_blockArena->release(_blockSlot);
+}
 
+osg::Uniform* Material::getUniform(const std::string& name)
+{
+	std::unordered_map<std::string, osg::Uniform*>::iterator iter = _uniformIndex.find(name);
+	return iter != _uniformIndex.end() ? iter->second : NULL;
 }
 
 void Material::removeUniform(const std::string& name)
@@ -72,6 +88,7 @@ void Material::removeUniform(const std::string& name)
 		if ((*iter)->getName() == name)
 		{
 			_uniforms.erase(iter);
+			_uniformIndex.erase(name);
 			return;
 		}
 	}
@@ -150,12 +167,17 @@ void Material::getProgramParameters(osg::Camera* camera, osgUtil::CullVisitor* c
 	parameters.morphNormals = getMorphNormals();
 
 	parameters.instancing = getInstancing();
+	parameters.vertexQuantization = getVertexQuantization();
 
 	parameters.useFog = getFog();
+
+	parameters.materialBlock = _uniformBlockEnable ? _blockLayout.getDeclaration() : std::string();
 }
 
 void Material::update(osg::Camera* camera, osgUtil::CullVisitor* cv, osg::Node* node)
 {
+	OSGTHREEJSX_SCOPED_TIMER(InstrumentTimer_MaterialUpdate);
+
 	//if (!_stateset)
 	//	_stateset = new osg::StateSet();
 	//osg::StateSet* stateset = _stateset;
@@ -175,6 +197,12 @@ void Material::update(osg::Camera* camera, osgUtil::CullVisitor* cv, osg::Node*
 
 	bool stateChange = false;
 
+	//the block layout is part of the program, it has to be known before the parameters
+	if (_uniformBlockEnable && (_preVersion != _curVersion))
+	{
+		updateUniformBlock(camera);
+	}
+
 	if (generateProgram())
 	{
 		ProgramParameters parameters;
@@ -237,64 +265,197 @@ void Material::update(osg::Camera* camera, osgUtil::CullVisitor* cv, osg::Node*
 			stateset->setAttributeAndModes(bf.get(), osg::StateAttribute::OVERRIDE | osg::StateAttribute::ON);
 		}
 
-		MaterialTextureList textures;
-		MaterialUniformList uniforms;
+		applyUniformAndTexture(camera, stateset);
 
-		///insert render state env here, ugly...
-		RenderState* rs = RenderState::FromCamera(camera);
-		if (rs && rs->getBackgroudEnv())
-		{
-			rs->getBackgroudEnv()->buildUniformAndTexture(this, uniforms, textures);
-		}
+		_preVersion = _curVersion;
+		_uniformsDirty = false;
+	}
+	else if (_uniformsDirty)
+	{
+		//the setters wrote the uniforms in place, only the block slot holds copies of them
+		_uniformsDirty = false;
+		if (_uniformBlockEnable && _blockArena.valid())
+			_blockArena->write(_blockSlot, _blockLayout, _buildUniforms);
+	}
+}
 
-		buildUniformAndTexture(uniforms, textures);
+void Material::buildLists(osg::Camera* camera)
+{
+	_buildTextures.clear();
 
-		textures.insert(textures.end(), _textures.begin(), _textures.end());
-		uniforms.insert(uniforms.end(), _uniforms.begin(), _uniforms.end());
+	///insert render state env here, ugly...
+	RenderState* rs = RenderState::FromCamera(camera);
+	if (rs && rs->getBackgroudEnv())
+	{
+		rs->getBackgroudEnv()->buildUniformAndTexture(this, _buildUniforms, _buildTextures);
+	}
 
-		int startTextureUnit = _startTextureUnit;
-		for (MaterialTextureList::iterator iter = textures.begin(); iter != textures.end(); iter++)
-		{
+	buildUniformAndTexture(_buildUniforms, _buildTextures);
+}
+
+void Material::updateUniformBlock(osg::Camera* camera)
+{
+	buildLists(camera);
+
+	MaterialBlockLayout layout;
+	layout.build(_buildUniforms);
+	if (_blockArena.valid() && (layout == _blockLayout))
+		return;
+
+	//the layout changed, move to the arena of the new layout
+	if (_blockArena.valid())
+		_blockArena->release(_blockSlot);
+	_blockArena = NULL;
+	_blockSlot = -1;
+
+	_blockLayout = layout;
+	if (!_blockLayout.empty())
+	{
+		_blockArena = MaterialBlockArena::getOrCreate(_blockLayout);
+		_blockSlot = _blockArena->allocate();
+	}
+}
+
+void Material::applyUniformAndTexture(osg::Camera* camera, osg::StateSet* stateset)
+{
+	buildLists(camera);
+
+	_buildTextures.insert(_buildTextures.end(), _textures.begin(), _textures.end());
+
+	int startTextureUnit = _startTextureUnit;
+	for (MaterialTextureList::iterator iter = _buildTextures.begin(); iter != _buildTextures.end(); iter++)
+	{
+		osg::Uniform* unit = stateset->getUniform(iter->_name);
+		if (!unit || !unit->set(startTextureUnit))
 			stateset->addUniform(new osg::Uniform(iter->_name.c_str(), startTextureUnit));
-			stateset->setTextureAttributeAndModes(startTextureUnit, iter->_texture, osg::StateAttribute::ON);
-			startTextureUnit += 1;
-		}
+		stateset->setTextureAttributeAndModes(startTextureUnit, iter->_texture, osg::StateAttribute::ON);
+		startTextureUnit += 1;
+	}
 
-		for (MaterialUniformList::iterator iter = uniforms.begin(); iter != uniforms.end(); iter++)
-		{
+	//let the camera bindings detect units shared with this material
+	RenderState* rs = RenderState::FromCamera(camera);
+	if (rs)
+		rs->getTextureUnitAllocator().reserveMaterialUnits(startTextureUnit);
+
+	//block members live in the shared buffer, the material only binds its range
+	bool useBlock = _uniformBlockEnable && _blockArena.valid();
+	if (useBlock)
+	{
+		_blockArena->write(_blockSlot, _blockLayout, _buildUniforms);
+		stateset->setAttribute(_blockArena->getBinding(_blockSlot), osg::StateAttribute::ON);
+	}
+
+	//the values were written in place, only uniforms the stateset does not hold yet are added
+	for (MaterialUniformList::iterator iter = _buildUniforms.begin(); iter != _buildUniforms.end(); iter++)
+	{
+		if (useBlock && MaterialBlockLayout::accepts(iter->get()))
+			continue;
+		if (stateset->getUniform((*iter)->getName()) != iter->get())
 			stateset->addUniform(*iter);
-		}
+	}
 
-		_preVersion = _curVersion;
+	for (MaterialUniformList::iterator iter = _uniforms.begin(); iter != _uniforms.end(); iter++)
+	{
+		if (stateset->getUniform((*iter)->getName()) != iter->get())
+			stateset->addUniform(*iter);
 	}
+
+	//the setters find the built uniforms by name
+	_parameterIndex.clear();
+	for (MaterialUniformList::iterator iter = _buildUniforms.begin(); iter != _buildUniforms.end(); iter++)
+		_parameterIndex[(*iter)->getName()] = iter->get();
 }
 
 osg::ref_ptr<Material> Material::getOrCreateDepthMaterial(Light* light)
 {
-	if (!_depthMaterial)
+	//point lights render distances, the others depth, a scene may mix both
+	if (light->getType() == LightType_Point)
 	{
-		if (light->getType() == LightType_Point)
+		PointLight* pointLight = dynamic_cast<PointLight*>(light);
+		MaterialDistance* material = dynamic_cast<MaterialDistance*>(_distanceMaterial.get());
+		if (!material)
 		{
-			MaterialDistance* material = new MaterialDistance();
-			PointLight* pointLight = dynamic_cast<PointLight*>(light);
+			material = new MaterialDistance();
+			material->_nearDistance = 0.1;
+			material->_layered = light->getShadow().valid() && light->getShadow()->getLayered();
 			if (pointLight)
 			{
-				material->_nearDistance = 0.1;
 				material->_farDistance = pointLight->getDistance();
 				material->_referencePosition = pointLight->getPosition();
 			}
-			_depthMaterial = material;
+			setupDepthMaterial(material);
+			_distanceMaterial = material;
 		}
-		else
-			_depthMaterial = new MaterialDepth();
-
-		if (_depthMaterial)
+		else if (pointLight && ((material->_referencePosition != pointLight->getPosition()) || (material->_farDistance != pointLight->getDistance())))
 		{
-			_depthMaterial->setMaxBones(getMaxBones());
-			_depthMaterial->setSkinning(getSkinning());
-			_depthMaterial->setMorphTargets(getMorphTargets());
-			_depthMaterial->setMorphNormals(getMorphNormals());
+			//follow the light when it moved
+			material->_farDistance = pointLight->getDistance();
+			material->_referencePosition = pointLight->getPosition();
+			material->dirty();
 		}
+		return _distanceMaterial;
+	}
+
+	//depth textures only need the depth buffer, no packed color
+	bool depthOnly = light->getShadow().valid() && light->getShadow()->getUseDepthTexture();
+	MaterialDepth* material = dynamic_cast<MaterialDepth*>(_depthMaterial.get());
+	if (!material)
+	{
+		material = new MaterialDepth();
+		setupDepthMaterial(material);
+		_depthMaterial = material;
+	}
+
+	DepthPackingType depthPacking = depthOnly ? DepthPackingType_No : DepthPackingType_RGBADepthPacking;
+	if (material->_depthPacking != depthPacking)
+	{
+		material->_depthPacking = depthPacking;
+		material->dirty();
 	}
 	return _depthMaterial;
 }
+
+osg::ref_ptr<Material> Material::getOrCreatePrePassMaterial()
+{
+	MaterialDepth* material = dynamic_cast<MaterialDepth*>(_prePassMaterial.get());
+	if (!material)
+	{
+		material = new MaterialDepth();
+		material->_depthPacking = DepthPackingType_No;
+		setupDepthMaterial(material);
+		_prePassMaterial = material;
+	}
+
+	//the main pass only draws where the pre-pass wrote, both must cull the same faces
+	if (material->getSide() != getSide())
+	{
+		material->setSide(getSide());
+		material->dirty();
+	}
+	return _prePassMaterial;
+}
+
+void Material::setVertexQuantization(unsigned int val)
+{
+	_vertexQuantization = val;
+
+	Material* derived[] = { _depthMaterial.get(), _distanceMaterial.get(), _prePassMaterial.get() };
+	for (size_t i = 0; i < sizeof(derived) / sizeof(derived[0]); i++)
+	{
+		if (derived[i] && derived[i]->getVertexQuantization() != val)
+		{
+			derived[i]->setVertexQuantization(val);
+			derived[i]->dirty();
+		}
+	}
+}
+
+void Material::setupDepthMaterial(Material* material)
+{
+	material->setMaxBones(getMaxBones());
+	material->setSkinning(getSkinning());
+	material->setMorphTargets(getMorphTargets());
+	material->setMorphNormals(getMorphNormals());
+	material->setInstancing(getInstancing());
+	material->setVertexQuantization(getVertexQuantization());
+}
@@ -0,0 +1,197 @@
+#include <sstream>
+#include <cstring>
+#include <unordered_map>
+#include <osgThreeJSX/MaterialBlock>
+
+using namespace osgThreeJSX;
+
+//GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT is at most 256 on common hardware
+static const unsigned int BLOCK_OFFSET_ALIGNMENT = 256;
+
+static unsigned int alignTo(unsigned int value, unsigned int alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+//std140 base alignment and size, false for the types that stay loose uniforms
+static bool getStd140Info(osg::Uniform::Type type, unsigned int& alignment, unsigned int& size, const char*& glslType)
+{
+	switch (type)
+	{
+	case osg::Uniform::FLOAT: alignment = 4; size = 4; glslType = "float"; return true;
+	case osg::Uniform::INT: alignment = 4; size = 4; glslType = "int"; return true;
+	case osg::Uniform::BOOL: alignment = 4; size = 4; glslType = "bool"; return true;
+	case osg::Uniform::FLOAT_VEC2: alignment = 8; size = 8; glslType = "vec2"; return true;
+	case osg::Uniform::FLOAT_VEC3: alignment = 16; size = 12; glslType = "vec3"; return true;
+	case osg::Uniform::FLOAT_VEC4: alignment = 16; size = 16; glslType = "vec4"; return true;
+	case osg::Uniform::FLOAT_MAT3: alignment = 16; size = 48; glslType = "mat3"; return true;
+	case osg::Uniform::FLOAT_MAT4: alignment = 16; size = 64; glslType = "mat4"; return true;
+	default: return false;
+	}
+}
+
+bool MaterialBlockLayout::accepts(const osg::Uniform* uniform)
+{
+	unsigned int alignment, size;
+	const char* glslType;
+	return uniform->getNumElements() == 1 && getStd140Info(uniform->getType(), alignment, size, glslType);
+}
+
+void MaterialBlockLayout::build(const std::vector< osg::ref_ptr<osg::Uniform> >& uniforms)
+{
+	_members.clear();
+	_size = 0;
+
+	std::stringstream ss;
+	for (std::vector< osg::ref_ptr<osg::Uniform> >::const_iterator iter = uniforms.begin(); iter != uniforms.end(); iter++)
+	{
+		unsigned int alignment, size;
+		const char* glslType;
+		if ((*iter)->getNumElements() != 1 || !getStd140Info((*iter)->getType(), alignment, size, glslType))
+			continue;
+
+		_size = alignTo(_size, alignment);
+		_members.push_back(MaterialBlockMember((*iter)->getName(), (*iter)->getType(), _size));
+		_size += size;
+
+		ss << glslType << " " << (*iter)->getName() << ";\n";
+	}
+	_size = alignTo(_size, 16);
+	_declaration = ss.str();
+}
+
+MaterialBlockArena::MaterialBlockArena(unsigned int blockSize) :
+	_blockSize(blockSize),
+	_stride(alignTo(blockSize, BLOCK_OFFSET_ALIGNMENT))
+{
+	_bufferObject = new osg::UniformBufferObject();
+	_bufferObject->setUsage(GL_DYNAMIC_DRAW);
+}
+
+osg::ref_ptr<MaterialBlockArena> MaterialBlockArena::getOrCreate(const MaterialBlockLayout& layout)
+{
+	typedef std::unordered_map<std::string, osg::observer_ptr<MaterialBlockArena> > ArenaMap;
+	static ArenaMap arenas;
+	static std::mutex mutex;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	osg::ref_ptr<MaterialBlockArena> arena;
+	if (arenas[layout.getDeclaration()].lock(arena))
+		return arena;
+
+	//forget the layouts no material uses anymore
+	for (ArenaMap::iterator iter = arenas.begin(); iter != arenas.end();)
+	{
+		if (iter->second.valid())
+			iter++;
+		else
+			iter = arenas.erase(iter);
+	}
+
+	arena = new MaterialBlockArena(layout.getSize());
+	arenas[layout.getDeclaration()] = arena.get();
+	return arena;
+}
+
+void MaterialBlockArena::reserve(unsigned int slots)
+{
+	//every slot is an entry of the buffer object, the stride keeps the entries at the offset alignment
+	unsigned int first = _bindings.size();
+	for (unsigned int i = first; i < slots; i++)
+	{
+		osg::ref_ptr<osg::FloatArray> block = new osg::FloatArray(_stride / sizeof(float));
+		block->setBufferObject(_bufferObject.get());
+		_blocks.push_back(block);
+		_bindings.push_back(new osg::UniformBufferBinding(MATERIAL_BLOCK_BINDING, block.get(), 0, _blockSize));
+	}
+	//lowest slots are handed out first
+	for (unsigned int i = slots; i > first; i--)
+	{
+		_freeSlots.push_back(i - 1);
+	}
+}
+
+int MaterialBlockArena::allocate()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (_freeSlots.empty())
+	{
+		unsigned int count = _bindings.size();
+		reserve(osg::maximum(count * 2, 16u));
+	}
+
+	int slot = _freeSlots.back();
+	_freeSlots.pop_back();
+	return slot;
+}
+
+void MaterialBlockArena::release(int slot)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_freeSlots.push_back(slot);
+}
+
+osg::UniformBufferBinding* MaterialBlockArena::getBinding(int slot)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _bindings[slot].get();
+}
+
+void MaterialBlockArena::write(int slot, const MaterialBlockLayout& layout, const std::vector< osg::ref_ptr<osg::Uniform> >& uniforms)
+{
+	osg::ref_ptr<osg::FloatArray> data;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		data = _blocks[slot];
+	}
+	float* block = &(*data)[0];
+	bool changed = false;
+
+	const MaterialBlockMemberList& members = layout.getMembers();
+	size_t memberIndex = 0;
+	for (std::vector< osg::ref_ptr<osg::Uniform> >::const_iterator iter = uniforms.begin(); iter != uniforms.end() && memberIndex < members.size(); iter++)
+	{
+		//the layout was built from this list, so the members come in the same order
+		const MaterialBlockMember& member = members[memberIndex];
+		if ((*iter)->getName() != member._name)
+			continue;
+		memberIndex++;
+		if ((*iter)->getType() != member._type)
+			continue;
+
+		//packed like the block, then compared so unchanged members do not dirty the slot
+		float value[16];
+		unsigned int size = 0;
+		const osg::FloatArray* floats = (*iter)->getFloatArray();
+		const osg::IntArray* ints = (*iter)->getIntArray();
+		switch (member._type)
+		{
+		case osg::Uniform::INT:
+		case osg::Uniform::BOOL:
+			if (ints) { memcpy(value, &(*ints)[0], sizeof(int)); size = sizeof(int); }
+			break;
+		case osg::Uniform::FLOAT_MAT3:
+			//each column is padded to a vec4
+			memcpy(value, block + member._offset / sizeof(float), sizeof(float) * 12);
+			for (int column = 0; floats && column < 3; column++)
+			{
+				memcpy(value + column * 4, &(*floats)[column * 3], sizeof(float) * 3);
+			}
+			size = floats ? sizeof(float) * 11 : 0;
+			break;
+		default:
+			if (floats) { size = osg::minimum((unsigned int)floats->size(), 16u) * sizeof(float); memcpy(value, &(*floats)[0], size); }
+			break;
+		}
+
+		float* dst = block + member._offset / sizeof(float);
+		if (size > 0 && memcmp(dst, value, size) != 0)
+		{
+			memcpy(dst, value, size);
+			changed = true;
+		}
+	}
+
+	if (changed)
+		data->dirty();
+}
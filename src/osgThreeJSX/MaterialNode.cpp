@@ -19,6 +19,15 @@ void MaterialNodeCullback::operator()(osg::Node* node, osg::NodeVisitor* nv)
 		RenderState* renderState = dynamic_cast<RenderState*>(camera->getUserData());
 		if (renderState)
 		{
+			//hidden behind the occluders rasterized by the camera
+			OcclusionCuller* occlusionCuller = renderState->getOcclusionCuller();
+			if (occlusionCuller && !renderState->isDepthPrePass())
+			{
+				osg::Matrix modelViewProjection = (*cv->getModelViewMatrix()) * (*cv->getProjectionMatrix());
+				if (occlusionCuller->isOccluded(node->getBound(), modelViewProjection))
+					return;
+			}
+
 			osg::ref_ptr<Material> material = _material;
 			if (renderState->getShadowLight() && material.valid())//shadow render state
 			{
@@ -35,14 +44,51 @@ void MaterialNodeCullback::operator()(osg::Node* node, osg::NodeVisitor* nv)
 
 				material = _material->getOrCreateDepthMaterial(renderState->getShadowLight());
 			}
+
+			//the pre-pass lays down depth, the main pass then only shades the visible fragments
+			osg::StateSet* passStateSet = NULL;
+			if (material.valid() && !renderState->getShadowLight() && renderState->getDepthPrePassEnable())
+			{
+				bool prePass = material->supportsDepthPrePass();
+				if (renderState->isDepthPrePass())
+				{
+					if (!prePass)
+						return;
+					material = _material->getOrCreatePrePassMaterial();
+				}
+				else if (prePass)
+				{
+					passStateSet = renderState->getDepthEqualStateSet();
+				}
+			}
+
+			//transparent draws accumulate unsorted in the OIT bin, its composite pass blends them over the frame
+			if (material.valid() && renderState->getWeightedBlendedOitEnable() && material->supportsWeightedBlendedOit())
+			{
+				passStateSet = renderState->getWeightedBlendedOitStateSet();
+			}
+
 			if (material.valid())
 			{
 				material->update(camera, cv, node);
+				TextureResidencyManager* textureResidency = renderState->getTextureResidencyManager();
+				if (textureResidency && !renderState->getShadowLight() && !renderState->isDepthPrePass())
+				{
+					textureResidency->request(material.get(), node, cv);
+				}
 				if (material->getStateset())
 				{
 					cv->pushStateSet(material->getStateset());
 				}
+				if (passStateSet)
+				{
+					cv->pushStateSet(passStateSet);
+				}
 				traverse(node, nv);
+				if (passStateSet)
+				{
+					cv->popStateSet();
+				}
 				if (material->getStateset())
 				{
 					cv->popStateSet();
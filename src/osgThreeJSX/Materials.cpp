@@ -219,6 +219,7 @@ void MaterialDepth::getProgramParameters(osg::Camera* camera, osgUtil::CullVisit
 
 MaterialDistance::MaterialDistance()
 {
+	_layered = false;
 }
 
 MaterialDistance::MaterialDistance(const MaterialDistance& other, const osg::CopyOp& copyop)
@@ -242,6 +243,13 @@ void MaterialDistance::buildUniformAndTexture(MaterialUniformList& uniforms, Mat
 void MaterialDistance::getProgramParameters(osg::Camera* camera, osgUtil::CullVisitor* cv, ProgramParameters& parameters)
 {
 	Material::getProgramParameters(camera, cv, parameters);
+
+	//one pass for the six cube faces, the geometry shader routes each triangle to the faces it touches
+	if (_layered)
+	{
+		parameters.defines["LAYERED_CUBE_SHADOW"] = "1";
+		parameters.geometry = ShaderChunk::get("distanceRGBA_geom");
+	}
 }
 
 MaterialCube::MaterialCube()
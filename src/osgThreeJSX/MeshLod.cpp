@@ -0,0 +1,56 @@
+#include <osgUtil/CullVisitor>
+#include <osgThreeJSX/MeshLod>
+
+using namespace osgThreeJSX;
+
+//////////////////////////////////////////////////////////////////////////
+void MeshLodChain::addLevel(osg::Geometry* geometry, float error)
+{
+	if (!_errors.empty())
+		error = osg::maximum(error, _errors.back());
+	_levels.push_back(geometry);
+	_errors.push_back(error);
+}
+
+unsigned int MeshLodChain::selectLevel(const std::vector<float>& errors, float pixelsPerUnit, float maxPixelError)
+{
+	unsigned int level = 0;
+	for (unsigned int i = 1; i < errors.size() && errors[i] * pixelsPerUnit <= maxPixelError; i++)
+		level = i;
+	return level;
+}
+
+//////////////////////////////////////////////////////////////////////////
+MeshLod::MeshLod() :
+	_maxPixelError(1.0f)
+{
+}
+
+MeshLod::MeshLod(const MeshLod& rhs, const osg::CopyOp& copyop) :
+	osg::Group(rhs, copyop),
+	_errors(rhs._errors),
+	_maxPixelError(rhs._maxPixelError)
+{
+}
+
+void MeshLod::traverse(osg::NodeVisitor& nv)
+{
+	if (_children.empty())
+		return;
+
+	if (nv.getTraversalMode() == osg::NodeVisitor::TRAVERSE_ALL_CHILDREN)
+	{
+		osg::Group::traverse(nv);
+		return;
+	}
+	if (nv.getTraversalMode() != osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN)
+		return;
+
+	unsigned int level = 0;
+	osgUtil::CullVisitor* cv = nv.asCullVisitor();
+	const osg::BoundingSphere& bound = getBound();
+	if (cv && bound.valid() && bound.radius() > 0.0f)
+		level = MeshLodChain::selectLevel(_errors, cv->clampedPixelSize(bound) / bound.radius(), _maxPixelError);
+
+	_children[osg::minimum(level, getNumChildren() - 1)]->accept(nv);
+}
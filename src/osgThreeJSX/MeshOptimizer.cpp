@@ -0,0 +1,476 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <osg/NodeVisitor>
+#include <osg/TriangleIndexFunctor>
+#include <osg/Notify>
+#include <osgAnimation/RigGeometry>
+#include <osgAnimation/MorphGeometry>
+#include <osgThreeJSX/MeshOptimizer>
+
+using namespace osgThreeJSX;
+
+//////////////////////////////////////////////////////////////////////////
+struct TriangleCollector
+{
+	void operator()(unsigned int i0, unsigned int i1, unsigned int i2)
+	{
+		//degenerate triangles draw nothing
+		if (i0 == i1 || i1 == i2 || i0 == i2)
+			return;
+		_indices->push_back(i0);
+		_indices->push_back(i1);
+		_indices->push_back(i2);
+	}
+
+	std::vector<unsigned int>* _indices;
+};
+
+class GeometryCollector : public osg::NodeVisitor
+{
+public:
+	GeometryCollector() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+	virtual void apply(osg::Node& node)
+	{
+		osg::Geometry* geometry = node.asGeometry();
+		if (geometry && _visited.insert(geometry).second)
+			_geometries.push_back(geometry);
+		traverse(node);
+	}
+
+	std::set<osg::Geometry*> _visited;
+	std::vector<osg::Geometry*> _geometries;
+};
+
+//FIFO cache, a vertex is in the cache while less than cacheSize vertices were loaded after it
+static unsigned int simulateCache(const unsigned int* indices, size_t count, unsigned int cacheSize, std::vector<unsigned int>& timestamps, unsigned int& timestamp)
+{
+	unsigned int misses = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int index = indices[i];
+		if (timestamp - timestamps[index] > cacheSize)
+		{
+			timestamps[index] = timestamp++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+static void addArray(std::vector<osg::Array*>& arrays, osg::Array* array)
+{
+	if (array && std::find(arrays.begin(), arrays.end(), array) == arrays.end())
+		arrays.push_back(array);
+}
+
+//every array indexed like the vertices of geometry, with the morph targets and sources
+static void addGeometryArrays(std::vector<osg::Array*>& arrays, osg::Geometry* geometry)
+{
+	addArray(arrays, geometry->getVertexArray());
+	addArray(arrays, geometry->getNormalArray());
+	addArray(arrays, geometry->getColorArray());
+	addArray(arrays, geometry->getSecondaryColorArray());
+	addArray(arrays, geometry->getFogCoordArray());
+	for (unsigned int i = 0; i < geometry->getNumTexCoordArrays(); i++)
+		addArray(arrays, geometry->getTexCoordArray(i));
+	for (unsigned int i = 0; i < geometry->getNumVertexAttribArrays(); i++)
+		addArray(arrays, geometry->getVertexAttribArray(i));
+
+	osgAnimation::MorphGeometry* morphGeometry = dynamic_cast<osgAnimation::MorphGeometry*>(geometry);
+	if (morphGeometry)
+	{
+		osgAnimation::MorphGeometry::MorphTargetList& targets = morphGeometry->getMorphTargetList();
+		for (size_t i = 0; i < targets.size(); i++)
+		{
+			if (!targets[i].getGeometry())
+				continue;
+			addArray(arrays, targets[i].getGeometry()->getVertexArray());
+			addArray(arrays, targets[i].getGeometry()->getNormalArray());
+		}
+		addArray(arrays, morphGeometry->getVertexSource());
+		addArray(arrays, morphGeometry->getNormalSource());
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+MeshOptimizer::MeshOptimizer() :
+	_cacheSize(16),
+	_overdrawEnable(true),
+	_overdrawThreshold(1.05f),
+	_vertexFetchEnable(true)
+{
+	resetStats();
+}
+
+void MeshOptimizer::resetStats()
+{
+	_numGeometries = 0;
+	_numTriangles = 0;
+	_missesBefore = 0;
+	_missesAfter = 0;
+}
+
+float MeshOptimizer::computeAcmr(const std::vector<unsigned int>& indices, unsigned int vertexCount, unsigned int cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int timestamp = cacheSize + 1;
+	unsigned int misses = simulateCache(&indices[0], indices.size(), cacheSize, timestamps, timestamp);
+	return (float)misses / (indices.size() / 3);
+}
+
+unsigned int MeshOptimizer::optimize(osg::Node* node)
+{
+	if (!node)
+		return 0;
+
+	GeometryCollector collector;
+	node->accept(collector);
+
+	//the source of a rig is optimized with it
+	std::set<osg::Geometry*> sources;
+	for (size_t i = 0; i < collector._geometries.size(); i++)
+	{
+		osgAnimation::RigGeometry* rigGeometry = dynamic_cast<osgAnimation::RigGeometry*>(collector._geometries[i]);
+		if (rigGeometry && rigGeometry->getSourceGeometry())
+			sources.insert(rigGeometry->getSourceGeometry());
+	}
+
+	//a vertex fetch reorder of an array would scramble the other geometries drawing it
+	std::map<const osg::Array*, unsigned int> users;
+	for (size_t i = 0; i < collector._geometries.size(); i++)
+	{
+		osg::Geometry* geometry = collector._geometries[i];
+		if (sources.find(geometry) != sources.end())
+			continue;
+
+		std::vector<osg::Array*> arrays;
+		addGeometryArrays(arrays, geometry);
+		osgAnimation::RigGeometry* rigGeometry = dynamic_cast<osgAnimation::RigGeometry*>(geometry);
+		if (rigGeometry && rigGeometry->getSourceGeometry() && rigGeometry->getSourceGeometry() != geometry)
+			addGeometryArrays(arrays, rigGeometry->getSourceGeometry());
+		for (size_t j = 0; j < arrays.size(); j++)
+		{
+			if (++users[arrays[j]] > 1)
+				_sharedArrays.insert(arrays[j]);
+		}
+	}
+
+	unsigned int count = 0;
+	for (size_t i = 0; i < collector._geometries.size(); i++)
+	{
+		if (sources.find(collector._geometries[i]) == sources.end() && optimize(collector._geometries[i]))
+			count++;
+	}
+	_sharedArrays.clear();
+	return count;
+}
+
+bool MeshOptimizer::optimize(osg::Geometry* geometry)
+{
+	const osg::Array* vertices = geometry->getVertexArray();
+	if (!vertices || vertices->getNumElements() == 0 || geometry->getNumPrimitiveSets() == 0)
+		return false;
+
+	for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++)
+	{
+		const osg::PrimitiveSet* primitiveSet = geometry->getPrimitiveSet(i);
+		GLenum mode = primitiveSet->getMode();
+		if (primitiveSet->getNumInstances() > 0 || mode == GL_POINTS || mode == GL_LINES || mode == GL_LINE_STRIP || mode == GL_LINE_LOOP)
+			return false;
+	}
+
+	std::vector<unsigned int> indices;
+	osg::TriangleIndexFunctor<TriangleCollector> functor;
+	functor._indices = &indices;
+	geometry->accept(functor);
+	if (indices.empty())
+		return false;
+
+	//skinned geometries draw the arrays of their source
+	std::vector<osg::Geometry*> family;
+	family.push_back(geometry);
+	osgAnimation::RigGeometry* rigGeometry = dynamic_cast<osgAnimation::RigGeometry*>(geometry);
+	if (rigGeometry && rigGeometry->getSourceGeometry() && rigGeometry->getSourceGeometry() != geometry)
+		family.push_back(rigGeometry->getSourceGeometry());
+
+	std::vector<osg::Array*> arrays;
+	for (size_t i = 0; i < family.size(); i++)
+		addGeometryArrays(arrays, family[i]);
+
+	unsigned int vertexCount = vertices->getNumElements();
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] >= vertexCount)
+			return false;
+	}
+
+	unsigned int triangleCount = indices.size() / 3;
+	float acmrBefore = computeAcmr(indices, vertexCount, _cacheSize);
+
+	std::vector<unsigned int> optimized;
+	std::vector<unsigned int> clusters;
+	optimizeVertexCache(indices, vertexCount, optimized, clusters);
+
+	const osg::Vec3Array* positions = dynamic_cast<const osg::Vec3Array*>(vertices);
+	if (_overdrawEnable && positions)
+		optimizeOverdraw(optimized, clusters, positions);
+
+	//the cache order is kept when it came out worse, the input may be optimized already
+	float acmrAfter = computeAcmr(optimized, vertexCount, _cacheSize);
+	if (acmrAfter > acmrBefore)
+	{
+		optimized = indices;
+		acmrAfter = acmrBefore;
+	}
+
+	bool shared = false;
+	for (size_t i = 0; i < arrays.size() && !shared; i++)
+		shared = _sharedArrays.find(arrays[i]) != _sharedArrays.end();
+	if (shared)
+		OSG_INFO << "osgThreeJSX::MeshOptimizer: " << geometry->getName() << " shares its arrays, the vertex order is kept" << std::endl;
+
+	if (_vertexFetchEnable && !shared && optimizeVertexFetch(optimized, vertexCount, arrays))
+		vertexCount = geometry->getVertexArray()->getNumElements();
+
+	osg::ref_ptr<osg::DrawElements> drawElements;
+	if (vertexCount <= 65536)
+		drawElements = new osg::DrawElementsUShort(GL_TRIANGLES, optimized.begin(), optimized.end());
+	else
+		drawElements = new osg::DrawElementsUInt(GL_TRIANGLES, optimized.begin(), optimized.end());
+
+	for (size_t i = 0; i < family.size(); i++)
+	{
+		family[i]->removePrimitiveSet(0, family[i]->getNumPrimitiveSets());
+		family[i]->addPrimitiveSet(drawElements);
+		family[i]->dirtyGLObjects();
+	}
+
+	OSG_INFO << "osgThreeJSX::MeshOptimizer: " << geometry->getName() << " " << triangleCount << " triangles, ACMR " << acmrBefore << " -> " << acmrAfter << std::endl;
+
+	_numGeometries++;
+	_numTriangles += triangleCount;
+	_missesBefore += (unsigned long long)(acmrBefore * triangleCount + 0.5f);
+	_missesAfter += (unsigned long long)(acmrAfter * triangleCount + 0.5f);
+	return true;
+}
+
+void MeshOptimizer::optimizeVertexCache(const std::vector<unsigned int>& indices, unsigned int vertexCount, std::vector<unsigned int>& result, std::vector<unsigned int>& clusters)
+{
+	//Tipsify, Sander et al. 2007, fans around a vertex and moves on to the vertex most likely still in the cache
+	unsigned int triangleCount = indices.size() / 3;
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		offsets[indices[i] + 1]++;
+	for (unsigned int i = 0; i < vertexCount; i++)
+		offsets[i + 1] += offsets[i];
+
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = i / 3;
+
+	std::vector<unsigned int> live(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+		live[i] = offsets[i + 1] - offsets[i];
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	deadEnd.reserve(indices.size());
+	result.clear();
+	result.reserve(indices.size());
+	clusters.clear();
+	clusters.push_back(0);
+
+	unsigned int time = _cacheSize + 1;
+	unsigned int cursor = 0;
+	int fanning = 0;
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (unsigned int i = offsets[fanning]; i < offsets[fanning + 1]; i++)
+		{
+			unsigned int triangle = adjacency[i];
+			if (emitted[triangle])
+				continue;
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				unsigned int vertex = indices[triangle * 3 + j];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				live[vertex]--;
+				if (time - cacheTime[vertex] > _cacheSize)
+					cacheTime[vertex] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		//the candidate that stays in the cache while its remaining triangles are drawn, the oldest of them
+		int best = -1;
+		int bestPriority = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			unsigned int vertex = candidates[i];
+			if (live[vertex] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[vertex] + 2 * live[vertex] <= _cacheSize)
+				priority = time - cacheTime[vertex];
+			if (priority > bestPriority)
+			{
+				best = vertex;
+				bestPriority = priority;
+			}
+		}
+
+		//dead end, the cache is about to be lost and a new cluster starts
+		if (best < 0)
+		{
+			while (!deadEnd.empty() && best < 0)
+			{
+				unsigned int vertex = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[vertex] > 0)
+					best = vertex;
+			}
+			while (cursor < vertexCount && best < 0)
+			{
+				if (live[cursor] > 0)
+					best = cursor;
+				else
+					cursor++;
+			}
+			if (best >= 0 && result.size() / 3 != clusters.back())
+				clusters.push_back(result.size() / 3);
+		}
+		fanning = best;
+	}
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<unsigned int>& clusters, const osg::Vec3Array* positions)
+{
+	//soft boundaries, a cluster is split where the part so far keeps the cache efficiency of the whole cluster
+	unsigned int triangleCount = indices.size() / 3;
+	std::vector<unsigned int> timestamps(positions->size(), 0);
+	unsigned int timestamp = _cacheSize + 1;
+	std::vector<unsigned int> splits;
+	for (size_t i = 0; i < clusters.size(); i++)
+	{
+		unsigned int start = clusters[i];
+		unsigned int end = i + 1 < clusters.size() ? clusters[i + 1] : triangleCount;
+
+		timestamp += _cacheSize + 1;
+		unsigned int misses = simulateCache(&indices[start * 3], (end - start) * 3, _cacheSize, timestamps, timestamp);
+		float threshold = _overdrawThreshold * misses / (end - start);
+
+		timestamp += _cacheSize + 1;
+		unsigned int clusterStart = start;
+		unsigned int clusterMisses = 0;
+		splits.push_back(start);
+		for (unsigned int triangle = start; triangle < end; triangle++)
+		{
+			clusterMisses += simulateCache(&indices[triangle * 3], 3, _cacheSize, timestamps, timestamp);
+			if (triangle + 1 < end && clusterMisses <= threshold * (triangle + 1 - clusterStart))
+			{
+				splits.push_back(triangle + 1);
+				clusterStart = triangle + 1;
+				clusterMisses = 0;
+				timestamp += _cacheSize + 1;
+			}
+		}
+	}
+
+	//outward facing clusters far from the center occlude the others, they go first
+	osg::Vec3d meshCenter;
+	double meshArea = 0.0;
+	std::vector<osg::Vec3d> centers(splits.size());
+	std::vector<osg::Vec3d> normals(splits.size());
+	for (size_t i = 0; i < splits.size(); i++)
+	{
+		unsigned int end = i + 1 < splits.size() ? splits[i + 1] : triangleCount;
+		double clusterArea = 0.0;
+		for (unsigned int triangle = splits[i]; triangle < end; triangle++)
+		{
+			const osg::Vec3f& p0 = (*positions)[indices[triangle * 3]];
+			const osg::Vec3f& p1 = (*positions)[indices[triangle * 3 + 1]];
+			const osg::Vec3f& p2 = (*positions)[indices[triangle * 3 + 2]];
+			osg::Vec3d normal = osg::Vec3d((p1 - p0) ^ (p2 - p0));
+			double area = normal.length();
+			osg::Vec3d center = osg::Vec3d(p0 + p1 + p2) / 3.0;
+
+			centers[i] += center * area;
+			normals[i] += normal;
+			clusterArea += area;
+			meshCenter += center * area;
+			meshArea += area;
+		}
+		centers[i] = clusterArea > 0.0 ? centers[i] / clusterArea : osg::Vec3d();
+		normals[i].normalize();
+	}
+	if (meshArea > 0.0)
+		meshCenter /= meshArea;
+
+	std::vector<std::pair<double, unsigned int> > order(splits.size());
+	for (size_t i = 0; i < splits.size(); i++)
+		order[i] = std::make_pair(-((centers[i] - meshCenter) * normals[i]), (unsigned int)i);
+	std::stable_sort(order.begin(), order.end());
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		unsigned int cluster = order[i].second;
+		unsigned int end = cluster + 1 < splits.size() ? splits[cluster + 1] : triangleCount;
+		result.insert(result.end(), indices.begin() + splits[cluster] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(result);
+}
+
+bool MeshOptimizer::optimizeVertexFetch(std::vector<unsigned int>& indices, unsigned int vertexCount, const std::vector<osg::Array*>& arrays)
+{
+	//every array must follow, a per vertex array of another size would be left behind
+	for (size_t i = 0; i < arrays.size(); i++)
+	{
+		if (arrays[i]->getNumElements() != vertexCount && arrays[i]->getBinding() == osg::Array::BIND_PER_VERTEX)
+			return false;
+	}
+
+	std::vector<unsigned int> remap(vertexCount, ~0u);
+	unsigned int next = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (remap[indices[i]] == ~0u)
+			remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+
+	//the unused vertices are dropped
+	std::vector<unsigned char> data;
+	for (size_t i = 0; i < arrays.size(); i++)
+	{
+		osg::Array* array = arrays[i];
+		if (array->getNumElements() != vertexCount)
+			continue;
+
+		unsigned int elementSize = array->getElementSize();
+		unsigned char* elements = (unsigned char*)const_cast<GLvoid*>(array->getDataPointer());
+		data.assign(elements, elements + (size_t)elementSize * vertexCount);
+		for (unsigned int vertex = 0; vertex < vertexCount; vertex++)
+		{
+			if (remap[vertex] != ~0u)
+				memcpy(elements + (size_t)remap[vertex] * elementSize, &data[(size_t)vertex * elementSize], elementSize);
+		}
+		array->resizeArray(next);
+		array->dirty();
+	}
+	return true;
+}
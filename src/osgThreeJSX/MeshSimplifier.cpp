@@ -0,0 +1,871 @@
+#include <cmath>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <thread>
+#include <algorithm>
+#include <unordered_set>
+#include <osg/NodeVisitor>
+#include <osg/Geode>
+#include <osg/TriangleIndexFunctor>
+#include <osg/Notify>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osgThreeJSX/MeshSimplifier>
+#include <osgThreeJSX/MeshOptimizer>
+#include <osgThreeJSX/MaterialNode>
+#include <osgThreeJSX/Material>
+#include <osgThreeJSX/ThreadPool>
+
+using namespace osgThreeJSX;
+
+//bump when the cache layout or the simplification changes
+static const unsigned int g_cacheVersion = 1;
+static const char g_cacheMagic[4] = { 'O', 'T', 'J', 'L' };
+
+//a border moving inwards costs more than a surface moving off its plane
+static const double g_borderWeight = 10.0;
+
+namespace
+{
+	enum VertexKind
+	{
+		VertexKind_Manifold,
+		VertexKind_Border,
+		VertexKind_Seam,
+		VertexKind_Locked
+	};
+
+	struct TriangleCollector
+	{
+		void operator()(unsigned int i0, unsigned int i1, unsigned int i2)
+		{
+			if (i0 == i1 || i1 == i2 || i0 == i2)
+				return;
+			_indices->push_back(i0);
+			_indices->push_back(i1);
+			_indices->push_back(i2);
+		}
+
+		std::vector<unsigned int>* _indices;
+	};
+
+	//sum of squared distances to planes, symmetric 4x4 matrix
+	struct Quadric
+	{
+		Quadric() : a00(0.0), a01(0.0), a02(0.0), a11(0.0), a12(0.0), a22(0.0), b0(0.0), b1(0.0), b2(0.0), c(0.0), w(0.0) {}
+
+		void addPlane(const osg::Vec3d& n, double d, double weight)
+		{
+			a00 += weight * n.x() * n.x();
+			a01 += weight * n.x() * n.y();
+			a02 += weight * n.x() * n.z();
+			a11 += weight * n.y() * n.y();
+			a12 += weight * n.y() * n.z();
+			a22 += weight * n.z() * n.z();
+			b0 += weight * n.x() * d;
+			b1 += weight * n.y() * d;
+			b2 += weight * n.z() * d;
+			c += weight * d * d;
+			w += weight;
+		}
+
+		void add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02;
+			a11 += q.a11; a12 += q.a12; a22 += q.a22;
+			b0 += q.b0; b1 += q.b1; b2 += q.b2;
+			c += q.c;
+			w += q.w;
+		}
+
+		//weighted mean of the squared distances
+		double error(const osg::Vec3d& p) const
+		{
+			double x = p.x(), y = p.y(), z = p.z();
+			double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+				+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+			return w > 0.0 ? fabs(e) / w : 0.0;
+		}
+
+		double a00, a01, a02, a11, a12, a22, b0, b1, b2, c, w;
+	};
+
+	struct Collapse
+	{
+		unsigned int _from;
+		unsigned int _to;
+		double _cost;
+
+		bool operator<(const Collapse& rhs) const { return _cost < rhs._cost; }
+	};
+
+	struct VertexAttributes
+	{
+		const osg::Vec3Array* _normals;
+		const osg::Vec2Array* _uvs;
+		const osg::Vec4Array* _skinIndices;
+		const osg::Vec4Array* _skinWeights;
+	};
+
+	//the geodes drawn with a material, not yet under a MeshLod
+	class MaterialGeodeCollector : public osg::NodeVisitor
+	{
+	public:
+		MaterialGeodeCollector() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+		virtual void apply(osg::Geode& geode)
+		{
+			Material* material = getMaterial(&geode);
+			if (!material || !_visited.insert(&geode).second)
+				return;
+			for (unsigned int i = 0; i < geode.getNumParents(); i++)
+			{
+				if (dynamic_cast<MeshLod*>(geode.getParent(i)))
+					return;
+			}
+			_geodes.push_back(&geode);
+			_materials.push_back(material);
+		}
+
+		static Material* getMaterial(osg::Node* node)
+		{
+			for (osg::Callback* callback = node->getCullCallback(); callback; callback = callback->getNestedCallback())
+			{
+				MaterialNodeCullback* materialCallback = dynamic_cast<MaterialNodeCullback*>(callback);
+				if (materialCallback)
+					return materialCallback->getMaterial().get();
+			}
+			return NULL;
+		}
+
+		std::set<osg::Geode*> _visited;
+		std::vector<osg::ref_ptr<osg::Geode> > _geodes;
+		std::vector<Material*> _materials;
+	};
+}
+
+static unsigned long long edgeKey(unsigned int a, unsigned int b)
+{
+	return ((unsigned long long)a << 32) | b;
+}
+
+static int getAttribIndex(Material* material, const std::string& name)
+{
+	if (!material)
+		return -1;
+	const MaterialVertexAttribList& attribs = material->getVertexAttribList();
+	for (MaterialVertexAttribList::const_iterator iter = attribs.begin(); iter != attribs.end(); iter++)
+	{
+		if (iter->_name == name)
+			return iter->_index;
+	}
+	return -1;
+}
+
+template<class ArrayType>
+static const ArrayType* getPerVertex(const osg::Array* array, unsigned int count)
+{
+	const ArrayType* result = dynamic_cast<const ArrayType*>(array);
+	if (!result || result->getNumElements() != count || result->getBinding() != osg::Array::BIND_PER_VERTEX)
+		return NULL;
+	return result;
+}
+
+//half the L1 distance of the joint weights
+static double skinDistance(const osg::Vec4& indicesU, const osg::Vec4& weightsU, const osg::Vec4& indicesV, const osg::Vec4& weightsV)
+{
+	double distance = 0.0;
+	for (unsigned int i = 0; i < 4; i++)
+	{
+		double weight = weightsU[i];
+		for (unsigned int j = 0; j < 4; j++)
+		{
+			if (indicesV[j] == indicesU[i])
+				weight -= weightsV[j];
+		}
+		distance += fabs(weight);
+	}
+	for (unsigned int j = 0; j < 4; j++)
+	{
+		bool shared = false;
+		for (unsigned int i = 0; i < 4 && !shared; i++)
+			shared = indicesU[i] == indicesV[j];
+		if (!shared)
+			distance += weightsV[j];
+	}
+	return distance * 0.5;
+}
+
+static void hashBytes(unsigned long long& hash, const void* data, size_t size)
+{
+	//FNV-1a
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+}
+
+static void hashArray(unsigned long long& hash, const osg::Array* array)
+{
+	unsigned int size = array ? array->getTotalDataSize() : 0;
+	hashBytes(hash, &size, sizeof(size));
+	if (size)
+		hashBytes(hash, array->getDataPointer(), size);
+}
+
+static bool collectTriangles(osg::Geometry* geometry, std::vector<unsigned int>& indices)
+{
+	for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++)
+	{
+		GLenum mode = geometry->getPrimitiveSet(i)->getMode();
+		if (mode == GL_POINTS || mode == GL_LINES || mode == GL_LINE_STRIP || mode == GL_LINE_LOOP)
+			return false;
+	}
+
+	osg::TriangleIndexFunctor<TriangleCollector> functor;
+	functor._indices = &indices;
+	geometry->accept(functor);
+
+	unsigned int vertexCount = geometry->getVertexArray()->getNumElements();
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		if (indices[i] >= vertexCount)
+			return false;
+	}
+	return !indices.empty();
+}
+
+//////////////////////////////////////////////////////////////////////////
+MeshSimplifier::MeshSimplifier() :
+	_numLevels(3),
+	_levelRatio(0.5f),
+	_maxError(0.05f),
+	_minTriangles(64),
+	_normalWeight(0.25f),
+	_uvWeight(1.0f),
+	_skinWeight(0.1f)
+{
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+}
+
+void MeshSimplifier::setThreadPool(ThreadPool* threadPool)
+{
+	_threadPool = threadPool;
+}
+
+ThreadPool* MeshSimplifier::getThreadPool()
+{
+	if (!_threadPool.valid())
+		_threadPool = new ThreadPool();
+	return _threadPool.get();
+}
+
+unsigned int MeshSimplifier::generate(osg::Node* node)
+{
+	if (!node)
+		return 0;
+
+	MaterialGeodeCollector collector;
+	node->accept(collector);
+
+	//a geometry drawn by several geodes is simplified once
+	std::map<osg::Geometry*, size_t> slots;
+	std::vector<osg::Geometry*> geometries;
+	std::vector<Material*> materials;
+	for (size_t i = 0; i < collector._geodes.size(); i++)
+	{
+		osg::Geode* geode = collector._geodes[i].get();
+		for (unsigned int j = 0; j < geode->getNumDrawables(); j++)
+		{
+			osg::Geometry* geometry = geode->getDrawable(j)->asGeometry();
+			if (!geometry || slots.find(geometry) != slots.end())
+				continue;
+			Material* material = MaterialGeodeCollector::getMaterial(geometry);
+			slots[geometry] = geometries.size();
+			geometries.push_back(geometry);
+			materials.push_back(material ? material : collector._materials[i]);
+		}
+	}
+
+	std::vector<osg::ref_ptr<MeshLodChain> > chains(geometries.size());
+	ThreadPool* threadPool = getThreadPool();
+	for (size_t i = 0; i < geometries.size(); i++)
+	{
+		osg::ref_ptr<MeshLodChain>* chain = &chains[i];
+		osg::Geometry* geometry = geometries[i];
+		Material* material = materials[i];
+		threadPool->addTask([this, chain, geometry, material]()
+		{
+			*chain = buildChain(geometry, material);
+		});
+	}
+	threadPool->wait();
+
+	unsigned int count = 0;
+	for (size_t i = 0; i < collector._geodes.size(); i++)
+	{
+		osg::Geode* geode = collector._geodes[i].get();
+		unsigned int numLevels = 1;
+		for (unsigned int j = 0; j < geode->getNumDrawables(); j++)
+		{
+			osg::Geometry* geometry = geode->getDrawable(j)->asGeometry();
+			if (geometry)
+				numLevels = osg::maximum(numLevels, chains[slots[geometry]]->getNumLevels());
+		}
+		if (numLevels < 2)
+			continue;
+
+		osg::ref_ptr<MeshLod> lod = new MeshLod();
+		lod->setName(geode->getName());
+		lod->addChild(geode);
+
+		std::vector<float> errors(numLevels, 0.0f);
+		for (unsigned int level = 1; level < numLevels; level++)
+		{
+			osg::ref_ptr<MaterialBaseNode<osg::Geode> > levelGeode = new MaterialBaseNode<osg::Geode>();
+			levelGeode->setName(geode->getName());
+			levelGeode->setNodeMask(geode->getNodeMask());
+			levelGeode->setStateSet(geode->getStateSet());
+			levelGeode->setMaterial(collector._materials[i]);
+			for (unsigned int j = 0; j < geode->getNumDrawables(); j++)
+			{
+				osg::Geometry* geometry = geode->getDrawable(j)->asGeometry();
+				if (!geometry)
+				{
+					levelGeode->addDrawable(geode->getDrawable(j));
+					continue;
+				}
+				MeshLodChain* chain = chains[slots[geometry]].get();
+				unsigned int chainLevel = osg::minimum(level, chain->getNumLevels() - 1);
+				levelGeode->addDrawable(chain->getLevel(chainLevel));
+				errors[level] = osg::maximum(errors[level], chain->getError(chainLevel));
+			}
+			lod->addChild(levelGeode);
+		}
+		lod->setErrors(errors);
+
+		osg::Node::ParentList parents = geode->getParents();
+		for (size_t j = 0; j < parents.size(); j++)
+		{
+			if (parents[j] != lod.get())
+				parents[j]->replaceChild(geode, lod);
+		}
+		count++;
+	}
+	return count;
+}
+
+osg::ref_ptr<MeshLodChain> MeshSimplifier::buildChain(osg::Geometry* geometry, Material* material) const
+{
+	osg::ref_ptr<MeshLodChain> chain = new MeshLodChain();
+	chain->addLevel(geometry, 0.0f);
+
+	const osg::Vec3Array* positions = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+	std::vector<unsigned int> indices;
+	if (!positions || positions->empty() || !collectTriangles(geometry, indices))
+		return chain;
+
+	std::vector<std::vector<unsigned int> > levels;
+	std::vector<float> errors;
+	std::string filename = _cacheDirectory.empty() ? std::string() : getCacheFilename(geometry, indices, material);
+	if (filename.empty() || !readCache(filename, positions->size(), levels, errors))
+	{
+		osg::BoundingBox box;
+		for (size_t i = 0; i < indices.size(); i++)
+			box.expandBy((*positions)[indices[i]]);
+		float maxError = _maxError * box.radius();
+
+		//each level starts from the full detail triangles, its error is measured against them
+		unsigned int triangleCount = indices.size() / 3;
+		for (unsigned int level = 0; level < _numLevels; level++)
+		{
+			unsigned int targetCount = (unsigned int)(triangleCount * _levelRatio);
+			if (targetCount < _minTriangles)
+				break;
+
+			std::vector<unsigned int> result;
+			float error = simplify(geometry, indices, targetCount * 3, maxError, result, material);
+
+			//stalled on the error limit or on locked vertices
+			if (result.size() / 3 > triangleCount * 0.9f)
+				break;
+
+			triangleCount = result.size() / 3;
+			levels.push_back(result);
+			errors.push_back(error);
+		}
+
+		if (!filename.empty())
+			writeCache(filename, positions->size(), levels, errors);
+	}
+
+	//the levels draw the arrays of geometry, their vertices stay where they are
+	osg::ref_ptr<MeshOptimizer> optimizer = new MeshOptimizer();
+	optimizer->setVertexFetchEnable(false);
+	for (size_t i = 0; i < levels.size(); i++)
+	{
+		osg::ref_ptr<osg::Geometry> levelGeometry = createLevelGeometry(geometry, levels[i]);
+		optimizer->optimize(levelGeometry.get());
+		chain->addLevel(levelGeometry.get(), errors[i]);
+	}
+
+	OSG_INFO << "osgThreeJSX::MeshSimplifier: " << geometry->getName() << " " << indices.size() / 3 << " triangles, " << levels.size() << " levels" << std::endl;
+	return chain;
+}
+
+float MeshSimplifier::simplify(const osg::Geometry* geometry, const std::vector<unsigned int>& indices, unsigned int targetCount, float maxError, std::vector<unsigned int>& result, Material* material) const
+{
+	result = indices;
+	const osg::Vec3Array* positions = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+	if (!positions || indices.size() <= targetCount)
+		return 0.0f;
+
+	unsigned int vertexCount = positions->size();
+	VertexAttributes attributes;
+	attributes._normals = getPerVertex<osg::Vec3Array>(geometry->getNormalArray(), vertexCount);
+	attributes._uvs = getPerVertex<osg::Vec2Array>(geometry->getTexCoordArray(0), vertexCount);
+	attributes._skinIndices = NULL;
+	attributes._skinWeights = NULL;
+	int skinIndex = getAttribIndex(material, "skinIndex");
+	int skinWeight = getAttribIndex(material, "skinWeight");
+	if (skinIndex >= 0 && skinWeight >= 0)
+	{
+		attributes._skinIndices = getPerVertex<osg::Vec4Array>(geometry->getVertexAttribArray(skinIndex), vertexCount);
+		attributes._skinWeights = attributes._skinIndices ? getPerVertex<osg::Vec4Array>(geometry->getVertexAttribArray(skinWeight), vertexCount) : NULL;
+	}
+
+	//the used vertices at the same position are the wedges of one vertex, the first one stands for them
+	std::vector<unsigned char> used(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		used[indices[i]] = 1;
+
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned int> wedge(vertexCount);
+	std::vector<unsigned int> wedgeCount(vertexCount, 0);
+	osg::BoundingBox box;
+	{
+		std::map<osg::Vec3f, unsigned int> firsts;
+		for (unsigned int i = 0; i < vertexCount; i++)
+		{
+			remap[i] = i;
+			wedge[i] = i;
+			if (!used[i])
+				continue;
+			remap[i] = firsts.insert(std::make_pair((*positions)[i], i)).first->second;
+			wedgeCount[remap[i]]++;
+			box.expandBy((*positions)[i]);
+			if (remap[i] != i)
+			{
+				wedge[i] = wedge[remap[i]];
+				wedge[remap[i]] = i;
+			}
+		}
+	}
+	double attributeScale = box.radius() * box.radius();
+
+	//triangles collapsed to a line by the welding draw nothing
+	result.clear();
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		unsigned int r0 = remap[indices[i]], r1 = remap[indices[i + 1]], r2 = remap[indices[i + 2]];
+		if (r0 != r1 && r1 != r2 && r0 != r2)
+			result.insert(result.end(), indices.begin() + i, indices.begin() + i + 3);
+	}
+
+	//an edge without its opposite is on the border
+	std::unordered_set<unsigned long long> edges;
+	for (size_t i = 0; i < result.size(); i++)
+	{
+		size_t next = i % 3 == 2 ? i - 2 : i + 1;
+		edges.insert(edgeKey(remap[result[i]], remap[result[next]]));
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	std::vector<unsigned char> open(vertexCount, 0);
+	for (size_t i = 0; i < result.size(); i += 3)
+	{
+		osg::Vec3d p[3];
+		for (unsigned int j = 0; j < 3; j++)
+			p[j] = osg::Vec3d((*positions)[result[i + j]]);
+		osg::Vec3d normal = (p[1] - p[0]) ^ (p[2] - p[0]);
+		double area = normal.normalize();
+
+		for (unsigned int j = 0; j < 3; j++)
+			quadrics[remap[result[i + j]]].addPlane(normal, -(normal * p[0]), area * 0.5);
+
+		for (unsigned int j = 0; j < 3; j++)
+		{
+			unsigned int a = remap[result[i + j]], b = remap[result[i + (j + 1) % 3]];
+			if (edges.find(edgeKey(b, a)) != edges.end())
+				continue;
+
+			//plane through the border edge perpendicular to the triangle
+			open[a] = open[b] = 1;
+			osg::Vec3d edge = p[(j + 1) % 3] - p[j];
+			osg::Vec3d borderNormal = edge ^ normal;
+			borderNormal.normalize();
+			double weight = edge.length2() * g_borderWeight;
+			quadrics[a].addPlane(borderNormal, -(borderNormal * p[j]), weight);
+			quadrics[b].addPlane(borderNormal, -(borderNormal * p[j]), weight);
+		}
+	}
+
+	std::vector<unsigned char> kinds(vertexCount, VertexKind_Locked);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		unsigned int r = remap[i];
+		if (wedgeCount[r] == 1)
+			kinds[i] = open[r] ? VertexKind_Border : VertexKind_Manifold;
+		else if (wedgeCount[r] == 2 && !open[r])
+			kinds[i] = VertexKind_Seam;
+	}
+
+	std::unordered_set<unsigned long long> wedgeEdges;
+	//the attributes the moved corners take from v against those the triangles around u interpolate at the position of v,
+	//the skin weights by their difference since the joints do not interpolate
+	std::vector<unsigned int> offsets(vertexCount + 1);
+	std::vector<unsigned int> adjacency;
+	auto attributeCost = [&](unsigned int u, unsigned int v) -> double
+	{
+		unsigned int ru = remap[u], rv = remap[v];
+		osg::Vec3f target = (*positions)[v];
+		double cost = 0.0;
+		double weight = 0.0;
+		for (unsigned int k = offsets[ru]; k < offsets[ru + 1] && (attributes._normals || attributes._uvs); k++)
+		{
+			const unsigned int* corners = &result[adjacency[k] * 3];
+			unsigned int moved = 3;
+			bool degenerate = false;
+			for (unsigned int j = 0; j < 3; j++)
+			{
+				if (remap[corners[j]] == ru)
+					moved = j;
+				degenerate = degenerate || remap[corners[j]] == rv;
+			}
+			if (degenerate || moved == 3)
+				continue;
+
+			//barycentric coordinates of the target in the plane of the triangle
+			osg::Vec3f p0 = (*positions)[corners[0]];
+			osg::Vec3f e0 = (*positions)[corners[1]] - p0;
+			osg::Vec3f e1 = (*positions)[corners[2]] - p0;
+			osg::Vec3f d = target - p0;
+			double d00 = e0 * e0, d01 = e0 * e1, d11 = e1 * e1, d20 = d * e0, d21 = d * e1;
+			double denominator = d00 * d11 - d01 * d01;
+			if (denominator <= 0.0)
+				continue;
+			float l1 = (float)((d11 * d20 - d01 * d21) / denominator);
+			float l2 = (float)((d00 * d21 - d01 * d20) / denominator);
+			float l0 = 1.0f - l1 - l2;
+			unsigned int to = corners[moved] == u ? v : wedge[v];
+
+			double error = 0.0;
+			if (attributes._normals)
+			{
+				const osg::Vec3Array& normals = *attributes._normals;
+				osg::Vec3f normal = normals[corners[0]] * l0 + normals[corners[1]] * l1 + normals[corners[2]] * l2;
+				error += _normalWeight * (normal - normals[to]).length2();
+			}
+			if (attributes._uvs)
+			{
+				const osg::Vec2Array& uvs = *attributes._uvs;
+				osg::Vec2f uv = uvs[corners[0]] * l0 + uvs[corners[1]] * l1 + uvs[corners[2]] * l2;
+				error += _uvWeight * (uv - uvs[to]).length2();
+			}
+			double area = sqrt(denominator) * 0.5;
+			cost += error * area;
+			weight += area;
+		}
+		if (weight > 0.0)
+			cost /= weight;
+
+		if (attributes._skinWeights)
+		{
+			double distance = skinDistance((*attributes._skinIndices)[u], (*attributes._skinWeights)[u], (*attributes._skinIndices)[v], (*attributes._skinWeights)[v]);
+			cost += _skinWeight * distance * distance;
+		}
+		return cost * attributeScale;
+	};
+	//DBL_MAX when u can not move to v
+	auto collapseCost = [&](unsigned int u, unsigned int v, bool border) -> double
+	{
+		switch (kinds[u])
+		{
+		case VertexKind_Manifold:
+			break;
+		case VertexKind_Border:
+			if (kinds[v] != VertexKind_Border || !border)
+				return DBL_MAX;
+			break;
+		case VertexKind_Seam:
+		{
+			//the other side of the seam moves along the same edge
+			unsigned int u2 = wedge[u], v2 = wedge[v];
+			if (kinds[v] != VertexKind_Seam || border
+				|| (wedgeEdges.find(edgeKey(u2, v2)) == wedgeEdges.end() && wedgeEdges.find(edgeKey(v2, u2)) == wedgeEdges.end()))
+				return DBL_MAX;
+			break;
+		}
+		default:
+			return DBL_MAX;
+		}
+		return quadrics[remap[u]].error(osg::Vec3d((*positions)[v])) + attributeCost(u, v);
+	};
+
+	double maxCost = (double)maxError * maxError;
+	double reached = 0.0;
+	unsigned int targetTriangles = targetCount / 3;
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> collapseRemap(vertexCount);
+	std::vector<unsigned char> locked(vertexCount);
+	while (result.size() / 3 > targetTriangles)
+	{
+		unsigned int triangleCount = result.size() / 3;
+		edges.clear();
+		wedgeEdges.clear();
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			size_t next = i % 3 == 2 ? i - 2 : i + 1;
+			edges.insert(edgeKey(remap[result[i]], remap[result[next]]));
+			wedgeEdges.insert(edgeKey(result[i], result[next]));
+		}
+
+		//triangles around each vertex
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (size_t i = 0; i < result.size(); i++)
+			offsets[remap[result[i]] + 1]++;
+		for (unsigned int i = 0; i < vertexCount; i++)
+			offsets[i + 1] += offsets[i];
+		adjacency.resize(result.size());
+		std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < result.size(); i++)
+			adjacency[fill[remap[result[i]]]++] = i / 3;
+
+		//the cheaper direction of each edge, inner edges are seen from both of their triangles and taken once
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i++)
+		{
+			unsigned int a = result[i], b = result[i % 3 == 2 ? i - 2 : i + 1];
+			bool border = edges.find(edgeKey(remap[b], remap[a])) == edges.end();
+			if (!border && remap[a] > remap[b])
+				continue;
+
+			Collapse collapse;
+			collapse._from = a;
+			collapse._to = b;
+			collapse._cost = collapseCost(a, b, border);
+			double reverseCost = collapseCost(b, a, border);
+			if (reverseCost < collapse._cost)
+			{
+				std::swap(collapse._from, collapse._to);
+				collapse._cost = reverseCost;
+			}
+			if (collapse._cost <= maxCost)
+				collapses.push_back(collapse);
+		}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end());
+
+		for (unsigned int i = 0; i < vertexCount; i++)
+			collapseRemap[i] = i;
+		std::fill(locked.begin(), locked.end(), 0);
+
+		//the cheapest collapses first, a vertex moves or is moved onto once per pass
+		unsigned int goal = triangleCount - targetTriangles;
+		unsigned int removed = 0;
+		unsigned int performed = 0;
+		for (size_t i = 0; i < collapses.size() && removed < goal; i++)
+		{
+			const Collapse& collapse = collapses[i];
+			unsigned int ru = remap[collapse._from], rv = remap[collapse._to];
+			if (locked[ru] || locked[rv])
+				continue;
+
+			//the triangles around u must not flip when it moves to v
+			osg::Vec3f target = (*positions)[collapse._to];
+			unsigned int lost = 0;
+			bool flipped = false;
+			for (unsigned int k = offsets[ru]; k < offsets[ru + 1] && !flipped; k++)
+			{
+				unsigned int triangle = adjacency[k];
+				unsigned int corners[3];
+				bool degenerate = false;
+				for (unsigned int j = 0; j < 3; j++)
+				{
+					corners[j] = collapseRemap[result[triangle * 3 + j]];
+					degenerate = degenerate || remap[corners[j]] == rv;
+				}
+				if (degenerate)
+				{
+					lost++;
+					continue;
+				}
+
+				osg::Vec3f p[3], q[3];
+				for (unsigned int j = 0; j < 3; j++)
+				{
+					p[j] = (*positions)[corners[j]];
+					q[j] = remap[corners[j]] == ru ? target : p[j];
+				}
+				osg::Vec3f before = (p[1] - p[0]) ^ (p[2] - p[0]);
+				osg::Vec3f after = (q[1] - q[0]) ^ (q[2] - q[0]);
+				flipped = before * after <= 0.0f && before.length2() > 0.0f;
+			}
+			if (flipped)
+				continue;
+
+			collapseRemap[collapse._from] = collapse._to;
+			if (kinds[collapse._from] == VertexKind_Seam)
+				collapseRemap[wedge[collapse._from]] = wedge[collapse._to];
+			quadrics[rv].add(quadrics[ru]);
+			locked[ru] = locked[rv] = 1;
+			reached = osg::maximum(reached, collapse._cost);
+			removed += lost;
+			performed++;
+		}
+		if (performed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			unsigned int i0 = collapseRemap[result[i]], i1 = collapseRemap[result[i + 1]], i2 = collapseRemap[result[i + 2]];
+			if (remap[i0] == remap[i1] || remap[i1] == remap[i2] || remap[i0] == remap[i2])
+				continue;
+			result[write++] = i0;
+			result[write++] = i1;
+			result[write++] = i2;
+		}
+		result.resize(write);
+	}
+	return (float)sqrt(reached);
+}
+
+std::string MeshSimplifier::getCacheFilename(const osg::Geometry* geometry, const std::vector<unsigned int>& indices, Material* material) const
+{
+	unsigned long long hash = 14695981039346656037ull;
+	float settings[6] = { (float)_numLevels, _levelRatio, _maxError, (float)_minTriangles, _normalWeight, _uvWeight };
+	hashBytes(hash, &g_cacheVersion, sizeof(g_cacheVersion));
+	hashBytes(hash, settings, sizeof(settings));
+	hashBytes(hash, &_skinWeight, sizeof(_skinWeight));
+
+	int skinAttribs[2] = { getAttribIndex(material, "skinIndex"), getAttribIndex(material, "skinWeight") };
+	hashBytes(hash, skinAttribs, sizeof(skinAttribs));
+	hashArray(hash, geometry->getVertexArray());
+	hashArray(hash, geometry->getNormalArray());
+	hashArray(hash, geometry->getTexCoordArray(0));
+	for (unsigned int i = 0; i < 2; i++)
+		hashArray(hash, skinAttribs[i] >= 0 ? geometry->getVertexAttribArray(skinAttribs[i]) : NULL);
+	hashBytes(hash, &indices[0], indices.size() * sizeof(unsigned int));
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.lod", hash);
+	return osgDB::concatPaths(_cacheDirectory, name);
+}
+
+bool MeshSimplifier::readCache(const std::string& filename, unsigned int vertexCount, std::vector<std::vector<unsigned int> >& levels, std::vector<float>& errors) const
+{
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file)
+		return false;
+
+	char magic[4];
+	unsigned int header[3];
+	file.read(magic, sizeof(magic));
+	file.read((char*)header, sizeof(header));
+	if (!file || memcmp(magic, g_cacheMagic, sizeof(magic)) != 0 || header[0] != g_cacheVersion || header[1] != vertexCount)
+		return false;
+
+	levels.resize(header[2]);
+	errors.resize(header[2]);
+	for (unsigned int i = 0; i < header[2]; i++)
+	{
+		unsigned int count = 0;
+		file.read((char*)&errors[i], sizeof(float));
+		file.read((char*)&count, sizeof(count));
+		if (!file || count % 3 != 0 || count > (1u << 30))
+			return false;
+		levels[i].resize(count);
+		if (count)
+			file.read((char*)&levels[i][0], count * sizeof(unsigned int));
+		if (!file)
+			return false;
+		for (unsigned int j = 0; j < count; j++)
+		{
+			if (levels[i][j] >= vertexCount)
+				return false;
+		}
+	}
+	return true;
+}
+
+void MeshSimplifier::writeCache(const std::string& filename, unsigned int vertexCount, const std::vector<std::vector<unsigned int> >& levels, const std::vector<float>& errors) const
+{
+	if (!osgDB::fileExists(_cacheDirectory) && !osgDB::makeDirectory(_cacheDirectory))
+	{
+		OSG_WARN << "osgThreeJSX::MeshSimplifier: can not create " << _cacheDirectory << std::endl;
+		return;
+	}
+
+	//written aside and renamed, a reader never sees a partial file
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::string temporary = filename + suffix;
+	{
+		std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		unsigned int header[3] = { g_cacheVersion, vertexCount, (unsigned int)levels.size() };
+		file.write(g_cacheMagic, sizeof(g_cacheMagic));
+		file.write((const char*)header, sizeof(header));
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			unsigned int count = levels[i].size();
+			file.write((const char*)&errors[i], sizeof(float));
+			file.write((const char*)&count, sizeof(count));
+			if (count)
+				file.write((const char*)&levels[i][0], count * sizeof(unsigned int));
+		}
+		if (!file)
+		{
+			OSG_WARN << "osgThreeJSX::MeshSimplifier: can not write " << temporary << std::endl;
+			return;
+		}
+	}
+	if (rename(temporary.c_str(), filename.c_str()) != 0)
+		remove(temporary.c_str());
+}
+
+osg::Geometry* MeshSimplifier::createLevelGeometry(osg::Geometry* geometry, const std::vector<unsigned int>& indices) const
+{
+	osg::Geometry* level = new osg::Geometry;
+	level->setName(geometry->getName());
+	level->setVertexArray(geometry->getVertexArray());
+	level->setNormalArray(geometry->getNormalArray());
+	level->setColorArray(geometry->getColorArray());
+	level->setSecondaryColorArray(geometry->getSecondaryColorArray());
+	level->setFogCoordArray(geometry->getFogCoordArray());
+	for (unsigned int i = 0; i < geometry->getNumTexCoordArrays(); i++)
+		level->setTexCoordArray(i, geometry->getTexCoordArray(i));
+	for (unsigned int i = 0; i < geometry->getNumVertexAttribArrays(); i++)
+		level->setVertexAttribArray(i, geometry->getVertexAttribArray(i));
+	level->setStateSet(geometry->getStateSet());
+	level->setUseDisplayList(false);
+	level->setUseVertexBufferObjects(true);
+	level->setInitialBound(geometry->getBoundingBox());
+
+	if (geometry->getVertexArray()->getNumElements() <= 65536)
+		level->addPrimitiveSet(new osg::DrawElementsUShort(GL_TRIANGLES, indices.begin(), indices.end()));
+	else
+		level->addPrimitiveSet(new osg::DrawElementsUInt(GL_TRIANGLES, indices.begin(), indices.end()));
+	return level;
+}
@@ -0,0 +1,498 @@
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
+#include <osg/Geometry>
+#include <osg/Transform>
+#include <osg/TriangleFunctor>
+#include <osgThreeJSX/OcclusionCuller>
+#include <osgThreeJSX/MaterialNode>
+#include <osgThreeJSX/Material>
+#include <osgThreeJSX/InstanceGeometry>
+#undef RELATIVE
+#include <osgAnimation/RigGeometry>
+#include <osgAnimation/MorphGeometry>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OSGTHREEJSX_OCCLUSION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace osgThreeJSX;
+
+//vertices this close to the eye plane are treated as crossing it
+static const float NEAR_W_EPSILON = 1e-5f;
+
+//////////////////////////////////////////////////////////////////////////
+DepthRasterizer::DepthRasterizer() :
+	_width(0),
+	_height(0),
+	_tilesX(0),
+	_tilesY(0)
+{
+}
+
+void DepthRasterizer::resize(int width, int height)
+{
+	_tilesX = osg::maximum((width + TileSize - 1) / TileSize, 1);
+	_tilesY = osg::maximum((height + TileSize - 1) / TileSize, 1);
+	_width = _tilesX * TileSize;
+	_height = _tilesY * TileSize;
+	_depth.resize(_width * _height);
+	_tileMax.resize(_tilesX * _tilesY);
+	clear();
+}
+
+void DepthRasterizer::clear()
+{
+	std::fill(_depth.begin(), _depth.end(), 1.0f);
+	std::fill(_tileMax.begin(), _tileMax.end(), 1.0f);
+}
+
+void DepthRasterizer::drawTriangles(const osg::Vec4f* vertices, unsigned int count)
+{
+	float halfWidth = _width * 0.5f;
+	float halfHeight = _height * 0.5f;
+	for (unsigned int i = 0; i + 2 < count; i += 3)
+	{
+		const osg::Vec4f& a = vertices[i];
+		const osg::Vec4f& b = vertices[i + 1];
+		const osg::Vec4f& c = vertices[i + 2];
+
+		//clipping against the near plane would add vertices, dropping the triangle only loses occlusion
+		if (a.w() < NEAR_W_EPSILON || b.w() < NEAR_W_EPSILON || c.w() < NEAR_W_EPSILON)
+			continue;
+
+		osg::Vec3f screen[3];
+		const osg::Vec4f* clip[3] = { &a, &b, &c };
+		for (int j = 0; j < 3; j++)
+		{
+			float invW = 1.0f / clip[j]->w();
+			screen[j].set((clip[j]->x() * invW + 1.0f) * halfWidth, (clip[j]->y() * invW + 1.0f) * halfHeight, clip[j]->z() * invW);
+		}
+		drawTriangle(screen[0], screen[1], screen[2]);
+	}
+}
+
+void DepthRasterizer::drawTriangle(const osg::Vec3f& v0, const osg::Vec3f& v1, const osg::Vec3f& v2)
+{
+	//occluders are closed meshes, so both windings are drawn
+	float area = (v1.x() - v0.x()) * (v2.y() - v0.y()) - (v1.y() - v0.y()) * (v2.x() - v0.x());
+	if (!(std::fabs(area) > 1e-6f))
+		return;
+
+	const osg::Vec3f& a = v0;
+	const osg::Vec3f& b = area > 0.0f ? v1 : v2;
+	const osg::Vec3f& c = area > 0.0f ? v2 : v1;
+	area = std::fabs(area);
+
+	//everything beyond the far plane stays at the cleared depth
+	if (a.z() > 1.0f && b.z() > 1.0f && c.z() > 1.0f)
+		return;
+
+	int minX = osg::maximum((int)std::floor(osg::minimum(osg::minimum(a.x(), b.x()), c.x())), 0);
+	int minY = osg::maximum((int)std::floor(osg::minimum(osg::minimum(a.y(), b.y()), c.y())), 0);
+	int maxX = osg::minimum((int)std::ceil(osg::maximum(osg::maximum(a.x(), b.x()), c.x())), _width - 1);
+	int maxY = osg::minimum((int)std::ceil(osg::maximum(osg::maximum(a.y(), b.y()), c.y())), _height - 1);
+	if (minX > maxX || minY > maxY)
+		return;
+
+	//edge functions e(x, y) = A * x + B * y + C, positive inside
+	float edgeA[3] = { b.y() - c.y(), c.y() - a.y(), a.y() - b.y() };
+	float edgeB[3] = { c.x() - b.x(), a.x() - c.x(), b.x() - a.x() };
+	float edgeC[3] = {
+		b.x() * c.y() - b.y() * c.x(),
+		c.x() * a.y() - c.y() * a.x(),
+		a.x() * b.y() - a.y() * b.x() };
+
+	//depth is linear in screen space after the perspective divide
+	float invArea = 1.0f / area;
+	float depthA = (edgeA[0] * a.z() + edgeA[1] * b.z() + edgeA[2] * c.z()) * invArea;
+	float depthB = (edgeB[0] * a.z() + edgeB[1] * b.z() + edgeB[2] * c.z()) * invArea;
+	float depthC = (edgeC[0] * a.z() + edgeC[1] * b.z() + edgeC[2] * c.z()) * invArea;
+
+#ifdef OSGTHREEJSX_OCCLUSION_SSE2
+	//four pixels at a time, the rows are a multiple of the tile size
+	minX &= ~3;
+	__m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 stepA0 = _mm_set1_ps(edgeA[0] * 4.0f);
+	__m128 stepA1 = _mm_set1_ps(edgeA[1] * 4.0f);
+	__m128 stepA2 = _mm_set1_ps(edgeA[2] * 4.0f);
+	__m128 stepDepth = _mm_set1_ps(depthA * 4.0f);
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		__m128 px = _mm_add_ps(_mm_set1_ps((float)minX), offsets);
+		__m128 e0 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(edgeA[0])), _mm_set1_ps(edgeB[0] * py + edgeC[0]));
+		__m128 e1 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(edgeA[1])), _mm_set1_ps(edgeB[1] * py + edgeC[1]));
+		__m128 e2 = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(edgeA[2])), _mm_set1_ps(edgeB[2] * py + edgeC[2]));
+		__m128 z = _mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(depthA)), _mm_set1_ps(depthB * py + depthC));
+
+		float* row = &_depth[y * _width];
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+			if (_mm_movemask_ps(inside))
+			{
+				__m128 depth = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(depth, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, depth)));
+			}
+			e0 = _mm_add_ps(e0, stepA0);
+			e1 = _mm_add_ps(e1, stepA1);
+			e2 = _mm_add_ps(e2, stepA2);
+			z = _mm_add_ps(z, stepDepth);
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float* row = &_depth[y * _width];
+		for (int x = minX; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+			if (edgeA[0] * px + edgeB[0] * py + edgeC[0] < 0.0f ||
+				edgeA[1] * px + edgeB[1] * py + edgeC[1] < 0.0f ||
+				edgeA[2] * px + edgeB[2] * py + edgeC[2] < 0.0f)
+				continue;
+
+			float z = depthA * px + depthB * py + depthC;
+			if (z < row[x])
+				row[x] = z;
+		}
+	}
+#endif
+}
+
+void DepthRasterizer::updateTiles()
+{
+	for (int ty = 0; ty < _tilesY; ty++)
+	{
+		for (int tx = 0; tx < _tilesX; tx++)
+		{
+			float farthest = -1.0f;
+			for (int y = ty * TileSize; y < (ty + 1) * TileSize; y++)
+			{
+				const float* row = &_depth[y * _width + tx * TileSize];
+				for (int x = 0; x < TileSize; x++)
+				{
+					farthest = osg::maximum(farthest, row[x]);
+				}
+			}
+			_tileMax[ty * _tilesX + tx] = farthest;
+		}
+	}
+}
+
+bool DepthRasterizer::isOccluded(float minX, float minY, float maxX, float maxY, float depth) const
+{
+	if (_width == 0)
+		return false;
+
+	//outside the viewport the frustum culling decides
+	if (maxX < -1.0f || maxY < -1.0f || minX > 1.0f || minY > 1.0f)
+		return false;
+
+	int x0 = osg::maximum((int)std::floor((minX + 1.0f) * 0.5f * _width), 0);
+	int y0 = osg::maximum((int)std::floor((minY + 1.0f) * 0.5f * _height), 0);
+	int x1 = osg::minimum((int)std::ceil((maxX + 1.0f) * 0.5f * _width), _width) - 1;
+	int y1 = osg::minimum((int)std::ceil((maxY + 1.0f) * 0.5f * _height), _height) - 1;
+
+	for (int ty = y0 / TileSize; ty <= y1 / TileSize; ty++)
+	{
+		for (int tx = x0 / TileSize; tx <= x1 / TileSize; tx++)
+		{
+			//the whole tile is nearer
+			if (_tileMax[ty * _tilesX + tx] < depth)
+				continue;
+
+			int rowBegin = osg::maximum(ty * TileSize, y0);
+			int rowEnd = osg::minimum((ty + 1) * TileSize - 1, y1);
+			int columnBegin = osg::maximum(tx * TileSize, x0);
+			int columnEnd = osg::minimum((tx + 1) * TileSize - 1, x1);
+			for (int y = rowBegin; y <= rowEnd; y++)
+			{
+				const float* row = &_depth[y * _width];
+				for (int x = columnBegin; x <= columnEnd; x++)
+				{
+					if (row[x] >= depth)
+						return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+struct OccluderTriangleCollector
+{
+	std::vector<osg::Vec3f>* _triangles;
+
+	void operator()(const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3)
+	{
+		_triangles->push_back(v1);
+		_triangles->push_back(v2);
+		_triangles->push_back(v3);
+	}
+
+	void operator()(const osg::Vec3& v1, const osg::Vec3& v2, const osg::Vec3& v3, bool)
+	{
+		operator()(v1, v2, v3);
+	}
+};
+
+//find the material of a node from its cull callbacks
+static Material* getNodeMaterial(osg::Node& node)
+{
+	for (osg::Callback* callback = node.getCullCallback(); callback; callback = callback->getNestedCallback())
+	{
+		MaterialNodeCullback* materialCallback = dynamic_cast<MaterialNodeCullback*>(callback);
+		if (materialCallback)
+			return materialCallback->getMaterial().get();
+	}
+	return NULL;
+}
+
+//skinned, morphed and instanced vertices are drawn away from where the vertex array puts them
+static bool isStaticGeometry(osg::Drawable& drawable)
+{
+	if (dynamic_cast<osgAnimation::RigGeometry*>(&drawable) || dynamic_cast<osgAnimation::MorphGeometry*>(&drawable))
+		return false;
+
+	osg::Geometry* geometry = drawable.asGeometry();
+	for (unsigned int i = 0; geometry && i < geometry->getNumPrimitiveSets(); i++)
+	{
+		if (geometry->getPrimitiveSet(i)->getNumInstances() > 1)
+			return false;
+	}
+	return true;
+}
+
+//draw the flagged or large low poly drawables inside the view frustum into the depth buffer
+class OccluderDrawVisitor : public osg::NodeVisitor
+{
+public:
+	OccluderDrawVisitor(OcclusionCuller* culler, const osg::Matrix& view, const osg::Matrix& projection) :
+		osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ACTIVE_CHILDREN),
+		_culler(culler),
+		_projection(projection),
+		_count(0)
+	{
+		_frustum.setToUnitFrustum(true, true);
+		_frustum.transformProvidingInverse(view * projection);
+		_matrixStack.push_back(view);
+		_occluderStack.push_back(false);
+		_opaqueStack.push_back(true);
+	}
+
+	virtual void apply(osg::Node& node)
+	{
+		if (!intersects(node.getBound()) || dynamic_cast<InstanceGeometry*>(&node))
+			return;
+
+		push(node);
+		traverse(node);
+		pop();
+	}
+
+	virtual void apply(osg::Transform& transform)
+	{
+		if (!intersects(transform.getBound()))
+			return;
+
+		osg::Matrix matrix = _matrixStack.back();
+		transform.computeLocalToWorldMatrix(matrix, this);
+
+		_matrixStack.push_back(matrix);
+		push(transform);
+		traverse(transform);
+		pop();
+		_matrixStack.pop_back();
+	}
+
+	virtual void apply(osg::Drawable& drawable)
+	{
+		const osg::BoundingSphere& bs = drawable.getBound();
+		if (!bs.valid() || !intersects(bs) || !_opaqueStack.back())
+			return;
+		if (!isStaticGeometry(drawable))
+			return;
+
+		//material drawables carry their own material cull callback
+		Material* material = getNodeMaterial(drawable);
+		if (material && !material->supportsDepthPrePass())
+			return;
+
+		bool flagged = _occluderStack.back() || (drawable.getNodeMask() & _culler->getOccluderMask()) != 0;
+		if (!flagged)
+		{
+			//projected diameter as a fraction of the viewport height
+			osg::Vec3d center = bs.center() * _matrixStack.back();
+			osg::Vec3d scales = _matrixStack.back().getScale();
+			double scale = osg::maximum(osg::maximum(scales.x(), scales.y()), scales.z());
+			bool ortho = _projection(3, 3) == 1.0;
+			double distance = ortho ? 1.0 : -center.z();
+			if (distance <= 0.0)
+				return;
+			double size = bs.radius() * scale * _projection(1, 1) / distance;
+			if (size < _culler->getOccluderScreenSize())
+				return;
+		}
+
+		const std::vector<osg::Vec3f>& triangles = _culler->getOccluderTriangles(&drawable);
+		if (triangles.empty() || (!flagged && triangles.size() / 3 > _culler->getMaxOccluderTriangles()))
+			return;
+
+		_culler->drawOccluder(triangles, _matrixStack.back() * _projection);
+		_count++;
+	}
+
+	unsigned int getCount() { return _count; }
+protected:
+	bool intersects(const osg::BoundingSphere& bs)
+	{
+		if (!bs.valid())
+			return true;
+
+		osg::Vec3d scales = _matrixStack.back().getScale();
+		double scale = osg::maximum(osg::maximum(scales.x(), scales.y()), scales.z());
+		return _frustum.contains(osg::BoundingSphere(bs.center() * _matrixStack.back(), bs.radius() * scale));
+	}
+
+	void push(osg::Node& node)
+	{
+		_occluderStack.push_back(_occluderStack.back() || (node.getNodeMask() & _culler->getOccluderMask()) != 0);
+
+		//transparent, alpha tested or displaced materials do not hide what is behind them
+		Material* material = getNodeMaterial(node);
+		_opaqueStack.push_back(material ? material->supportsDepthPrePass() : _opaqueStack.back());
+	}
+
+	void pop()
+	{
+		_opaqueStack.pop_back();
+		_occluderStack.pop_back();
+	}
+protected:
+	OcclusionCuller* _culler;
+	osg::Matrix _projection;
+	osg::Polytope _frustum;
+	std::vector<osg::Matrix> _matrixStack;
+	std::vector<bool> _occluderStack;
+	std::vector<bool> _opaqueStack;
+	unsigned int _count;
+};
+
+//////////////////////////////////////////////////////////////////////////
+OcclusionCuller::OcclusionCuller() :
+	_resolution(256),
+	_occluderMask(0),
+	_occluderScreenSize(0.1f),
+	_maxOccluderTriangles(512),
+	_occluderCount(0),
+	_testedCount(0),
+	_occludedCount(0)
+{
+}
+
+void OcclusionCuller::beginFrame(osg::Camera* camera, osgUtil::CullVisitor* cv)
+{
+	_testedCount = 0;
+	_occludedCount = 0;
+
+	const osg::Viewport* viewport = camera->getViewport();
+	double aspect = viewport && viewport->width() > 0 ? viewport->height() / viewport->width() : 1.0;
+	int height = osg::maximum((int)(_resolution * aspect + 0.5), 1);
+	if (_rasterizer.getWidth() != ((_resolution + DepthRasterizer::TileSize - 1) / DepthRasterizer::TileSize) * DepthRasterizer::TileSize ||
+		_rasterizer.getHeight() != ((height + DepthRasterizer::TileSize - 1) / DepthRasterizer::TileSize) * DepthRasterizer::TileSize)
+		_rasterizer.resize(_resolution, height);
+	else
+		_rasterizer.clear();
+
+	//the camera callback runs with the view matrix of the camera on the stack
+	OccluderDrawVisitor visitor(this, *cv->getModelViewMatrix(), *cv->getProjectionMatrix());
+	visitor.setTraversalMask(cv->getTraversalMask());
+	for (unsigned int i = 0; i < camera->getNumChildren(); i++)
+	{
+		camera->getChild(i)->accept(visitor);
+	}
+	_occluderCount = visitor.getCount();
+
+	_rasterizer.updateTiles();
+
+	//drop the meshes of deleted drawables
+	for (OccluderMeshMap::iterator iter = _meshes.begin(); iter != _meshes.end();)
+	{
+		if (!iter->second._drawable.valid())
+			_meshes.erase(iter++);
+		else
+			iter++;
+	}
+}
+
+bool OcclusionCuller::isOccluded(const osg::BoundingSphere& bound, const osg::Matrix& modelViewProjection)
+{
+	if (!bound.valid() || _occluderCount == 0)
+		return false;
+
+	_testedCount++;
+
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (int i = 0; i < 8; i++)
+	{
+		osg::Vec3d corner = bound.center() + osg::Vec3d(
+			(i & 1) ? bound.radius() : -bound.radius(),
+			(i & 2) ? bound.radius() : -bound.radius(),
+			(i & 4) ? bound.radius() : -bound.radius());
+		osg::Vec4d clip = osg::Vec4d(corner, 1.0) * modelViewProjection;
+
+		//touching the near plane, nothing can be in front of it
+		if (clip.w() < NEAR_W_EPSILON)
+			return false;
+
+		float x = clip.x() / clip.w(), y = clip.y() / clip.w(), z = clip.z() / clip.w();
+		minX = osg::minimum(minX, x); maxX = osg::maximum(maxX, x);
+		minY = osg::minimum(minY, y); maxY = osg::maximum(maxY, y);
+		minZ = osg::minimum(minZ, z);
+	}
+
+	if (minZ < -1.0f)
+		return false;
+
+	bool occluded = _rasterizer.isOccluded(minX, minY, maxX, maxY, minZ);
+	if (occluded)
+		_occludedCount++;
+	return occluded;
+}
+
+const std::vector<osg::Vec3f>& OcclusionCuller::getOccluderTriangles(osg::Drawable* drawable)
+{
+	OccluderMesh& mesh = _meshes[drawable];
+
+	osg::Geometry* geometry = drawable->asGeometry();
+	unsigned int modifiedCount = geometry && geometry->getVertexArray() ? geometry->getVertexArray()->getModifiedCount() : 0;
+	if (mesh._drawable.get() != drawable || mesh._modifiedCount != modifiedCount)
+	{
+		mesh._drawable = drawable;
+		mesh._modifiedCount = modifiedCount;
+		mesh._triangles.clear();
+
+		osg::TriangleFunctor<OccluderTriangleCollector> functor;
+		functor._triangles = &mesh._triangles;
+		drawable->accept(functor);
+	}
+	return mesh._triangles;
+}
+
+void OcclusionCuller::drawOccluder(const std::vector<osg::Vec3f>& triangles, const osg::Matrix& modelViewProjection)
+{
+	_clipVertices.resize(triangles.size());
+	for (size_t i = 0; i < triangles.size(); i++)
+	{
+		_clipVertices[i] = osg::Vec4f(osg::Vec4d(triangles[i], 1.0) * modelViewProjection);
+	}
+	_rasterizer.drawTriangles(_clipVertices.data(), _clipVertices.size());
+}
\ No newline at end of file
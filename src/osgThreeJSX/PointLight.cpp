@@ -4,6 +4,7 @@
 #include <osgThreeJSX/RenderState>
 #include <osg/Texture2D>
 #include <osg/Geometry>
+#include <osg/ViewportIndexed>
 
 using namespace osgThreeJSX;
 
@@ -43,11 +44,46 @@ public:
 		}
 	}
 	//
+	virtual void getCameras(CameraList& cameras)
+	{
+		cameras.insert(cameras.end(), _cameras.begin(), _cameras.end());
+	}
+	//
 	virtual void setupCamera(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
 	{
 		osg::Vec4 viewports[] = { osg::Vec4(2, 1, 1, 1), osg::Vec4(0, 1, 1, 1), osg::Vec4(3, 1, 1, 1),
 			osg::Vec4(1, 1, 1, 1), osg::Vec4(3, 0, 1, 1), osg::Vec4(1, 0, 1, 1) };
 
+		if (_layered)
+		{
+			//one camera culls the union of the six faces, the faces keep their tiles through indexed viewports
+			osg::Camera* camera = createCamera(light, node);
+			camera->setViewport(0, 0, _mapSize.x() * _frameExtents.x(), _mapSize.y() * _frameExtents.y());
+			camera->setInheritanceMask(camera->getInheritanceMask() & ~osg::CullSettings::CULLING_MODE);
+			camera->setCullingMode(osg::CullSettings::VIEW_FRUSTUM_CULLING);
+
+			for (int i = 0; i < sizeof(viewports) / sizeof(viewports[0]); i++)
+			{
+				camera->getOrCreateStateSet()->setAttribute(new osg::ViewportIndexed(i, _mapSize.x() * viewports[i].x(), _mapSize.y() * viewports[i].y(), _mapSize.x(), _mapSize.y()));
+			}
+
+			_cameras.push_back(camera);
+		}
+		else
+		{
+			for (int i = 0; i < sizeof(viewports) / sizeof(viewports[0]); i++)
+			{
+				osg::Camera* camera = createCamera(light, node);
+				camera->setViewport(_mapSize.x() * viewports[i].x(), _mapSize.y() * viewports[i].y(), _mapSize.x(), _mapSize.y());
+				_cameras.push_back(camera);
+			}
+		}
+
+		updateCamera(shadowMap, light, node);
+	}
+	//
+	virtual void updateCamera(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
+	{
 		osg::Vec3 cubeDirections[] = { osg::Vec3(1, 0, 0), osg::Vec3(-1, 0, 0), osg::Vec3(0, 0, 1),
 			osg::Vec3(0, 0, -1), osg::Vec3(0, 1, 0), osg::Vec3(0, -1, 0) };
 
@@ -56,32 +92,53 @@ public:
 
 		PointLight* dLight = dynamic_cast<PointLight*>(light.get());
 
-		for (int i = 0; i < sizeof(viewports) / sizeof(viewports[0]); i++)
+		if (_layered)
 		{
-			osg::Camera* camera = new osg::Camera;
-			camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
-			camera->setViewport(_mapSize.x() * viewports[i].x(), _mapSize.y() * viewports[i].y(), _mapSize.x(), _mapSize.y());
-			camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
-			camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
-			camera->attach(osg::Camera::COLOR_BUFFER, _map);
-			camera->setClearColor(osg::Vec4f(1.0f, 1.0f, 1.0f, 1.0f));
-			camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-			camera->addChild(node);
-
-			osg::ref_ptr<RenderState> rs = new RenderState();
-			rs->setupCamera(camera, light);
-
-			camera->setProjectionMatrixAsPerspective(90.0, _mapSize.x() / _mapSize.y(), 0.1, dLight->getDistance());
-
-			osg::Vec3 ortho_lightDir = cubeDirections[i];
-			camera->setViewMatrixAsLookAt(dLight->getPosition(), dLight->getPosition() + ortho_lightDir * 10.0, cubeUps[i]);
-
-			_cameras.push_back(camera);
+			osg::Camera* camera = _cameras[0].get();
+			float distance = dLight->getDistance();
+			camera->setViewMatrix(osg::Matrix::translate(osg::Vec3() - dLight->getPosition()));
+			camera->setProjectionMatrixAsOrtho(-distance, distance, -distance, distance, -distance, distance);
+
+			osg::ref_ptr<osg::Uniform> faceMatrices = camera->getOrCreateStateSet()->getOrCreateUniform("cubeFaceMatrices", osg::Uniform::FLOAT_MAT4, 6);
+			for (int i = 0; i < 6; i++)
+			{
+				osg::Matrix view = osg::Matrix::lookAt(dLight->getPosition(), dLight->getPosition() + cubeDirections[i] * 10.0, cubeUps[i]);
+				osg::Matrix projection = osg::Matrix::perspective(90.0, _mapSize.x() / _mapSize.y(), 0.1, distance);
+				faceMatrices->setElement(i, view * projection);
+			}
+		}
+		else
+		{
+			for (size_t i = 0; i < _cameras.size(); i++)
+			{
+				osg::Camera* camera = _cameras[i].get();
+				camera->setProjectionMatrixAsPerspective(90.0, _mapSize.x() / _mapSize.y(), 0.1, dLight->getDistance());
+
+				osg::Vec3 ortho_lightDir = cubeDirections[i];
+				camera->setViewMatrixAsLookAt(dLight->getPosition(), dLight->getPosition() + ortho_lightDir * 10.0, cubeUps[i]);
+			}
 		}
 
 		_matrix.makeTranslate(osg::Vec3() - dLight->getPosition());
 	}
+protected:
+	//
+	osg::Camera* createCamera(const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
+	{
+		osg::Camera* camera = new osg::Camera;
+		camera->setReferenceFrame(osg::Camera::ABSOLUTE_RF);
+		camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
+		camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
+		camera->attach(osg::Camera::COLOR_BUFFER, _map);
+		camera->setClearColor(osg::Vec4f(1.0f, 1.0f, 1.0f, 1.0f));
+		camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		camera->addChild(node);
+
+		osg::ref_ptr<RenderState> rs = new RenderState();
+		rs->setupCamera(camera, light);
+		return camera;
+	}
 
 	META_Object(osg, PointLightShadow);
 };
@@ -127,4 +127,12 @@ osg::Vec3 ProbeLight::getCoefficient(unsigned int idx)
 		ret = _shCoefficients[idx];
 	}
 	return ret;
+}
+
+void ProbeLight::setCoefficient(unsigned int idx, const osg::Vec3d& coefficient)
+{
+	if (idx < sizeof(_shCoefficients) / sizeof(_shCoefficients[0]))
+	{
+		_shCoefficients[idx] = coefficient;
+	}
 }
\ No newline at end of file
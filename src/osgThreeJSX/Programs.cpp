@@ -8,6 +8,9 @@
 #include <osgThreeJSX/Programs>
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/MaterialData>
+#include <osgThreeJSX/MaterialBlock>
+#include <osgThreeJSX/Instrumentation>
+#include <osgThreeJSX/Tracer>
 
 using namespace osgThreeJSX;
 
@@ -96,6 +99,7 @@ ProgramParameters::ProgramParameters()
 	numDirLightShadows = 0;
 	numSpotLightShadows = 0;
 	numPointLightShadows = 0;
+	numDirLightCascades = 1;
 
 	numClippingPlanes = 0;
 	numClipIntersection = 0;
@@ -108,11 +112,16 @@ ProgramParameters::ProgramParameters()
 	fog = false;
 	fogExp2 = false;
 
+	depthPrePass = false;
+
+	weightedBlendedOit = false;
+
 	logarithmicDepthBuffer = false;
 	rendererExtensionFragDepth = false;
 
 	shadowMapEnabled = false;
 	shadowMapType = ShadowMapType_BasicShadowMap;
+	shadowMapDepthTexture = false;
 
 	depthPacking = DepthPackingType_No;
 
@@ -121,6 +130,8 @@ ProgramParameters::ProgramParameters()
 	sheen = false;
 
 	instancing = false;
+
+	vertexQuantization = VertexQuantizationType_None;
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -146,6 +157,11 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 	prefixVertex << "#version " << parameters.glslversion << "\n";
 	prefixVertex << precision << "\n";
 	prefixVertex << customDefines << "\n";
+	if (!parameters.materialBlock.empty())
+		prefixVertex << "layout(std140) uniform MaterialBlock {\n" << parameters.materialBlock << "};\n";
+	//the pre-pass and the main pass must produce bitwise equal depths for GL_EQUAL
+	if (parameters.depthPrePass)
+		prefixVertex << "invariant gl_Position;" << "\n";
 	prefixVertex << "#define attribute in" << "\n";
 	prefixVertex << "#define varying out" << "\n";
 	prefixVertex << "#define texture2D texture" << "\n";
@@ -189,6 +205,11 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 
 	if (parameters.flatShading) prefixVertex << "#define FLAT_SHADED\n";
 
+	if (parameters.vertexQuantization & VertexQuantizationType_Position) prefixVertex << "#define QUANTIZED_POSITION\n";
+	if (parameters.vertexQuantization & VertexQuantizationType_Normal) prefixVertex << "#define QUANTIZED_NORMAL\n";
+	if (parameters.vertexQuantization & VertexQuantizationType_Tangent) prefixVertex << "#define QUANTIZED_TANGENT\n";
+	if (parameters.vertexQuantization & VertexQuantizationType_UvUnorm16) prefixVertex << "#define QUANTIZED_UV\n";
+
 	if (parameters.skinning) prefixVertex << "#define USE_SKINNING\n";
 	if (parameters.useVertexTexture) prefixVertex << "#define BONE_TEXTURE\n";
 
@@ -200,6 +221,7 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 
 	if (parameters.shadowMapEnabled) prefixVertex << "#define USE_SHADOWMAP\n";
 	if (parameters.shadowMapEnabled) prefixVertex << "#define " << shadowMapTypeDefine << "\n";
+	if (parameters.shadowMapEnabled && parameters.numDirLightCascades > 1) prefixVertex << "#define USE_CSM\n";
 
 	if (parameters.sizeAttenuation) prefixVertex << "#define USE_SIZEATTENUATION\n";
 
@@ -241,11 +263,29 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 	prefixVertex << "uniform mat4 osg_ModelViewProjectionMatrix;\n";
 
 	prefixVertex << "attribute vec3 position;\n";
-	prefixVertex << "attribute vec3 normal;\n";
+	prefixVertex << "#ifdef QUANTIZED_POSITION\n";
+	prefixVertex << "	uniform mat4 positionDequant;\n";
+	prefixVertex << "#endif\n";
+	prefixVertex << "#ifdef QUANTIZED_NORMAL\n";
+	prefixVertex << "	attribute vec2 normal;\n";
+	prefixVertex << "#else\n";
+	prefixVertex << "	attribute vec3 normal;\n";
+	prefixVertex << "#endif\n";
 	prefixVertex << "attribute vec2 uv;\n";
+	prefixVertex << "#ifdef QUANTIZED_UV\n";
+	prefixVertex << "	uniform vec4 uvDequant;\n";
+	prefixVertex << "	uniform vec4 uv2Dequant;\n";
+	prefixVertex << "#endif\n";
 	prefixVertex << "#ifdef USE_TANGENT\n";
 	prefixVertex << "	attribute vec4 tangent;\n";
 	prefixVertex << "#endif\n";
+	prefixVertex << "#if defined( QUANTIZED_NORMAL ) || defined( QUANTIZED_TANGENT )\n";
+	prefixVertex << "vec3 octDecode( vec2 e ) {\n";
+	prefixVertex << "	vec3 v = vec3( e, 1.0 - abs( e.x ) - abs( e.y ) );\n";
+	prefixVertex << "	if ( v.z < 0.0 ) v.xy = ( 1.0 - abs( v.yx ) ) * vec2( v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0 );\n";
+	prefixVertex << "	return normalize( v );\n";
+	prefixVertex << "}\n";
+	prefixVertex << "#endif\n";
 
 	prefixVertex << "#ifdef USE_COLOR\n";
 	prefixVertex << "	attribute vec3 color;\n";
@@ -277,10 +317,23 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 	prefixFragment << "#version " << parameters.glslversion << "\n";
 	prefixFragment << "#define varying in" << "\n";
 
-	prefixFragment << "out highp vec4 pc_fragColor;" << "\n";
+	//the OIT variant keeps the color of the material in a variable, the main appended below writes the weighted sums
+	if (parameters.weightedBlendedOit)
+	{
+		prefixFragment << "layout(location = 0) out highp vec4 oit_accum;" << "\n";
+		prefixFragment << "layout(location = 1) out highp vec4 oit_coverage;" << "\n";
+		prefixFragment << "highp vec4 pc_fragColor;" << "\n";
+		prefixFragment << "#define main oit_main" << "\n";
+	}
+	else
+	{
+		prefixFragment << "out highp vec4 pc_fragColor;" << "\n";
+	}
 	prefixFragment << "#define gl_FragColor pc_fragColor" << "\n";
 	prefixFragment << precision << "\n";
 	prefixFragment << customDefines << "\n";
+	if (!parameters.materialBlock.empty())
+		prefixFragment << "layout(std140) uniform MaterialBlock {\n" << parameters.materialBlock << "};\n";
 
 	prefixFragment << "#define texture2D texture" << "\n";
 	prefixFragment << "#define textureCube texture" << "\n";
@@ -334,6 +387,9 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 
 	if (parameters.shadowMapEnabled) prefixFragment << "#define USE_SHADOWMAP\n";
 	if (parameters.shadowMapEnabled) prefixFragment << "#define " << shadowMapTypeDefine << "\n";
+	if (parameters.shadowMapEnabled && parameters.shadowMapDepthTexture) prefixFragment << "#define SHADOWMAP_DEPTH_TEXTURE\n";
+	if (parameters.shadowMapEnabled && parameters.numDirLightCascades > 1) prefixFragment << "#define USE_CSM\n";
+	if (parameters.shadowMapEnabled && parameters.numDirLightCascades > 1) prefixFragment << "#define CSM_CASCADES " << parameters.numDirLightCascades << "\n";
 
 	if (parameters.premultipliedAlpha) prefixFragment << "#define PREMULTIPLIED_ALPHA\n";
 
@@ -387,10 +443,12 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 
 	std::string vertexGlsl;
 	std::string fragmentGlsl;
+	std::string geometryGlsl;
 	if (parameters.isRaw)
 	{
 		vertexGlsl = parameters.vertex;
 		fragmentGlsl = parameters.fragment;
+		geometryGlsl = parameters.geometry;
 	}
 	else
 	{
@@ -398,19 +456,36 @@ Program::Program(const std::string& cacheKey, const ProgramParameters& parameter
 		vertexShader = replaceLightNums(vertexShader, parameters);
 		vertexShader = replaceClippingPlaneNums(vertexShader, parameters);
 		vertexShader = unrollLoops(vertexShader);
+		vertexShader = replaceMaterialBlock(vertexShader, parameters);
 
 		std::string fragmentShader = resolveIncludes(parameters.fragment);
 		fragmentShader = replaceLightNums(fragmentShader, parameters);
 		fragmentShader = replaceClippingPlaneNums(fragmentShader, parameters);
 		fragmentShader = unrollLoops(fragmentShader);
+		fragmentShader = replaceMaterialBlock(fragmentShader, parameters);
 
 		vertexGlsl = prefixVertex.str() + vertexShader;
 		fragmentGlsl = prefixFragment.str() + fragmentShader;
+		if (parameters.weightedBlendedOit)
+			fragmentGlsl += generateWeightedBlendedOitMain();
+
+		//the geometry stage only gets the version and the defines, it may still declare its extensions
+		if (!parameters.geometry.empty())
+		{
+			std::stringstream prefixGeometry;
+			prefixGeometry << "#version " << parameters.glslversion << "\n";
+			prefixGeometry << customDefines << "\n";
+			geometryGlsl = prefixGeometry.str() + resolveIncludes(parameters.geometry);
+		}
 	}
 
 	_osgProgram = new osg::Program();
 	_osgProgram->addShader(new osg::Shader(osg::Shader::VERTEX, vertexGlsl));
 	_osgProgram->addShader(new osg::Shader(osg::Shader::FRAGMENT, fragmentGlsl));
+	if (!geometryGlsl.empty())
+		_osgProgram->addShader(new osg::Shader(osg::Shader::GEOMETRY, geometryGlsl));
+	if (!parameters.isRaw && !parameters.materialBlock.empty())
+		_osgProgram->addBindUniformBlock("MaterialBlock", MATERIAL_BLOCK_BINDING);
 }
 
 ShaderObject* Program::getShaderObject(const std::string& name)
@@ -427,6 +502,26 @@ ShaderObject* Program::getShaderObject(const std::string& name)
 	return nullptr;
 }
 
+//weights of McGuire and Bavoil, near and opaque fragments count more, the coverage target keeps 1 - the product of (1 - alpha)
+std::string Program::generateWeightedBlendedOitMain()
+{
+	std::stringstream ss;
+	ss << "#undef main\n";
+	ss << "void main() {\n";
+	ss << "	oit_main();\n";
+	ss << "	float alpha = clamp( pc_fragColor.a, 0.0, 1.0 );\n";
+	ss << "#ifdef PREMULTIPLIED_ALPHA\n";
+	ss << "	vec3 color = pc_fragColor.rgb;\n";
+	ss << "#else\n";
+	ss << "	vec3 color = pc_fragColor.rgb * alpha;\n";
+	ss << "#endif\n";
+	ss << "	float weight = clamp( pow( min( 1.0, alpha * 10.0 ) + 0.01, 3.0 ) * 1e8 * pow( 1.0 - gl_FragCoord.z * 0.9, 3.0 ), 1e-2, 3e3 );\n";
+	ss << "	oit_accum = vec4( color, alpha ) * weight;\n";
+	ss << "	oit_coverage = vec4( alpha );\n";
+	ss << "}\n";
+	return ss.str();
+}
+
 std::string Program::generatePrecision(const ProgramParameters& parameters)
 {
 	std::stringstream ss;
@@ -563,6 +658,23 @@ std::string Program::unrollLoops(const std::string& shaderText)
 	});
 }
 
+std::string Program::replaceMaterialBlock(const std::string& shaderText, const ProgramParameters& parameters)
+{
+	if (parameters.materialBlock.empty())
+		return shaderText;
+
+	//the block members replace the loose declarations of the chunks
+	std::stringstream names;
+	std::regex memberPattern("\\w+ (\\w+);");
+	for (std::sregex_iterator iter(parameters.materialBlock.begin(), parameters.materialBlock.end(), memberPattern); iter != std::sregex_iterator(); iter++)
+	{
+		names << (names.tellp() > 0 ? "|" : "") << iter->str(1);
+	}
+
+	std::regex pattern("[ \\t]*uniform\\s+(?:(?:lowp|mediump|highp)\\s+)?\\w+\\s+(?:" + names.str() + ")\\s*;");
+	return std::regex_replace(shaderText, pattern, "");
+}
+
 std::string Program::generateDefines(const ProgramParameters& parameters)
 {
 	std::stringstream ss;
@@ -778,6 +890,7 @@ void ProgramGenerator::getParameters(Material* material, osg::Camera* camera, os
 		parameters.numDirLightShadows = renderState->getShadowNumOfType(LightType_Direction);
 		parameters.numSpotLightShadows = renderState->getShadowNumOfType(LightType_Spot);
 		parameters.numPointLightShadows = renderState->getShadowNumOfType(LightType_Point);
+		parameters.numDirLightCascades = renderState->getShadowCascadeCount();
 
 		parameters.fog = renderState->getFog().valid();
 		if (parameters.fog)
@@ -794,10 +907,15 @@ void ProgramGenerator::getParameters(Material* material, osg::Camera* camera, os
 		{
 			parameters.shadowMapEnabled = shadowMap->isEnable();
 			parameters.shadowMapType = shadowMap->getMapType();
+			parameters.shadowMapDepthTexture = shadowMap->getDepthTextureEnable() && (shadowMap->getMapType() != ShadowMapType_VSMShadowMap);
 		}
 
 		parameters.physicallyCorrectLights = renderState->getPhysicallyCorrectLights();
 
+		parameters.depthPrePass = renderState->getDepthPrePassEnable();
+
+		parameters.weightedBlendedOit = renderState->getWeightedBlendedOitEnable() && material->supportsWeightedBlendedOit();
+
 		parameters.logarithmicDepthBuffer = renderState->getLogarithmicDepthBuffer();
 		parameters.rendererExtensionFragDepth = parameters.logarithmicDepthBuffer;
 
@@ -853,17 +971,25 @@ std::string ProgramGenerator::getKey(const ProgramParameters& parameters)
 
 	ss << parameters.instancing;
 
+	ss << parameters.vertexQuantization;
+
 	ss << parameters.sheen;
 
-	ss << parameters.shadowMapEnabled << parameters.shadowMapType;
+	ss << parameters.shadowMapEnabled << parameters.shadowMapType << parameters.shadowMapDepthTexture;
 
 	ss << parameters.numDirLightShadows << parameters.numSpotLightShadows << parameters.numPointLightShadows;
 
+	ss << parameters.numDirLightCascades;
+
+	ss << parameters.depthPrePass << parameters.weightedBlendedOit;
+
 	ss << parameters.numClippingPlanes << parameters.numClipIntersection;
 
 	ss << parameters.numDirLights << parameters.numPointLights << parameters.numSpotLights << parameters.numRectAreaLights << parameters.numHemiLights;
 
-	ss << parameters.vertex << parameters.fragment;
+	ss << parameters.vertex << parameters.fragment << parameters.geometry;
+
+	ss << parameters.materialBlock;
 
 	return ss.str();
 }
@@ -873,9 +999,22 @@ osg::ref_ptr<Program> ProgramGenerator::getOrCreateProgram(const std::string& ca
 	ProgramMap::iterator iter = _cachePrograms.find(cacheKey);
 	if (iter != _cachePrograms.end())
 	{
+		OSGTHREEJSX_COUNT(InstrumentCounter_ProgramCacheHits, 1);
 		return iter->second;
 	}
+
+	OSGTHREEJSX_SCOPED_TIMER(InstrumentTimer_ProgramCreate);
+	OSGTHREEJSX_COUNT(InstrumentCounter_ProgramBuilds, 1);
+	ScopedTrace trace("Program create", "program");
 	osg::ref_ptr<Program> program = new Program(cacheKey, parameters);
+	if (trace.isActive() && program->getOsgProgram().valid())
+	{
+		//bytes of the generated shader sources
+		long long sourceSize = 0;
+		for (unsigned int i = 0; i < program->getOsgProgram()->getNumShaders(); i++)
+			sourceSize += program->getOsgProgram()->getShader(i)->getShaderSource().size();
+		trace.setArg("sourceSize", sourceSize);
+	}
 	_cachePrograms[cacheKey] = program;
 	return program;
 }
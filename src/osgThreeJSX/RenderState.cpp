@@ -10,11 +10,39 @@
 #include <osgThreeJSX/ProbeLight>
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/Materials>
+#include <osgThreeJSX/Instrumentation>
+#include <osgThreeJSX/Tracer>
 #include <osg/ShapeDrawable>
 #include <osg/Depth>
+#include <osg/ColorMask>
+#include <osg/BlendFunc>
+#include <osg/BlendFunci>
+#include <osg/BlendEquation>
+#include <osg/GLExtensions>
 #include <osg/TextureCubeMap>
+#include <osg/Stats>
+#include <osgUtil/StateGraph>
+#include <osgUtil/RenderLeaf>
+#include <cfloat>
+#include <algorithm>
+#include <sstream>
 using namespace osgThreeJSX;
 
+#ifndef GL_R8
+#define GL_R8 0x8229
+#endif
+
+//after the opaque bins and before the depth sorted bin of the transparent materials left out of OIT
+static const int g_weightedBlendedOitBin = 9;
+
+//the light uniforms are written every cull, they count as touched like the material writes
+template<typename ValueType>
+static void setLightUniform(osg::StateSet* stateset, const char* name, osg::Uniform::Type type, const ValueType& value)
+{
+	stateset->getOrCreateUniform(name, type)->set(value);
+	OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, 1);
+}
+
 //////////////////////////////////////////////////////////////////////////
 class RenderCameraCullCallback : public osg::NodeCallback
 {
@@ -28,7 +56,17 @@ public:
 		osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
 		if (cv)
 		{
+			ScopedTrace trace("RenderState cull", "cull");
+			if (trace.isActive() && cv->getFrameStamp())
+				trace.setArg("frame", cv->getFrameStamp()->getFrameNumber());
+
 			_renderState->onCull(cv);
+
+			if (_renderState->beginDepthPrePass(cv))
+			{
+				traverse(node, nv);
+				_renderState->endDepthPrePass(cv);
+			}
 		}
 		traverse(node, nv);
 	}
@@ -64,6 +102,42 @@ RenderState::RenderState()
 	setPhysicallyCorrectLights(false);
 
 	_bgEnv = nullptr;
+
+	_sortEnable = true;
+	_programSwitches = 0;
+	_frameNumber = 0;
+	_opaqueSort = new MaterialSortCallback(this, false);
+	_transparentSort = new MaterialSortCallback(this, true);
+
+	//the pre-pass goes to bin -1, before every opaque draw
+	_depthPrePassEnable = false;
+	_depthPrePass = false;
+	_depthPrePassStateSet = new osg::StateSet();
+	_depthPrePassStateSet->setAttributeAndModes(new osg::Depth(osg::Depth::LESS, 0.0, 1.0, true), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
+	_depthPrePassStateSet->setAttributeAndModes(new osg::ColorMask(false, false, false, false), osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE);
+	_depthPrePassStateSet->setRenderBinDetails(-1, "RenderBin", osg::StateSet::OVERRIDE_RENDERBIN_DETAILS);
+
+	//bin 1 keeps the depth tested draws apart, their samples are counted there
+	_depthEqualStateSet = new osg::StateSet();
+	_depthEqualStateSet->setAttributeAndModes(new osg::Depth(osg::Depth::EQUAL, 0.0, 1.0, false), osg::StateAttribute::ON);
+	_depthEqualStateSet->setRenderBinDetails(1, "RenderBin");
+
+	_prePassSamples = new SamplesPassedCallback();
+	_mainPassSamples = new SamplesPassedCallback();
+
+	//buffer 0 sums the weighted colors, buffer 1 the coverage 1 - (1 - a0)(1 - a1)...
+	//the material state set is pushed first and overrides its blending, PROTECTED keeps these
+	_weightedBlendedOitEnable = false;
+	_weightedBlendedOitStateSet = new osg::StateSet();
+	osg::StateAttribute::GLModeValue oitValue = osg::StateAttribute::ON | osg::StateAttribute::OVERRIDE | osg::StateAttribute::PROTECTED;
+	_weightedBlendedOitStateSet->setMode(GL_BLEND, oitValue);
+	_weightedBlendedOitStateSet->setAttributeAndModes(new osg::Depth(osg::Depth::LESS, 0.0, 1.0, false), oitValue);
+	_weightedBlendedOitStateSet->setAttributeAndModes(new osg::BlendEquation(osg::BlendEquation::FUNC_ADD), oitValue);
+	_weightedBlendedOitStateSet->setAttributeAndModes(new osg::BlendFunci(0, osg::BlendFunc::ONE, osg::BlendFunc::ONE), oitValue);
+	_weightedBlendedOitStateSet->setAttributeAndModes(new osg::BlendFunci(1, osg::BlendFunc::ONE_MINUS_DST_COLOR, osg::BlendFunc::ONE), oitValue);
+	_weightedBlendedOitStateSet->setRenderBinDetails(g_weightedBlendedOitBin, "RenderBin", osg::StateSet::OVERRIDE_RENDERBIN_DETAILS);
+	//the material state set above puts its draws in the depth sorted bin, the OIT bin must be a bin of the stage
+	_weightedBlendedOitStateSet->setNestRenderBins(false);
 }
 
 RenderState* RenderState::FromCamera(osg::Camera* camera)
@@ -88,6 +162,263 @@ void RenderState::setupCamera(osg::Camera* camera, Light* light)
 	camera->addCullCallback(_cameraCallback);
 }
 
+void RenderState::setOcclusionCullingEnable(bool flag)
+{
+	if (!flag)
+		_occlusionCuller = NULL;
+	else if (!_occlusionCuller.valid())
+		_occlusionCuller = new OcclusionCuller();
+}
+
+void RenderState::addProgramSwitches(unsigned int count)
+{
+	_programSwitches += count;
+
+	osg::Stats* stats = _camera.valid() ? _camera->getStats() : NULL;
+	if (stats && stats->collectStats("rendering"))
+		stats->setAttribute(_frameNumber, "Program switches", _programSwitches);
+}
+
+bool RenderState::beginDepthPrePass(osgUtil::CullVisitor* cv)
+{
+	if (!getDepthPrePassEnable())
+		return false;
+
+	osgUtil::RenderBin* renderBin = cv->getCurrentRenderBin();
+	if (renderBin)
+	{
+		osgUtil::RenderBin* prePassBin = renderBin->find_or_insert(-1, "RenderBin");
+		osgUtil::RenderBin* depthEqualBin = renderBin->find_or_insert(1, "RenderBin");
+		prePassBin->setDrawCallback(_prePassSamples.get());
+		depthEqualBin->setDrawCallback(_mainPassSamples.get());
+		if (_sortEnable)
+		{
+			prePassBin->setSortCallback(_opaqueSort.get());
+			depthEqualBin->setSortCallback(_opaqueSort.get());
+		}
+	}
+
+	osg::Stats* stats = _camera->getStats();
+	if (stats && stats->collectStats("rendering"))
+		stats->setAttribute(_frameNumber, "Depth pre-pass saved fragments", getDepthPrePassSavedFragments());
+
+	_depthPrePass = true;
+	cv->pushStateSet(_depthPrePassStateSet.get());
+	return true;
+}
+
+void RenderState::endDepthPrePass(osgUtil::CullVisitor* cv)
+{
+	cv->popStateSet();
+	_depthPrePass = false;
+}
+
+unsigned int RenderState::getDepthPrePassSavedFragments()
+{
+	unsigned int prePass = _prePassSamples->getSamples();
+	unsigned int mainPass = _mainPassSamples->getSamples();
+	return prePass > mainPass ? prePass - mainPass : 0;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void SamplesPassedCallback::drawImplementation(osgUtil::RenderBin* bin, osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous)
+{
+#if defined(OSG_GLES2_AVAILABLE) || defined(OSG_GLES3_AVAILABLE)
+	//GL_SAMPLES_PASSED is not available in GLES
+	bin->drawImplementation(renderInfo, previous);
+#else
+	unsigned int contextID = renderInfo.getContextID();
+	osg::GLExtensions* ext = renderInfo.getState()->get<osg::GLExtensions>();
+	if (!ext->isOcclusionQuerySupported && !ext->isARBOcclusionQuerySupported)
+	{
+		bin->drawImplementation(renderInfo, previous);
+		return;
+	}
+
+	if (_queries.size() <= contextID)
+		_queries.resize(contextID + 1);
+
+	Query& query = _queries[contextID];
+	if (!query._id)
+	{
+		ext->glGenQueries(1, &query._id);
+	}
+	else if (query._pending)
+	{
+		GLint available = 0;
+		ext->glGetQueryObjectiv(query._id, GL_QUERY_RESULT_AVAILABLE_ARB, &available);
+		if (available)
+		{
+			GLuint samples = 0;
+			ext->glGetQueryObjectuiv(query._id, GL_QUERY_RESULT_ARB, &samples);
+			_samples = samples;
+			query._pending = false;
+		}
+	}
+
+	//a query still in flight is not restarted, the bin is drawn without it
+	if (query._pending)
+	{
+		bin->drawImplementation(renderInfo, previous);
+		return;
+	}
+
+	ext->glBeginQuery(GL_SAMPLES_PASSED_ARB, query._id);
+	bin->drawImplementation(renderInfo, previous);
+	ext->glEndQuery(GL_SAMPLES_PASSED_ARB);
+	query._pending = true;
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////
+WeightedBlendedOitCallback::WeightedBlendedOitCallback(const std::string& glslversion, const std::string& precision) :
+	_width(0),
+	_height(0),
+	_unsupportedReported(false)
+{
+	std::stringstream vertex, fragment;
+	vertex << "#version " << glslversion << "\n";
+	vertex << "in vec3 position;\n";
+	vertex << "void main() {\n";
+	vertex << "	gl_Position = vec4( position.xy, 0.0, 1.0 );\n";
+	vertex << "}\n";
+
+	//average color of the layers, its alpha is the coverage so the frame keeps 1 - coverage of its color
+	fragment << "#version " << glslversion << "\n";
+	fragment << "precision " << precision << " float;\n";
+	fragment << "uniform sampler2D oitAccum;\n";
+	fragment << "uniform sampler2D oitCoverage;\n";
+	fragment << "out highp vec4 pc_fragColor;\n";
+	fragment << "void main() {\n";
+	fragment << "	ivec2 coord = ivec2( gl_FragCoord.xy );\n";
+	fragment << "	float coverage = texelFetch( oitCoverage, coord, 0 ).r;\n";
+	fragment << "	if ( coverage <= 0.0 ) discard;\n";
+	fragment << "	vec4 accum = texelFetch( oitAccum, coord, 0 );\n";
+	fragment << "	pc_fragColor = vec4( accum.rgb / max( accum.a, 1e-5 ), coverage );\n";
+	fragment << "}\n";
+
+	osg::ref_ptr<osg::Program> program = new osg::Program();
+	program->addShader(new osg::Shader(osg::Shader::VERTEX, vertex.str()));
+	program->addShader(new osg::Shader(osg::Shader::FRAGMENT, fragment.str()));
+	program->addBindAttribLocation("position", 0);
+
+	_compositeStateSet = new osg::StateSet();
+	_compositeStateSet->setAttributeAndModes(program.get(), osg::StateAttribute::ON);
+	_compositeStateSet->addUniform(new osg::Uniform("oitAccum", 0));
+	_compositeStateSet->addUniform(new osg::Uniform("oitCoverage", 1));
+	_compositeStateSet->setMode(GL_BLEND, osg::StateAttribute::ON);
+	_compositeStateSet->setAttributeAndModes(new osg::BlendFunc(osg::BlendFunc::SRC_ALPHA, osg::BlendFunc::ONE_MINUS_SRC_ALPHA), osg::StateAttribute::ON);
+	_compositeStateSet->setMode(GL_DEPTH_TEST, osg::StateAttribute::OFF);
+	_compositeStateSet->setMode(GL_CULL_FACE, osg::StateAttribute::OFF);
+
+	//one triangle covering the viewport
+	osg::ref_ptr<osg::Vec3Array> vertices = new osg::Vec3Array();
+	vertices->push_back(osg::Vec3(-1.0f, -1.0f, 0.0f));
+	vertices->push_back(osg::Vec3(3.0f, -1.0f, 0.0f));
+	vertices->push_back(osg::Vec3(-1.0f, 3.0f, 0.0f));
+	_compositeGeometry = new osg::Geometry();
+	_compositeGeometry->setVertexArray(vertices.get());
+	_compositeGeometry->addPrimitiveSet(new osg::DrawArrays(GL_TRIANGLES, 0, 3));
+	_compositeGeometry->setUseDisplayList(false);
+	_compositeGeometry->setUseVertexBufferObjects(true);
+}
+
+void WeightedBlendedOitCallback::resize(int width, int height)
+{
+	_width = width;
+	_height = height;
+
+	_accum = new osg::Texture2D();
+	_accum->setTextureSize(width, height);
+	_accum->setInternalFormat(GL_RGBA16F_ARB);
+	_accum->setSourceFormat(GL_RGBA);
+	_accum->setSourceType(GL_FLOAT);
+
+	_coverage = new osg::Texture2D();
+	_coverage->setTextureSize(width, height);
+	_coverage->setInternalFormat(GL_R8);
+	_coverage->setSourceFormat(GL_RED);
+	_coverage->setSourceType(GL_UNSIGNED_BYTE);
+
+	osg::Texture2D* textures[] = { _accum.get(), _coverage.get() };
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		textures[i]->setFilter(osg::Texture::MIN_FILTER, osg::Texture::NEAREST);
+		textures[i]->setFilter(osg::Texture::MAG_FILTER, osg::Texture::NEAREST);
+		textures[i]->setWrap(osg::Texture::WRAP_S, osg::Texture::CLAMP_TO_EDGE);
+		textures[i]->setWrap(osg::Texture::WRAP_T, osg::Texture::CLAMP_TO_EDGE);
+		textures[i]->setResizeNonPowerOfTwoHint(false);
+		_compositeStateSet->setTextureAttributeAndModes(i, textures[i], osg::StateAttribute::ON);
+	}
+
+	_fbo = new osg::FrameBufferObject();
+	_fbo->setAttachment(osg::Camera::COLOR_BUFFER0, osg::FrameBufferAttachment(_accum.get()));
+	_fbo->setAttachment(osg::Camera::COLOR_BUFFER1, osg::FrameBufferAttachment(_coverage.get()));
+	_fbo->setAttachment(osg::Camera::PACKED_DEPTH_STENCIL_BUFFER, osg::FrameBufferAttachment(new osg::RenderBuffer(width, height, GL_DEPTH24_STENCIL8_EXT)));
+}
+
+void WeightedBlendedOitCallback::drawImplementation(osgUtil::RenderBin* bin, osg::RenderInfo& renderInfo, osgUtil::RenderLeaf*& previous)
+{
+	if (bin->getStateGraphList().empty() && bin->getRenderLeafList().empty())
+		return;
+
+	osg::State& state = *renderInfo.getState();
+	osg::GLExtensions* ext = state.get<osg::GLExtensions>();
+	if (!ext->isFrameBufferObjectSupported || !ext->glBlitFramebuffer || !ext->glBlendFunci)
+	{
+		if (!_unsupportedReported)
+		{
+			OSG_WARN << "osgThreeJSX::WeightedBlendedOitCallback: framebuffer blits or per buffer blending are not supported, the transparent draws are skipped" << std::endl;
+			_unsupportedReported = true;
+		}
+		return;
+	}
+
+	const osg::Viewport* viewport = state.getCurrentViewport();
+	if (!viewport)
+		return;
+	int width = (int)(viewport->x() + viewport->width());
+	int height = (int)(viewport->y() + viewport->height());
+	if (width <= 0 || height <= 0)
+		return;
+	if (!_fbo.valid() || width != _width || height != _height)
+		resize(width, height);
+
+	//the previous leaf left its state applied, the bin and the composite start from the state of the stage
+	if (previous)
+	{
+		osgUtil::StateGraph::moveToRootStateGraph(state, previous->_parent);
+		state.apply();
+		previous = NULL;
+	}
+
+	GLint frameBuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING_EXT, &frameBuffer);
+
+	//the layers are depth tested against the opaque scene already drawn into the frame
+	_fbo->apply(state, osg::FrameBufferObject::READ_DRAW);
+	ext->glBindFramebuffer(GL_READ_FRAMEBUFFER_EXT, frameBuffer);
+	ext->glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	bin->drawImplementation(renderInfo, previous);
+
+	if (previous)
+	{
+		osgUtil::StateGraph::moveToRootStateGraph(state, previous->_parent);
+		state.apply();
+		previous = NULL;
+	}
+	ext->glBindFramebuffer(GL_FRAMEBUFFER_EXT, frameBuffer);
+
+	state.pushStateSet(_compositeStateSet.get());
+	state.apply();
+	_compositeGeometry->draw(renderInfo);
+	state.popStateSet();
+	state.apply();
+}
+
 void RenderState::setupShadow(osg::Node* root, ShadowMapType mapType)
 {
 	_shadowMap = new ShadowMap();
@@ -96,13 +427,51 @@ void RenderState::setupShadow(osg::Node* root, ShadowMapType mapType)
 
 void RenderState::onCull(osgUtil::CullVisitor* cv)
 {
+	OSGTHREEJSX_SCOPED_TIMER(InstrumentTimer_RenderStateCull);
+
 	auto stateset = _camera->getOrCreateStateSet();
 	stateset->getOrCreateUniform("osg_ViewMatrix", osg::Uniform::FLOAT_MAT4)->set(_camera->getViewMatrix());
 	stateset->getOrCreateUniform("osg_ViewMatrixInverse", osg::Uniform::FLOAT_MAT4)->set(_camera->getInverseViewMatrix());
 
+	//shadow cameras only hand out the instance data unit
+	_textureUnits.beginFrame(cv->getState()->getMaxTextureUnits());
+
 	if (getShadowLight())
 		return;
 
+	//the stage and its depth sorted bin are rebuilt every frame, the callbacks sort them after the traversal
+	_programSwitches = 0;
+	_frameNumber = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0;
+	//everything gathered since the last main camera cull belongs to the previous frame
+	if (_frameNumber > 0)
+		OSGTHREEJSX_END_FRAME(_frameNumber - 1, _camera->getStats());
+	osgUtil::RenderBin* renderBin = cv->getCurrentRenderBin();
+	if (_sortEnable && renderBin)
+	{
+		renderBin->setSortCallback(_opaqueSort.get());
+		renderBin->find_or_insert(10, "DepthSortedBin")->setSortCallback(_transparentSort.get());
+	}
+
+	//the OIT bin is only sorted by state, its callback accumulates and composites it
+	if (getWeightedBlendedOitEnable() && renderBin)
+	{
+		if (!_weightedBlendedOitComposite.valid())
+			_weightedBlendedOitComposite = new WeightedBlendedOitCallback(_capabilities.glslversion, _capabilities.precision);
+		renderBin->find_or_insert(g_weightedBlendedOitBin, "RenderBin")->setDrawCallback(_weightedBlendedOitComposite.get());
+	}
+
+	//counts of the previous frame, then the occluders of this one
+	if (_occlusionCuller.valid())
+	{
+		osg::Stats* stats = _camera->getStats();
+		if (stats && stats->collectStats("rendering") && _frameNumber > 0)
+		{
+			stats->setAttribute(_frameNumber - 1, "Occlusion tested", _occlusionCuller->getTestedCount());
+			stats->setAttribute(_frameNumber - 1, "Occlusion culled", _occlusionCuller->getOccludedCount());
+		}
+		_occlusionCuller->beginFrame(_camera.get(), cv);
+	}
+
 	if (_shadowMap)
 		_shadowMap->onCull(this, cv);
 
@@ -128,28 +497,32 @@ void RenderState::onCull(osgUtil::CullVisitor* cv)
 		ambient += light->getColor() * light->getIntensity();
 		intensity += light->getIntensity();
 	}
-	stateset->getOrCreateUniform("ambientLightColor", osg::Uniform::FLOAT_VEC3)->set(ambient);
-	stateset->getOrCreateUniform("ambientLightIntensity", osg::Uniform::FLOAT)->set(intensity);
+	setLightUniform(stateset, "ambientLightColor", osg::Uniform::FLOAT_VEC3, ambient);
+	setLightUniform(stateset, "ambientLightIntensity", osg::Uniform::FLOAT, intensity);
+
+	//shadows left out of the previous frame may get a unit again
+	_skippedShadows.clear();
 
-	///TODO:ugly, -1 reserve for geometry instance data texture
-	int textureUnit = cv->getState()->getMaxTextureUnits() - 2;
 	//direction
-	updateDirectionLight(cv, textureUnit);
+	updateDirectionLight(cv);
 
 	//point
-	updatePointLight(cv, textureUnit);
+	updatePointLight(cv);
 
 	//spot
-	updateSpotLight(cv, textureUnit);
+	updateSpotLight(cv);
 
 	//hemisphere
-	updateHemisphereLight(cv, textureUnit);
+	updateHemisphereLight(cv);
 
 	//RectArea
-	updateRectAreaLight(cv, textureUnit);
+	updateRectAreaLight(cv);
 
 	//Probe
-	updateProbeLight(cv, textureUnit);
+	updateProbeLight(cv);
+
+	//lights removed since the last frame give their units back
+	_textureUnits.endFrame(stateset);
 
 	//fog
 	if (getFog())
@@ -187,18 +560,200 @@ void RenderState::onCull(osgUtil::CullVisitor* cv)
 
 }
 
-void RenderState::useTextureUnit(int& textureUnit)
+//////////////////////////////////////////////////////////////////////////
+struct MaterialSortKey
 {
-	textureUnit--;
+	const osg::StateAttribute* _program;
+	size_t _textures;
+};
+
+//the closest program and the textures of all units along the state graph path
+static MaterialSortKey computeSortKey(osgUtil::StateGraph* stateGraph)
+{
+	MaterialSortKey key = { NULL, 0 };
+	for (osgUtil::StateGraph* sg = stateGraph; sg; sg = sg->_parent)
+	{
+		const osg::StateSet* stateset = sg->getStateSet();
+		if (!stateset)
+			continue;
+
+		if (!key._program)
+			key._program = stateset->getAttribute(osg::StateAttribute::PROGRAM);
+
+		const osg::StateSet::TextureAttributeList& units = stateset->getTextureAttributeList();
+		for (size_t unit = 0; unit < units.size(); unit++)
+		{
+			const osg::StateAttribute* texture = stateset->getTextureAttribute(unit, osg::StateAttribute::TEXTURE);
+			if (texture)
+				key._textures = key._textures * 31 + (size_t)texture + unit;
+		}
+	}
+	return key;
 }
 
-void RenderState::updateDirectionLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void MaterialSortCallback::sortImplementation(osgUtil::RenderBin* bin)
+{
+	bin->copyLeavesFromStateGraphListToRenderLeafList();
+	osgUtil::RenderBin::RenderLeafList& leaves = bin->getRenderLeafList();
+
+	//one key per state graph, leaves of the same graph share it
+	std::map<osgUtil::StateGraph*, MaterialSortKey> keys;
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		if (keys.find(leaves[i]->_parent) == keys.end())
+			keys[leaves[i]->_parent] = computeSortKey(leaves[i]->_parent);
+	}
+
+	if (_transparent)
+	{
+		std::stable_sort(leaves.begin(), leaves.end(), [](const osgUtil::RenderLeaf* a, const osgUtil::RenderLeaf* b) {
+			return a->_depth > b->_depth;
+		});
+	}
+	else
+	{
+		std::stable_sort(leaves.begin(), leaves.end(), [&keys](const osgUtil::RenderLeaf* a, const osgUtil::RenderLeaf* b) {
+			const MaterialSortKey& ka = keys[a->_parent];
+			const MaterialSortKey& kb = keys[b->_parent];
+			if (ka._program != kb._program)
+				return ka._program < kb._program;
+			if (ka._textures != kb._textures)
+				return ka._textures < kb._textures;
+			return a->_depth < b->_depth;
+		});
+	}
+
+	unsigned int switches = 0;
+	const osg::StateAttribute* program = NULL;
+	for (size_t i = 0; i < leaves.size(); i++)
+	{
+		const osg::StateAttribute* leafProgram = keys[leaves[i]->_parent]._program;
+		if (i > 0 && leafProgram != program)
+			switches++;
+		program = leafProgram;
+	}
+
+	if (_renderState.valid())
+		_renderState->addProgramSwitches(switches);
+}
+
+//////////////////////////////////////////////////////////////////////////
+const char* TextureUnitAllocator::InstanceDataName = "instanceImage";
+
+TextureUnitAllocator::TextureUnitAllocator()
+{
+	_maxUnits = 0;
+	_materialUnits = 0;
+	_frame = 0;
+	_collisionReported = false;
+}
+
+void TextureUnitAllocator::beginFrame(int maxUnits)
+{
+	_frame++;
+	if (maxUnits == _maxUnits)
+		return;
+
+	_bindings.clear();
+	_unitUsed.assign(maxUnits, false);
+	_maxUnits = maxUnits;
+
+	//always the top unit, whatever the camera
+	if (acquire(InstanceDataName) >= 0)
+		_bindings[InstanceDataName]._persistent = true;
+}
+
+void TextureUnitAllocator::endFrame(osg::StateSet* stateset)
+{
+	for (BindingMap::iterator iter = _bindings.begin(); iter != _bindings.end();)
+	{
+		if (iter->second._persistent || iter->second._frame == _frame)
+		{
+			iter++;
+			continue;
+		}
+
+		if (iter->second._texture.valid())
+			stateset->removeTextureAttribute(iter->second._unit, osg::StateAttribute::TEXTURE);
+		_unitUsed[iter->second._unit] = false;
+		_bindings.erase(iter++);
+	}
+}
+
+int TextureUnitAllocator::acquire(const std::string& name)
+{
+	BindingMap::iterator iter = _bindings.find(name);
+	if (iter != _bindings.end())
+	{
+		iter->second._frame = _frame;
+		return iter->second._unit;
+	}
+
+	int unit = _maxUnits - 1;
+	while (unit >= 0 && _unitUsed[unit])
+	{
+		unit--;
+	}
+	if (unit < 0)
+	{
+		OSG_WARN << "osgThreeJSX: no texture unit left for " << name << std::endl;
+		return -1;
+	}
+
+	_unitUsed[unit] = true;
+	Binding& binding = _bindings[name];
+	binding._unit = unit;
+	binding._frame = _frame;
+	binding._persistent = false;
+	checkCollision(name, unit);
+	return unit;
+}
+
+int TextureUnitAllocator::bind(osg::StateSet* stateset, const std::string& name, osg::Texture* texture)
+{
+	int unit = acquire(name);
+	if (unit < 0)
+		return unit;
+
+	Binding& binding = _bindings[name];
+	if (binding._texture.get() != texture)
+	{
+		stateset->setTextureAttribute(unit, texture);
+		binding._texture = texture;
+	}
+	return unit;
+}
+
+void TextureUnitAllocator::reserveMaterialUnits(int count)
+{
+	if (count <= _materialUnits)
+		return;
+
+	_materialUnits = count;
+	for (BindingMap::iterator iter = _bindings.begin(); iter != _bindings.end(); iter++)
+	{
+		checkCollision(iter->first, iter->second._unit);
+	}
+}
+
+void TextureUnitAllocator::checkCollision(const std::string& name, int unit)
+{
+	if (unit >= _materialUnits || _collisionReported)
+		return;
+
+	OSG_WARN << "osgThreeJSX: texture unit " << unit << " of " << name << " is also used by a material, "
+		<< _materialUnits << " material units and " << _bindings.size() << " camera units exceed " << _maxUnits << std::endl;
+	_collisionReported = true;
+}
+
+void RenderState::updateDirectionLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 	osg::Matrix viewMat = _camera->getViewMatrix();
 
 	LightList* list = getLightsOfType(LightType_Direction);	
 	std::vector<osg::ref_ptr<LightShadow> > shadowLightList;
+	std::vector<int> shadowUnitList;
 
 	for (int i = 0; list && i < list->size(); i++)
 	{
@@ -208,20 +763,33 @@ void RenderState::updateDirectionLight(osgUtil::CullVisitor* cv, int& textureUni
 		sprintf(szUniformName, "directionalLights[%d].direction", i);
 		if (light->isFlow())
 		{
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getDirection());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getDirection());
 		}
 		else
 		{
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(osg::Matrix::transform3x3(osg::Vec3() - light->getDirection(), viewMat));
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, osg::Matrix::transform3x3(osg::Vec3() - light->getDirection(), viewMat));
 		}
 
 		sprintf(szUniformName, "directionalLights[%d].color", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getColor() * light->getIntensity());
 
 		if (light->getCastShadow())
 		{
 			osg::ref_ptr<LightShadow> shadow = light->getShadow();
+			int textureUnit = -1;
+			if (shadow->getMap())
+			{
+				sprintf(szUniformName, "directionalShadowMap[%d]", (int)shadowLightList.size());
+				textureUnit = _textureUnits.bind(stateset, szUniformName, shadow->getMap());
+				//out of units, the shadow is left out for this camera and frame, the light keeps casting
+				if (textureUnit < 0)
+				{
+					_skippedShadows.push_back(light);
+					continue;
+				}
+			}
 			shadowLightList.push_back(shadow);
+			shadowUnitList.push_back(textureUnit);
 		}
 	}
 
@@ -236,27 +804,50 @@ void RenderState::updateDirectionLight(osgUtil::CullVisitor* cv, int& textureUni
 
 			char szUniformName[64] = { 0 };
 			sprintf(szUniformName, "directionalLightShadows[%d].shadowBias", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getBias());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getBias());
 			sprintf(szUniformName, "directionalLightShadows[%d].shadowRadius", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getRadius());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getRadius());
 			sprintf(szUniformName, "directionalLightShadows[%d].shadowMapSize", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC2)->set(shadow->getMapSize());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC2, osg::Vec2(shadow->getMapSize().x() * shadow->_frameExtents.x(), shadow->getMapSize().y() * shadow->_frameExtents.y()));
 
 			if (shadow->getMap())
 			{
-				stateset->setTextureAttribute(textureUnit, shadow->getMap());
-				shadowMapUniform->setElement(i, textureUnit);
+				shadowMapUniform->setElement(i, shadowUnitList[i]);
 
 				shadowMatrixUniform->setElement(i, shadow->getMatrix());
-				useTextureUnit(textureUnit);
+				OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, 2);
 			}
 
 		}
+
+		//lights with fewer cascades repeat their last one, lights without cascades use their single matrix everywhere
+		int cascadeCount = getShadowCascadeCount();
+		if (cascadeCount > 1)
+		{
+			osg::ref_ptr<osg::Uniform> cascadeMatrixUniform = stateset->getOrCreateUniform("directionalShadowCascadeMatrix", osg::Uniform::FLOAT_MAT4, shadowLightList.size() * cascadeCount);
+			osg::ref_ptr<osg::Uniform> cascadeSplitsUniform = stateset->getOrCreateUniform("directionalShadowCascadeSplits", osg::Uniform::FLOAT_VEC4, shadowLightList.size());
+
+			for (size_t i = 0; i < shadowLightList.size(); i++)
+			{
+				osg::ref_ptr<LightShadow> shadow = shadowLightList[i];
+				const std::vector<osg::Matrix>& matrices = shadow->getCascadeMatrices();
+
+				for (int c = 0; c < cascadeCount; c++)
+				{
+					osg::Matrix matrix = matrices.empty() ? shadow->getMatrix() : matrices[osg::minimum((size_t)c, matrices.size() - 1)];
+					cascadeMatrixUniform->setElement(i * cascadeCount + c, matrix);
+				}
+
+				osg::Vec4 splits = matrices.empty() ? osg::Vec4(FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX) : shadow->getCascadeSplits();
+				cascadeSplitsUniform->setElement(i, splits);
+				OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, cascadeCount + 1);
+			}
+		}
 	}
 
 }
 
-void RenderState::updatePointLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void RenderState::updatePointLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 	osg::Matrix viewMat = _camera->getViewMatrix();
@@ -267,6 +858,7 @@ void RenderState::updatePointLight(osgUtil::CullVisitor* cv, int& textureUnit)
 	{
 		PointLight* light;
 		LightShadow* shadow;
+		int textureUnit;
 	};
 	std::vector<PointLightShadowData> shadowLightList;
 
@@ -279,16 +871,16 @@ void RenderState::updatePointLight(osgUtil::CullVisitor* cv, int& textureUnit)
 		osg::Vec3 viewPosition = light->getPosition() * viewMat;
 
 		sprintf(szUniformName, "pointLights[%d].position", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(viewPosition);
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, viewPosition);
 
 		sprintf(szUniformName, "pointLights[%d].color", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getColor() * light->getIntensity());
 
 		sprintf(szUniformName, "pointLights[%d].distance", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(light->getDistance());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, light->getDistance());
 
 		sprintf(szUniformName, "pointLights[%d].decay", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(light->getDecay());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, light->getDecay());
 
 		if (light->getCastShadow())
 		{
@@ -296,6 +888,18 @@ void RenderState::updatePointLight(osgUtil::CullVisitor* cv, int& textureUnit)
 			PointLightShadowData data;
 			data.light = light;
 			data.shadow = shadow;
+			data.textureUnit = -1;
+			if (shadow->getMap())
+			{
+				sprintf(szUniformName, "pointShadowMap[%d]", (int)shadowLightList.size());
+				data.textureUnit = _textureUnits.bind(stateset, szUniformName, shadow->getMap());
+				//out of units, the shadow is left out for this camera and frame, the light keeps casting
+				if (data.textureUnit < 0)
+				{
+					_skippedShadows.push_back(light);
+					continue;
+				}
+			}
 			shadowLightList.push_back(data);
 		}
 	}
@@ -311,29 +915,28 @@ void RenderState::updatePointLight(osgUtil::CullVisitor* cv, int& textureUnit)
 
 			char szUniformName[64] = { 0 };
 			sprintf(szUniformName, "pointLightShadows[%d].shadowBias", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getBias());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getBias());
 			sprintf(szUniformName, "pointLightShadows[%d].shadowRadius", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getRadius());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getRadius());
 			sprintf(szUniformName, "pointLightShadows[%d].shadowMapSize", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC2)->set(shadow->getMapSize());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC2, shadow->getMapSize());
 			sprintf(szUniformName, "pointLightShadows[%d].shadowCameraNear", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(0.1f);
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, 0.1f);
 			sprintf(szUniformName, "pointLightShadows[%d].shadowCameraFar", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadowLightList[i].light->getDistance());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadowLightList[i].light->getDistance());
 
 			if (shadow->getMap())
 			{
-				stateset->setTextureAttribute(textureUnit, shadow->getMap());
-				shadowMapUniform->setElement(i, textureUnit);
+				shadowMapUniform->setElement(i, shadowLightList[i].textureUnit);
 
 				shadowMatrixUniform->setElement(i, shadow->getMatrix());
-				useTextureUnit(textureUnit);
+				OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, 2);
 			}
 		}
 	}
 }
 
-void RenderState::updateSpotLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void RenderState::updateSpotLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 	osg::Matrix viewMat = _camera->getViewMatrix();
@@ -341,6 +944,7 @@ void RenderState::updateSpotLight(osgUtil::CullVisitor* cv, int& textureUnit)
 	LightList* list = getLightsOfType(LightType_Spot);
 
 	std::vector<osg::ref_ptr<LightShadow> > shadowLightList;
+	std::vector<int> shadowUnitList;
 
 	for (int i = 0; list && i < list->size(); i++)
 	{
@@ -350,30 +954,43 @@ void RenderState::updateSpotLight(osgUtil::CullVisitor* cv, int& textureUnit)
 
 		osg::Vec3 viewPosition = light->getPosition() * viewMat;
 		sprintf(szUniformName, "spotLights[%d].position", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(viewPosition);
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, viewPosition);
 
 		sprintf(szUniformName, "spotLights[%d].direction", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(osg::Matrix::transform3x3(osg::Vec3() - light->getDirection(), viewMat));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, osg::Matrix::transform3x3(osg::Vec3() - light->getDirection(), viewMat));
 
 		sprintf(szUniformName, "spotLights[%d].color", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getColor() * light->getIntensity());
 
 		sprintf(szUniformName, "spotLights[%d].distance", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(light->getDistance());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, light->getDistance());
 
 		sprintf(szUniformName, "spotLights[%d].decay", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(light->getDecay());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, light->getDecay());
 
 		sprintf(szUniformName, "spotLights[%d].coneCos", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(cos(light->getAngle()));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, cos(light->getAngle()));
 
 		sprintf(szUniformName, "spotLights[%d].penumbraCos", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(cos(light->getAngle() * (1.0f - light->getPenumbra())));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, cos(light->getAngle() * (1.0f - light->getPenumbra())));
 
 		if (light->getCastShadow())
 		{
 			osg::ref_ptr<LightShadow> shadow = light->getShadow();
+			int textureUnit = -1;
+			if (shadow->getMap())
+			{
+				sprintf(szUniformName, "spotShadowMap[%d]", (int)shadowLightList.size());
+				textureUnit = _textureUnits.bind(stateset, szUniformName, shadow->getMap());
+				//out of units, the shadow is left out for this camera and frame, the light keeps casting
+				if (textureUnit < 0)
+				{
+					_skippedShadows.push_back(light);
+					continue;
+				}
+			}
 			shadowLightList.push_back(shadow);
+			shadowUnitList.push_back(textureUnit);
 		}
 	}
 
@@ -388,25 +1005,24 @@ void RenderState::updateSpotLight(osgUtil::CullVisitor* cv, int& textureUnit)
 
 			char szUniformName[64] = { 0 };
 			sprintf(szUniformName, "spotLightShadows[%d].shadowBias", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getBias());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getBias());
 			sprintf(szUniformName, "spotLightShadows[%d].shadowRadius", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT)->set(shadow->getRadius());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT, shadow->getRadius());
 			sprintf(szUniformName, "spotLightShadows[%d].shadowMapSize", i);
-			stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC2)->set(shadow->getMapSize());
+			setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC2, shadow->getMapSize());
 
 			if (shadow->getMap())
 			{
-				stateset->setTextureAttribute(textureUnit, shadow->getMap());
-				shadowMapUniform->setElement(i, textureUnit);
+				shadowMapUniform->setElement(i, shadowUnitList[i]);
 
 				shadowMatrixUniform->setElement(i, shadow->getMatrix());
-				useTextureUnit(textureUnit);
+				OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, 2);
 			}
 		}
 	}
 }
 
-void RenderState::updateHemisphereLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void RenderState::updateHemisphereLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 	osg::Matrix viewMat = _camera->getViewMatrix();
@@ -420,17 +1036,17 @@ void RenderState::updateHemisphereLight(osgUtil::CullVisitor* cv, int& textureUn
 		char szUniformName[64] = { 0 };
 
 		sprintf(szUniformName, "hemisphereLights[%d].direction", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(osg::Matrix::transform3x3(osg::Vec3()-light->getDirection(), viewMat));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, osg::Matrix::transform3x3(osg::Vec3()-light->getDirection(), viewMat));
 
 		sprintf(szUniformName, "hemisphereLights[%d].skyColor", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getSkyColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getSkyColor() * light->getIntensity());
 
 		sprintf(szUniformName, "hemisphereLights[%d].groundColor", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getGroundColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getGroundColor() * light->getIntensity());
 	}
 }
 
-void RenderState::updateRectAreaLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void RenderState::updateRectAreaLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 	osg::Matrix viewMat = _camera->getViewMatrix();
@@ -439,13 +1055,12 @@ void RenderState::updateRectAreaLight(osgUtil::CullVisitor* cv, int& textureUnit
 
 	if (list && list->size())
 	{
-		stateset->getOrCreateUniform("ltc_1", osg::Uniform::INT)->set(textureUnit);
-		stateset->setTextureAttribute(textureUnit, RectAreaLight::getOrCreateLTC1Texture());
-		useTextureUnit(textureUnit);
-
-		stateset->getOrCreateUniform("ltc_2", osg::Uniform::INT)->set(textureUnit);
-		stateset->setTextureAttribute(textureUnit, RectAreaLight::getOrCreateLTC2Texture());
-		useTextureUnit(textureUnit);
+		int ltc1Unit = _textureUnits.bind(stateset, "ltc_1", RectAreaLight::getOrCreateLTC1Texture());
+		if (ltc1Unit >= 0)
+			setLightUniform(stateset, "ltc_1", osg::Uniform::INT, ltc1Unit);
+		int ltc2Unit = _textureUnits.bind(stateset, "ltc_2", RectAreaLight::getOrCreateLTC2Texture());
+		if (ltc2Unit >= 0)
+			setLightUniform(stateset, "ltc_2", osg::Uniform::INT, ltc2Unit);
 	}
 
 	for (int i = 0; list && i < list->size(); i++)
@@ -457,10 +1072,10 @@ void RenderState::updateRectAreaLight(osgUtil::CullVisitor* cv, int& textureUnit
 		osg::Vec3 viewPosition = light->getPosition() * viewMat;
 
 		sprintf(szUniformName, "rectAreaLights[%d].position", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(viewPosition);
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, viewPosition);
 
 		sprintf(szUniformName, "rectAreaLights[%d].color", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(light->getColor() * light->getIntensity());
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, light->getColor() * light->getIntensity());
 
 		osg::Vec3 direction = light->getDirection();
 		direction.normalize();		
@@ -471,15 +1086,15 @@ void RenderState::updateRectAreaLight(osgUtil::CullVisitor* cv, int& textureUnit
 		mat = invertMat * viewMat;
 
 		sprintf(szUniformName, "rectAreaLights[%d].halfWidth", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(osg::Matrix::transform3x3(osg::Vec3(light->getWidth() / 2.0, 0, 0), mat));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, osg::Matrix::transform3x3(osg::Vec3(light->getWidth() / 2.0, 0, 0), mat));
 
 		sprintf(szUniformName, "rectAreaLights[%d].halfHeight", i);
-		stateset->getOrCreateUniform(szUniformName, osg::Uniform::FLOAT_VEC3)->set(osg::Matrix::transform3x3(osg::Vec3(0, light->getHeight() / 2.0, 0), mat));
+		setLightUniform(stateset, szUniformName, osg::Uniform::FLOAT_VEC3, osg::Matrix::transform3x3(osg::Vec3(0, light->getHeight() / 2.0, 0), mat));
 	}
 }
 
 
-void RenderState::updateProbeLight(osgUtil::CullVisitor* cv, int& textureUnit)
+void RenderState::updateProbeLight(osgUtil::CullVisitor* cv)
 {
 	auto stateset = _camera->getOrCreateStateSet();
 
@@ -511,6 +1126,7 @@ void RenderState::updateProbeLight(osgUtil::CullVisitor* cv, int& textureUnit)
 		{
 			probeUniform->setElement(j, probe[j]);
 		}
+		OSGTHREEJSX_COUNT(InstrumentCounter_UniformsTouched, PROBE_SH_NUM);
 	}
 }
 
@@ -557,7 +1173,7 @@ int RenderState::getShadowNumOfType(LightType type)
 		for (int i = 0; list && i < list->size(); i++)
 		{
 			Light* light = (*list)[i].get();
-			if (light->getCastShadow())
+			if (light->getCastShadow() && std::find(_skippedShadows.begin(), _skippedShadows.end(), light) == _skippedShadows.end())
 			{
 				num++;
 			}
@@ -566,6 +1182,22 @@ int RenderState::getShadowNumOfType(LightType type)
 	return num;
 }
 
+int RenderState::getShadowCascadeCount()
+{
+	int num = 1;
+	LightList* list = getLightsOfType(LightType_Direction);
+
+	for (int i = 0; list && i < list->size(); i++)
+	{
+		Light* light = (*list)[i].get();
+		if (light->getCastShadow() && light->getShadow().valid())
+		{
+			num = osg::maximum(num, light->getShadow()->getCascadeCount());
+		}
+	}
+	return num;
+}
+
 MaterialDataEnv* RenderState::getBackgroudEnv()
 {
 	return _bgEnv;
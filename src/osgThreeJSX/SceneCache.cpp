@@ -0,0 +1,2233 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <vector>
+#include <osg/Geode>
+#include <osg/MatrixTransform>
+#include <osg/Texture2D>
+#include <osg/TextureCubeMap>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <osgAnimation/Skeleton>
+#include <osgAnimation/Bone>
+#include <osgAnimation/UpdateBone>
+#include <osgAnimation/UpdateMatrixTransform>
+#include <osgAnimation/StackedTranslateElement>
+#include <osgAnimation/StackedQuaternionElement>
+#include <osgAnimation/StackedScaleElement>
+#include <osgAnimation/Channel>
+#include <osgAnimation/Animation>
+#include <osgThreeJSX/SceneCache>
+#include <osgThreeJSX/MappedFile>
+#include <osgThreeJSX/Materials>
+#include <osgThreeJSX/Animation>
+#include <osgThreeJSX/InstanceGeometry>
+#include <osgThreeJSX/MeshLod>
+#include <osgThreeJSX/ProbeLight>
+#include <osgThreeJSX/VertexQuantizer>
+
+using namespace osgThreeJSX;
+
+//bump when the layout changes
+static const unsigned int g_version = 1;
+static const char g_magic[4] = { 'O', 'T', 'J', 'S' };
+//reads back as another value on a machine of the other byte order
+static const unsigned int g_byteOrder = 0x01020304;
+//arrays, images and keyframes start on this boundary of the file, the mapping starts on a page
+static const size_t g_blockAlignment = 16;
+
+namespace
+{
+	enum CacheNodeType
+	{
+		CacheNodeType_Group,
+		CacheNodeType_MatrixTransform,
+		CacheNodeType_Bone,
+		CacheNodeType_Skeleton,
+		CacheNodeType_AnimationNode,
+		CacheNodeType_Geode,
+		CacheNodeType_MeshLod,
+		CacheNodeType_InstanceGeometry
+	};
+
+	enum CacheCallbackType
+	{
+		CacheCallbackType_UpdateMatrixTransform,
+		CacheCallbackType_UpdateBone,
+		CacheCallbackType_UpdateSkeleton,
+		CacheCallbackType_UpdateMorph
+	};
+
+	enum CacheElementType
+	{
+		CacheElementType_Translate,
+		CacheElementType_Quaternion,
+		CacheElementType_Scale
+	};
+
+	enum CacheGeometryType
+	{
+		CacheGeometryType_Geometry,
+		CacheGeometryType_Morph,
+		CacheGeometryType_Rig
+	};
+
+	enum CacheMaterialType
+	{
+		CacheMaterialType_Basic,
+		CacheMaterialType_Lambert,
+		CacheMaterialType_Phong,
+		CacheMaterialType_Standard,
+		CacheMaterialType_Physical
+	};
+
+	enum CacheTextureType
+	{
+		CacheTextureType_2D,
+		CacheTextureType_CubeMap
+	};
+
+	enum CacheChannelType
+	{
+		CacheChannelType_Vec3Linear,
+		CacheChannelType_QuatSphericalLinear,
+		CacheChannelType_FloatLinear
+	};
+
+	enum CacheUniformData
+	{
+		CacheUniformData_None,
+		CacheUniformData_Float,
+		CacheUniformData_Double,
+		CacheUniformData_Int,
+		CacheUniformData_UInt
+	};
+}
+
+//the material uniforms the skin and morph transforms create when they first run
+static bool isRuntimeUniform(const std::string& name)
+{
+	return name == "morphTargetBaseInfluence" || name == "morphTargetInfluences" || name == "boneMatrices"
+		|| name == "bindMatrix" || name == "bindMatrixInverse";
+}
+
+//the material a material node draws with, from its cull callbacks
+static Material* findMaterial(osg::Node* node)
+{
+	for (osg::Callback* callback = node->getCullCallback(); callback; callback = callback->getNestedCallback())
+	{
+		MaterialNodeCullback* materialCallback = dynamic_cast<MaterialNodeCullback*>(callback);
+		if (materialCallback)
+			return materialCallback->getMaterial().get();
+	}
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//sequential binary output, blocks are aligned relative to the start of the file
+class CacheWriter
+{
+public:
+	CacheWriter(std::ostream& stream) : _stream(stream), _offset(0) {}
+
+	template<typename T>
+	void write(const T& value) { writeBytes(&value, sizeof(T)); }
+
+	void writeBytes(const void* data, size_t size)
+	{
+		if (size == 0)
+			return;
+		_stream.write((const char*)data, size);
+		_offset += size;
+	}
+
+	void writeString(const std::string& value)
+	{
+		write<unsigned int>(value.size());
+		writeBytes(value.data(), value.size());
+	}
+
+	//size, padding to the block alignment, data
+	void writeBlock(const void* data, size_t size)
+	{
+		write<unsigned long long>(size);
+		static const char zeros[g_blockAlignment] = { 0 };
+		writeBytes(zeros, (g_blockAlignment - _offset % g_blockAlignment) % g_blockAlignment);
+		writeBytes(data, size);
+	}
+protected:
+	std::ostream& _stream;
+	size_t _offset;
+};
+
+//bounds checked reads over the mapping, the first read past the end fails all the following ones
+class CacheReader
+{
+public:
+	CacheReader(const unsigned char* data, size_t size) : _data(data), _size(size), _offset(0), _failed(false) {}
+
+	template<typename T>
+	T read()
+	{
+		T value = T();
+		const unsigned char* data = take(sizeof(T));
+		if (data)
+			memcpy(&value, data, sizeof(T));
+		return value;
+	}
+
+	void readBytes(void* result, size_t size)
+	{
+		const unsigned char* data = take(size);
+		if (data)
+			memcpy(result, data, size);
+	}
+
+	std::string readString()
+	{
+		unsigned int size = read<unsigned int>();
+		const unsigned char* data = take(size);
+		return data ? std::string((const char*)data, size) : std::string();
+	}
+
+	//a count of records, each at least one byte long
+	unsigned int readCount()
+	{
+		unsigned int count = read<unsigned int>();
+		if (count > _size - _offset)
+			_failed = true;
+		return _failed ? 0 : count;
+	}
+
+	//points into the mapping
+	const unsigned char* readBlock(size_t& size)
+	{
+		unsigned long long blockSize = read<unsigned long long>();
+		size_t offset = (_offset + g_blockAlignment - 1) / g_blockAlignment * g_blockAlignment;
+		if (_failed || offset > _size || blockSize > _size - offset)
+		{
+			_failed = true;
+			size = 0;
+			return NULL;
+		}
+		_offset = offset;
+		size = (size_t)blockSize;
+		return take(size);
+	}
+
+	bool failed() const { return _failed; }
+protected:
+	const unsigned char* take(size_t size)
+	{
+		if (_failed || size > _size - _offset)
+		{
+			_failed = true;
+			return NULL;
+		}
+		const unsigned char* data = _data + _offset;
+		_offset += size;
+		return data;
+	}
+protected:
+	const unsigned char* _data;
+	size_t _size;
+	size_t _offset;
+	bool _failed;
+};
+
+//////////////////////////////////////////////////////////////////////////
+//objects of one type in the order they are written, shared objects once
+template<typename T>
+class CacheTable
+{
+public:
+	int find(const T* object) const
+	{
+		typename std::map<const T*, int>::const_iterator iter = _ids.find(object);
+		return iter == _ids.end() ? -1 : iter->second;
+	}
+
+	int add(T* object)
+	{
+		int id = _objects.size();
+		_ids[object] = id;
+		_objects.push_back(object);
+		return id;
+	}
+
+	const std::vector<T*>& getObjects() const { return _objects; }
+protected:
+	std::vector<T*> _objects;
+	std::map<const T*, int> _ids;
+};
+
+template<typename T>
+static T* getObject(const std::vector<osg::ref_ptr<T> >& objects, int id)
+{
+	return id >= 0 && id < (int)objects.size() ? objects[id].get() : NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////
+template<typename ValueType, typename ChannelType>
+static void writeKeyframes(CacheWriter& writer, ChannelType* channel)
+{
+	typedef typename ChannelType::KeyframeContainerType KeyframeContainerType;
+	KeyframeContainerType* keyframes = channel->getSamplerTyped() ? channel->getSamplerTyped()->getKeyframeContainerTyped() : NULL;
+	unsigned int count = keyframes ? keyframes->size() : 0;
+	std::vector<double> times(count);
+	std::vector<ValueType> values(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		times[i] = (*keyframes)[i].getTime();
+		values[i] = (*keyframes)[i].getValue();
+	}
+	writer.write<unsigned int>(count);
+	writer.writeBlock(count ? &times[0] : NULL, count * sizeof(double));
+	writer.writeBlock(count ? &values[0] : NULL, count * sizeof(ValueType));
+}
+
+template<typename ValueType, typename ChannelType>
+static bool readKeyframes(CacheReader& reader, ChannelType* channel)
+{
+	typedef typename ChannelType::KeyframeContainerType KeyframeContainerType;
+	typedef typename KeyframeContainerType::KeyType KeyType;
+	unsigned int count = reader.read<unsigned int>();
+	size_t timesSize, valuesSize;
+	const double* times = (const double*)reader.readBlock(timesSize);
+	const ValueType* values = (const ValueType*)reader.readBlock(valuesSize);
+	if (reader.failed() || timesSize != count * sizeof(double) || valuesSize != count * sizeof(ValueType))
+		return false;
+
+	KeyframeContainerType* keyframes = channel->getOrCreateSampler()->getOrCreateKeyframeContainer();
+	keyframes->reserve(count);
+	for (unsigned int i = 0; i < count; i++)
+		keyframes->push_back(KeyType(times[i], values[i]));
+	return true;
+}
+
+template<class ArrayType>
+static osg::Array* createArray(unsigned int count, const unsigned char* data, size_t size)
+{
+	osg::ref_ptr<ArrayType> array = new ArrayType(count);
+	if (count == 0)
+		return array.release();
+	if (size != count * sizeof((*array)[0]))
+		return NULL;
+	memcpy(&(*array)[0], data, size);
+	return array.release();
+}
+
+static osg::Array* createArray(osg::Array::Type type, GLenum dataType, unsigned int count, const unsigned char* data, size_t size)
+{
+	switch (type)
+	{
+	case osg::Array::ByteArrayType: return createArray<osg::ByteArray>(count, data, size);
+	case osg::Array::ShortArrayType: return createArray<osg::ShortArray>(count, data, size);
+	case osg::Array::IntArrayType: return createArray<osg::IntArray>(count, data, size);
+	case osg::Array::UByteArrayType: return createArray<osg::UByteArray>(count, data, size);
+	case osg::Array::UShortArrayType: return createArray<osg::UShortArray>(count, data, size);
+	case osg::Array::UIntArrayType: return createArray<osg::UIntArray>(count, data, size);
+	case osg::Array::FloatArrayType: return createArray<osg::FloatArray>(count, data, size);
+	case osg::Array::DoubleArrayType: return createArray<osg::DoubleArray>(count, data, size);
+	case osg::Array::Vec2bArrayType: return createArray<osg::Vec2bArray>(count, data, size);
+	case osg::Array::Vec3bArrayType: return createArray<osg::Vec3bArray>(count, data, size);
+	case osg::Array::Vec4bArrayType: return createArray<osg::Vec4bArray>(count, data, size);
+	case osg::Array::Vec2sArrayType: return createArray<osg::Vec2sArray>(count, data, size);
+	case osg::Array::Vec3sArrayType: return createArray<osg::Vec3sArray>(count, data, size);
+	case osg::Array::Vec4sArrayType: return createArray<osg::Vec4sArray>(count, data, size);
+	case osg::Array::Vec2iArrayType: return createArray<osg::Vec2iArray>(count, data, size);
+	case osg::Array::Vec3iArrayType: return createArray<osg::Vec3iArray>(count, data, size);
+	case osg::Array::Vec4iArrayType: return createArray<osg::Vec4iArray>(count, data, size);
+	case osg::Array::Vec2ubArrayType: return createArray<osg::Vec2ubArray>(count, data, size);
+	case osg::Array::Vec3ubArrayType: return createArray<osg::Vec3ubArray>(count, data, size);
+	case osg::Array::Vec4ubArrayType: return createArray<osg::Vec4ubArray>(count, data, size);
+	case osg::Array::Vec2usArrayType:
+		if (dataType == GL_HALF_FLOAT)
+			return createArray<Vec2HalfArray>(count, data, size);
+		return createArray<osg::Vec2usArray>(count, data, size);
+	case osg::Array::Vec3usArrayType: return createArray<osg::Vec3usArray>(count, data, size);
+	case osg::Array::Vec4usArrayType: return createArray<osg::Vec4usArray>(count, data, size);
+	case osg::Array::Vec2uiArrayType: return createArray<osg::Vec2uiArray>(count, data, size);
+	case osg::Array::Vec3uiArrayType: return createArray<osg::Vec3uiArray>(count, data, size);
+	case osg::Array::Vec4uiArrayType: return createArray<osg::Vec4uiArray>(count, data, size);
+	case osg::Array::Vec2ArrayType: return createArray<osg::Vec2Array>(count, data, size);
+	case osg::Array::Vec3ArrayType: return createArray<osg::Vec3Array>(count, data, size);
+	case osg::Array::Vec4ArrayType: return createArray<osg::Vec4Array>(count, data, size);
+	case osg::Array::Vec2dArrayType: return createArray<osg::Vec2dArray>(count, data, size);
+	case osg::Array::Vec3dArrayType: return createArray<osg::Vec3dArray>(count, data, size);
+	case osg::Array::Vec4dArrayType: return createArray<osg::Vec4dArray>(count, data, size);
+	case osg::Array::MatrixArrayType: return createArray<osg::MatrixfArray>(count, data, size);
+	case osg::Array::MatrixdArrayType: return createArray<osg::MatrixdArray>(count, data, size);
+	case osg::Array::QuatArrayType: return createArray<osg::QuatArray>(count, data, size);
+	default: return NULL;
+	}
+}
+
+//vertices every per vertex array of geometry holds
+static unsigned int getNumVertices(const osg::Geometry* geometry)
+{
+	const osg::Array* vertices = geometry->getVertexArray();
+	unsigned int count = vertices ? vertices->getNumElements() : 0;
+
+	std::vector<const osg::Array*> arrays;
+	arrays.push_back(geometry->getNormalArray());
+	arrays.push_back(geometry->getColorArray());
+	arrays.push_back(geometry->getSecondaryColorArray());
+	arrays.push_back(geometry->getFogCoordArray());
+	for (unsigned int i = 0; i < geometry->getNumTexCoordArrays(); i++)
+		arrays.push_back(geometry->getTexCoordArray(i));
+	for (unsigned int i = 0; i < geometry->getNumVertexAttribArrays(); i++)
+		arrays.push_back(geometry->getVertexAttribArray(i));
+	for (size_t i = 0; i < arrays.size(); i++)
+	{
+		if (arrays[i] && arrays[i]->getBinding() == osg::Array::BIND_PER_VERTEX)
+			count = osg::minimum(count, arrays[i]->getNumElements());
+	}
+	return count;
+}
+
+//false when the primitive set reads past numVertices, by the range of DrawArrays or the largest index of DrawElements
+static bool checkPrimitiveSet(const osg::PrimitiveSet* primitiveSet, unsigned int numVertices)
+{
+	const osg::DrawArrays* drawArrays = dynamic_cast<const osg::DrawArrays*>(primitiveSet);
+	if (drawArrays)
+		return (unsigned long long)drawArrays->getFirst() + drawArrays->getCount() <= numVertices;
+
+	const osg::DrawElements* drawElements = primitiveSet->getDrawElements();
+	for (unsigned int i = 0; drawElements && i < drawElements->getNumIndices(); i++)
+	{
+		if (drawElements->index(i) >= numVertices)
+			return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////
+class SceneCacheWriter
+{
+public:
+	SceneCacheWriter(std::ostream& stream) : _writer(stream) {}
+
+	void write(osg::Node* scene, const LightList* lights)
+	{
+		int root = collectNode(scene);
+
+		_writer.writeBytes(g_magic, sizeof(g_magic));
+		_writer.write<unsigned int>(g_version);
+		_writer.write<unsigned int>(g_byteOrder);
+
+		_writer.write<unsigned int>(_images.getObjects().size());
+		for (size_t i = 0; i < _images.getObjects().size(); i++)
+			writeImage(_images.getObjects()[i]);
+		_writer.write<unsigned int>(_textures.getObjects().size());
+		for (size_t i = 0; i < _textures.getObjects().size(); i++)
+			writeTexture(_textures.getObjects()[i]);
+		_writer.write<unsigned int>(_stateSets.getObjects().size());
+		for (size_t i = 0; i < _stateSets.getObjects().size(); i++)
+			writeStateSet(_stateSets.getObjects()[i]);
+		_writer.write<unsigned int>(_materials.getObjects().size());
+		for (size_t i = 0; i < _materials.getObjects().size(); i++)
+			writeMaterial(_materials.getObjects()[i]);
+		_writer.write<unsigned int>(_arrays.getObjects().size());
+		for (size_t i = 0; i < _arrays.getObjects().size(); i++)
+			writeArray(_arrays.getObjects()[i]);
+		_writer.write<unsigned int>(_primitiveSets.getObjects().size());
+		for (size_t i = 0; i < _primitiveSets.getObjects().size(); i++)
+			writePrimitiveSet(_primitiveSets.getObjects()[i]);
+		_writer.write<unsigned int>(_geometries.getObjects().size());
+		for (size_t i = 0; i < _geometries.getObjects().size(); i++)
+			writeGeometry(_geometries.getObjects()[i]);
+		_writer.write<unsigned int>(_nodes.getObjects().size());
+		for (size_t i = 0; i < _nodes.getObjects().size(); i++)
+			writeNode(_nodes.getObjects()[i]);
+		_writer.write<int>(root);
+
+		std::vector<ProbeLight*> probes;
+		for (size_t i = 0; lights && i < lights->size(); i++)
+		{
+			ProbeLight* probe = dynamic_cast<ProbeLight*>((*lights)[i].get());
+			if (probe)
+				probes.push_back(probe);
+		}
+		_writer.write<unsigned int>(probes.size());
+		for (size_t i = 0; i < probes.size(); i++)
+		{
+			_writer.write<float>(probes[i]->getIntensity());
+			for (unsigned int c = 0; c < PROBE_SH_NUM; c++)
+				_writer.write<osg::Vec3f>(probes[i]->getCoefficient(c));
+		}
+	}
+protected:
+	//the ids of what an object refers to are assigned before its own, so it is read after them
+	int collectNode(osg::Node* node)
+	{
+		int id = _nodes.find(node);
+		if (id >= 0)
+			return id;
+
+		InstanceGeometry* instance = dynamic_cast<InstanceGeometry*>(node);
+		osg::Group* group = node->asGroup();
+		if (instance)
+		{
+			if (instance->getGeometry())
+				collectGeometry(instance->getGeometry());
+			MeshLodChain* chain = instance->getLodChain();
+			for (unsigned int i = 0; chain && i < chain->getNumLevels(); i++)
+				collectGeometry(chain->getLevel(i));
+			collectMaterial(findMaterial(node));
+		}
+		else if (node->asGeode())
+		{
+			osg::Geode* geode = node->asGeode();
+			for (unsigned int i = 0; i < geode->getNumDrawables(); i++)
+			{
+				if (geode->getDrawable(i)->asGeometry())
+					collectGeometry(geode->getDrawable(i)->asGeometry());
+				else
+					OSG_WARN << "osgThreeJSX::SceneCache: " << geode->getDrawable(i)->className() << " skipped" << std::endl;
+			}
+			collectMaterial(findMaterial(node));
+		}
+		else if (group)
+		{
+			if (!dynamic_cast<MeshLod*>(node) && !dynamic_cast<osg::MatrixTransform*>(node) && strcmp(node->className(), "Group") != 0)
+				OSG_WARN << "osgThreeJSX::SceneCache: " << node->className() << " written as a group" << std::endl;
+			for (unsigned int i = 0; i < group->getNumChildren(); i++)
+				collectNode(group->getChild(i));
+		}
+		else
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: " << node->className() << " skipped" << std::endl;
+			return -1;
+		}
+		collectStateSet(node->getStateSet());
+		return _nodes.add(node);
+	}
+
+	int collectGeometry(osg::Geometry* geometry)
+	{
+		int id = _geometries.find(geometry);
+		if (id >= 0)
+			return id;
+
+		collectArray(geometry->getVertexArray());
+		collectArray(geometry->getNormalArray());
+		collectArray(geometry->getColorArray());
+		collectArray(geometry->getSecondaryColorArray());
+		collectArray(geometry->getFogCoordArray());
+		for (unsigned int i = 0; i < geometry->getNumTexCoordArrays(); i++)
+			collectArray(geometry->getTexCoordArray(i));
+		for (unsigned int i = 0; i < geometry->getNumVertexAttribArrays(); i++)
+			collectArray(geometry->getVertexAttribArray(i));
+		for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++)
+			collectPrimitiveSet(geometry->getPrimitiveSet(i));
+		collectStateSet(geometry->getStateSet());
+		collectMaterial(findMaterial(geometry));
+
+		osgAnimation::MorphGeometry* morph = dynamic_cast<osgAnimation::MorphGeometry*>(geometry);
+		osgAnimation::RigGeometry* rig = dynamic_cast<osgAnimation::RigGeometry*>(geometry);
+		if (morph)
+		{
+			osgAnimation::MorphGeometry::MorphTargetList& targets = morph->getMorphTargetList();
+			for (size_t i = 0; i < targets.size(); i++)
+				collectGeometry(targets[i].getGeometry());
+		}
+		if (rig)
+		{
+			if (rig->getSourceGeometry())
+				collectGeometry(rig->getSourceGeometry());
+			RigTransformMaterial* transform = dynamic_cast<RigTransformMaterial*>(rig->getRigTransformImplementation());
+			if (transform)
+				collectArray(transform->getMatrixPalette().get());
+			else
+				OSG_WARN << "osgThreeJSX::SceneCache: only RigTransformMaterial skins are kept, " << geometry->getName() << " is written without its bones" << std::endl;
+		}
+		return _geometries.add(geometry);
+	}
+
+	int collectArray(osg::Array* array)
+	{
+		if (!array)
+			return -1;
+		int id = _arrays.find(array);
+		return id >= 0 ? id : _arrays.add(array);
+	}
+
+	int collectPrimitiveSet(osg::PrimitiveSet* primitiveSet)
+	{
+		int id = _primitiveSets.find(primitiveSet);
+		if (id >= 0)
+			return id;
+
+		switch (primitiveSet->getType())
+		{
+		case osg::PrimitiveSet::DrawArraysPrimitiveType:
+		case osg::PrimitiveSet::DrawElementsUBytePrimitiveType:
+		case osg::PrimitiveSet::DrawElementsUShortPrimitiveType:
+		case osg::PrimitiveSet::DrawElementsUIntPrimitiveType:
+			return _primitiveSets.add(primitiveSet);
+		default:
+			OSG_WARN << "osgThreeJSX::SceneCache: " << primitiveSet->className() << " skipped" << std::endl;
+			return -1;
+		}
+	}
+
+	int collectStateSet(osg::StateSet* stateSet)
+	{
+		if (!stateSet)
+			return -1;
+		int id = _stateSets.find(stateSet);
+		return id >= 0 ? id : _stateSets.add(stateSet);
+	}
+
+	int collectMaterial(Material* material)
+	{
+		if (!material)
+			return -1;
+		int id = _materials.find(material);
+		if (id >= 0)
+			return id;
+
+		if (!dynamic_cast<MaterialBasic*>(material) && !dynamic_cast<MaterialLambert*>(material) && !dynamic_cast<MaterialPhong*>(material))
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: " << material->className() << " skipped" << std::endl;
+			return -1;
+		}
+
+		MaterialBasic* basic = dynamic_cast<MaterialBasic*>(material);
+		MaterialLambert* lambert = dynamic_cast<MaterialLambert*>(material);
+		MaterialPhong* phong = dynamic_cast<MaterialPhong*>(material);
+		MaterialStandard* standard = dynamic_cast<MaterialStandard*>(material);
+		MaterialPhysical* physical = dynamic_cast<MaterialPhysical*>(material);
+		if (basic)
+		{
+			collectTextures(basic->_common, basic->_light, basic->_ao, basic->_specular, basic->_env);
+		}
+		if (lambert)
+		{
+			collectTextures(lambert->_common, lambert->_light, lambert->_ao, lambert->_specular, lambert->_env);
+			collectTexture(lambert->_emissive.emissiveMap.get());
+		}
+		if (phong)
+		{
+			collectTextures(phong->_common, phong->_light, phong->_ao, phong->_specular, phong->_env);
+			collectTexture(phong->_emissive.emissiveMap.get());
+			collectTexture(phong->_bump.bumpMap.get());
+			collectTexture(phong->_normal.normalMap.get());
+			collectTexture(phong->_displacement.displacementMap.get());
+		}
+		if (standard)
+		{
+			collectTexture(standard->_emissive.emissiveMap.get());
+			collectTexture(standard->_bump.bumpMap.get());
+			collectTexture(standard->_normal.normalMap.get());
+			collectTexture(standard->_displacement.displacementMap.get());
+			collectTexture(standard->_roughness.roughnessMap.get());
+			collectTexture(standard->_metalness.metalnessMap.get());
+		}
+		if (physical)
+		{
+			collectTexture(physical->_physical.clearcoatMap.get());
+			collectTexture(physical->_physical.clearcoatRoughnessMap.get());
+			collectTexture(physical->_physical.clearcoatNormalMap.get());
+		}
+		return _materials.add(material);
+	}
+
+	void collectTextures(MaterialDataCommon& common, MaterialDataLight& light, MaterialDataAo& ao, MaterialDataSpecular& specular, MaterialDataEnv& env)
+	{
+		collectTexture(common.map.get());
+		collectTexture(common.alphaMap.get());
+		collectTexture(light.lightMap.get());
+		collectTexture(ao.aoMap.get());
+		collectTexture(specular.specularMap.get());
+		collectTexture(env.envMap.get());
+	}
+
+	int collectTexture(osg::Texture* texture)
+	{
+		if (!texture)
+			return -1;
+		int id = _textures.find(texture);
+		if (id >= 0)
+			return id;
+
+		if (dynamic_cast<osg::Texture2D*>(texture))
+		{
+			collectImage(texture->getImage(0));
+		}
+		else if (dynamic_cast<osg::TextureCubeMap*>(texture))
+		{
+			for (unsigned int face = 0; face < 6; face++)
+				collectImage(texture->getImage(face));
+		}
+		else
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: " << texture->className() << " skipped" << std::endl;
+			return -1;
+		}
+		return _textures.add(texture);
+	}
+
+	int collectImage(osg::Image* image)
+	{
+		if (!image)
+			return -1;
+		int id = _images.find(image);
+		if (id >= 0)
+			return id;
+
+		if (!image->data() || !image->isDataContiguous())
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: image " << image->getFileName() << " has no data to write, skipped" << std::endl;
+			return -1;
+		}
+		return _images.add(image);
+	}
+protected:
+	void writeImage(osg::Image* image)
+	{
+		_writer.writeString(image->getFileName());
+		_writer.write<int>(image->s());
+		_writer.write<int>(image->t());
+		_writer.write<int>(image->r());
+		_writer.write<int>(image->getInternalTextureFormat());
+		_writer.write<unsigned int>(image->getPixelFormat());
+		_writer.write<unsigned int>(image->getDataType());
+		_writer.write<unsigned int>(image->getPacking());
+		_writer.write<unsigned int>(image->getOrigin());
+		const osg::Image::MipmapDataType& mipmaps = image->getMipmapLevels();
+		_writer.write<unsigned int>(mipmaps.size());
+		for (size_t i = 0; i < mipmaps.size(); i++)
+			_writer.write<unsigned int>(mipmaps[i]);
+		_writer.writeBlock(image->data(), image->getTotalSizeInBytesIncludingMipmaps());
+	}
+
+	void writeTexture(osg::Texture* texture)
+	{
+		bool cubeMap = dynamic_cast<osg::TextureCubeMap*>(texture) != NULL;
+		_writer.write<unsigned int>(cubeMap ? CacheTextureType_CubeMap : CacheTextureType_2D);
+		_writer.writeString(texture->getName());
+		for (unsigned int face = 0; face < (cubeMap ? 6u : 1u); face++)
+			_writer.write<int>(_images.find(texture->getImage(face)));
+		_writer.write<int>(texture->getTextureWidth());
+		_writer.write<int>(texture->getTextureHeight());
+		_writer.write<unsigned int>(texture->getFilter(osg::Texture::MIN_FILTER));
+		_writer.write<unsigned int>(texture->getFilter(osg::Texture::MAG_FILTER));
+		_writer.write<unsigned int>(texture->getWrap(osg::Texture::WRAP_S));
+		_writer.write<unsigned int>(texture->getWrap(osg::Texture::WRAP_T));
+		_writer.write<unsigned int>(texture->getWrap(osg::Texture::WRAP_R));
+		_writer.write<float>(texture->getMaxAnisotropy());
+		_writer.write<unsigned char>(texture->getResizeNonPowerOfTwoHint());
+		_writer.write<unsigned char>(texture->getUseHardwareMipMapGeneration());
+		_writer.write<unsigned int>(texture->getInternalFormatMode());
+		_writer.write<int>(texture->getInternalFormatMode() == osg::Texture::USE_USER_DEFINED_FORMAT ? texture->getInternalFormat() : 0);
+		_writer.write<unsigned int>(texture->getSourceFormat());
+		_writer.write<unsigned int>(texture->getSourceType());
+	}
+
+	void writeUniform(const osg::Uniform* uniform)
+	{
+		_writer.writeString(uniform->getName());
+		_writer.write<unsigned int>(uniform->getType());
+		_writer.write<unsigned int>(uniform->getNumElements());
+		if (uniform->getFloatArray())
+		{
+			_writer.write<unsigned int>(CacheUniformData_Float);
+			_writer.writeBlock(uniform->getFloatArray()->getDataPointer(), uniform->getFloatArray()->getTotalDataSize());
+		}
+		else if (uniform->getDoubleArray())
+		{
+			_writer.write<unsigned int>(CacheUniformData_Double);
+			_writer.writeBlock(uniform->getDoubleArray()->getDataPointer(), uniform->getDoubleArray()->getTotalDataSize());
+		}
+		else if (uniform->getIntArray())
+		{
+			_writer.write<unsigned int>(CacheUniformData_Int);
+			_writer.writeBlock(uniform->getIntArray()->getDataPointer(), uniform->getIntArray()->getTotalDataSize());
+		}
+		else if (uniform->getUIntArray())
+		{
+			_writer.write<unsigned int>(CacheUniformData_UInt);
+			_writer.writeBlock(uniform->getUIntArray()->getDataPointer(), uniform->getUIntArray()->getTotalDataSize());
+		}
+		else
+		{
+			_writer.write<unsigned int>(CacheUniformData_None);
+		}
+	}
+
+	void writeStateSet(osg::StateSet* stateSet)
+	{
+		const osg::StateSet::UniformList& uniforms = stateSet->getUniformList();
+		_writer.write<unsigned int>(uniforms.size());
+		for (osg::StateSet::UniformList::const_iterator iter = uniforms.begin(); iter != uniforms.end(); iter++)
+		{
+			writeUniform(iter->second.first.get());
+			_writer.write<unsigned int>(iter->second.second);
+		}
+	}
+
+	void writeTextureId(const osg::ref_ptr<osg::Texture>& texture)
+	{
+		_writer.write<int>(_textures.find(texture.get()));
+	}
+
+	void writeData(const MaterialDataCommon& data)
+	{
+		_writer.write<osg::Vec3f>(data.color);
+		_writer.write<float>(data.opacity);
+		writeTextureId(data.map);
+		_writer.write<int>(data.mapEncoding);
+		_writer.write<osg::Matrix3>(data.uvTransform);
+		_writer.write<osg::Matrix3>(data.uv2Transform);
+		writeTextureId(data.alphaMap);
+	}
+
+	void writeData(const MaterialDataLight& data)
+	{
+		writeTextureId(data.lightMap);
+		_writer.write<float>(data.lightMapIntensity);
+		_writer.write<int>(data.lightMapEncoding);
+	}
+
+	void writeData(const MaterialDataAo& data)
+	{
+		writeTextureId(data.aoMap);
+		_writer.write<float>(data.aoMapIntensity);
+	}
+
+	void writeData(const MaterialDataSpecular& data)
+	{
+		writeTextureId(data.specularMap);
+		_writer.write<osg::Vec3f>(data.specular);
+	}
+
+	void writeData(const MaterialDataEnv& data)
+	{
+		writeTextureId(data.envMap);
+		_writer.write<int>(data.envMapMode);
+		_writer.write<int>(data.combine);
+		_writer.write<int>(data.envMapEncoding);
+		_writer.write<float>(data.envMapIntensity);
+		_writer.write<float>(data.reflectivity);
+		_writer.write<float>(data.refractionRatio);
+	}
+
+	void writeData(const MaterialDataEmissive& data)
+	{
+		writeTextureId(data.emissiveMap);
+		_writer.write<int>(data.emissiveMapEncoding);
+		_writer.write<osg::Vec3f>(data.emissive);
+		_writer.write<float>(data.emissiveIntensity);
+	}
+
+	void writeData(const MaterialDataBump& data)
+	{
+		writeTextureId(data.bumpMap);
+		_writer.write<float>(data.bumpScale);
+	}
+
+	void writeData(const MaterialDataNormal& data)
+	{
+		writeTextureId(data.normalMap);
+		_writer.write<osg::Vec2f>(data.normalScale);
+		_writer.write<int>(data.normalMapType);
+	}
+
+	void writeData(const MaterialDataDisplacement& data)
+	{
+		writeTextureId(data.displacementMap);
+		_writer.write<float>(data.displacementScale);
+		_writer.write<float>(data.displacementBias);
+	}
+
+	void writeData(const MaterialDataRoughness& data)
+	{
+		writeTextureId(data.roughnessMap);
+		_writer.write<float>(data.roughness);
+	}
+
+	void writeData(const MaterialDataMetalness& data)
+	{
+		writeTextureId(data.metalnessMap);
+		_writer.write<float>(data.metalness);
+	}
+
+	void writeData(const MaterialDataShininess& data)
+	{
+		_writer.write<float>(data.shininess);
+	}
+
+	void writeData(const MaterialDataPhysical& data)
+	{
+		_writer.write<float>(data.clearcoat);
+		writeTextureId(data.clearcoatMap);
+		_writer.write<float>(data.clearcoatRoughness);
+		writeTextureId(data.clearcoatRoughnessMap);
+		writeTextureId(data.clearcoatNormalMap);
+		_writer.write<osg::Vec2f>(data.clearcoatNormalScale);
+		_writer.write<unsigned char>(data.sheenFlag);
+		_writer.write<osg::Vec3f>(data.sheen);
+		_writer.write<float>(data.transparency);
+		_writer.write<float>(data.reflectivity);
+	}
+
+	void writeMaterial(Material* material)
+	{
+		MaterialBasic* basic = dynamic_cast<MaterialBasic*>(material);
+		MaterialLambert* lambert = dynamic_cast<MaterialLambert*>(material);
+		MaterialPhong* phong = dynamic_cast<MaterialPhong*>(material);
+		MaterialStandard* standard = dynamic_cast<MaterialStandard*>(material);
+		MaterialPhysical* physical = dynamic_cast<MaterialPhysical*>(material);
+		CacheMaterialType type = physical ? CacheMaterialType_Physical : standard ? CacheMaterialType_Standard :
+			basic ? CacheMaterialType_Basic : lambert ? CacheMaterialType_Lambert : CacheMaterialType_Phong;
+		_writer.write<unsigned int>(type);
+		_writer.writeString(material->getName());
+
+		const DefineMap& defines = material->getDefines();
+		_writer.write<unsigned int>(defines.size());
+		for (DefineMap::const_iterator iter = defines.begin(); iter != defines.end(); iter++)
+		{
+			_writer.writeString(iter->first);
+			_writer.writeString(iter->second);
+		}
+		const MaterialVertexAttribList& attribs = material->getVertexAttribList();
+		_writer.write<unsigned int>(attribs.size());
+		for (size_t i = 0; i < attribs.size(); i++)
+		{
+			_writer.writeString(attribs[i]._name);
+			_writer.write<unsigned int>(attribs[i]._index);
+		}
+
+		_writer.write<unsigned char>(material->getVertexTangents());
+		_writer.write<unsigned char>(material->getVertexColors());
+		_writer.write<unsigned char>(material->getFlatShading());
+		_writer.write<int>(material->getSide());
+		_writer.write<unsigned char>(material->getDithering());
+		_writer.write<unsigned char>(material->getPremultipliedAlpha());
+		_writer.write<unsigned char>(material->getFog());
+		_writer.write<float>(material->getAlphaTest());
+		_writer.write<unsigned char>(material->getInstancing());
+		_writer.write<unsigned int>(material->getVertexQuantization());
+		_writer.write<unsigned char>(material->getTransparent());
+		_writer.write<unsigned char>(material->getSkinning());
+		_writer.write<int>(material->getMaxBones());
+		_writer.write<unsigned char>(material->getMorphTargets());
+		_writer.write<unsigned char>(material->getMorphNormals());
+		_writer.write<unsigned char>(material->getCastShadow());
+		_writer.write<unsigned char>(material->getReceiveShadow());
+		osg::BlendFunc::BlendFuncMode src, dst, srcAlpha, dstAlpha;
+		material->getBlendFuncMode(src, dst, srcAlpha, dstAlpha);
+		_writer.write<int>(src);
+		_writer.write<int>(dst);
+		_writer.write<int>(srcAlpha);
+		_writer.write<int>(dstAlpha);
+		osg::BlendEquation::Equation equation, equationAlpha;
+		material->getBlendEquation(equation, equationAlpha);
+		_writer.write<int>(equation);
+		_writer.write<int>(equationAlpha);
+		_writer.write<unsigned char>(material->getUniformBlockEnable());
+
+		std::vector<const osg::Uniform*> uniforms;
+		const MaterialUniformList& uniformList = material->getUniformList();
+		for (size_t i = 0; i < uniformList.size(); i++)
+		{
+			if (!isRuntimeUniform(uniformList[i]->getName()))
+				uniforms.push_back(uniformList[i].get());
+		}
+		_writer.write<unsigned int>(uniforms.size());
+		for (size_t i = 0; i < uniforms.size(); i++)
+			writeUniform(uniforms[i]);
+
+		if (basic)
+		{
+			writeData(basic->_common);
+			writeData(basic->_light);
+			writeData(basic->_ao);
+			writeData(basic->_specular);
+			writeData(basic->_env);
+		}
+		if (lambert)
+		{
+			writeData(lambert->_common);
+			writeData(lambert->_light);
+			writeData(lambert->_ao);
+			writeData(lambert->_specular);
+			writeData(lambert->_env);
+			writeData(lambert->_emissive);
+		}
+		if (phong)
+		{
+			writeData(phong->_common);
+			writeData(phong->_light);
+			writeData(phong->_ao);
+			writeData(phong->_specular);
+			writeData(phong->_env);
+			writeData(phong->_emissive);
+			writeData(phong->_bump);
+			writeData(phong->_normal);
+			writeData(phong->_displacement);
+			writeData(phong->_shininess);
+		}
+		if (standard)
+		{
+			writeData(standard->_emissive);
+			writeData(standard->_bump);
+			writeData(standard->_normal);
+			writeData(standard->_displacement);
+			writeData(standard->_roughness);
+			writeData(standard->_metalness);
+		}
+		if (physical)
+		{
+			writeData(physical->_physical);
+		}
+	}
+
+	void writeArray(osg::Array* array)
+	{
+		_writer.write<unsigned int>(array->getType());
+		_writer.write<unsigned int>(array->getDataType());
+		_writer.write<int>(array->getBinding());
+		_writer.write<unsigned char>(array->getNormalize());
+		_writer.write<unsigned int>(array->getNumElements());
+		_writer.writeBlock(array->getDataPointer(), array->getTotalDataSize());
+	}
+
+	void writePrimitiveSet(osg::PrimitiveSet* primitiveSet)
+	{
+		_writer.write<unsigned int>(primitiveSet->getType());
+		_writer.write<unsigned int>(primitiveSet->getMode());
+		_writer.write<int>(primitiveSet->getNumInstances());
+		osg::DrawArrays* drawArrays = dynamic_cast<osg::DrawArrays*>(primitiveSet);
+		if (drawArrays)
+		{
+			_writer.write<int>(drawArrays->getFirst());
+			_writer.write<int>(drawArrays->getCount());
+		}
+		else
+		{
+			_writer.write<unsigned int>(primitiveSet->getNumIndices());
+			_writer.writeBlock(primitiveSet->getDataPointer(), primitiveSet->getTotalDataSize());
+		}
+	}
+
+	void writeGeometry(osg::Geometry* geometry)
+	{
+		osgAnimation::MorphGeometry* morph = dynamic_cast<osgAnimation::MorphGeometry*>(geometry);
+		osgAnimation::RigGeometry* rig = dynamic_cast<osgAnimation::RigGeometry*>(geometry);
+		_writer.write<unsigned int>(rig ? CacheGeometryType_Rig : morph ? CacheGeometryType_Morph : CacheGeometryType_Geometry);
+		_writer.writeString(geometry->getName());
+		_writer.write<int>(_stateSets.find(geometry->getStateSet()));
+		_writer.write<int>(_materials.find(findMaterial(geometry)));
+		_writer.write<unsigned char>(geometry->getUseVertexBufferObjects());
+		_writer.write<unsigned char>(geometry->getUseDisplayList());
+
+		_writer.write<int>(_arrays.find(geometry->getVertexArray()));
+		_writer.write<int>(_arrays.find(geometry->getNormalArray()));
+		_writer.write<int>(_arrays.find(geometry->getColorArray()));
+		_writer.write<int>(_arrays.find(geometry->getSecondaryColorArray()));
+		_writer.write<int>(_arrays.find(geometry->getFogCoordArray()));
+		_writer.write<unsigned int>(geometry->getNumTexCoordArrays());
+		for (unsigned int i = 0; i < geometry->getNumTexCoordArrays(); i++)
+			_writer.write<int>(_arrays.find(geometry->getTexCoordArray(i)));
+		_writer.write<unsigned int>(geometry->getNumVertexAttribArrays());
+		for (unsigned int i = 0; i < geometry->getNumVertexAttribArrays(); i++)
+			_writer.write<int>(_arrays.find(geometry->getVertexAttribArray(i)));
+		_writer.write<unsigned int>(geometry->getNumPrimitiveSets());
+		for (unsigned int i = 0; i < geometry->getNumPrimitiveSets(); i++)
+			_writer.write<int>(_primitiveSets.find(geometry->getPrimitiveSet(i)));
+
+		//quantized vertices are not readable by the bound computation
+		const osg::BoundingBox& bound = geometry->getInitialBound();
+		_writer.write<unsigned char>(bound.valid());
+		_writer.write<osg::Vec3f>(bound._min);
+		_writer.write<osg::Vec3f>(bound._max);
+
+		if (morph)
+		{
+			_writer.write<unsigned int>(morph->getMethod());
+			_writer.write<unsigned char>(dynamic_cast<MorphTransformMaterial*>(morph->getMorphTransformImplementation()) != NULL);
+			osgAnimation::MorphGeometry::MorphTargetList& targets = morph->getMorphTargetList();
+			_writer.write<unsigned int>(targets.size());
+			for (size_t i = 0; i < targets.size(); i++)
+			{
+				_writer.write<int>(_geometries.find(targets[i].getGeometry()));
+				_writer.write<float>(targets[i].getWeight());
+			}
+		}
+		if (rig)
+		{
+			RigTransformMaterial* transform = dynamic_cast<RigTransformMaterial*>(rig->getRigTransformImplementation());
+			_writer.write<int>(_geometries.find(rig->getSourceGeometry()));
+			_writer.write<int>(_nodes.find(rig->getSkeleton()));
+			_writer.write<unsigned char>(transform != NULL);
+			if (transform)
+			{
+				const RigTransformMaterial::BonePalette& bones = transform->getBonePalette();
+				_writer.write<unsigned int>(bones.size());
+				for (size_t i = 0; i < bones.size(); i++)
+					_writer.write<int>(_nodes.find(bones[i].get()));
+				_writer.write<int>(_arrays.find(transform->getMatrixPalette().get()));
+			}
+		}
+	}
+
+	void writeStackedTransform(osgAnimation::StackedTransform& transforms)
+	{
+		std::vector<osgAnimation::StackedTransformElement*> elements;
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			osgAnimation::StackedTransformElement* element = transforms[i].get();
+			if (dynamic_cast<osgAnimation::StackedTranslateElement*>(element) || dynamic_cast<osgAnimation::StackedQuaternionElement*>(element)
+				|| dynamic_cast<osgAnimation::StackedScaleElement*>(element))
+				elements.push_back(element);
+			else if (element)
+				OSG_WARN << "osgThreeJSX::SceneCache: " << element->className() << " skipped" << std::endl;
+		}
+
+		_writer.write<unsigned int>(elements.size());
+		for (size_t i = 0; i < elements.size(); i++)
+		{
+			osgAnimation::StackedTranslateElement* translate = dynamic_cast<osgAnimation::StackedTranslateElement*>(elements[i]);
+			osgAnimation::StackedQuaternionElement* quaternion = dynamic_cast<osgAnimation::StackedQuaternionElement*>(elements[i]);
+			osgAnimation::StackedScaleElement* scale = dynamic_cast<osgAnimation::StackedScaleElement*>(elements[i]);
+			if (translate)
+			{
+				_writer.write<unsigned int>(CacheElementType_Translate);
+				_writer.writeString(translate->getName());
+				_writer.write<osg::Vec3f>(translate->getTranslate());
+			}
+			else if (quaternion)
+			{
+				_writer.write<unsigned int>(CacheElementType_Quaternion);
+				_writer.writeString(quaternion->getName());
+				_writer.write<osg::Quat>(quaternion->getQuaternion());
+			}
+			else
+			{
+				_writer.write<unsigned int>(CacheElementType_Scale);
+				_writer.writeString(scale->getName());
+				_writer.write<osg::Vec3f>(scale->getScale());
+			}
+		}
+	}
+
+	void writeUpdateCallbacks(osg::Node* node)
+	{
+		std::vector<osg::Callback*> callbacks;
+		for (osg::Callback* callback = node->getUpdateCallback(); callback; callback = callback->getNestedCallback())
+		{
+			//the manager of an AnimationNode is created with it
+			if (dynamic_cast<osgAnimation::AnimationManagerBase*>(callback))
+				continue;
+			if (dynamic_cast<osgAnimation::UpdateMatrixTransform*>(callback) || dynamic_cast<osgAnimation::Skeleton::UpdateSkeleton*>(callback)
+				|| dynamic_cast<osgAnimation::UpdateMorph*>(callback))
+				callbacks.push_back(callback);
+			else
+				OSG_WARN << "osgThreeJSX::SceneCache: " << callback->className() << " skipped" << std::endl;
+		}
+
+		_writer.write<unsigned int>(callbacks.size());
+		for (size_t i = 0; i < callbacks.size(); i++)
+		{
+			osgAnimation::UpdateMatrixTransform* update = dynamic_cast<osgAnimation::UpdateMatrixTransform*>(callbacks[i]);
+			if (dynamic_cast<osgAnimation::UpdateBone*>(callbacks[i]))
+				_writer.write<unsigned int>(CacheCallbackType_UpdateBone);
+			else if (update)
+				_writer.write<unsigned int>(CacheCallbackType_UpdateMatrixTransform);
+			else if (dynamic_cast<osgAnimation::UpdateMorph*>(callbacks[i]))
+				_writer.write<unsigned int>(CacheCallbackType_UpdateMorph);
+			else
+				_writer.write<unsigned int>(CacheCallbackType_UpdateSkeleton);
+			_writer.writeString(callbacks[i]->getName());
+			if (update)
+				writeStackedTransform(update->getStackedTransforms());
+		}
+	}
+
+	void writeAnimation(osgAnimation::Animation* animation)
+	{
+		std::vector<osgAnimation::Channel*> channels;
+		osgAnimation::ChannelList& channelList = animation->getChannels();
+		for (size_t i = 0; i < channelList.size(); i++)
+		{
+			osgAnimation::Channel* channel = channelList[i].get();
+			if (dynamic_cast<osgAnimation::Vec3LinearChannel*>(channel) || dynamic_cast<osgAnimation::QuatSphericalLinearChannel*>(channel)
+				|| dynamic_cast<osgAnimation::FloatLinearChannel*>(channel))
+				channels.push_back(channel);
+			else
+				OSG_WARN << "osgThreeJSX::SceneCache: " << channel->className() << " of " << animation->getName() << " skipped" << std::endl;
+		}
+
+		_writer.writeString(animation->getName());
+		_writer.write<unsigned int>(animation->getPlayMode());
+		_writer.write<float>(animation->getWeight());
+		_writer.write<double>(animation->getStartTime());
+		_writer.write<unsigned int>(channels.size());
+		for (size_t i = 0; i < channels.size(); i++)
+		{
+			osgAnimation::Vec3LinearChannel* vec3Channel = dynamic_cast<osgAnimation::Vec3LinearChannel*>(channels[i]);
+			osgAnimation::QuatSphericalLinearChannel* quatChannel = dynamic_cast<osgAnimation::QuatSphericalLinearChannel*>(channels[i]);
+			osgAnimation::FloatLinearChannel* floatChannel = dynamic_cast<osgAnimation::FloatLinearChannel*>(channels[i]);
+			_writer.write<unsigned int>(vec3Channel ? CacheChannelType_Vec3Linear : quatChannel ? CacheChannelType_QuatSphericalLinear : CacheChannelType_FloatLinear);
+			_writer.writeString(channels[i]->getName());
+			_writer.writeString(channels[i]->getTargetName());
+			if (vec3Channel)
+				writeKeyframes<osg::Vec3f>(_writer, vec3Channel);
+			else if (quatChannel)
+				writeKeyframes<osg::Quat>(_writer, quatChannel);
+			else
+				writeKeyframes<float>(_writer, floatChannel);
+		}
+	}
+
+	void writeNode(osg::Node* node)
+	{
+		InstanceGeometry* instance = dynamic_cast<InstanceGeometry*>(node);
+		MeshLod* meshLod = dynamic_cast<MeshLod*>(node);
+		AnimationNode* animationNode = dynamic_cast<AnimationNode*>(node);
+		osgAnimation::Skeleton* skeleton = dynamic_cast<osgAnimation::Skeleton*>(node);
+		osgAnimation::Bone* bone = dynamic_cast<osgAnimation::Bone*>(node);
+		osg::MatrixTransform* transform = dynamic_cast<osg::MatrixTransform*>(node);
+		osg::Geode* geode = node->asGeode();
+		osg::Group* group = node->asGroup();
+
+		CacheNodeType type = CacheNodeType_Group;
+		if (instance)
+			type = CacheNodeType_InstanceGeometry;
+		else if (geode)
+			type = CacheNodeType_Geode;
+		else if (meshLod)
+			type = CacheNodeType_MeshLod;
+		else if (animationNode)
+			type = CacheNodeType_AnimationNode;
+		else if (skeleton)
+			type = CacheNodeType_Skeleton;
+		else if (bone)
+			type = CacheNodeType_Bone;
+		else if (transform)
+			type = CacheNodeType_MatrixTransform;
+		_writer.write<unsigned int>(type);
+		_writer.writeString(node->getName());
+		_writer.write<unsigned int>(node->getNodeMask());
+		_writer.write<int>(_stateSets.find(node->getStateSet()));
+
+		std::vector<int> children;
+		for (unsigned int i = 0; group && !geode && i < group->getNumChildren(); i++)
+		{
+			int child = _nodes.find(group->getChild(i));
+			if (child >= 0)
+				children.push_back(child);
+		}
+		_writer.write<unsigned int>(children.size());
+		for (size_t i = 0; i < children.size(); i++)
+			_writer.write<int>(children[i]);
+
+		if (transform)
+		{
+			_writer.write<osg::Matrixd>(transform->getMatrix());
+		}
+		if (animationNode)
+		{
+			const osgAnimation::AnimationList& animations = animationNode->getAnimationManager()->getAnimationList();
+			_writer.write<unsigned int>(animations.size());
+			for (size_t i = 0; i < animations.size(); i++)
+				writeAnimation(animations[i].get());
+		}
+		if (geode)
+		{
+			std::vector<int> drawables;
+			for (unsigned int i = 0; i < geode->getNumDrawables(); i++)
+			{
+				int drawable = _geometries.find(geode->getDrawable(i)->asGeometry());
+				if (drawable >= 0)
+					drawables.push_back(drawable);
+			}
+			_writer.write<int>(_materials.find(findMaterial(node)));
+			_writer.write<unsigned int>(drawables.size());
+			for (size_t i = 0; i < drawables.size(); i++)
+				_writer.write<int>(drawables[i]);
+		}
+		if (meshLod)
+		{
+			const std::vector<float>& errors = meshLod->getErrors();
+			_writer.write<float>(meshLod->getMaxPixelError());
+			_writer.write<unsigned int>(errors.size());
+			for (size_t i = 0; i < errors.size(); i++)
+				_writer.write<float>(errors[i]);
+		}
+		if (instance)
+		{
+			_writer.write<int>(_materials.find(findMaterial(node)));
+			_writer.write<int>(_geometries.find(instance->getGeometry()));
+			_writer.write<float>(instance->getMaxPixelError());
+			MeshLodChain* chain = instance->getLodChain();
+			unsigned int numLevels = chain ? chain->getNumLevels() : 0;
+			_writer.write<unsigned int>(numLevels);
+			for (unsigned int i = 0; i < numLevels; i++)
+			{
+				_writer.write<int>(_geometries.find(chain->getLevel(i)));
+				_writer.write<float>(chain->getError(i));
+			}
+			std::vector<osg::Matrixf> matrices(instance->getNumInstances());
+			for (unsigned int i = 0; i < matrices.size(); i++)
+				matrices[i] = instance->getInstanceMatrix(i);
+			_writer.write<unsigned int>(matrices.size());
+			_writer.writeBlock(matrices.empty() ? NULL : &matrices[0], matrices.size() * sizeof(osg::Matrixf));
+		}
+		writeUpdateCallbacks(node);
+	}
+protected:
+	CacheWriter _writer;
+	CacheTable<osg::Image> _images;
+	CacheTable<osg::Texture> _textures;
+	CacheTable<osg::StateSet> _stateSets;
+	CacheTable<Material> _materials;
+	CacheTable<osg::Array> _arrays;
+	CacheTable<osg::PrimitiveSet> _primitiveSets;
+	CacheTable<osg::Geometry> _geometries;
+	CacheTable<osg::Node> _nodes;
+};
+
+//////////////////////////////////////////////////////////////////////////
+class SceneCacheReader
+{
+public:
+	SceneCacheReader(const unsigned char* data, size_t size) : _reader(data, size) {}
+
+	osg::ref_ptr<osg::Node> read(LightList* lights, std::string& error)
+	{
+		char magic[sizeof(g_magic)] = { 0 };
+		_reader.readBytes(magic, sizeof(magic));
+		if (memcmp(magic, g_magic, sizeof(g_magic)) != 0)
+		{
+			error = "not a scene cache";
+			return NULL;
+		}
+		unsigned int version = _reader.read<unsigned int>();
+		unsigned int byteOrder = _reader.read<unsigned int>();
+		if (version != g_version || byteOrder != g_byteOrder)
+		{
+			error = "scene cache of another version or byte order";
+			return NULL;
+		}
+
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_images.push_back(readImage());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_textures.push_back(readTexture());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_stateSets.push_back(readStateSet());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_materials.push_back(readMaterial());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_arrays.push_back(readArray());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_primitiveSets.push_back(readPrimitiveSet());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_geometries.push_back(readGeometry());
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			_nodes.push_back(readNode());
+		osg::ref_ptr<osg::Node> root = getObject(_nodes, _reader.read<int>());
+		linkRigs();
+
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::ref_ptr<ProbeLight> probe = new ProbeLight;
+			probe->setIntensity(_reader.read<float>());
+			for (unsigned int c = 0; c < PROBE_SH_NUM; c++)
+				probe->setCoefficient(c, _reader.read<osg::Vec3f>());
+			if (lights && !_reader.failed())
+				lights->push_back(probe);
+		}
+
+		if (_reader.failed() || !root.valid())
+		{
+			error = "truncated or damaged scene cache";
+			return NULL;
+		}
+		return root;
+	}
+protected:
+	osg::ref_ptr<osg::Image> readImage()
+	{
+		std::string fileName = _reader.readString();
+		int s = _reader.read<int>();
+		int t = _reader.read<int>();
+		int r = _reader.read<int>();
+		int internalFormat = _reader.read<int>();
+		GLenum pixelFormat = _reader.read<unsigned int>();
+		GLenum dataType = _reader.read<unsigned int>();
+		unsigned int packing = _reader.read<unsigned int>();
+		osg::Image::Origin origin = (osg::Image::Origin)_reader.read<unsigned int>();
+		osg::Image::MipmapDataType mipmaps(_reader.readCount());
+		for (size_t i = 0; i < mipmaps.size(); i++)
+			mipmaps[i] = _reader.read<unsigned int>();
+		size_t size;
+		const unsigned char* data = _reader.readBlock(size);
+		if (_reader.failed())
+			return NULL;
+
+		//the levels are read at their offsets, they must stay inside the block
+		unsigned int previous = 0;
+		for (size_t i = 0; i < mipmaps.size(); i++)
+		{
+			if (mipmaps[i] <= previous || mipmaps[i] >= size)
+			{
+				OSG_WARN << "osgThreeJSX::SceneCache: image " << fileName << " has invalid mipmap offsets" << std::endl;
+				return NULL;
+			}
+			previous = mipmaps[i];
+		}
+
+		unsigned char* pixels = new unsigned char[size];
+		memcpy(pixels, data, size);
+		osg::ref_ptr<osg::Image> image = new osg::Image;
+		image->setImage(s, t, r, internalFormat, pixelFormat, dataType, pixels, osg::Image::USE_NEW_DELETE, packing);
+		image->setMipmapLevels(mipmaps);
+		image->setOrigin(origin);
+		image->setFileName(fileName);
+		if (image->getTotalSizeInBytesIncludingMipmaps() != size)
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: image " << fileName << " does not match its size" << std::endl;
+			return NULL;
+		}
+		return image;
+	}
+
+	osg::ref_ptr<osg::Texture> readTexture()
+	{
+		osg::ref_ptr<osg::Texture> texture;
+		if (_reader.read<unsigned int>() == CacheTextureType_CubeMap)
+		{
+			osg::ref_ptr<osg::TextureCubeMap> cubeMap = new osg::TextureCubeMap;
+			cubeMap->setName(_reader.readString());
+			for (unsigned int face = 0; face < 6; face++)
+				cubeMap->setImage(face, getObject(_images, _reader.read<int>()));
+			int width = _reader.read<int>();
+			int height = _reader.read<int>();
+			cubeMap->setTextureSize(width, height);
+			texture = cubeMap;
+		}
+		else
+		{
+			osg::ref_ptr<osg::Texture2D> texture2D = new osg::Texture2D;
+			texture2D->setName(_reader.readString());
+			texture2D->setImage(getObject(_images, _reader.read<int>()));
+			int width = _reader.read<int>();
+			int height = _reader.read<int>();
+			texture2D->setTextureSize(width, height);
+			texture = texture2D;
+		}
+		texture->setFilter(osg::Texture::MIN_FILTER, (osg::Texture::FilterMode)_reader.read<unsigned int>());
+		texture->setFilter(osg::Texture::MAG_FILTER, (osg::Texture::FilterMode)_reader.read<unsigned int>());
+		texture->setWrap(osg::Texture::WRAP_S, (osg::Texture::WrapMode)_reader.read<unsigned int>());
+		texture->setWrap(osg::Texture::WRAP_T, (osg::Texture::WrapMode)_reader.read<unsigned int>());
+		texture->setWrap(osg::Texture::WRAP_R, (osg::Texture::WrapMode)_reader.read<unsigned int>());
+		texture->setMaxAnisotropy(_reader.read<float>());
+		texture->setResizeNonPowerOfTwoHint(_reader.read<unsigned char>() != 0);
+		texture->setUseHardwareMipMapGeneration(_reader.read<unsigned char>() != 0);
+		osg::Texture::InternalFormatMode internalFormatMode = (osg::Texture::InternalFormatMode)_reader.read<unsigned int>();
+		int internalFormat = _reader.read<int>();
+		if (internalFormatMode == osg::Texture::USE_USER_DEFINED_FORMAT)
+			texture->setInternalFormat(internalFormat);
+		else
+			texture->setInternalFormatMode(internalFormatMode);
+		texture->setSourceFormat(_reader.read<unsigned int>());
+		texture->setSourceType(_reader.read<unsigned int>());
+		return texture;
+	}
+
+	osg::ref_ptr<osg::Uniform> readUniform()
+	{
+		std::string name = _reader.readString();
+		osg::Uniform::Type type = (osg::Uniform::Type)_reader.read<unsigned int>();
+		unsigned int numElements = _reader.read<unsigned int>();
+		unsigned int dataType = _reader.read<unsigned int>();
+		size_t size = 0;
+		const unsigned char* data = dataType != CacheUniformData_None ? _reader.readBlock(size) : NULL;
+		//every element takes at least four bytes
+		if (_reader.failed() || dataType == CacheUniformData_None || numElements == 0 || numElements > size)
+			return NULL;
+
+		osg::ref_ptr<osg::Uniform> uniform = new osg::Uniform(type, name, numElements);
+		osg::Array* array = NULL;
+		if (dataType == CacheUniformData_Float)
+			array = uniform->getFloatArray();
+		else if (dataType == CacheUniformData_Double)
+			array = uniform->getDoubleArray();
+		else if (dataType == CacheUniformData_Int)
+			array = uniform->getIntArray();
+		else if (dataType == CacheUniformData_UInt)
+			array = uniform->getUIntArray();
+		if (array && array->getTotalDataSize() == size)
+		{
+			memcpy(const_cast<GLvoid*>(array->getDataPointer()), data, size);
+			uniform->dirty();
+		}
+		return uniform;
+	}
+
+	osg::ref_ptr<osg::StateSet> readStateSet()
+	{
+		osg::ref_ptr<osg::StateSet> stateSet = new osg::StateSet;
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::ref_ptr<osg::Uniform> uniform = readUniform();
+			unsigned int value = _reader.read<unsigned int>();
+			if (uniform.valid())
+				stateSet->addUniform(uniform, value);
+		}
+		return stateSet;
+	}
+
+	osg::ref_ptr<osg::Texture> readTextureId()
+	{
+		return getObject(_textures, _reader.read<int>());
+	}
+
+	void readData(MaterialDataCommon& data)
+	{
+		data.color = _reader.read<osg::Vec3f>();
+		data.opacity = _reader.read<float>();
+		data.map = readTextureId();
+		data.mapEncoding = (TextureEncodingType)_reader.read<int>();
+		data.uvTransform = _reader.read<osg::Matrix3>();
+		data.uv2Transform = _reader.read<osg::Matrix3>();
+		data.alphaMap = readTextureId();
+	}
+
+	void readData(MaterialDataLight& data)
+	{
+		data.lightMap = readTextureId();
+		data.lightMapIntensity = _reader.read<float>();
+		data.lightMapEncoding = (TextureEncodingType)_reader.read<int>();
+	}
+
+	void readData(MaterialDataAo& data)
+	{
+		data.aoMap = readTextureId();
+		data.aoMapIntensity = _reader.read<float>();
+	}
+
+	void readData(MaterialDataSpecular& data)
+	{
+		data.specularMap = readTextureId();
+		data.specular = _reader.read<osg::Vec3f>();
+	}
+
+	void readData(MaterialDataEnv& data)
+	{
+		data.envMap = readTextureId();
+		data.envMapMode = (EnvMapModeType)_reader.read<int>();
+		data.combine = (EnvMapCombineType)_reader.read<int>();
+		data.envMapEncoding = (TextureEncodingType)_reader.read<int>();
+		data.envMapIntensity = _reader.read<float>();
+		data.reflectivity = _reader.read<float>();
+		data.refractionRatio = _reader.read<float>();
+	}
+
+	void readData(MaterialDataEmissive& data)
+	{
+		data.emissiveMap = readTextureId();
+		data.emissiveMapEncoding = (TextureEncodingType)_reader.read<int>();
+		data.emissive = _reader.read<osg::Vec3f>();
+		data.emissiveIntensity = _reader.read<float>();
+	}
+
+	void readData(MaterialDataBump& data)
+	{
+		data.bumpMap = readTextureId();
+		data.bumpScale = _reader.read<float>();
+	}
+
+	void readData(MaterialDataNormal& data)
+	{
+		data.normalMap = readTextureId();
+		data.normalScale = _reader.read<osg::Vec2f>();
+		data.normalMapType = (NormalMapType)_reader.read<int>();
+	}
+
+	void readData(MaterialDataDisplacement& data)
+	{
+		data.displacementMap = readTextureId();
+		data.displacementScale = _reader.read<float>();
+		data.displacementBias = _reader.read<float>();
+	}
+
+	void readData(MaterialDataRoughness& data)
+	{
+		data.roughnessMap = readTextureId();
+		data.roughness = _reader.read<float>();
+	}
+
+	void readData(MaterialDataMetalness& data)
+	{
+		data.metalnessMap = readTextureId();
+		data.metalness = _reader.read<float>();
+	}
+
+	void readData(MaterialDataShininess& data)
+	{
+		data.shininess = _reader.read<float>();
+	}
+
+	void readData(MaterialDataPhysical& data)
+	{
+		data.clearcoat = _reader.read<float>();
+		data.clearcoatMap = readTextureId();
+		data.clearcoatRoughness = _reader.read<float>();
+		data.clearcoatRoughnessMap = readTextureId();
+		data.clearcoatNormalMap = readTextureId();
+		data.clearcoatNormalScale = _reader.read<osg::Vec2f>();
+		data.sheenFlag = _reader.read<unsigned char>() != 0;
+		data.sheen = _reader.read<osg::Vec3f>();
+		data.transparency = _reader.read<float>();
+		data.reflectivity = _reader.read<float>();
+	}
+
+	osg::ref_ptr<Material> readMaterial()
+	{
+		osg::ref_ptr<Material> material;
+		MaterialBasic* basic = NULL;
+		MaterialLambert* lambert = NULL;
+		MaterialPhong* phong = NULL;
+		MaterialStandard* standard = NULL;
+		MaterialPhysical* physical = NULL;
+		switch (_reader.read<unsigned int>())
+		{
+		case CacheMaterialType_Basic: material = basic = new MaterialBasic; break;
+		case CacheMaterialType_Lambert: material = lambert = new MaterialLambert; break;
+		case CacheMaterialType_Phong: material = phong = new MaterialPhong; break;
+		case CacheMaterialType_Standard: material = basic = standard = new MaterialStandard; break;
+		default: material = basic = standard = physical = new MaterialPhysical; break;
+		}
+		material->setName(_reader.readString());
+
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			std::string key = _reader.readString();
+			material->addDefine(key, _reader.readString());
+		}
+		MaterialVertexAttribList attribs(_reader.readCount());
+		for (size_t i = 0; i < attribs.size(); i++)
+		{
+			attribs[i]._name = _reader.readString();
+			attribs[i]._index = _reader.read<unsigned int>();
+		}
+		material->setVertexAttribList(attribs);
+
+		material->setVertexTangents(_reader.read<unsigned char>() != 0);
+		material->setVertexColors(_reader.read<unsigned char>() != 0);
+		material->setFlatShading(_reader.read<unsigned char>() != 0);
+		material->setSide((MaterialSideType)_reader.read<int>());
+		material->setDithering(_reader.read<unsigned char>() != 0);
+		material->setPremultipliedAlpha(_reader.read<unsigned char>() != 0);
+		material->setFog(_reader.read<unsigned char>() != 0);
+		material->setAlphaTest(_reader.read<float>());
+		material->setInstancing(_reader.read<unsigned char>() != 0);
+		material->setVertexQuantization(_reader.read<unsigned int>());
+		material->setTransparent(_reader.read<unsigned char>() != 0);
+		material->setSkinning(_reader.read<unsigned char>() != 0);
+		material->setMaxBones(_reader.read<int>());
+		material->setMorphTargets(_reader.read<unsigned char>() != 0);
+		material->setMorphNormals(_reader.read<unsigned char>() != 0);
+		material->setCastShadow(_reader.read<unsigned char>() != 0);
+		material->setReceiveShadow(_reader.read<unsigned char>() != 0);
+		osg::BlendFunc::BlendFuncMode src = (osg::BlendFunc::BlendFuncMode)_reader.read<int>();
+		osg::BlendFunc::BlendFuncMode dst = (osg::BlendFunc::BlendFuncMode)_reader.read<int>();
+		osg::BlendFunc::BlendFuncMode srcAlpha = (osg::BlendFunc::BlendFuncMode)_reader.read<int>();
+		osg::BlendFunc::BlendFuncMode dstAlpha = (osg::BlendFunc::BlendFuncMode)_reader.read<int>();
+		material->setBlendFuncMode(src, dst, srcAlpha, dstAlpha);
+		osg::BlendEquation::Equation equation = (osg::BlendEquation::Equation)_reader.read<int>();
+		osg::BlendEquation::Equation equationAlpha = (osg::BlendEquation::Equation)_reader.read<int>();
+		material->setBlendEquation(equation, equationAlpha);
+		bool uniformBlock = _reader.read<unsigned char>() != 0;
+		if (uniformBlock)
+			material->setUniformBlockEnable(true);
+
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::ref_ptr<osg::Uniform> uniform = readUniform();
+			if (uniform.valid())
+				material->setUniform(uniform.get());
+		}
+
+		if (basic)
+		{
+			readData(basic->_common);
+			readData(basic->_light);
+			readData(basic->_ao);
+			readData(basic->_specular);
+			readData(basic->_env);
+		}
+		if (lambert)
+		{
+			readData(lambert->_common);
+			readData(lambert->_light);
+			readData(lambert->_ao);
+			readData(lambert->_specular);
+			readData(lambert->_env);
+			readData(lambert->_emissive);
+		}
+		if (phong)
+		{
+			readData(phong->_common);
+			readData(phong->_light);
+			readData(phong->_ao);
+			readData(phong->_specular);
+			readData(phong->_env);
+			readData(phong->_emissive);
+			readData(phong->_bump);
+			readData(phong->_normal);
+			readData(phong->_displacement);
+			readData(phong->_shininess);
+		}
+		if (standard)
+		{
+			readData(standard->_emissive);
+			readData(standard->_bump);
+			readData(standard->_normal);
+			readData(standard->_displacement);
+			readData(standard->_roughness);
+			readData(standard->_metalness);
+		}
+		if (physical)
+		{
+			readData(physical->_physical);
+		}
+		return material;
+	}
+
+	osg::ref_ptr<osg::Array> readArray()
+	{
+		osg::Array::Type type = (osg::Array::Type)_reader.read<unsigned int>();
+		GLenum dataType = _reader.read<unsigned int>();
+		osg::Array::Binding binding = (osg::Array::Binding)_reader.read<int>();
+		bool normalize = _reader.read<unsigned char>() != 0;
+		unsigned int count = _reader.read<unsigned int>();
+		size_t size;
+		const unsigned char* data = _reader.readBlock(size);
+		if (_reader.failed())
+			return NULL;
+
+		osg::ref_ptr<osg::Array> array = count <= size ? createArray(type, dataType, count, data, size) : NULL;
+		if (!array.valid())
+		{
+			OSG_WARN << "osgThreeJSX::SceneCache: array of type " << type << " skipped" << std::endl;
+			return NULL;
+		}
+		array->setBinding(binding);
+		array->setNormalize(normalize);
+		return array;
+	}
+
+	osg::ref_ptr<osg::PrimitiveSet> readPrimitiveSet()
+	{
+		osg::PrimitiveSet::Type type = (osg::PrimitiveSet::Type)_reader.read<unsigned int>();
+		GLenum mode = _reader.read<unsigned int>();
+		int numInstances = _reader.read<int>();
+		osg::ref_ptr<osg::PrimitiveSet> primitiveSet;
+		if (type == osg::PrimitiveSet::DrawArraysPrimitiveType)
+		{
+			int first = _reader.read<int>();
+			int count = _reader.read<int>();
+			if (_reader.failed() || first < 0 || count < 0)
+				return NULL;
+			primitiveSet = new osg::DrawArrays(mode, first, count, numInstances);
+			return primitiveSet;
+		}
+
+		unsigned int count = _reader.read<unsigned int>();
+		size_t size;
+		const unsigned char* data = _reader.readBlock(size);
+		size_t indexSize = type == osg::PrimitiveSet::DrawElementsUBytePrimitiveType ? sizeof(GLubyte) :
+			type == osg::PrimitiveSet::DrawElementsUShortPrimitiveType ? sizeof(GLushort) : sizeof(GLuint);
+		if (_reader.failed() || size != count * indexSize)
+			return NULL;
+
+		void* indices = NULL;
+		if (indexSize == sizeof(GLubyte))
+		{
+			osg::DrawElementsUByte* elements = new osg::DrawElementsUByte(mode, count);
+			indices = count ? &(*elements)[0] : NULL;
+			primitiveSet = elements;
+		}
+		else if (indexSize == sizeof(GLushort))
+		{
+			osg::DrawElementsUShort* elements = new osg::DrawElementsUShort(mode, count);
+			indices = count ? &(*elements)[0] : NULL;
+			primitiveSet = elements;
+		}
+		else
+		{
+			osg::DrawElementsUInt* elements = new osg::DrawElementsUInt(mode, count);
+			indices = count ? &(*elements)[0] : NULL;
+			primitiveSet = elements;
+		}
+		if (count)
+			memcpy(indices, data, size);
+		primitiveSet->setNumInstances(numInstances);
+		return primitiveSet;
+	}
+
+	osg::ref_ptr<osg::Geometry> readGeometry()
+	{
+		CacheGeometryType type = (CacheGeometryType)_reader.read<unsigned int>();
+		std::string name = _reader.readString();
+		osg::StateSet* stateSet = getObject(_stateSets, _reader.read<int>());
+		Material* material = getObject(_materials, _reader.read<int>());
+
+		osg::ref_ptr<osg::Geometry> geometry;
+		MaterialMorphGeometry* morph = NULL;
+		MaterialRigGeometry* rig = NULL;
+		if (type == CacheGeometryType_Rig)
+		{
+			geometry = rig = new MaterialRigGeometry;
+			if (material)
+				rig->setMaterial(material);
+		}
+		else if (type == CacheGeometryType_Morph)
+		{
+			geometry = morph = new MaterialMorphGeometry;
+			if (material)
+				morph->setMaterial(material);
+		}
+		else if (material)
+		{
+			osg::ref_ptr<MaterialBaseNode<osg::Geometry> > materialGeometry = new MaterialBaseNode<osg::Geometry>;
+			materialGeometry->setMaterial(material);
+			geometry = materialGeometry;
+		}
+		else
+		{
+			geometry = new osg::Geometry;
+		}
+		geometry->setName(name);
+		geometry->setStateSet(stateSet);
+		bool useVertexBufferObjects = _reader.read<unsigned char>() != 0;
+		geometry->setUseDisplayList(_reader.read<unsigned char>() != 0);
+		geometry->setUseVertexBufferObjects(useVertexBufferObjects);
+
+		geometry->setVertexArray(getObject(_arrays, _reader.read<int>()));
+		geometry->setNormalArray(getObject(_arrays, _reader.read<int>()));
+		geometry->setColorArray(getObject(_arrays, _reader.read<int>()));
+		geometry->setSecondaryColorArray(getObject(_arrays, _reader.read<int>()));
+		geometry->setFogCoordArray(getObject(_arrays, _reader.read<int>()));
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::Array* array = getObject(_arrays, _reader.read<int>());
+			if (array)
+				geometry->setTexCoordArray(i, array);
+		}
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::Array* array = getObject(_arrays, _reader.read<int>());
+			if (array)
+				geometry->setVertexAttribArray(i, array);
+		}
+		count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			osg::PrimitiveSet* primitiveSet = getObject(_primitiveSets, _reader.read<int>());
+			if (primitiveSet)
+				geometry->addPrimitiveSet(primitiveSet);
+		}
+
+		bool boundValid = _reader.read<unsigned char>() != 0;
+		osg::BoundingBox bound;
+		bound._min = _reader.read<osg::Vec3f>();
+		bound._max = _reader.read<osg::Vec3f>();
+		if (boundValid)
+			geometry->setInitialBound(bound);
+
+		if (morph)
+		{
+			morph->setMethod((osgAnimation::MorphGeometry::Method)_reader.read<unsigned int>());
+			if (_reader.read<unsigned char>() != 0)
+				morph->setMorphTransformImplementation(new MorphTransformMaterial);
+			count = _reader.readCount();
+			for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			{
+				osg::Geometry* target = getObject(_geometries, _reader.read<int>());
+				float weight = _reader.read<float>();
+				if (target)
+					morph->addMorphTarget(target, weight);
+			}
+		}
+		if (rig)
+		{
+			RigLink link;
+			link._geometry = rig;
+			osg::Geometry* source = getObject(_geometries, _reader.read<int>());
+			if (source)
+				rig->setSourceGeometry(source);
+			link._skeleton = _reader.read<int>();
+			link._transform = _reader.read<unsigned char>() != 0;
+			if (link._transform)
+			{
+				link._bones.resize(_reader.readCount());
+				for (size_t i = 0; i < link._bones.size(); i++)
+					link._bones[i] = _reader.read<int>();
+				link._palette = dynamic_cast<osg::MatrixfArray*>(getObject(_arrays, _reader.read<int>()));
+			}
+			_rigLinks.push_back(link);
+		}
+
+		//the primitive sets are shared, they are checked against the arrays of each geometry drawing them; a rig without
+		//arrays draws those of its source
+		const osg::Geometry* arrays = (!geometry->getVertexArray() && rig && rig->getSourceGeometry()) ? rig->getSourceGeometry() : geometry.get();
+		unsigned int numVertices = getNumVertices(arrays);
+		for (unsigned int i = geometry->getNumPrimitiveSets(); i-- > 0;)
+		{
+			if (!checkPrimitiveSet(geometry->getPrimitiveSet(i), numVertices))
+			{
+				OSG_WARN << "osgThreeJSX::SceneCache: primitive set " << i << " of " << name << " reads past " << numVertices << " vertices, skipped" << std::endl;
+				geometry->removePrimitiveSet(i);
+			}
+		}
+		return geometry;
+	}
+
+	void readStackedTransform(osgAnimation::StackedTransform& transforms)
+	{
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			CacheElementType type = (CacheElementType)_reader.read<unsigned int>();
+			std::string name = _reader.readString();
+			if (type == CacheElementType_Translate)
+				transforms.push_back(new osgAnimation::StackedTranslateElement(name, _reader.read<osg::Vec3f>()));
+			else if (type == CacheElementType_Quaternion)
+				transforms.push_back(new osgAnimation::StackedQuaternionElement(name, _reader.read<osg::Quat>()));
+			else
+				transforms.push_back(new osgAnimation::StackedScaleElement(name, _reader.read<osg::Vec3f>()));
+		}
+	}
+
+	void readUpdateCallbacks(osg::Node* node)
+	{
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			CacheCallbackType type = (CacheCallbackType)_reader.read<unsigned int>();
+			std::string name = _reader.readString();
+			if (type == CacheCallbackType_UpdateMatrixTransform || type == CacheCallbackType_UpdateBone)
+			{
+				osg::ref_ptr<osgAnimation::UpdateMatrixTransform> callback = type == CacheCallbackType_UpdateBone ?
+					new osgAnimation::UpdateBone(name) : new osgAnimation::UpdateMatrixTransform(name);
+				readStackedTransform(callback->getStackedTransforms());
+				node->addUpdateCallback(callback);
+			}
+			else if (type == CacheCallbackType_UpdateMorph)
+			{
+				node->addUpdateCallback(new osgAnimation::UpdateMorph(name));
+			}
+			else if (dynamic_cast<osgAnimation::Skeleton*>(node))
+			{
+				static_cast<osgAnimation::Skeleton*>(node)->setDefaultUpdateCallback();
+			}
+		}
+	}
+
+	osg::ref_ptr<osgAnimation::Animation> readAnimation()
+	{
+		osg::ref_ptr<osgAnimation::Animation> animation = new osgAnimation::Animation;
+		animation->setName(_reader.readString());
+		animation->setPlayMode((osgAnimation::Animation::PlayMode)_reader.read<unsigned int>());
+		animation->setWeight(_reader.read<float>());
+		animation->setStartTime(_reader.read<double>());
+		unsigned int count = _reader.readCount();
+		for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+		{
+			CacheChannelType type = (CacheChannelType)_reader.read<unsigned int>();
+			std::string name = _reader.readString();
+			std::string targetName = _reader.readString();
+			osg::ref_ptr<osgAnimation::Channel> channel;
+			bool valid = false;
+			if (type == CacheChannelType_Vec3Linear)
+			{
+				osg::ref_ptr<osgAnimation::Vec3LinearChannel> vec3Channel = new osgAnimation::Vec3LinearChannel;
+				valid = readKeyframes<osg::Vec3f>(_reader, vec3Channel.get());
+				channel = vec3Channel;
+			}
+			else if (type == CacheChannelType_QuatSphericalLinear)
+			{
+				osg::ref_ptr<osgAnimation::QuatSphericalLinearChannel> quatChannel = new osgAnimation::QuatSphericalLinearChannel;
+				valid = readKeyframes<osg::Quat>(_reader, quatChannel.get());
+				channel = quatChannel;
+			}
+			else
+			{
+				osg::ref_ptr<osgAnimation::FloatLinearChannel> floatChannel = new osgAnimation::FloatLinearChannel;
+				valid = readKeyframes<float>(_reader, floatChannel.get());
+				channel = floatChannel;
+			}
+			if (!valid)
+				continue;
+			channel->setName(name);
+			channel->setTargetName(targetName);
+			animation->addChannel(channel);
+		}
+		return animation;
+	}
+
+	osg::ref_ptr<osg::Node> readNode()
+	{
+		CacheNodeType type = (CacheNodeType)_reader.read<unsigned int>();
+		std::string name = _reader.readString();
+		unsigned int nodeMask = _reader.read<unsigned int>();
+		osg::StateSet* stateSet = getObject(_stateSets, _reader.read<int>());
+		std::vector<int> children(_reader.readCount());
+		for (size_t i = 0; i < children.size(); i++)
+			children[i] = _reader.read<int>();
+
+		osg::ref_ptr<osg::Node> node;
+		osg::MatrixTransform* transform = NULL;
+		switch (type)
+		{
+		case CacheNodeType_MatrixTransform:
+			node = transform = new osg::MatrixTransform;
+			break;
+		case CacheNodeType_Bone:
+			node = transform = new osgAnimation::Bone(name);
+			break;
+		case CacheNodeType_Skeleton:
+			node = transform = new osgAnimation::Skeleton;
+			break;
+		case CacheNodeType_AnimationNode:
+		{
+			AnimationNode* animationNode = new AnimationNode;
+			node = transform = animationNode;
+			break;
+		}
+		case CacheNodeType_Geode:
+		{
+			Material* material = getObject(_materials, _reader.read<int>());
+			osg::ref_ptr<osg::Geode> geode;
+			if (material)
+			{
+				osg::ref_ptr<MaterialBaseNode<osg::Geode> > materialGeode = new MaterialBaseNode<osg::Geode>;
+				materialGeode->setMaterial(material);
+				geode = materialGeode;
+			}
+			else
+			{
+				geode = new osg::Geode;
+			}
+			unsigned int count = _reader.readCount();
+			for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			{
+				osg::Geometry* geometry = getObject(_geometries, _reader.read<int>());
+				if (geometry)
+					geode->addDrawable(geometry);
+			}
+			node = geode;
+			break;
+		}
+		case CacheNodeType_MeshLod:
+		{
+			osg::ref_ptr<MeshLod> meshLod = new MeshLod;
+			meshLod->setMaxPixelError(_reader.read<float>());
+			std::vector<float> errors(_reader.readCount());
+			for (size_t i = 0; i < errors.size(); i++)
+				errors[i] = _reader.read<float>();
+			meshLod->setErrors(errors);
+			node = meshLod;
+			break;
+		}
+		case CacheNodeType_InstanceGeometry:
+		{
+			Material* material = getObject(_materials, _reader.read<int>());
+			osg::ref_ptr<InstanceGeometry> instance;
+			if (material)
+			{
+				osg::ref_ptr<MaterialBaseNode<InstanceGeometry> > materialInstance = new MaterialBaseNode<InstanceGeometry>;
+				materialInstance->setMaterial(material);
+				instance = materialInstance;
+			}
+			else
+			{
+				instance = new InstanceGeometry;
+			}
+			osg::Geometry* geometry = getObject(_geometries, _reader.read<int>());
+			if (geometry)
+				instance->setGeometry(geometry);
+			instance->setMaxPixelError(_reader.read<float>());
+			osg::ref_ptr<MeshLodChain> chain = new MeshLodChain;
+			unsigned int count = _reader.readCount();
+			for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+			{
+				osg::Geometry* level = getObject(_geometries, _reader.read<int>());
+				float error = _reader.read<float>();
+				if (level)
+					chain->addLevel(level, error);
+			}
+			if (chain->getNumLevels() > 0)
+				instance->setLodChain(chain);
+			unsigned int numInstances = _reader.read<unsigned int>();
+			size_t size;
+			const unsigned char* matrices = _reader.readBlock(size);
+			if (!_reader.failed() && size == numInstances * sizeof(osg::Matrixf))
+				instance->setInstances((const osg::Matrixf*)matrices, numInstances);
+			node = instance;
+			break;
+		}
+		default:
+			node = new osg::Group;
+			break;
+		}
+		node->setName(name);
+		node->setNodeMask(nodeMask);
+		node->setStateSet(stateSet);
+
+		osg::Group* group = node->asGroup();
+		for (size_t i = 0; group && i < children.size(); i++)
+		{
+			osg::Node* child = getObject(_nodes, children[i]);
+			if (child)
+				group->addChild(child);
+		}
+		if (transform)
+			transform->setMatrix(_reader.read<osg::Matrixd>());
+		if (type == CacheNodeType_AnimationNode)
+		{
+			AnimationNode* animationNode = static_cast<AnimationNode*>(node.get());
+			unsigned int count = _reader.readCount();
+			for (unsigned int i = 0; i < count && !_reader.failed(); i++)
+				animationNode->getAnimationManager()->registerAnimation(readAnimation());
+		}
+		readUpdateCallbacks(node.get());
+		return node;
+	}
+
+	//the skins refer to bones and skeletons read after them
+	void linkRigs()
+	{
+		for (size_t i = 0; i < _rigLinks.size(); i++)
+		{
+			RigLink& link = _rigLinks[i];
+			link._geometry->setSkeleton(dynamic_cast<osgAnimation::Skeleton*>(getObject(_nodes, link._skeleton)));
+			if (!link._transform)
+				continue;
+
+			osg::ref_ptr<RigTransformMaterial> rigTransform = new RigTransformMaterial;
+			for (size_t b = 0; b < link._bones.size(); b++)
+			{
+				osgAnimation::Bone* bone = dynamic_cast<osgAnimation::Bone*>(getObject(_nodes, link._bones[b]));
+				if (bone)
+					rigTransform->addBone(bone);
+			}
+			rigTransform->setMatrixPalette(link._palette);
+			link._geometry->setRigTransformImplementation(rigTransform);
+		}
+	}
+protected:
+	struct RigLink
+	{
+		RigLink() : _geometry(NULL), _skeleton(-1), _transform(false) {}
+		MaterialRigGeometry* _geometry;
+		int _skeleton;
+		bool _transform;
+		std::vector<int> _bones;
+		osg::ref_ptr<osg::MatrixfArray> _palette;
+	};
+
+	CacheReader _reader;
+	std::vector<osg::ref_ptr<osg::Image> > _images;
+	std::vector<osg::ref_ptr<osg::Texture> > _textures;
+	std::vector<osg::ref_ptr<osg::StateSet> > _stateSets;
+	std::vector<osg::ref_ptr<Material> > _materials;
+	std::vector<osg::ref_ptr<osg::Array> > _arrays;
+	std::vector<osg::ref_ptr<osg::PrimitiveSet> > _primitiveSets;
+	std::vector<osg::ref_ptr<osg::Geometry> > _geometries;
+	std::vector<osg::ref_ptr<osg::Node> > _nodes;
+	std::vector<RigLink> _rigLinks;
+};
+
+//////////////////////////////////////////////////////////////////////////
+SceneCache::SceneCache() :
+	_loadTime(0.0)
+{
+}
+
+unsigned int SceneCache::getVersion()
+{
+	return g_version;
+}
+
+bool SceneCache::write(const std::string& filename, osg::Node* scene, const LightList* lights)
+{
+	_error.clear();
+	if (!scene)
+	{
+		_error = "no scene to write";
+		return false;
+	}
+
+	//written aside and renamed, a reader never sees a partial file
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream file(temporary.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			_error = "can not write " + temporary;
+			return false;
+		}
+		SceneCacheWriter writer(file);
+		writer.write(scene, lights);
+		if (!file)
+		{
+			_error = "can not write " + temporary;
+			file.close();
+			remove(temporary.c_str());
+			return false;
+		}
+	}
+	//rename does not replace an existing file everywhere
+	if (rename(temporary.c_str(), filename.c_str()) != 0 && (remove(filename.c_str()) != 0 || rename(temporary.c_str(), filename.c_str()) != 0))
+	{
+		_error = "can not rename " + temporary + " to " + filename;
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+osg::ref_ptr<osg::Node> SceneCache::read(const std::string& filename, LightList* lights)
+{
+	_error.clear();
+	osg::Timer_t start = osg::Timer::instance()->tick();
+
+	osg::ref_ptr<MappedFile> file = new MappedFile;
+	if (!file->open(filename))
+	{
+		_error = "can not open " + filename;
+		return NULL;
+	}
+
+	SceneCacheReader reader(file->getData(), file->getSize());
+	osg::ref_ptr<osg::Node> scene = reader.read(lights, _error);
+	if (!scene.valid())
+		_error = filename + ": " + _error;
+
+	_loadTime = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+	return scene;
+}
@@ -5,6 +5,7 @@
 #include <osgThreeJSX/Shadow>
 #include <osgThreeJSX/RenderState>
 #include <osgThreeJSX/Light>
+#include <osgThreeJSX/Instrumentation>
 
 using namespace osgThreeJSX;
 
@@ -13,6 +14,7 @@ ShadowMap::ShadowMap()
 {
 	_mapType = ShadowMapType_PCFShadowMap;
 	_enable = false;
+	_depthTexture = false;
 }
 
 void ShadowMap::setup(const osg::ref_ptr<osg::Node>& scene, ShadowMapType mapType /* = ShadowMapType_BasicShadowMap */)
@@ -27,6 +29,8 @@ void ShadowMap::onCull(RenderState* renderState, osgUtil::CullVisitor* cv)
 	if (!isEnable())
 		return;
 
+	OSGTHREEJSX_SCOPED_TIMER(InstrumentTimer_ShadowMapCull);
+
 	LightList lights = renderState->getAllLight();
 	for (LightList::iterator iter = lights.begin(); iter != lights.end(); iter++)
 	{
@@ -38,6 +42,7 @@ void ShadowMap::onCull(RenderState* renderState, osgUtil::CullVisitor* cv)
 		if (shadow.valid() == false)
 			continue;
 
-		shadow->render(this, light, _sceneNode, cv);
+		if (shadow->render(this, light, _sceneNode, cv))
+			OSGTHREEJSX_COUNT(InstrumentCounter_ShadowPasses, 1);
 	}
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <osgThreeJSX/RenderState>
 #include <osg/Texture2D>
 #include <osg/Geometry>
+#include <cfloat>
 
 
 using namespace osgThreeJSX;
@@ -48,15 +49,18 @@ public:
 		_camera->setViewport(0, 0, _mapSize.x(), _mapSize.y());
 		_camera->setRenderOrder(osg::Camera::PRE_RENDER, 1);
 		_camera->setRenderTargetImplementation(osg::Camera::FRAME_BUFFER_OBJECT);
-		_camera->attach(osg::Camera::COLOR_BUFFER, _map);
-		_camera->setClearColor(osg::Vec4f(1.0f, 1.0f, 1.0f, 1.0f));
-		_camera->setClearMask(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		attachMap(_camera, _map);
 
 		_camera->addChild(node);
 
 		osg::ref_ptr<RenderState> rs = new RenderState();
 		rs->setupCamera(_camera, light);
 
+		updateCamera(shadowMap, light, node);
+	}
+	//
+	virtual void updateCamera(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node)
+	{
 		SpotLight* dLight = dynamic_cast<SpotLight*>(light.get());
 			   	
 		float fov = dLight->getAngle() * 2.0 * 180.0 / osg::PI;
@@ -78,6 +82,87 @@ public:
 			osg::Matrix::translate(1.0, 1.0, 1.0) *
 			osg::Matrix::scale(0.5f, 0.5f, 0.5f);
 	}
+	//narrow the frustum to the receivers in view and the casters that can shadow them
+	virtual bool fitToView(ShadowMap* shadowMap, const osg::ref_ptr<Light>& light, const osg::ref_ptr<osg::Node>& node, osgUtil::CullVisitor* cv)
+	{
+		SpotLight* dLight = dynamic_cast<SpotLight*>(light.get());
+		if (!_autoFit || dLight->getDistance() <= 0.0f)
+			return false;
+
+		const double minNear = 0.1;
+		double tanY = tan(dLight->getAngle());
+		double tanX = tanY * _mapSize.x() / _mapSize.y();
+		double left = -tanX, right = tanX, bottom = -tanY, top = tanY;
+		double znear = minNear, zfar = dLight->getDistance();
+
+		osg::Matrix lightView = _camera->getViewMatrix();
+		osg::Matrix coneProjection;
+		coneProjection.makeFrustum(left * znear, right * znear, bottom * znear, top * znear, znear, zfar);
+
+		osg::Vec3d nearCorners[4], farCorners[4];
+		double viewNear, viewFar;
+		if (computeViewFrustum(cv, node->getBound(), _cascadeMaxDistance, nearCorners, farCorners, viewNear, viewFar))
+		{
+			osg::BoundingBox receivers;
+			for (int i = 0; i < 4; i++)
+			{
+				receivers.expandBy(nearCorners[i] * lightView);
+				receivers.expandBy(farCorners[i] * lightView);
+			}
+
+			osg::Polytope volume;
+			volume.setToUnitFrustum();
+			volume.transformProvidingInverse(lightView * coneProjection);
+			osg::BoundingBox casters = computeCasterBound(node, volume, lightView);
+
+			//the light looks down -z, a box only narrows the cone when it lies fully in front of the light
+			clipWindow(receivers, znear, left, right, bottom, top);
+			if (casters.valid())
+			{
+				clipWindow(casters, znear, left, right, bottom, top);
+				znear = osg::maximum(znear, -(double)casters.zMax());
+			}
+			zfar = osg::minimum(zfar, -(double)receivers.zMin());
+		}
+		if (left >= right || bottom >= top || zfar <= znear)
+		{
+			left = -tanX; right = tanX; bottom = -tanY; top = tanY;
+			znear = minNear; zfar = dLight->getDistance();
+		}
+
+		_camera->setProjectionMatrixAsFrustum(left * znear, right * znear, bottom * znear, top * znear, znear, zfar);
+
+		osg::Matrix matrix = _camera->getViewMatrix() *
+			_camera->getProjectionMatrix() *
+			osg::Matrix::translate(1.0, 1.0, 1.0) *
+			osg::Matrix::scale(0.5f, 0.5f, 0.5f);
+		bool moved = (matrix != _matrix);
+		_matrix = matrix;
+		return moved;
+	}
+protected:
+	//intersect the tangent window with the projection of a light space box
+	void clipWindow(const osg::BoundingBox& box, double znear, double& left, double& right, double& bottom, double& top)
+	{
+		if (!box.valid() || box.zMax() >= -znear)
+			return;
+
+		double boxLeft = DBL_MAX, boxRight = -DBL_MAX, boxBottom = DBL_MAX, boxTop = -DBL_MAX;
+		for (unsigned int i = 0; i < 8; i++)
+		{
+			osg::Vec3d corner = box.corner(i);
+			double x = corner.x() / -corner.z();
+			double y = corner.y() / -corner.z();
+			boxLeft = osg::minimum(boxLeft, x);
+			boxRight = osg::maximum(boxRight, x);
+			boxBottom = osg::minimum(boxBottom, y);
+			boxTop = osg::maximum(boxTop, y);
+		}
+		left = osg::maximum(left, boxLeft);
+		right = osg::minimum(right, boxRight);
+		bottom = osg::maximum(bottom, boxBottom);
+		top = osg::minimum(top, boxTop);
+	}
 
 	META_Object(osg, SpotLightShadow);
 };
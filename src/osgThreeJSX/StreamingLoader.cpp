@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <osg/Geode>
+#include <osg/Timer>
+#include <osg/Notify>
+#include <osgThreeJSX/StreamingLoader>
+#include <osgThreeJSX/Materials>
+#include <osgThreeJSX/Tracer>
+
+using namespace osgThreeJSX;
+
+//////////////////////////////////////////////////////////////////////////
+class StreamingUpdateCallback : public osg::NodeCallback
+{
+public:
+	StreamingUpdateCallback(StreamingLoader* loader) : _loader(loader) {}
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+	{
+		if (nv->getFrameStamp())
+			_loader->update(nv->getFrameStamp()->getFrameNumber());
+		traverse(node, nv);
+	}
+private:
+	osg::ref_ptr<StreamingLoader> _loader;
+};
+
+class StreamingCullCallback : public osg::NodeCallback
+{
+public:
+	StreamingCullCallback(StreamingLoader* loader) : _loader(loader) {}
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+	{
+		osgUtil::CullVisitor* cv = dynamic_cast<osgUtil::CullVisitor*>(nv);
+		if (cv)
+			_loader->cull(cv->getCurrentCamera(), cv);
+		traverse(node, nv);
+	}
+private:
+	osg::ref_ptr<StreamingLoader> _loader;
+};
+
+class StreamingDrawCallback : public osg::Camera::DrawCallback
+{
+public:
+	StreamingDrawCallback(StreamingLoader* loader) : _loader(loader) {}
+
+	virtual void operator()(osg::RenderInfo& renderInfo) const
+	{
+		_loader->compile(renderInfo);
+	}
+private:
+	osg::ref_ptr<StreamingLoader> _loader;
+};
+
+//collects the material nodes of a loaded subtree
+class StreamingMaterialVisitor : public osg::NodeVisitor
+{
+public:
+	StreamingMaterialVisitor() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+	virtual void apply(osg::Node& node)
+	{
+		for (osg::Callback* callback = node.getCullCallback(); callback; callback = callback->getNestedCallback())
+		{
+			MaterialNodeCullback* materialCallback = dynamic_cast<MaterialNodeCullback*>(callback);
+			if (materialCallback && materialCallback->getMaterial().valid())
+			{
+				StreamingMaterialItem item;
+				item._node = &node;
+				item._callback = materialCallback;
+				item._material = materialCallback->getMaterial();
+				item._nodeMask = node.getNodeMask();
+				_items.push_back(item);
+			}
+		}
+		traverse(node);
+	}
+
+	StreamingLoader::StreamingMaterialList _items;
+};
+
+//uniforms written by the rig and morph transforms into their material
+static const char* s_deformUniforms[] = { "boneMatrices", "bindMatrix", "bindMatrixInverse", "morphTargetInfluences", "morphTargetBaseInfluence" };
+
+//////////////////////////////////////////////////////////////////////////
+StreamingLoader::StreamingLoader() :
+	_numLoading(0),
+	_generateFrame(~0u),
+	_compileFrame(~0u),
+	_frameBudget(2.0),
+	_maxAttachPerFrame(1),
+	_placeholderEnable(true),
+	_frameNumber(0),
+	_frameCost(0.0),
+	_lastFrameCost(0.0),
+	_maxFrameCost(0.0),
+	_generateEstimate(0.0),
+	_compileEstimate(0.0)
+{
+	//one loading thread, the glTF decoding itself runs on the pool of the GltfLoader
+	_loadingThread = new ThreadPool(1);
+	_gltfLoader = new GltfLoader();
+}
+
+StreamingLoader::~StreamingLoader()
+{
+	_loadingThread = NULL;
+}
+
+void StreamingLoader::setupCamera(osg::Camera* camera)
+{
+	camera->addUpdateCallback(new StreamingUpdateCallback(this));
+	camera->addCullCallback(new StreamingCullCallback(this));
+	camera->addPreDrawCallback(new StreamingDrawCallback(this));
+}
+
+void StreamingLoader::load(const std::string& filename, osg::Group* parent)
+{
+	osg::ref_ptr<GltfLoader> gltfLoader = _gltfLoader;
+	load([gltfLoader, filename]()
+	{
+		osg::ref_ptr<osg::Node> node = gltfLoader->load(filename);
+		if (!node.valid())
+			OSG_WARN << "osgThreeJSX::StreamingLoader: " << gltfLoader->getError() << std::endl;
+		return node;
+	}, parent);
+}
+
+void StreamingLoader::load(const LoadFunction& function, osg::Group* parent)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_numLoading++;
+	}
+
+	osg::observer_ptr<osg::Group> observer(parent);
+	_loadingThread->addTask([this, function, observer]()
+	{
+		Request request;
+		request._node = function();
+		request._parent = observer;
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_numLoading--;
+		if (request._node.valid())
+			_loaded.push_back(request);
+	});
+}
+
+unsigned int StreamingLoader::getNumPending()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _numLoading + _loaded.size() + _generating.size() + _compiling.size() + _compiled.size();
+}
+
+void StreamingLoader::beginFrame(unsigned int frameNumber)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	if (frameNumber <= _frameNumber)
+		return;
+
+	_lastFrameCost = _frameCost;
+	_maxFrameCost = std::max(_maxFrameCost, _frameCost);
+	_frameCost = 0.0;
+	_frameNumber = frameNumber;
+}
+
+bool StreamingLoader::hasBudget(double estimate)
+{
+	//the first item of a frame always runs so streaming never stalls
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _frameCost == 0.0 || _frameCost + estimate <= _frameBudget;
+}
+
+void StreamingLoader::addCost(double cost)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_frameCost += cost;
+}
+
+void StreamingLoader::update(unsigned int frameNumber)
+{
+	beginFrame(frameNumber);
+
+	for (unsigned int i = 0; i < _maxAttachPerFrame && hasBudget(0.0); i++)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			if (_loaded.empty())
+				break;
+			request = _loaded.front();
+			_loaded.pop_front();
+		}
+
+		osg::ref_ptr<osg::Group> parent;
+		if (!request._parent.lock(parent))
+			continue;
+
+		ScopedTrace trace("streaming attach", "streaming");
+		osg::Timer_t start = osg::Timer::instance()->tick();
+		activate(request._node.get());
+		parent->addChild(request._node);
+		addCost(osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick()));
+	}
+}
+
+void StreamingLoader::activate(osg::Node* node)
+{
+	StreamingMaterialVisitor visitor;
+	node->accept(visitor);
+
+	for (StreamingMaterialList::iterator iter = visitor._items.begin(); iter != visitor._items.end(); iter++)
+	{
+		if (_placeholderEnable)
+		{
+			iter->_placeholder = createPlaceholder(iter->_material.get());
+			iter->_callback->setMaterial(iter->_placeholder);
+		}
+		else
+		{
+			iter->_node.get()->setNodeMask(0);
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_generating.insert(_generating.end(), visitor._items.begin(), visitor._items.end());
+}
+
+osg::ref_ptr<Material> StreamingLoader::createPlaceholder(Material* material)
+{
+	MaterialDataCommon* common = NULL;
+	if (MaterialBasic* basic = dynamic_cast<MaterialBasic*>(material))
+		common = &basic->_common;
+	else if (MaterialLambert* lambert = dynamic_cast<MaterialLambert*>(material))
+		common = &lambert->_common;
+	else if (MaterialPhong* phong = dynamic_cast<MaterialPhong*>(material))
+		common = &phong->_common;
+
+	//unlit and untextured, its few variants are shared by every streamed material
+	osg::ref_ptr<MaterialBasic> placeholder = new MaterialBasic();
+	if (common)
+	{
+		placeholder->_common.color = common->color;
+		placeholder->_common.opacity = common->opacity;
+	}
+	placeholder->setSide(material->getSide());
+	placeholder->setTransparent(material->getTransparent());
+	placeholder->setVertexColors(material->getVertexColors());
+	placeholder->setSkinning(material->getSkinning());
+	placeholder->setMaxBones(material->getMaxBones());
+	placeholder->setMorphTargets(material->getMorphTargets());
+	placeholder->setMorphNormals(material->getMorphNormals());
+	placeholder->setInstancing(material->getInstancing());
+	placeholder->setVertexQuantization(material->getVertexQuantization());
+	placeholder->setVertexAttribList(material->getVertexAttribList());
+	placeholder->setCastShadow(material->getCastShadow());
+	placeholder->setReceiveShadow(material->getReceiveShadow());
+
+	osg::BlendFunc::BlendFuncMode src, dst, srcAlpha, dstAlpha;
+	material->getBlendFuncMode(src, dst, srcAlpha, dstAlpha);
+	placeholder->setBlendFuncMode(src, dst, srcAlpha, dstAlpha);
+	return placeholder;
+}
+
+void StreamingLoader::shareDeformUniforms(StreamingMaterialList& items)
+{
+	for (StreamingMaterialList::iterator iter = items.begin(); iter != items.end(); iter++)
+	{
+		if (!iter->_placeholder.valid() || (!iter->_material->getSkinning() && !iter->_material->getMorphTargets()))
+			continue;
+
+		//the transforms create them on their first update
+		for (size_t i = 0; i < sizeof(s_deformUniforms) / sizeof(s_deformUniforms[0]); i++)
+		{
+			osg::Uniform* uniform = iter->_material->getUniform(s_deformUniforms[i]);
+			if (uniform && iter->_placeholder->getUniform(s_deformUniforms[i]) != uniform)
+				iter->_placeholder->setUniform(uniform);
+		}
+	}
+}
+
+void StreamingLoader::cull(osg::Camera* camera, osgUtil::CullVisitor* cv)
+{
+	//the depth pre-pass traverses the camera twice
+	unsigned int frameNumber = cv->getFrameStamp() ? cv->getFrameStamp()->getFrameNumber() : 0;
+	if (frameNumber == _generateFrame)
+		return;
+	_generateFrame = frameNumber;
+	beginFrame(frameNumber);
+
+	StreamingMaterialList items;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		//compiled at the last draw, the real materials take over before this traversal
+		for (StreamingMaterialList::iterator iter = _compiled.begin(); iter != _compiled.end(); iter++)
+		{
+			iter->_callback->setMaterial(iter->_material);
+			osg::ref_ptr<osg::Node> node;
+			if (!iter->_placeholder.valid() && iter->_node.lock(node))
+				node->setNodeMask(iter->_nodeMask);
+		}
+		_compiled.clear();
+
+		shareDeformUniforms(_generating);
+		shareDeformUniforms(_compiling);
+		items.swap(_generating);
+	}
+
+	size_t count = 0;
+	for (; count < items.size() && hasBudget(_generateEstimate); count++)
+	{
+		StreamingMaterialItem& item = items[count];
+		osg::ref_ptr<osg::Node> node;
+		if (!item._node.lock(node))
+			continue;
+
+		//the program and the state of the variant this camera will draw
+		ScopedTrace trace("streaming generate", "streaming");
+		osg::Timer_t start = osg::Timer::instance()->tick();
+		item._material->update(camera, cv, node.get());
+		double cost = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+		_generateEstimate = _generateEstimate * 0.75 + cost * 0.25;
+		addCost(cost);
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_compiling.push_back(item);
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_generating.insert(_generating.begin(), items.begin() + count, items.end());
+}
+
+void StreamingLoader::compile(osg::RenderInfo& renderInfo)
+{
+	osg::State* state = renderInfo.getState();
+	unsigned int frameNumber = state->getFrameStamp() ? state->getFrameStamp()->getFrameNumber() : 0;
+	if (frameNumber == _compileFrame)
+		return;
+	_compileFrame = frameNumber;
+	beginFrame(frameNumber);
+
+	StreamingMaterialList items;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		items.swap(_compiling);
+	}
+
+	size_t count = 0;
+	for (; count < items.size() && hasBudget(_compileEstimate); count++)
+	{
+		StreamingMaterialItem& item = items[count];
+		osg::ref_ptr<osg::Node> node;
+		if (!item._node.lock(node))
+			continue;
+
+		//program link and texture upload, then the buffers of the drawables
+		ScopedTrace trace("streaming compile", "streaming");
+		osg::Timer_t start = osg::Timer::instance()->tick();
+		if (item._material->getStateset())
+			item._material->getStateset()->compileGLObjects(*state);
+		//the rig and morph geometries carry their material themselves
+		osg::Geode* geode = node->asGeode();
+		for (unsigned int i = 0; geode && i < geode->getNumDrawables(); i++)
+			geode->getDrawable(i)->compileGLObjects(renderInfo);
+		if (node->asDrawable())
+			node->asDrawable()->compileGLObjects(renderInfo);
+		double cost = osg::Timer::instance()->delta_m(start, osg::Timer::instance()->tick());
+		_compileEstimate = _compileEstimate * 0.75 + cost * 0.25;
+		addCost(cost);
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_compiled.push_back(item);
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_compiling.insert(_compiling.begin(), items.begin() + count, items.end());
+}
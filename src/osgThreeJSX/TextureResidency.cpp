@@ -0,0 +1,531 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/TriangleIndexFunctor>
+#include <osg/Stats>
+#include <osg/Notify>
+#include <osgDB/ReadFile>
+#include <osgDB/FileUtils>
+#include <osgDB/FileNameUtils>
+#include <osgThreeJSX/TextureResidency>
+#include <osgThreeJSX/KtxTranscoder>
+#include <osgThreeJSX/RenderState>
+#include <osgThreeJSX/Material>
+
+using namespace osgThreeJSX;
+
+//////////////////////////////////////////////////////////////////////////
+class TextureResidencyUpdateCallback : public osg::NodeCallback
+{
+public:
+	TextureResidencyUpdateCallback(TextureResidencyManager* manager) : _manager(manager) {}
+
+	virtual void operator()(osg::Node* node, osg::NodeVisitor* nv)
+	{
+		if (node->asCamera() && nv->getFrameStamp())
+			_manager->update(node->asCamera(), nv->getFrameStamp()->getFrameNumber());
+		traverse(node, nv);
+	}
+private:
+	osg::ref_ptr<TextureResidencyManager> _manager;
+};
+
+class TextureResidencyDrawCallback : public osg::Camera::DrawCallback
+{
+public:
+	TextureResidencyDrawCallback(TextureResidencyManager* manager) : _manager(manager) {}
+
+	virtual void operator()(osg::RenderInfo&) const
+	{
+		_manager->swapImages();
+	}
+private:
+	osg::ref_ptr<TextureResidencyManager> _manager;
+};
+
+//areas of the triangles in model space and in uv space
+struct UvAreaCollector
+{
+	UvAreaCollector() : _vertices(NULL), _uvs(NULL), _area(0.0), _uvArea(0.0) {}
+
+	void operator()(unsigned int i0, unsigned int i1, unsigned int i2)
+	{
+		if (i0 >= _vertices->size() || i1 >= _vertices->size() || i2 >= _vertices->size())
+			return;
+
+		const osg::Vec3& v0 = (*_vertices)[i0];
+		_area += (((*_vertices)[i1] - v0) ^ ((*_vertices)[i2] - v0)).length() * 0.5;
+
+		const osg::Vec2& t0 = (*_uvs)[i0];
+		osg::Vec2 e1 = (*_uvs)[i1] - t0;
+		osg::Vec2 e2 = (*_uvs)[i2] - t0;
+		_uvArea += fabs(e1.x() * e2.y() - e1.y() * e2.x()) * 0.5;
+	}
+
+	const osg::Vec3Array* _vertices;
+	const osg::Vec2Array* _uvs;
+	double _area;
+	double _uvArea;
+};
+
+//the level whose width matches the image
+static unsigned int getLevel(unsigned int width, unsigned int levelWidth)
+{
+	unsigned int level = 0;
+	while ((width >> (level + 1)) >= levelWidth && (width >> (level + 1)) > 0)
+		level++;
+	return level;
+}
+
+//the image with its finest levels dropped, NULL when it can not be made on the CPU
+static osg::ref_ptr<osg::Image> reduceImage(const osg::Image* image, unsigned int levels)
+{
+	unsigned int width = std::max(1, image->s() >> levels);
+	unsigned int height = std::max(1, image->t() >> levels);
+	if (image->getNumMipmapLevels() > 1)
+	{
+		//the next levels are already there
+		if (levels >= image->getNumMipmapLevels())
+			return NULL;
+
+		unsigned int offset = image->getMipmapOffset(levels);
+		unsigned int size = image->getTotalSizeInBytesIncludingMipmaps() - offset;
+		unsigned char* data = new unsigned char[size];
+		memcpy(data, image->data() + offset, size);
+
+		osg::Image::MipmapDataType offsets;
+		for (unsigned int i = levels + 1; i < image->getNumMipmapLevels(); i++)
+			offsets.push_back(image->getMipmapOffset(i) - offset);
+
+		osg::ref_ptr<osg::Image> result = new osg::Image();
+		result->setImage(width, height, 1, image->getInternalTextureFormat(), image->getPixelFormat(), image->getDataType(), data, osg::Image::USE_NEW_DELETE, image->getPacking());
+		result->setMipmapLevels(offsets);
+		result->setOrigin(image->getOrigin());
+		result->setFileName(image->getFileName());
+		return result;
+	}
+
+	if (image->isCompressed())
+		return NULL;
+
+	osg::ref_ptr<osg::Image> result = new osg::Image(*image, osg::CopyOp::DEEP_COPY_ALL);
+	result->scaleImage(width, height, 1);
+	return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+TextureResidencyManager::TextureResidencyManager() :
+	_budget(256 * 1024 * 1024),
+	_residentBytes(0),
+	_maxLoads(4),
+	_texelsPerPixel(1.0f),
+	_frameNumber(0),
+	_numLoads(0),
+	_numEvictions(0)
+{
+	_threadPool = new ThreadPool(2);
+}
+
+TextureResidencyManager::~TextureResidencyManager()
+{
+	//the loads in flight finish before the entries go away
+	_threadPool = NULL;
+}
+
+void TextureResidencyManager::setupCamera(osg::Camera* camera)
+{
+	RenderState* renderState = RenderState::FromCamera(camera);
+	if (renderState)
+		renderState->setTextureResidencyManager(this);
+	camera->addUpdateCallback(new TextureResidencyUpdateCallback(this));
+	camera->addPreDrawCallback(new TextureResidencyDrawCallback(this));
+}
+
+TextureResidencyEntry* TextureResidencyManager::getOrCreateEntry(osg::Texture2D* texture)
+{
+	EntryMap::iterator iter = _entries.find(texture);
+	if (iter != _entries.end())
+		return iter->second._filename.empty() ? NULL : &iter->second;
+
+	//images made in memory or compressed without mipmaps are left alone, an empty filename marks them
+	TextureResidencyEntry& entry = _entries[texture];
+	entry._texture = texture;
+	entry._loading = false;
+	entry._residentLevel = 0;
+	entry._requestedLevel = 0;
+	entry._requestFrame = 0;
+	entry._lastUsedFrame = 0;
+	entry._numLevels = 0;
+
+	osg::Image* image = texture->getImage();
+	if (!image || image->getFileName().empty() || image->s() <= 0 || image->t() <= 0 || (image->isCompressed() && image->getNumMipmapLevels() <= 1))
+		return NULL;
+
+	entry._filename = image->getFileName();
+	entry._origin = image->getOrigin();
+	entry._width = image->s();
+	entry._height = image->t();
+	entry._pixelFormat = image->getPixelFormat();
+	entry._dataType = image->getDataType();
+
+	//the GPU builds the whole chain of uncompressed images, compressed ones only have their file levels
+	unsigned int numLevels = 1;
+	while ((std::max(entry._width, entry._height) >> numLevels) > 0)
+		numLevels++;
+	entry._numLevels = image->isCompressed() ? std::min(numLevels, image->getNumMipmapLevels()) : numLevels;
+	entry._image = image;
+	_residentBytes += getBytes(entry, 0);
+	return &entry;
+}
+
+float TextureResidencyManager::getUvDensity(osg::Node* node)
+{
+	std::map<const osg::Node*, UvDensity>::iterator iter = _uvDensities.find(node);
+	if (iter != _uvDensities.end() && iter->second._node.get() == node)
+		return iter->second._density;
+
+	double area = 0.0;
+	double uvArea = 0.0;
+	osg::Geode* geode = node->asGeode();
+	for (unsigned int i = 0; geode && i < geode->getNumDrawables(); i++)
+	{
+		osg::Geometry* geometry = geode->getDrawable(i)->asGeometry();
+		if (!geometry)
+			continue;
+
+		osg::TriangleIndexFunctor<UvAreaCollector> collector;
+		collector._vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+		collector._uvs = dynamic_cast<const osg::Vec2Array*>(geometry->getTexCoordArray(0));
+		if (!collector._vertices || !collector._uvs || collector._uvs->size() < collector._vertices->size())
+			continue;
+
+		geometry->accept(collector);
+		area += collector._area;
+		uvArea += collector._uvArea;
+	}
+
+	//without uvs the texture is taken as stretched once over the bound
+	float density = 1.0f / std::max(node->getBound().radius() * 2.0f, 1e-6f);
+	if (area > 0.0 && uvArea > 0.0)
+		density = sqrt(uvArea / area);
+
+	UvDensity& entry = _uvDensities[node];
+	entry._node = node;
+	entry._density = density;
+	return density;
+}
+
+size_t TextureResidencyManager::getBytes(const TextureResidencyEntry& entry, unsigned int level)
+{
+	size_t bytes = 0;
+	for (unsigned int i = level; i < entry._numLevels; i++)
+		bytes += osg::Image::computeImageSizeInBytes(std::max(1u, entry._width >> i), std::max(1u, entry._height >> i), 1, entry._pixelFormat, entry._dataType, 1);
+	return bytes;
+}
+
+void TextureResidencyManager::request(Material* material, osg::Node* node, osgUtil::CullVisitor* cv)
+{
+	const MaterialTextureList& textures = material->getBuildTextureList();
+	if (textures.empty() || !cv->getFrameStamp())
+		return;
+
+	//texels across the node against pixels across its projection
+	const osg::BoundingSphere& bound = node->getBound();
+	float pixels = std::max(cv->clampedPixelSize(bound) * 2.0f, 1.0f) * _texelsPerPixel;
+	unsigned int frameNumber = cv->getFrameStamp()->getFrameNumber();
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	float uvAcross = getUvDensity(node) * bound.radius() * 2.0f;
+	for (MaterialTextureList::const_iterator iter = textures.begin(); iter != textures.end(); iter++)
+	{
+		osg::Texture2D* texture = dynamic_cast<osg::Texture2D*>(iter->_texture.get());
+		bool created = texture && _entries.find(texture) == _entries.end();
+		TextureResidencyEntry* entry = texture ? getOrCreateEntry(texture) : NULL;
+		if (!entry)
+			continue;
+
+		float texels = uvAcross * std::max(entry->_width, entry->_height);
+		unsigned int level = 0;
+		if (texels > pixels)
+			level = std::min((unsigned int)floor(log2(texels / pixels)), entry->_numLevels - 1);
+
+		if (entry->_requestFrame != frameNumber || level < entry->_requestedLevel)
+			entry->_requestedLevel = level;
+		entry->_requestFrame = frameNumber;
+		entry->_lastUsedFrame = frameNumber;
+
+		//the file was read whole, the texture starts at the level asked for
+		if (created && level > 0)
+			reduce(*entry, level);
+	}
+}
+
+void TextureResidencyManager::setImage(TextureResidencyEntry& entry, osg::Image* image)
+{
+	entry._image = image;
+	ImageSwap swap;
+	swap._texture = entry._texture;
+	swap._image = image;
+	_swaps.push_back(swap);
+}
+
+void TextureResidencyManager::load(TextureResidencyEntry& entry, unsigned int level)
+{
+	entry._loading = true;
+
+	osg::observer_ptr<osg::Texture2D> texture = entry._texture;
+	std::string filename = entry._filename;
+	osg::Image::Origin origin = entry._origin;
+	unsigned int width = entry._width;
+	unsigned int height = entry._height;
+	_threadPool->addTask([this, texture, filename, origin, width, height, level]()
+	{
+		//KTX2 files only give the levels asked for
+		std::string path = osgDB::findDataFile(filename);
+		osg::ref_ptr<osg::Image> image;
+		if (osgDB::getLowerCaseFileExtension(filename) == "ktx2")
+			image = KtxTranscoder::instance()->read(path, NULL, level);
+		else if (!path.empty())
+			image = osgDB::readRefImageFile(path);
+
+		LoadResult result;
+		result._texture = texture;
+		result._level = level;
+		result._reduced = false;
+		if (image.valid() && image->s() > 0)
+		{
+			result._level = getLevel(width, image->s());
+			if (result._level < level && !image->isCompressed())
+			{
+				image->scaleImage(std::max(1u, width >> level), std::max(1u, height >> level), 1);
+				result._level = level;
+			}
+			if (!image->isCompressed() && image->getOrigin() != origin)
+			{
+				image->flipVertical();
+				image->setOrigin(origin);
+			}
+			image->setFileName(filename);
+			result._image = image;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_results.push_back(result);
+	});
+}
+
+void TextureResidencyManager::reduce(TextureResidencyEntry& entry, unsigned int level)
+{
+	entry._loading = true;
+	_residentBytes -= getBytes(entry, entry._residentLevel);
+	unsigned int levels = level - entry._residentLevel;
+	entry._residentLevel = level;
+	_residentBytes += getBytes(entry, entry._residentLevel);
+
+	osg::observer_ptr<osg::Texture2D> texture = entry._texture;
+	osg::ref_ptr<osg::Image> image = entry._image;
+	_threadPool->addTask([this, texture, image, level, levels]()
+	{
+		LoadResult result;
+		result._texture = texture;
+		result._image = image.valid() ? reduceImage(image.get(), levels) : NULL;
+		result._level = level;
+		result._reduced = true;
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_results.push_back(result);
+	});
+}
+
+void TextureResidencyManager::release(TextureResidencyEntry& entry)
+{
+	_residentBytes -= getBytes(entry, entry._residentLevel);
+	entry._filename.clear();
+	entry._image = NULL;
+}
+
+bool TextureResidencyManager::evict(unsigned int frameNumber, const TextureResidencyEntry* keep)
+{
+	//not drawn lately first, then finer than needed, then the least recently used
+	TextureResidencyEntry* best = NULL;
+	int bestNeeded = 0;
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); iter++)
+	{
+		TextureResidencyEntry& entry = iter->second;
+		if (&entry == keep || entry._filename.empty() || entry._loading || entry._residentLevel + 1 >= entry._numLevels || !entry._texture.valid())
+			continue;
+
+		int needed = entry._lastUsedFrame + 1 >= frameNumber && entry._residentLevel >= entry._requestedLevel ? 1 : 0;
+		if (!best || needed < bestNeeded || (needed == bestNeeded && entry._lastUsedFrame < best->_lastUsedFrame))
+		{
+			best = &entry;
+			bestNeeded = needed;
+		}
+	}
+	if (!best)
+		return false;
+
+	reduce(*best, best->_residentLevel + 1);
+	_numEvictions++;
+	return true;
+}
+
+void TextureResidencyManager::update(osg::Camera* camera, unsigned int frameNumber)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_frameNumber = frameNumber;
+
+	//levels read since the last frame
+	for (std::vector<LoadResult>::iterator iter = _results.begin(); iter != _results.end(); iter++)
+	{
+		osg::ref_ptr<osg::Texture2D> texture;
+		EntryMap::iterator entry = iter->_texture.lock(texture) ? _entries.find(texture.get()) : _entries.end();
+		if (entry == _entries.end())
+			continue;
+
+		entry->second._loading = false;
+		if (entry->second._filename.empty())
+			continue;
+		if (!iter->_image.valid())
+		{
+			//a coarser level that can not be made on the CPU only stops the managing
+			if (!iter->_reduced)
+				OSG_WARN << "osgThreeJSX::TextureResidencyManager: can not read " << entry->second._filename << std::endl;
+			release(entry->second);
+			continue;
+		}
+		if (iter->_reduced)
+			setImage(entry->second, iter->_image.get());
+		else if (iter->_level < entry->second._residentLevel)
+		{
+			_residentBytes -= getBytes(entry->second, entry->second._residentLevel);
+			entry->second._residentLevel = iter->_level;
+			_residentBytes += getBytes(entry->second, entry->second._residentLevel);
+			setImage(entry->second, iter->_image.get());
+			_numLoads++;
+		}
+	}
+	_results.clear();
+
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end();)
+	{
+		if (iter->second._texture.valid())
+		{
+			iter++;
+			continue;
+		}
+		if (!iter->second._filename.empty())
+			_residentBytes -= getBytes(iter->second, iter->second._residentLevel);
+		_entries.erase(iter++);
+	}
+	for (std::map<const osg::Node*, UvDensity>::iterator iter = _uvDensities.begin(); iter != _uvDensities.end();)
+	{
+		if (iter->second._node.valid())
+			iter++;
+		else
+			_uvDensities.erase(iter++);
+	}
+
+	//finer levels for the textures drawn in the last frame, the most missing levels first
+	std::vector<TextureResidencyEntry*> loads;
+	unsigned int numLoading = 0;
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); iter++)
+	{
+		TextureResidencyEntry& entry = iter->second;
+		if (entry._loading)
+			numLoading++;
+		else if (!entry._filename.empty() && entry._lastUsedFrame + 1 >= frameNumber && entry._requestedLevel < entry._residentLevel)
+			loads.push_back(&entry);
+	}
+	std::sort(loads.begin(), loads.end(), [](const TextureResidencyEntry* lhs, const TextureResidencyEntry* rhs)
+	{
+		return lhs->_residentLevel - lhs->_requestedLevel > rhs->_residentLevel - rhs->_requestedLevel;
+	});
+
+	size_t reserved = 0;
+	for (size_t i = 0; i < loads.size() && numLoading < _maxLoads; i++)
+	{
+		TextureResidencyEntry& entry = *loads[i];
+		size_t extra = getBytes(entry, entry._requestedLevel) - getBytes(entry, entry._residentLevel);
+		while (_residentBytes + reserved + extra > _budget && evict(frameNumber, &entry)) {}
+		if (_residentBytes + reserved + extra > _budget)
+			break;
+
+		load(entry, entry._requestedLevel);
+		reserved += extra;
+		numLoading++;
+	}
+
+	while (_residentBytes > _budget && evict(frameNumber, NULL)) {}
+
+	osg::Stats* stats = camera->getStats();
+	if (stats && stats->collectStats("rendering"))
+	{
+		stats->setAttribute(frameNumber, "Texture resident MB", _residentBytes / (1024.0 * 1024.0));
+		stats->setAttribute(frameNumber, "Texture budget MB", _budget / (1024.0 * 1024.0));
+		stats->setAttribute(frameNumber, "Texture loads", numLoading);
+	}
+}
+
+void TextureResidencyManager::swapImages()
+{
+	std::vector<ImageSwap> swaps;
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		swaps.swap(_swaps);
+	}
+
+	//the draw thread is the only one applying the textures, another size needs another texture object
+	for (std::vector<ImageSwap>::iterator iter = swaps.begin(); iter != swaps.end(); iter++)
+	{
+		osg::ref_ptr<osg::Texture2D> texture;
+		if (!iter->_texture.lock(texture))
+			continue;
+		texture->setImage(iter->_image.get());
+		texture->dirtyTextureObject();
+	}
+}
+
+unsigned int TextureResidencyManager::getNumTextures()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	unsigned int count = 0;
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); iter++)
+	{
+		if (!iter->second._filename.empty())
+			count++;
+	}
+	return count;
+}
+
+size_t TextureResidencyManager::getResidentBytes()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _residentBytes;
+}
+
+size_t TextureResidencyManager::getRequestedBytes()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	size_t bytes = 0;
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); iter++)
+	{
+		if (!iter->second._filename.empty())
+			bytes += getBytes(iter->second, iter->second._requestedLevel);
+	}
+	return bytes;
+}
+
+unsigned int TextureResidencyManager::getNumLoading()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	unsigned int count = 0;
+	for (EntryMap::iterator iter = _entries.begin(); iter != _entries.end(); iter++)
+	{
+		if (iter->second._loading)
+			count++;
+	}
+	return count;
+}
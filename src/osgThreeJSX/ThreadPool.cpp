@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <osgThreeJSX/ThreadPool>
+
+using namespace osgThreeJSX;
+
+ThreadPool::ThreadPool(unsigned int numThreads) :
+	_pending(0),
+	_stop(false)
+{
+	if (numThreads == 0)
+		numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < numThreads; i++)
+		_threads.push_back(std::thread(&ThreadPool::run, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_taskCondition.notify_all();
+	for (size_t i = 0; i < _threads.size(); i++)
+		_threads[i].join();
+}
+
+void ThreadPool::addTask(const Task& task)
+{
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_tasks.push_back(task);
+		_pending++;
+	}
+	_taskCondition.notify_one();
+}
+
+unsigned int ThreadPool::getNumPendingTasks()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	return _pending;
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (_pending > 0)
+	{
+		if (!runOne(lock))
+			_doneCondition.wait(lock);
+	}
+}
+
+void ThreadPool::run()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_taskCondition.wait(lock, [this]() { return _stop || !_tasks.empty(); });
+		if (_stop && _tasks.empty())
+			return;
+		runOne(lock);
+	}
+}
+
+bool ThreadPool::runOne(std::unique_lock<std::mutex>& lock)
+{
+	if (_tasks.empty())
+		return false;
+
+	Task task = _tasks.front();
+	_tasks.pop_front();
+	lock.unlock();
+	task();
+	lock.lock();
+
+	if (--_pending == 0)
+		_doneCondition.notify_all();
+	return true;
+}
@@ -0,0 +1,170 @@
+#include <fstream>
+#include <algorithm>
+#include <vector>
+#include <cstdlib>
+#include <osg/Notify>
+#include <osgThreeJSX/Tracer>
+
+using namespace osgThreeJSX;
+
+static std::atomic<unsigned int> g_nextThreadId(1);
+
+//a begin or end of an event, sorted so nested spans of a thread stay balanced
+struct TraceMark
+{
+	const TraceEvent* _event;
+	osg::Timer_t _time;
+	bool _begin;
+
+	bool operator<(const TraceMark& rhs) const
+	{
+		if (_time != rhs._time)
+			return _time < rhs._time;
+		if (_begin != rhs._begin)
+			return !_begin;
+		//the outer span begins first and ends last
+		osg::Timer_t duration = _event->_end - _event->_begin;
+		osg::Timer_t rhsDuration = rhs._event->_end - rhs._event->_begin;
+		return _begin ? duration > rhsDuration : duration < rhsDuration;
+	}
+};
+
+Tracer& Tracer::instance()
+{
+	static Tracer instance;
+	return instance;
+}
+
+unsigned int Tracer::getCurrentThreadId()
+{
+	static thread_local unsigned int threadId = g_nextThreadId++;
+	return threadId;
+}
+
+Tracer::Tracer() :
+	_enable(false),
+	_next(0),
+	_capacity(65536),
+	_slots(NULL),
+	_origin(osg::Timer::instance()->tick()),
+	_secondsPerTick(osg::Timer::instance()->getSecondsPerTick())
+{
+	const char* filename = getenv("OSGTHREEJSX_TRACE");
+	if (filename && *filename)
+	{
+		setWriteAtExit(filename);
+		setEnable(true);
+	}
+}
+
+Tracer::~Tracer()
+{
+	_enable = false;
+	if (!_exitFilename.empty() && _slots)
+	{
+		if (!writeChromeTrace(_exitFilename))
+			OSG_WARN << "osgThreeJSX::Tracer can not write " << _exitFilename << std::endl;
+	}
+	delete[] _slots;
+}
+
+void Tracer::setEnable(bool enable)
+{
+	if (enable && _slots == NULL)
+	{
+		_slots = new Slot[_capacity];
+		for (unsigned int i = 0; i < _capacity; i++)
+			_slots[i]._sequence = 0;
+	}
+	_enable = enable;
+}
+
+void Tracer::setCapacity(unsigned int capacity)
+{
+	//recorders may still hold a slot, the buffer is never reallocated
+	if (_slots == NULL && capacity > 0)
+		_capacity = capacity;
+}
+
+void Tracer::record(const TraceEvent& event)
+{
+	if (_slots == NULL)
+		return;
+
+	unsigned long long index = _next.fetch_add(1, std::memory_order_relaxed);
+	Slot& slot = _slots[index % _capacity];
+	slot._sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot._event = event;
+	slot._sequence.store(index + 1, std::memory_order_release);
+}
+
+void Tracer::clear()
+{
+	if (_slots == NULL)
+		return;
+
+	for (unsigned int i = 0; i < _capacity; i++)
+		_slots[i]._sequence = 0;
+}
+
+bool Tracer::writeChromeTrace(const std::string& filename)
+{
+	std::ofstream file(filename.c_str());
+	if (!file)
+		return false;
+
+	//copy what is stable, a slot rewritten during the copy is skipped
+	std::vector<TraceEvent> events;
+	unsigned long long next = _slots ? _next.load(std::memory_order_acquire) : 0;
+	unsigned long long first = next > _capacity ? next - _capacity : 0;
+	for (unsigned long long index = first; index < next; index++)
+	{
+		Slot& slot = _slots[index % _capacity];
+		if (slot._sequence.load(std::memory_order_acquire) != index + 1)
+			continue;
+		TraceEvent event = slot._event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot._sequence.load(std::memory_order_relaxed) != index + 1)
+			continue;
+		events.push_back(event);
+	}
+
+	std::vector<TraceMark> marks;
+	marks.reserve(events.size() * 2);
+	unsigned int maxThreadId = 0;
+	for (std::vector<TraceEvent>::const_iterator iter = events.begin(); iter != events.end(); iter++)
+	{
+		TraceMark mark;
+		mark._event = &(*iter);
+		mark._time = iter->_begin;
+		mark._begin = true;
+		marks.push_back(mark);
+		mark._time = iter->_end;
+		mark._begin = false;
+		marks.push_back(mark);
+		maxThreadId = std::max(maxThreadId, iter->_threadId);
+	}
+	std::stable_sort(marks.begin(), marks.end());
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"osgThreeJSX\"}}";
+	for (unsigned int i = 1; i <= maxThreadId; i++)
+		file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"thread " << i << "\"}}";
+
+	file.setf(std::ios::fixed);
+	file.precision(3);
+	for (std::vector<TraceMark>::const_iterator iter = marks.begin(); iter != marks.end(); iter++)
+	{
+		const TraceEvent& event = *iter->_event;
+		//microseconds since the tracer started
+		double ts = (double)((long long)(iter->_time - _origin)) * _secondsPerTick * 1e6;
+		file << ",\n{\"name\":\"" << event._name << "\",\"cat\":\"" << event._category << "\",\"ph\":\"" << (iter->_begin ? "B" : "E")
+			<< "\",\"pid\":1,\"tid\":" << event._threadId << ",\"ts\":" << ts;
+		if (iter->_begin && event._argName)
+			file << ",\"args\":{\"" << event._argName << "\":" << event._argValue << "}";
+		file << "}";
+	}
+	file << "\n]}\n";
+	return true;
+}
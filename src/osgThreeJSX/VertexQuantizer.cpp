@@ -0,0 +1,402 @@
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <algorithm>
+#include <osg/NodeVisitor>
+#include <osg/StateSet>
+#include <osgAnimation/RigGeometry>
+#include <osgAnimation/MorphGeometry>
+#include <osgThreeJSX/VertexQuantizer>
+#include <osgThreeJSX/MaterialNode>
+#include <osgThreeJSX/Material>
+
+using namespace osgThreeJSX;
+
+//largest finite half float
+static const float g_halfMax = 65504.0f;
+
+//////////////////////////////////////////////////////////////////////////
+//the geometries under each material node, down to the next material node
+class MaterialGeometryCollector : public osg::NodeVisitor
+{
+public:
+	MaterialGeometryCollector() : osg::NodeVisitor(osg::NodeVisitor::TRAVERSE_ALL_CHILDREN) {}
+
+	virtual void apply(osg::Node& node)
+	{
+		Material* material = NULL;
+		for (osg::Callback* callback = node.getCullCallback(); callback && !material; callback = callback->getNestedCallback())
+		{
+			MaterialNodeCullback* materialCallback = dynamic_cast<MaterialNodeCullback*>(callback);
+			if (materialCallback)
+				material = materialCallback->getMaterial().get();
+		}
+
+		if (material)
+			_stack.push_back(material);
+
+		osg::Geometry* geometry = node.asGeometry();
+		if (geometry && !_stack.empty())
+		{
+			std::vector<osg::Geometry*>& geometries = _materials[_stack.back()];
+			if (std::find(geometries.begin(), geometries.end(), geometry) == geometries.end())
+			{
+				geometries.push_back(geometry);
+				_geometries[geometry].push_back(_stack.back());
+			}
+		}
+
+		traverse(node);
+
+		if (material)
+			_stack.pop_back();
+	}
+
+	std::vector<Material*> _stack;
+	std::map<Material*, std::vector<osg::Geometry*> > _materials;
+	std::map<osg::Geometry*, std::vector<Material*> > _geometries;
+};
+
+static short toSnorm16(float value)
+{
+	return (short)floor(osg::clampBetween(value, -1.0f, 1.0f) * 32767.0f + 0.5f);
+}
+
+static unsigned short toUnorm16(float value)
+{
+	return (unsigned short)floor(osg::clampBetween(value, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+//round to nearest, overflow to infinity
+static unsigned short toHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = bits & 0x7fffff;
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return sign;
+		mantissa |= 0x800000;
+		unsigned int shift = 14 - exponent;
+		unsigned int half = mantissa >> shift;
+		if ((mantissa >> (shift - 1)) & 1)
+			half++;
+		return sign | half;
+	}
+	if (exponent >= 31)
+		return sign | 0x7c00;
+
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		half++;
+	return half;
+}
+
+//octahedral mapping of a unit vector, the inverse of octDecode in the vertex prefix
+static osg::Vec2f octEncode(const osg::Vec3f& direction)
+{
+	float sum = fabs(direction.x()) + fabs(direction.y()) + fabs(direction.z());
+	if (sum <= 0.0f)
+		return osg::Vec2f(0.0f, 0.0f);
+
+	osg::Vec3f n = direction / sum;
+	if (n.z() >= 0.0f)
+		return osg::Vec2f(n.x(), n.y());
+	return osg::Vec2f((1.0f - fabs(n.y())) * (n.x() >= 0.0f ? 1.0f : -1.0f), (1.0f - fabs(n.x())) * (n.y() >= 0.0f ? 1.0f : -1.0f));
+}
+
+static int getAttribIndex(Material* material, const std::string& name)
+{
+	const MaterialVertexAttribList& attribs = material->getVertexAttribList();
+	for (MaterialVertexAttribList::const_iterator iter = attribs.begin(); iter != attribs.end(); iter++)
+	{
+		if (iter->_name == name)
+			return iter->_index;
+	}
+	return -1;
+}
+
+//absent arrays take any flag, there is nothing to decode
+template<class ArrayType>
+static bool isPerVertex(const osg::Array* array, unsigned int count)
+{
+	if (!array)
+		return true;
+	return dynamic_cast<const ArrayType*>(array) && array->getNumElements() == count && array->getBinding() == osg::Array::BIND_PER_VERTEX;
+}
+
+//////////////////////////////////////////////////////////////////////////
+VertexQuantizer::VertexQuantizer(unsigned int flags) :
+	_flags(flags),
+	_sourceBytes(0),
+	_quantizedBytes(0)
+{
+}
+
+unsigned int VertexQuantizer::getSupportedFlags(const osg::Geometry* geometry, Material* material, unsigned int flags)
+{
+	if (dynamic_cast<const osgAnimation::RigGeometry*>(geometry) || dynamic_cast<const osgAnimation::MorphGeometry*>(geometry))
+		return VertexQuantizationType_None;
+
+	const osg::Vec3Array* vertices = dynamic_cast<const osg::Vec3Array*>(geometry->getVertexArray());
+	if (!vertices || vertices->empty())
+		return VertexQuantizationType_None;
+	unsigned int count = vertices->size();
+
+	unsigned int result = flags & VertexQuantizationType_Position;
+	if ((flags & VertexQuantizationType_Normal) && isPerVertex<osg::Vec3Array>(geometry->getNormalArray(), count))
+		result |= VertexQuantizationType_Normal;
+
+	int tangentIndex = getAttribIndex(material, "tangent");
+	if ((flags & VertexQuantizationType_Tangent) && material->getVertexTangents() && tangentIndex >= 0
+		&& isPerVertex<osg::Vec4Array>(geometry->getVertexAttribArray(tangentIndex), count))
+		result |= VertexQuantizationType_Tangent;
+
+	unsigned int uvFlags = flags & (VertexQuantizationType_UvHalf | VertexQuantizationType_UvUnorm16);
+	for (unsigned int unit = 0; unit < 2 && uvFlags; unit++)
+	{
+		const osg::Array* array = geometry->getTexCoordArray(unit);
+		if (!isPerVertex<osg::Vec2Array>(array, count))
+			uvFlags = VertexQuantizationType_None;
+		else if (array && (uvFlags & VertexQuantizationType_UvHalf))
+		{
+			const osg::Vec2Array* uvs = static_cast<const osg::Vec2Array*>(array);
+			for (osg::Vec2Array::const_iterator iter = uvs->begin(); iter != uvs->end(); iter++)
+			{
+				if (!(fabs(iter->x()) <= g_halfMax && fabs(iter->y()) <= g_halfMax))
+				{
+					uvFlags &= ~VertexQuantizationType_UvHalf;
+					break;
+				}
+			}
+		}
+	}
+	return result | uvFlags;
+}
+
+unsigned int VertexQuantizer::quantize(osg::Node* node)
+{
+	if (!node)
+		return 0;
+
+	MaterialGeometryCollector collector;
+	node->accept(collector);
+
+	unsigned int requested = _flags;
+	if (requested & VertexQuantizationType_UvUnorm16)
+		requested &= ~VertexQuantizationType_UvHalf;
+
+	//materials converted before keep their layout, so do the geometries they share
+	std::map<Material*, unsigned int> flags;
+	for (std::map<Material*, std::vector<osg::Geometry*> >::iterator iter = collector._materials.begin(); iter != collector._materials.end(); iter++)
+	{
+		unsigned int materialFlags = iter->first->getVertexQuantization() == VertexQuantizationType_None ? requested : VertexQuantizationType_None;
+		for (size_t i = 0; i < iter->second.size() && materialFlags; i++)
+			materialFlags &= getSupportedFlags(iter->second[i], iter->first, materialFlags);
+		flags[iter->first] = materialFlags;
+	}
+
+	//a geometry drawn with several materials has one layout, they all take the common flags
+	bool changed = true;
+	while (changed)
+	{
+		changed = false;
+		for (std::map<osg::Geometry*, std::vector<Material*> >::iterator iter = collector._geometries.begin(); iter != collector._geometries.end(); iter++)
+		{
+			unsigned int common = requested;
+			for (size_t i = 0; i < iter->second.size(); i++)
+				common &= flags[iter->second[i]];
+			for (size_t i = 0; i < iter->second.size(); i++)
+			{
+				if (flags[iter->second[i]] != common)
+				{
+					flags[iter->second[i]] = common;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	unsigned int count = 0;
+	for (std::map<osg::Geometry*, std::vector<Material*> >::iterator iter = collector._geometries.begin(); iter != collector._geometries.end(); iter++)
+	{
+		Material* material = iter->second.front();
+		if (flags[material] == VertexQuantizationType_None)
+			continue;
+		quantizeGeometry(iter->first, material, flags[material]);
+		count++;
+	}
+
+	for (std::map<Material*, unsigned int>::iterator iter = flags.begin(); iter != flags.end(); iter++)
+	{
+		if (iter->second != VertexQuantizationType_None)
+		{
+			iter->first->setVertexQuantization(iter->second);
+			iter->first->dirty();
+		}
+	}
+
+	_arrays.clear();
+	return count;
+}
+
+void VertexQuantizer::quantizeGeometry(osg::Geometry* geometry, Material* material, unsigned int flags)
+{
+	osg::StateSet* stateset = NULL;
+	if (flags & (VertexQuantizationType_Position | VertexQuantizationType_UvUnorm16))
+		stateset = geometry->getOrCreateStateSet();
+
+	if (flags & VertexQuantizationType_Position)
+	{
+		//bounds can not be computed from the packed vertices
+		geometry->setInitialBound(geometry->getBoundingBox());
+
+		osg::Matrixf dequant;
+		geometry->setVertexArray(quantizePositions(geometry->getVertexArray(), dequant));
+		stateset->getOrCreateUniform("positionDequant", osg::Uniform::FLOAT_MAT4)->set(dequant);
+	}
+
+	if ((flags & VertexQuantizationType_Normal) && geometry->getNormalArray())
+		geometry->setNormalArray(quantizeDirections(geometry->getNormalArray(), false), osg::Array::BIND_PER_VERTEX);
+
+	int tangentIndex = getAttribIndex(material, "tangent");
+	if ((flags & VertexQuantizationType_Tangent) && tangentIndex >= 0 && geometry->getVertexAttribArray(tangentIndex))
+		geometry->setVertexAttribArray(tangentIndex, quantizeDirections(geometry->getVertexAttribArray(tangentIndex), true), osg::Array::BIND_PER_VERTEX);
+
+	bool half = (flags & VertexQuantizationType_UvHalf) != 0;
+	if (half || (flags & VertexQuantizationType_UvUnorm16))
+	{
+		for (unsigned int unit = 0; unit < 2; unit++)
+		{
+			if (!geometry->getTexCoordArray(unit))
+				continue;
+
+			osg::Vec4f dequant;
+			geometry->setTexCoordArray(unit, quantizeUvs(geometry->getTexCoordArray(unit), half, dequant), osg::Array::BIND_PER_VERTEX);
+			if (!half)
+				stateset->getOrCreateUniform(unit == 0 ? "uvDequant" : "uv2Dequant", osg::Uniform::FLOAT_VEC4)->set(dequant);
+		}
+	}
+
+	geometry->dirtyGLObjects();
+}
+
+osg::Array* VertexQuantizer::quantizePositions(osg::Array* array, osg::Matrixf& dequant)
+{
+	QuantizedArray& entry = _arrays[array];
+	if (!entry._array.valid())
+	{
+		const osg::Vec3Array* positions = static_cast<const osg::Vec3Array*>(array);
+		osg::BoundingBox box;
+		for (osg::Vec3Array::const_iterator iter = positions->begin(); iter != positions->end(); iter++)
+			box.expandBy(*iter);
+
+		osg::Vec3f center = box.center();
+		osg::Vec3f extent = (box._max - box._min) * 0.5f;
+		for (int i = 0; i < 3; i++)
+			extent[i] = std::max(extent[i], 1e-12f);
+
+		osg::ref_ptr<osg::Vec3sArray> result = new osg::Vec3sArray(positions->size());
+		for (size_t i = 0; i < positions->size(); i++)
+		{
+			osg::Vec3f position = (*positions)[i] - center;
+			(*result)[i].set(toSnorm16(position.x() / extent.x()), toSnorm16(position.y() / extent.y()), toSnorm16(position.z() / extent.z()));
+		}
+		result->setNormalize(true);
+		result->setBinding(osg::Array::BIND_PER_VERTEX);
+
+		entry._source = array;
+		entry._array = result;
+		entry._matrix = osg::Matrixf::scale(extent) * osg::Matrixf::translate(center);
+		_sourceBytes += array->getTotalDataSize();
+		_quantizedBytes += result->getTotalDataSize();
+	}
+	dequant = entry._matrix;
+	return entry._array.get();
+}
+
+osg::Array* VertexQuantizer::quantizeDirections(osg::Array* array, bool tangents)
+{
+	QuantizedArray& entry = _arrays[array];
+	if (!entry._array.valid())
+	{
+		if (tangents)
+		{
+			//the handedness stays in w for the bitangent
+			const osg::Vec4Array* source = static_cast<const osg::Vec4Array*>(array);
+			osg::ref_ptr<osg::Vec4sArray> result = new osg::Vec4sArray(source->size());
+			for (size_t i = 0; i < source->size(); i++)
+			{
+				const osg::Vec4f& tangent = (*source)[i];
+				osg::Vec2f encoded = octEncode(osg::Vec3f(tangent.x(), tangent.y(), tangent.z()));
+				(*result)[i].set(toSnorm16(encoded.x()), toSnorm16(encoded.y()), 0, tangent.w() < 0.0f ? -32767 : 32767);
+			}
+			entry._array = result;
+		}
+		else
+		{
+			const osg::Vec3Array* source = static_cast<const osg::Vec3Array*>(array);
+			osg::ref_ptr<osg::Vec2sArray> result = new osg::Vec2sArray(source->size());
+			for (size_t i = 0; i < source->size(); i++)
+			{
+				osg::Vec2f encoded = octEncode((*source)[i]);
+				(*result)[i].set(toSnorm16(encoded.x()), toSnorm16(encoded.y()));
+			}
+			entry._array = result;
+		}
+		entry._array->setNormalize(true);
+		entry._array->setBinding(osg::Array::BIND_PER_VERTEX);
+
+		entry._source = array;
+		_sourceBytes += array->getTotalDataSize();
+		_quantizedBytes += entry._array->getTotalDataSize();
+	}
+	return entry._array.get();
+}
+
+osg::Array* VertexQuantizer::quantizeUvs(osg::Array* array, bool half, osg::Vec4f& dequant)
+{
+	QuantizedArray& entry = _arrays[array];
+	if (!entry._array.valid())
+	{
+		const osg::Vec2Array* uvs = static_cast<const osg::Vec2Array*>(array);
+		if (half)
+		{
+			osg::ref_ptr<Vec2HalfArray> result = new Vec2HalfArray(uvs->size());
+			for (size_t i = 0; i < uvs->size(); i++)
+				(*result)[i].set(toHalf((*uvs)[i].x()), toHalf((*uvs)[i].y()));
+			entry._array = result;
+		}
+		else
+		{
+			osg::Vec2f minimum(FLT_MAX, FLT_MAX);
+			osg::Vec2f maximum(-FLT_MAX, -FLT_MAX);
+			for (osg::Vec2Array::const_iterator iter = uvs->begin(); iter != uvs->end(); iter++)
+			{
+				minimum.set(std::min(minimum.x(), iter->x()), std::min(minimum.y(), iter->y()));
+				maximum.set(std::max(maximum.x(), iter->x()), std::max(maximum.y(), iter->y()));
+			}
+			osg::Vec2f scale(std::max(maximum.x() - minimum.x(), 1e-12f), std::max(maximum.y() - minimum.y(), 1e-12f));
+
+			osg::ref_ptr<osg::Vec2usArray> result = new osg::Vec2usArray(uvs->size());
+			for (size_t i = 0; i < uvs->size(); i++)
+			{
+				const osg::Vec2f& uv = (*uvs)[i];
+				(*result)[i].set(toUnorm16((uv.x() - minimum.x()) / scale.x()), toUnorm16((uv.y() - minimum.y()) / scale.y()));
+			}
+			result->setNormalize(true);
+			entry._array = result;
+			entry._dequant.set(scale.x(), scale.y(), minimum.x(), minimum.y());
+		}
+		entry._array->setBinding(osg::Array::BIND_PER_VERTEX);
+
+		entry._source = array;
+		_sourceBytes += array->getTotalDataSize();
+		_quantizedBytes += entry._array->getTotalDataSize();
+	}
+	dequant = entry._dequant;
+	return entry._array.get();
+}